@@ -68,6 +68,49 @@ void mutex_lock(struct mutex *m);
 bool mutex_trylock(struct mutex *m);
 #endif
 
+/*
+ * Reader/writer lock, any number of readers can hold the lock at the
+ * same time while a writer holds it exclusively. Waiting writers are
+ * preferred over new readers. Like a mutex it sleeps in normal world
+ * while waiting.
+ */
+struct rwlock {
+	unsigned spin_lock;	/* used when operating on this struct */
+	unsigned num_readers;
+	unsigned num_write_waiters;
+	int writer_id;
+	struct wait_queue read_wq;
+	struct wait_queue write_wq;
+};
+#define RWLOCK_INITIALIZER \
+	{ .writer_id = -1, .read_wq = WAIT_QUEUE_INITIALIZER, \
+	  .write_wq = WAIT_QUEUE_INITIALIZER, }
+
+void rwlock_init(struct rwlock *rw);
+void rwlock_destroy(struct rwlock *rw);
+
+#ifdef CFG_MUTEX_DEBUG
+void rwlock_read_lock_debug(struct rwlock *rw, const char *fname, int lineno);
+#define rwlock_read_lock(rw) rwlock_read_lock_debug((rw), __FILE__, __LINE__)
+
+void rwlock_read_unlock_debug(struct rwlock *rw, const char *fname,
+			      int lineno);
+#define rwlock_read_unlock(rw) \
+	rwlock_read_unlock_debug((rw), __FILE__, __LINE__)
+
+void rwlock_write_lock_debug(struct rwlock *rw, const char *fname, int lineno);
+#define rwlock_write_lock(rw) rwlock_write_lock_debug((rw), __FILE__, __LINE__)
+
+void rwlock_write_unlock_debug(struct rwlock *rw, const char *fname,
+			       int lineno);
+#define rwlock_write_unlock(rw) \
+	rwlock_write_unlock_debug((rw), __FILE__, __LINE__)
+#else
+void rwlock_read_lock(struct rwlock *rw);
+void rwlock_read_unlock(struct rwlock *rw);
+void rwlock_write_lock(struct rwlock *rw);
+void rwlock_write_unlock(struct rwlock *rw);
+#endif
 
 struct condvar {
 	unsigned spin_lock;
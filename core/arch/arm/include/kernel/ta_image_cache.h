@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef KERNEL_TA_IMAGE_CACHE_H
+#define KERNEL_TA_IMAGE_CACHE_H
+
+#include <mm/tee_mm.h>
+#include <sys/queue.h>
+#include <tee_api_types.h>
+#include <types_ext.h>
+#include <utee_defines.h>
+
+/*
+ * Cache of verified user TA images. An image is the content of the code
+ * memory of a TA as it is once loaded, relocated and verified but before
+ * the TA has executed. An image is identified by the UUID of the TA and
+ * the hash in the signed header of the TA. Opening a session to a TA
+ * whose signed header in normal world has a cached image copies the
+ * image instead of fetching the rest of the TA and checking its signature
+ * again, so an updated TA in normal world is never hidden by the cache.
+ * If tee-supplicant can't load TAs in chunks the whole TA has already
+ * been fetched when the cache is checked.
+ *
+ * Images are kept in secure DDR, the total size is bounded by
+ * CFG_TA_IMAGE_CACHE_SIZE and the least recently used images are
+ * evicted first.
+ */
+
+struct ta_image_seg {
+	vaddr_t offs;
+	size_t size;
+	uint32_t flags;
+};
+
+struct ta_image {
+	TEE_UUID uuid;
+	uint32_t algo;				/* From the signed header */
+	size_t hash_size;
+	uint8_t hash[TEE_SHA512_HASH_SIZE];
+	bool is_32bit;
+	size_t stack_size;
+	vaddr_t load_addr;
+	size_t vasize;
+	void *data;				/* vasize bytes of image */
+	struct ta_image_seg *segs;
+	size_t num_segs;
+
+	tee_mm_entry_t *mm;
+	unsigned int refcount;
+	bool evicted;
+	TAILQ_ENTRY(ta_image) link;
+};
+
+/*
+ * Allocates an image of vasize bytes with room for num_segs segments,
+ * evicting unused images if needed. Returns NULL if the image doesn't
+ * fit in the cache. The caller fills in the image and publishes it with
+ * ta_image_cache_insert().
+ */
+struct ta_image *ta_image_cache_alloc(size_t vasize, size_t num_segs);
+
+/* Publishes an image, replaces any previous image of the same TA */
+void ta_image_cache_insert(struct ta_image *img);
+
+/*
+ * Returns a referenced image of the TA with the supplied signed header
+ * algorithm and hash, or NULL on a cache miss. The reference is dropped
+ * with ta_image_cache_put().
+ */
+struct ta_image *ta_image_cache_get(const TEE_UUID *uuid, uint32_t algo,
+				    const void *hash, size_t hash_size);
+void ta_image_cache_put(struct ta_image *img);
+
+/* Evicts the image of the TA if cached, for instance if it fails to load */
+void ta_image_cache_remove(const TEE_UUID *uuid);
+
+/*
+ * Evicts all unused images. Returns true if any secure DDR was released.
+ */
+bool ta_image_cache_flush(void);
+
+#ifdef CFG_WITH_STATS
+struct ta_image_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t num_images;
+	uint32_t size;		/* Bytes of secure DDR used by images */
+	uint32_t max_size;	/* CFG_TA_IMAGE_CACHE_SIZE */
+};
+
+void ta_image_cache_get_stats(struct ta_image_cache_stats *stats,
+			      bool reset);
+#endif
+
+#endif /*KERNEL_TA_IMAGE_CACHE_H*/
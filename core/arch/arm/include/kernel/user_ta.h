@@ -28,6 +28,7 @@
 #define KERNEL_USER_TA_H
 
 #include <assert.h>
+#include <kernel/ptr_hash.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <mm/tee_mm.h>
@@ -51,6 +52,10 @@ struct user_ta_ctx {
 	struct tee_obj_head objects;
 	/* List of storage enumerators opened by this TA */
 	struct tee_storage_enum_head storage_enums;
+	/* The cryp states, objects and enumerators above by user reference */
+	struct ptr_hash cryp_state_hash;
+	struct ptr_hash object_hash;
+	struct ptr_hash storage_enum_hash;
 	tee_mm_entry_t *mm;	/* secure world memory */
 	tee_mm_entry_t *mm_stack;/* stack */
 	uint32_t load_addr;	/* elf load addr (from TAs address space) */
@@ -80,6 +85,10 @@ static inline struct user_ta_ctx *to_user_ta_ctx(struct tee_ta_ctx *ctx)
 }
 
 #ifdef CFG_WITH_USER_TA
+/*
+ * Loads a user TA for the session. Called without tee_ta_mutex held, the
+ * caller registers the new context in tee_ctxes.
+ */
 TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 			struct tee_ta_session *s);
 #else
@@ -73,6 +73,10 @@ void wq_wait_final(struct wait_queue *wq, struct wait_queue_elem *wqe,
 void wq_wake_one(struct wait_queue *wq, const void *sync_obj,
 		const char *fname, int lineno);
 
+/* Wakes up all wait queue elements not waiting on a condvar */
+void wq_wake_all(struct wait_queue *wq, const void *sync_obj,
+		const char *fname, int lineno);
+
 /* Returns true if the wait queue doesn't contain any elements */
 bool wq_is_empty(struct wait_queue *wq);
 
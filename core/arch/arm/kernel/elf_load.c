@@ -41,8 +41,13 @@
 struct elf_load_state {
 	bool is_32bit;
 
-	uint8_t *nwdata;
 	size_t nwdata_len;
+	elf_load_get_window_t get_window;
+	void *get_window_priv;
+	/* The window of the ELF in shared memory last supplied */
+	uint8_t *win;
+	size_t win_offs;
+	size_t win_len;
 
 	void *hash_ctx;
 	uint32_t hash_algo;
@@ -130,9 +135,36 @@ static void copy_phdr(struct elf_phdr *phdr, struct elf_load_state *state,
 			 COPY_PHDR(phdr, ((Elf64_Phdr *)state->phdr + idx)));
 }
 
+/*
+ * Returns a pointer to the ELF at offs and how many bytes, at most len,
+ * are available there before the next window has to be fetched.
+ */
+static TEE_Result get_nwdata(struct elf_load_state *state, size_t offs,
+			size_t *len, uint8_t **p)
+{
+	TEE_Result res;
+
+	if (offs < state->win_offs ||
+	    offs - state->win_offs >= state->win_len) {
+		res = state->get_window(state->get_window_priv, offs,
+					&state->win, &state->win_len);
+		if (res != TEE_SUCCESS)
+			return res;
+		if (!state->win_len)
+			return TEE_ERROR_SECURITY;
+		state->win_offs = offs;
+	}
+
+	*p = state->win + (offs - state->win_offs);
+	*len = MIN(*len, state->win_len - (offs - state->win_offs));
+	return TEE_SUCCESS;
+}
+
 static TEE_Result advance_to(struct elf_load_state *state, size_t offs)
 {
 	TEE_Result res;
+	uint8_t *p;
+	size_t l;
 
 	if (offs < state->next_offs)
 		return TEE_ERROR_BAD_STATE;
@@ -142,13 +174,18 @@ static TEE_Result advance_to(struct elf_load_state *state, size_t offs)
 	if (offs > state->nwdata_len)
 		return TEE_ERROR_SECURITY;
 
-	res = crypto_ops.hash.update(state->hash_ctx, state->hash_algo,
-			state->nwdata + state->next_offs,
-			offs - state->next_offs);
-	if (res != TEE_SUCCESS)
-		return res;
-	state->next_offs = offs;
-	return res;
+	while (state->next_offs < offs) {
+		l = offs - state->next_offs;
+		res = get_nwdata(state, state->next_offs, &l, &p);
+		if (res != TEE_SUCCESS)
+			return res;
+		res = crypto_ops.hash.update(state->hash_ctx, state->hash_algo,
+					     p, l);
+		if (res != TEE_SUCCESS)
+			return res;
+		state->next_offs += l;
+	}
+	return TEE_SUCCESS;
 }
 
 static TEE_Result copy_to(struct elf_load_state *state,
@@ -156,6 +193,9 @@ static TEE_Result copy_to(struct elf_load_state *state,
 			size_t offs, size_t len)
 {
 	TEE_Result res;
+	uint8_t *p;
+	size_t n;
+	size_t l;
 
 	res = advance_to(state, offs);
 	if (res != TEE_SUCCESS)
@@ -168,7 +208,13 @@ static TEE_Result copy_to(struct elf_load_state *state,
 	    (len + offs) < offs || (len + offs) > state->nwdata_len)
 		return TEE_ERROR_SECURITY;
 
-	memcpy((uint8_t *)dst + dst_offs, state->nwdata + offs, len);
+	for (n = 0; n < len; n += l) {
+		l = len - n;
+		res = get_nwdata(state, offs + n, &l, &p);
+		if (res != TEE_SUCCESS)
+			return res;
+		memcpy((uint8_t *)dst + dst_offs + n, p, l);
+	}
 	res = crypto_ops.hash.update(state->hash_ctx, state->hash_algo,
 				      (uint8_t *)dst + dst_offs, len);
 	if (res != TEE_SUCCESS)
@@ -194,8 +240,10 @@ static TEE_Result alloc_and_copy_to(void **p, struct elf_load_state *state,
 	return res;
 }
 
-TEE_Result elf_load_init(void *hash_ctx, uint32_t hash_algo, uint8_t *nwdata,
-			size_t nwdata_len, struct elf_load_state **ret_state)
+TEE_Result elf_load_init(void *hash_ctx, uint32_t hash_algo,
+			size_t nwdata_len, elf_load_get_window_t get_window,
+			void *get_window_priv,
+			struct elf_load_state **ret_state)
 {
 	struct elf_load_state *state;
 
@@ -204,8 +252,9 @@ TEE_Result elf_load_init(void *hash_ctx, uint32_t hash_algo, uint8_t *nwdata,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	state->hash_ctx = hash_ctx;
 	state->hash_algo = hash_algo;
-	state->nwdata = nwdata;
 	state->nwdata_len = nwdata_len;
+	state->get_window = get_window;
+	state->get_window_priv = get_window_priv;
 	*ret_state = state;
 	return TEE_SUCCESS;
 }
@@ -32,8 +32,17 @@
 
 struct elf_load_state;
 
-TEE_Result elf_load_init(void *hash_ctx, uint32_t hash_algo, uint8_t *nwdata,
-			size_t nwdata_len, struct elf_load_state **state);
+/*
+ * Supplies a window of the ELF in non-secure memory starting at offset
+ * offs, the ELF is read sequentially from start to end. The window is
+ * used until the next call, a window of zero bytes is an error.
+ */
+typedef TEE_Result (*elf_load_get_window_t)(void *priv, size_t offs,
+			uint8_t **win, size_t *win_len);
+
+TEE_Result elf_load_init(void *hash_ctx, uint32_t hash_algo,
+			size_t nwdata_len, elf_load_get_window_t get_window,
+			void *get_window_priv, struct elf_load_state **state);
 TEE_Result elf_load_head(struct elf_load_state *state, size_t head_size,
 			void **head, size_t *vasize, bool *is_32bit);
 TEE_Result elf_load_body(struct elf_load_state *state, vaddr_t vabase);
@@ -163,6 +163,178 @@ void mutex_destroy(struct mutex *m)
 		panic("waitqueue not empty");
 }
 
+void rwlock_init(struct rwlock *rw)
+{
+	*rw = (struct rwlock)RWLOCK_INITIALIZER;
+}
+
+void rwlock_destroy(struct rwlock *rw)
+{
+	/*
+	 * Caller guarantees that no one will try to take the lock so
+	 * there's no need to take the spinlock before accessing it.
+	 */
+	if (rw->num_readers || rw->writer_id != -1 || rw->num_write_waiters)
+		panic();
+	if (!wq_is_empty(&rw->read_wq) || !wq_is_empty(&rw->write_wq))
+		panic("waitqueue not empty");
+}
+
+static void __rwlock_read_lock(struct rwlock *rw, const char *fname,
+			int lineno)
+{
+	while (true) {
+		uint32_t old_itr_status;
+		bool can_lock;
+		struct wait_queue_elem wqe;
+
+		/*
+		 * Readers have to wait for both an active writer and
+		 * waiting writers, otherwise a writer could be starved.
+		 */
+		old_itr_status = thread_mask_exceptions(THREAD_EXCP_ALL);
+		cpu_spin_lock(&rw->spin_lock);
+
+		can_lock = rw->writer_id == -1 && !rw->num_write_waiters;
+		if (can_lock)
+			rw->num_readers++;
+		else
+			wq_wait_init(&rw->read_wq, &wqe);
+
+		cpu_spin_unlock(&rw->spin_lock);
+		thread_unmask_exceptions(old_itr_status);
+
+		if (can_lock)
+			return;
+
+		wq_wait_final(&rw->read_wq, &wqe, rw, fname, lineno);
+	}
+}
+
+static void __rwlock_read_unlock(struct rwlock *rw, const char *fname,
+			int lineno)
+{
+	uint32_t old_itr_status;
+	bool wake_writer;
+
+	old_itr_status = thread_mask_exceptions(THREAD_EXCP_ALL);
+	cpu_spin_lock(&rw->spin_lock);
+
+	if (!rw->num_readers)
+		panic();
+
+	rw->num_readers--;
+	wake_writer = !rw->num_readers && rw->num_write_waiters;
+
+	cpu_spin_unlock(&rw->spin_lock);
+	thread_unmask_exceptions(old_itr_status);
+
+	if (wake_writer)
+		wq_wake_one(&rw->write_wq, rw, fname, lineno);
+}
+
+static void __rwlock_write_lock(struct rwlock *rw, const char *fname,
+			int lineno)
+{
+	bool waited = false;
+
+	while (true) {
+		uint32_t old_itr_status;
+		bool can_lock;
+		struct wait_queue_elem wqe;
+
+		old_itr_status = thread_mask_exceptions(THREAD_EXCP_ALL);
+		cpu_spin_lock(&rw->spin_lock);
+
+		if (waited)
+			rw->num_write_waiters--;
+
+		can_lock = rw->writer_id == -1 && !rw->num_readers;
+		if (can_lock) {
+			rw->writer_id = thread_get_id();
+		} else {
+			rw->num_write_waiters++;
+			wq_wait_init(&rw->write_wq, &wqe);
+		}
+
+		cpu_spin_unlock(&rw->spin_lock);
+		thread_unmask_exceptions(old_itr_status);
+
+		if (can_lock)
+			return;
+
+		wq_wait_final(&rw->write_wq, &wqe, rw, fname, lineno);
+		waited = true;
+	}
+}
+
+static void __rwlock_write_unlock(struct rwlock *rw, const char *fname,
+			int lineno)
+{
+	uint32_t old_itr_status;
+	bool wake_writer;
+
+	old_itr_status = thread_mask_exceptions(THREAD_EXCP_ALL);
+	cpu_spin_lock(&rw->spin_lock);
+
+	if (rw->writer_id != thread_get_id())
+		panic();
+
+	rw->writer_id = -1;
+	wake_writer = rw->num_write_waiters;
+
+	cpu_spin_unlock(&rw->spin_lock);
+	thread_unmask_exceptions(old_itr_status);
+
+	if (wake_writer)
+		wq_wake_one(&rw->write_wq, rw, fname, lineno);
+	else
+		wq_wake_all(&rw->read_wq, rw, fname, lineno);
+}
+
+#ifdef CFG_MUTEX_DEBUG
+void rwlock_read_lock_debug(struct rwlock *rw, const char *fname, int lineno)
+{
+	__rwlock_read_lock(rw, fname, lineno);
+}
+
+void rwlock_read_unlock_debug(struct rwlock *rw, const char *fname, int lineno)
+{
+	__rwlock_read_unlock(rw, fname, lineno);
+}
+
+void rwlock_write_lock_debug(struct rwlock *rw, const char *fname, int lineno)
+{
+	__rwlock_write_lock(rw, fname, lineno);
+}
+
+void rwlock_write_unlock_debug(struct rwlock *rw, const char *fname,
+			       int lineno)
+{
+	__rwlock_write_unlock(rw, fname, lineno);
+}
+#else
+void rwlock_read_lock(struct rwlock *rw)
+{
+	__rwlock_read_lock(rw, NULL, -1);
+}
+
+void rwlock_read_unlock(struct rwlock *rw)
+{
+	__rwlock_read_unlock(rw, NULL, -1);
+}
+
+void rwlock_write_lock(struct rwlock *rw)
+{
+	__rwlock_write_lock(rw, NULL, -1);
+}
+
+void rwlock_write_unlock(struct rwlock *rw)
+{
+	__rwlock_write_unlock(rw, NULL, -1);
+}
+#endif /*CFG_MUTEX_DEBUG*/
+
 void condvar_init(struct condvar *cv)
 {
 	*cv = (struct condvar)CONDVAR_INITIALIZER;
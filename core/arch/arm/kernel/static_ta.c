@@ -53,6 +53,9 @@ static TEE_Result tee_ta_param_pa2va(struct tee_ta_param *param)
 		case TEE_PARAM_TYPE_MEMREF_INPUT:
 		case TEE_PARAM_TYPE_MEMREF_OUTPUT:
 		case TEE_PARAM_TYPE_MEMREF_INOUT:
+			/* Not mapped contiguously in core */
+			if (param->frags[n])
+				return TEE_ERROR_BAD_PARAMETERS;
 			pa = (paddr_t)param->params[n].memref.buffer;
 			va = phys_to_virt(pa, MEM_AREA_NSEC_SHM);
 			if (!va)
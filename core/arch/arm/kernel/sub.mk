@@ -1,5 +1,6 @@
 srcs-y += tee_ta_manager.c
 srcs-$(CFG_WITH_USER_TA) += user_ta.c
+srcs-$(CFG_TA_IMAGE_CACHE) += ta_image_cache.c
 srcs-y += static_ta.c
 srcs-y += elf_load.c
 srcs-y += tee_time.c
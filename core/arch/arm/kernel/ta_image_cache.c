@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <assert.h>
+#include <kernel/mutex.h>
+#include <kernel/ta_image_cache.h>
+#include <kernel/tee_ta_manager.h>
+#include <mm/core_memprot.h>
+#include <mm/core_mmu.h>
+#include <mm/tee_mm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+/*
+ * Images are ordered from most to least recently used. The mutex protects
+ * the list, the reference counts and the counters below. It's taken
+ * before tee_ta_mutex which is needed to allocate and free secure DDR.
+ */
+static struct mutex ta_image_mutex = MUTEX_INITIALIZER;
+static TAILQ_HEAD(ta_image_head, ta_image) ta_images =
+	TAILQ_HEAD_INITIALIZER(ta_images);
+/* Includes images allocated but not yet inserted, or evicted but in use */
+static size_t ta_image_size;
+static size_t ta_image_num;
+
+#ifdef CFG_WITH_STATS
+static struct ta_image_cache_stats ta_image_stats;
+#define INC_STATS(field)	(ta_image_stats.field++)
+#else
+#define INC_STATS(field)	do { } while (0)
+#endif
+
+static void free_image(struct ta_image *img)
+{
+	size_t s = tee_mm_get_bytes(img->mm);
+
+	/* Don't leave traces of the TA behind, like user_ta_ctx_destroy() */
+	if (img->data) {
+		memset(img->data, 0, s);
+		cache_maintenance_l1(DCACHE_AREA_CLEAN, img->data, s);
+	}
+
+	mutex_lock(&tee_ta_mutex);
+	tee_mm_free(img->mm);
+	mutex_unlock(&tee_ta_mutex);
+
+	ta_image_size -= s;
+	free(img->segs);
+	free(img);
+}
+
+static void evict_image(struct ta_image *img)
+{
+	TAILQ_REMOVE(&ta_images, img, link);
+	ta_image_num--;
+	INC_STATS(evictions);
+	if (img->refcount)
+		img->evicted = true;
+	else
+		free_image(img);
+}
+
+static struct ta_image *find_image(const TEE_UUID *uuid)
+{
+	struct ta_image *img;
+
+	TAILQ_FOREACH(img, &ta_images, link)
+		if (!memcmp(&img->uuid, uuid, sizeof(*uuid)))
+			return img;
+	return NULL;
+}
+
+static bool image_matches(const struct ta_image *img, uint32_t algo,
+			  const void *hash, size_t hash_size)
+{
+	return img->algo == algo && img->hash_size == hash_size &&
+	       !memcmp(img->hash, hash, hash_size);
+}
+
+/* Evicts unused images, least recently used first, until size bytes fit */
+static bool make_room(size_t size)
+{
+	struct ta_image *img;
+	struct ta_image *prev;
+
+	TAILQ_FOREACH_REVERSE_SAFE(img, &ta_images, ta_image_head, link,
+				   prev) {
+		if (ta_image_size + size <= CFG_TA_IMAGE_CACHE_SIZE)
+			break;
+		if (!img->refcount)
+			evict_image(img);
+	}
+
+	return ta_image_size + size <= CFG_TA_IMAGE_CACHE_SIZE;
+}
+
+struct ta_image *ta_image_cache_alloc(size_t vasize, size_t num_segs)
+{
+	struct ta_image *img;
+
+	if (vasize > CFG_TA_IMAGE_CACHE_SIZE)
+		return NULL;
+
+	img = calloc(1, sizeof(*img));
+	if (!img)
+		return NULL;
+	img->segs = calloc(num_segs, sizeof(*img->segs));
+	if (!img->segs)
+		goto err;
+
+	mutex_lock(&ta_image_mutex);
+	if (make_room(vasize)) {
+		mutex_lock(&tee_ta_mutex);
+		img->mm = tee_mm_alloc(&tee_mm_sec_ddr, vasize);
+		mutex_unlock(&tee_ta_mutex);
+	}
+	if (img->mm)
+		ta_image_size += tee_mm_get_bytes(img->mm);
+	mutex_unlock(&ta_image_mutex);
+	if (!img->mm)
+		goto err;
+
+	img->vasize = vasize;
+	img->num_segs = num_segs;
+	/* Not in the cache until ta_image_cache_insert() */
+	img->refcount = 1;
+	img->evicted = true;
+	img->data = phys_to_virt(tee_mm_get_smem(img->mm), MEM_AREA_TA_RAM);
+	if (!img->data) {
+		ta_image_cache_put(img);
+		return NULL;
+	}
+	return img;
+err:
+	free(img->segs);
+	free(img);
+	return NULL;
+}
+
+void ta_image_cache_insert(struct ta_image *img)
+{
+	struct ta_image *old;
+
+	cache_maintenance_l1(DCACHE_AREA_CLEAN, img->data, img->vasize);
+
+	mutex_lock(&ta_image_mutex);
+	old = find_image(&img->uuid);
+	if (old)
+		evict_image(old);
+	assert(img->refcount == 1 && img->evicted);
+	img->refcount = 0;
+	img->evicted = false;
+	TAILQ_INSERT_HEAD(&ta_images, img, link);
+	ta_image_num++;
+	mutex_unlock(&ta_image_mutex);
+}
+
+struct ta_image *ta_image_cache_get(const TEE_UUID *uuid, uint32_t algo,
+				    const void *hash, size_t hash_size)
+{
+	struct ta_image *img;
+
+	mutex_lock(&ta_image_mutex);
+	img = find_image(uuid);
+	/* A different hash means that the TA was updated in normal world */
+	if (img && image_matches(img, algo, hash, hash_size)) {
+		INC_STATS(hits);
+		img->refcount++;
+		TAILQ_REMOVE(&ta_images, img, link);
+		TAILQ_INSERT_HEAD(&ta_images, img, link);
+	} else {
+		img = NULL;
+		INC_STATS(misses);
+	}
+	mutex_unlock(&ta_image_mutex);
+
+	return img;
+}
+
+void ta_image_cache_put(struct ta_image *img)
+{
+	if (!img)
+		return;
+
+	mutex_lock(&ta_image_mutex);
+	assert(img->refcount);
+	img->refcount--;
+	if (!img->refcount && img->evicted)
+		free_image(img);
+	mutex_unlock(&ta_image_mutex);
+}
+
+void ta_image_cache_remove(const TEE_UUID *uuid)
+{
+	struct ta_image *img;
+
+	mutex_lock(&ta_image_mutex);
+	img = find_image(uuid);
+	if (img)
+		evict_image(img);
+	mutex_unlock(&ta_image_mutex);
+}
+
+bool ta_image_cache_flush(void)
+{
+	struct ta_image *img;
+	struct ta_image *next;
+	bool flushed = false;
+
+	mutex_lock(&ta_image_mutex);
+	TAILQ_FOREACH_SAFE(img, &ta_images, link, next) {
+		if (!img->refcount) {
+			evict_image(img);
+			flushed = true;
+		}
+	}
+	mutex_unlock(&ta_image_mutex);
+
+	if (flushed)
+		DMSG("Flushed TA image cache");
+	return flushed;
+}
+
+#ifdef CFG_WITH_STATS
+void ta_image_cache_get_stats(struct ta_image_cache_stats *stats,
+			      bool reset)
+{
+	mutex_lock(&ta_image_mutex);
+	*stats = ta_image_stats;
+	stats->num_images = ta_image_num;
+	stats->size = ta_image_size;
+	stats->max_size = CFG_TA_IMAGE_CACHE_SIZE;
+	if (reset) {
+		ta_image_stats.hits = 0;
+		ta_image_stats.misses = 0;
+		ta_image_stats.evictions = 0;
+	}
+	mutex_unlock(&ta_image_mutex);
+}
+#endif
@@ -29,6 +29,30 @@
 #include <mm/tee_mmu_types.h>
 #include <mm/core_memprot.h>
 
+/*
+ * Fragmented memrefs are used to pass buffers allocated anywhere in
+ * normal world memory, not only from the reserved shared memory. As for
+ * contiguous memrefs, memory outside the reserved shared memory is only
+ * accepted by TAs flagged with TA_FLAG_UNSAFE_NW_PARAMS.
+ */
+static bool verify_frags(struct tee_ta_session *sess,
+			 const struct tee_ta_param_frags *frags)
+{
+	const struct tee_ta_param_frag *f;
+	size_t n;
+
+	for (n = 0; n < frags->num_frags; n++) {
+		f = frags->frags + n;
+		if (core_pbuf_is(CORE_MEM_NSEC_SHM, f->pa, f->size))
+			continue;
+		if ((sess->ctx->flags & TA_FLAG_UNSAFE_NW_PARAMS) &&
+		    core_pbuf_is(CORE_MEM_MULTPURPOSE, f->pa, f->size))
+			continue;
+		return false;
+	}
+	return true;
+}
+
 /**
  * tee_ta_verify_param() - check that the 4 "params" match security
  */
@@ -45,6 +69,12 @@ TEE_Result tee_ta_verify_param(struct tee_ta_session *sess,
 		case TEE_PARAM_TYPE_MEMREF_INOUT:
 		case TEE_PARAM_TYPE_MEMREF_INPUT:
 
+			if (param->frags[n]) {
+				if (!verify_frags(sess, param->frags[n]))
+					return TEE_ERROR_SECURITY;
+				break;
+			}
+
 			if (param->param_attr[n] & TEE_MATTR_VIRTUAL) {
 				p = virt_to_phys(
 					param->params[n].memref.buffer);
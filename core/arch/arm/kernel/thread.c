@@ -30,6 +30,7 @@
 
 #include <arm.h>
 #include <assert.h>
+#include <atomic.h>
 #include <keep.h>
 #include <kernel/misc.h>
 #include <kernel/panic.h>
@@ -142,7 +143,14 @@ thread_pm_handler_t thread_system_off_handler_ptr;
 thread_pm_handler_t thread_system_reset_handler_ptr;
 
 
-static unsigned int thread_global_lock = SPINLOCK_UNLOCK;
+/*
+ * Bit n in thread_free_map is set when threads[n] is free. A thread is
+ * allocated by atomically clearing its bit and released by setting it
+ * again, so entering and leaving a standard call never needs a global
+ * lock.
+ */
+#define THREAD_FREE_MAP_WORDS	((CFG_NUM_THREADS + 31) / 32)
+static uint32_t thread_free_map[THREAD_FREE_MAP_WORDS];
 static bool thread_prealloc_rpc_cache;
 
 static void init_canaries(void)
@@ -216,14 +224,129 @@ void thread_check_canaries(void)
 #endif/*CFG_WITH_STACK_CANARIES*/
 }
 
-static void lock_global(void)
+static uint32_t free_map_mask(size_t word)
+{
+	size_t nbits = CFG_NUM_THREADS - word * 32;
+
+	if (nbits >= 32)
+		return 0xffffffff;
+	return BIT32(nbits) - 1;
+}
+
+static bool free_map_claim(size_t *thread_id)
+{
+	size_t w;
+	uint32_t old;
+	uint32_t v;
+
+	for (w = 0; w < THREAD_FREE_MAP_WORDS; w++) {
+		v = thread_free_map[w];
+		while (v) {
+			size_t b = __builtin_ctz(v);
+
+			old = atomic_cmpxchg32(thread_free_map + w, v,
+					       v & ~BIT32(b));
+			if (old == v) {
+				*thread_id = w * 32 + b;
+				return true;
+			}
+			v = old;
+		}
+	}
+
+	return false;
+}
+
+static void free_map_release(size_t thread_id)
+{
+	uint32_t *p = thread_free_map + thread_id / 32;
+	uint32_t bit = BIT32(thread_id % 32);
+	uint32_t old;
+	uint32_t v = *p;
+
+	assert(!(v & bit));
+	while (true) {
+		old = atomic_cmpxchg32(p, v, v | bit);
+		if (old == v)
+			break;
+		v = old;
+	}
+}
+
+/*
+ * Claims every thread at once, only succeeds if all threads are free.
+ * While claimed no standard call can be started, release with
+ * free_map_release_all().
+ */
+static bool free_map_claim_all(void)
+{
+	size_t w;
+	uint32_t mask;
+
+	for (w = 0; w < THREAD_FREE_MAP_WORDS; w++) {
+		mask = free_map_mask(w);
+		if (atomic_cmpxchg32(thread_free_map + w, mask, 0) != mask)
+			goto err;
+	}
+	return true;
+err:
+	while (w) {
+		w--;
+		atomic_cmpxchg32(thread_free_map + w, 0, free_map_mask(w));
+	}
+	return false;
+}
+
+static void free_map_release_all(void)
+{
+	size_t w;
+
+	for (w = 0; w < THREAD_FREE_MAP_WORDS; w++)
+		atomic_cmpxchg32(thread_free_map + w, 0, free_map_mask(w));
+}
+
+/*
+ * The state word of a thread holds an enum thread_state below
+ * THREAD_STATE_GEN and a generation count above, which each transition
+ * increases. A compare and exchange of a state word read earlier fails if
+ * the thread has changed state in between, even if it's back in the same
+ * state.
+ */
+#define THREAD_STATE_GEN	BIT32(8)
+#define THREAD_STATE_MASK	(THREAD_STATE_GEN - 1)
+
+static uint32_t thread_read_state(size_t n)
+{
+	return *(volatile uint32_t *)&threads[n].state;
+}
+
+static enum thread_state __maybe_unused thread_get_state(size_t n)
 {
-	cpu_spin_lock(&thread_global_lock);
+	return thread_read_state(n) & THREAD_STATE_MASK;
 }
 
-static void unlock_global(void)
+static uint32_t thread_next_state(uint32_t w, enum thread_state to)
 {
-	cpu_spin_unlock(&thread_global_lock);
+	return ((w & ~THREAD_STATE_MASK) + THREAD_STATE_GEN) | to;
+}
+
+/*
+ * Atomic state transition of a thread, returns true if the thread was
+ * in state @from and now is in state @to.
+ */
+static bool thread_set_state(size_t n, enum thread_state from,
+			     enum thread_state to)
+{
+	uint32_t w;
+
+	do {
+		w = thread_read_state(n);
+		if ((w & THREAD_STATE_MASK) != (uint32_t)from)
+			return false;
+	} while (atomic_cmpxchg32(&threads[n].state, w,
+				  thread_next_state(w, to)) != w);
+
+	return true;
 }
 
 #ifdef ARM32
@@ -409,6 +532,11 @@ void thread_init_boot_thread(void)
 	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++)
 		thread_core_local[n].curr_thread = -1;
 
+	/* All threads but the boot thread are free */
+	for (n = 0; n < THREAD_FREE_MAP_WORDS; n++)
+		thread_free_map[n] = free_map_mask(n);
+	thread_free_map[0] &= ~BIT32(0);
+
 	l->curr_thread = 0;
 	threads[0].state = THREAD_STATE_ACTIVE;
 }
@@ -418,9 +546,11 @@ void thread_clr_boot_thread(void)
 	struct thread_core_local *l = thread_get_core_local();
 
 	assert(l->curr_thread >= 0 && l->curr_thread < CFG_NUM_THREADS);
-	assert(threads[l->curr_thread].state == THREAD_STATE_ACTIVE);
 	assert(TAILQ_EMPTY(&threads[l->curr_thread].mutexes));
-	threads[l->curr_thread].state = THREAD_STATE_FREE;
+	if (!thread_set_state(l->curr_thread, THREAD_STATE_ACTIVE,
+			      THREAD_STATE_FREE))
+		panic();
+	free_map_release(l->curr_thread);
 	l->curr_thread = -1;
 }
 
@@ -428,27 +558,17 @@ static void thread_alloc_and_run(struct thread_smc_args *args)
 {
 	size_t n;
 	struct thread_core_local *l = thread_get_core_local();
-	bool found_thread = false;
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state == THREAD_STATE_FREE) {
-			threads[n].state = THREAD_STATE_ACTIVE;
-			found_thread = true;
-			break;
-		}
-	}
-
-	unlock_global();
-
-	if (!found_thread) {
+	if (!free_map_claim(&n)) {
 		args->a0 = OPTEE_SMC_RETURN_ETHREAD_LIMIT;
 		return;
 	}
 
+	if (!thread_set_state(n, THREAD_STATE_FREE, THREAD_STATE_ACTIVE))
+		panic();
+
 	l->curr_thread = n;
 
 	threads[n].flags = 0;
@@ -499,23 +619,29 @@ static void thread_resume_from_rpc(struct thread_smc_args *args)
 {
 	size_t n = args->a3; /* thread id */
 	struct thread_core_local *l = thread_get_core_local();
-	uint32_t rv = 0;
+	uint32_t w;
 
 	assert(l->curr_thread == -1);
 
-	lock_global();
-
-	if (n < CFG_NUM_THREADS &&
-	    threads[n].state == THREAD_STATE_SUSPENDED &&
-	    args->a7 == threads[n].hyp_clnt_id)
-		threads[n].state = THREAD_STATE_ACTIVE;
-	else
-		rv = OPTEE_SMC_RETURN_ERESUME;
-
-	unlock_global();
+	if (n >= CFG_NUM_THREADS) {
+		args->a0 = OPTEE_SMC_RETURN_ERESUME;
+		return;
+	}
 
-	if (rv) {
-		args->a0 = rv;
+	/*
+	 * hyp_clnt_id is only updated after the thread has left the
+	 * suspended state, so reading it after the state word gives the
+	 * client of that suspension. If the thread has been freed and
+	 * allocated to another client since, the generation in the state
+	 * word has moved on and the exchange fails.
+	 */
+	w = thread_read_state(n);
+	dsb();
+	if ((w & THREAD_STATE_MASK) != THREAD_STATE_SUSPENDED ||
+	    args->a7 != threads[n].hyp_clnt_id ||
+	    atomic_cmpxchg32(&threads[n].state, w,
+			     thread_next_state(w, THREAD_STATE_ACTIVE)) != w) {
+		args->a0 = OPTEE_SMC_RETURN_ERESUME;
 		return;
 	}
 
@@ -627,14 +753,12 @@ void thread_state_free(void)
 		(void *)(threads[ct].stack_va_end - STACK_THREAD_SIZE),
 		STACK_THREAD_SIZE);
 
-	lock_global();
-
-	assert(threads[ct].state == THREAD_STATE_ACTIVE);
-	threads[ct].state = THREAD_STATE_FREE;
+	assert(thread_get_state(ct) == THREAD_STATE_ACTIVE);
 	threads[ct].flags = 0;
 	l->curr_thread = -1;
-
-	unlock_global();
+	if (!thread_set_state(ct, THREAD_STATE_ACTIVE, THREAD_STATE_FREE))
+		panic();
+	free_map_release(ct);
 }
 
 #ifdef ARM32
@@ -686,13 +810,10 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 		thread_user_save_vfp();
 	thread_lazy_restore_ns_vfp();
 
-	lock_global();
-
-	assert(threads[ct].state == THREAD_STATE_ACTIVE);
+	assert(thread_get_state(ct) == THREAD_STATE_ACTIVE);
 	threads[ct].flags |= flags;
 	threads[ct].regs.cpsr = cpsr;
 	threads[ct].regs.pc = pc;
-	threads[ct].state = THREAD_STATE_SUSPENDED;
 
 	threads[ct].have_user_map = core_mmu_user_mapping_is_active();
 	if (threads[ct].have_user_map) {
@@ -702,7 +823,12 @@ int thread_state_suspend(uint32_t flags, uint32_t cpsr, vaddr_t pc)
 
 	l->curr_thread = -1;
 
-	unlock_global();
+	/*
+	 * The state is updated last with a barrier so the saved context is
+	 * visible to the core resuming the thread.
+	 */
+	if (!thread_set_state(ct, THREAD_STATE_ACTIVE, THREAD_STATE_SUSPENDED))
+		panic();
 
 	return ct;
 }
@@ -1087,7 +1213,7 @@ void thread_add_mutex(struct mutex *m)
 	struct thread_core_local *l = thread_get_core_local();
 	int ct = l->curr_thread;
 
-	assert(ct != -1 && threads[ct].state == THREAD_STATE_ACTIVE);
+	assert(ct != -1 && thread_get_state(ct) == THREAD_STATE_ACTIVE);
 	assert(m->owner_id == -1);
 	m->owner_id = ct;
 	TAILQ_INSERT_TAIL(&threads[ct].mutexes, m, link);
@@ -1098,7 +1224,7 @@ void thread_rem_mutex(struct mutex *m)
 	struct thread_core_local *l = thread_get_core_local();
 	int ct = l->curr_thread;
 
-	assert(ct != -1 && threads[ct].state == THREAD_STATE_ACTIVE);
+	assert(ct != -1 && thread_get_state(ct) == THREAD_STATE_ACTIVE);
 	assert(m->owner_id == ct);
 	m->owner_id = -1;
 	TAILQ_REMOVE(&threads[ct].mutexes, m, link);
@@ -1110,13 +1236,9 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	size_t n;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_IRQ);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (!free_map_claim_all()) {
+		rv = false;
+		goto out_unmask;
 	}
 
 	rv = true;
@@ -1132,30 +1254,23 @@ bool thread_disable_prealloc_rpc_cache(uint64_t *cookie)
 	*cookie = 0;
 	thread_prealloc_rpc_cache = false;
 out:
-	unlock_global();
+	free_map_release_all();
+out_unmask:
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
 
 bool thread_enable_prealloc_rpc_cache(void)
 {
-	bool rv;
-	size_t n;
+	bool rv = false;
 	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_IRQ);
 
-	lock_global();
-
-	for (n = 0; n < CFG_NUM_THREADS; n++) {
-		if (threads[n].state != THREAD_STATE_FREE) {
-			rv = false;
-			goto out;
-		}
+	if (free_map_claim_all()) {
+		thread_prealloc_rpc_cache = true;
+		free_map_release_all();
+		rv = true;
 	}
 
-	rv = true;
-	thread_prealloc_rpc_cache = true;
-out:
-	unlock_global();
 	thread_unmask_exceptions(exceptions);
 	return rv;
 }
@@ -32,6 +32,7 @@
 #include <types_ext.h>
 #include <stdlib.h>
 #include <kernel/panic.h>
+#include <kernel/ta_image_cache.h>
 #include <kernel/tee_ta_manager.h>
 #include <kernel/thread.h>
 #include <kernel/user_ta.h>
@@ -58,16 +59,233 @@
 
 #define STACK_ALIGNMENT   (sizeof(long) * 2)
 
-static TEE_Result load_header(const struct shdr *signed_ta,
-		struct shdr **sec_shdr)
+/* Size of the window of shared memory used to fetch a TA in chunks */
+#define TA_LOAD_WINDOW_SIZE	(64 * 1024)
+/*
+ * Size of the first window, enough for the signed header which is all
+ * that's needed if the image of the TA is cached. A header with a SHA-512
+ * hash and a 4096 bit RSA signature is less than 600 bytes.
+ */
+#define TA_LOAD_HEADER_SIZE	1024
+
+/*
+ * A signed TA fetched from tee-supplicant, either in chunks through a
+ * window of TA_LOAD_WINDOW_SIZE bytes or in one piece if tee-supplicant
+ * doesn't support loading TAs in chunks.
+ */
+struct ta_nwdata {
+	TEE_UUID uuid;
+	uint8_t *buf;		/* Shared memory */
+	paddr_t pa;
+	uint64_t cookie;
+	size_t buf_offs;	/* Offset in signed TA of content of buf */
+	size_t buf_len;		/* Valid bytes in buf */
+	size_t size;		/* Size of signed TA */
+	size_t elf_offs;	/* Offset in signed TA of the ELF */
+	bool chunked;
+};
+
+/*
+ * Whether tee-supplicant can load TAs in chunks, negotiated by the first
+ * TA load and final from then on. Loads may run concurrently, but they
+ * all get the same answer from tee-supplicant.
+ */
+static enum {
+	TA_LOAD_CHUNKS_UNKNOWN,
+	TA_LOAD_CHUNKS_SUPPORTED,
+	TA_LOAD_CHUNKS_UNSUPPORTED,
+} ta_load_chunks;
+
+static TEE_Result alloc_nwdata_buf(struct ta_nwdata *nw, size_t size)
+{
+	thread_rpc_alloc_payload(size, &nw->pa, &nw->cookie);
+	if (!nw->pa)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	nw->buf = phys_to_virt(nw->pa, MEM_AREA_NSEC_SHM);
+	if (!nw->buf || !tee_vbuf_is_non_sec(nw->buf, size)) {
+		thread_rpc_free_payload(nw->cookie);
+		return TEE_ERROR_GENERIC;
+	}
+
+	return TEE_SUCCESS;
+}
+
+/*
+ * Fetches a window of at most len bytes of the signed TA starting at
+ * offs. The third
+ * parameter of OPTEE_MSG_RPC_CMD_LOAD_TA holds the offset in value.a and
+ * tee-supplicant returns the size of the signed TA in value.b.
+ *
+ * A reply to the first window that shows that tee-supplicant doesn't
+ * understand the third parameter returns TEE_ERROR_NOT_SUPPORTED.
+ */
+static TEE_Result rpc_load_chunk(struct ta_nwdata *nw, size_t offs,
+			size_t len)
+{
+	TEE_Result res;
+	struct optee_msg_param params[3];
+
+	memset(params, 0, sizeof(params));
+	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+	memcpy(&params[0].u.value, &nw->uuid, sizeof(TEE_UUID));
+	params[1].attr = OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT;
+	params[1].u.tmem.buf_ptr = nw->pa;
+	params[1].u.tmem.size = len;
+	params[1].u.tmem.shm_ref = nw->cookie;
+	params[2].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INOUT;
+	params[2].u.value.a = offs;
+
+	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 3, params);
+	if (!offs && (res == TEE_ERROR_BAD_PARAMETERS ||
+		      res == TEE_ERROR_NOT_SUPPORTED ||
+		      res == TEE_ERROR_NOT_IMPLEMENTED))
+		return TEE_ERROR_NOT_SUPPORTED;
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (!offs) {
+		/* An old tee-supplicant leaves value.b and tmem.size alone */
+		if (!params[2].u.value.b ||
+		    params[1].u.tmem.size < MIN(params[2].u.value.b,
+						(uint64_t)len))
+			return TEE_ERROR_NOT_SUPPORTED;
+		nw->size = params[2].u.value.b;
+	} else if (nw->size != params[2].u.value.b)
+		return TEE_ERROR_SECURITY;
+	if (offs >= nw->size)
+		return TEE_ERROR_SECURITY;
+
+	nw->buf_offs = offs;
+	nw->buf_len = MIN(params[1].u.tmem.size, (uint64_t)(nw->size - offs));
+	nw->buf_len = MIN(nw->buf_len, len);
+	return TEE_SUCCESS;
+}
+
+/* Fetches the entire signed TA, the size is queried first */
+static TEE_Result rpc_load_all(struct ta_nwdata *nw)
+{
+	TEE_Result res;
+	struct optee_msg_param params[2];
+
+	memset(params, 0, sizeof(params));
+	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+	memcpy(&params[0].u.value, &nw->uuid, sizeof(TEE_UUID));
+	params[1].attr = OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT;
+	params[1].u.tmem.buf_ptr = 0;
+	params[1].u.tmem.size = 0;
+	params[1].u.tmem.shm_ref = 0;
+
+	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 2, params);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	nw->size = params[1].u.tmem.size;
+	res = alloc_nwdata_buf(nw, nw->size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
+	memcpy(&params[0].u.value, &nw->uuid, sizeof(TEE_UUID));
+	params[1].attr = OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT;
+	params[1].u.tmem.buf_ptr = nw->pa;
+	params[1].u.tmem.shm_ref = nw->cookie;
+	/* Note that params[1].u.tmem.size is already assigned */
+
+	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 2, params);
+	if (res != TEE_SUCCESS) {
+		thread_rpc_free_payload(nw->cookie);
+		return res;
+	}
+
+	nw->buf_offs = 0;
+	nw->buf_len = nw->size;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Load a TA via RPC with UUID defined by input param uuid. On success the
+ * first TA_LOAD_HEADER_SIZE bytes of the signed TA, or all of it if
+ * tee-supplicant can't load TAs in chunks, are available in nw->buf and
+ * the shared memory is freed with thread_rpc_free_payload(nw->cookie).
+ */
+static TEE_Result rpc_load(const TEE_UUID *uuid, struct ta_nwdata *nw)
+{
+	TEE_Result res;
+
+	memset(nw, 0, sizeof(*nw));
+	nw->uuid = *uuid;
+
+	if (ta_load_chunks != TA_LOAD_CHUNKS_UNSUPPORTED) {
+		res = alloc_nwdata_buf(nw, TA_LOAD_WINDOW_SIZE);
+		if (res != TEE_SUCCESS)
+			return res;
+		res = rpc_load_chunk(nw, 0, TA_LOAD_HEADER_SIZE);
+		if (res == TEE_SUCCESS) {
+			nw->chunked = true;
+			ta_load_chunks = TA_LOAD_CHUNKS_SUPPORTED;
+			return TEE_SUCCESS;
+		}
+		thread_rpc_free_payload(nw->cookie);
+		/*
+		 * Other failures, a missing TA for instance, would fail
+		 * a load in one piece too. Once chunks have worked there's
+		 * nothing to fall back to.
+		 */
+		if (res != TEE_ERROR_NOT_SUPPORTED ||
+		    ta_load_chunks == TA_LOAD_CHUNKS_SUPPORTED)
+			return res;
+		DMSG("Loading TAs in chunks not supported");
+		ta_load_chunks = TA_LOAD_CHUNKS_UNSUPPORTED;
+	}
+
+	return rpc_load_all(nw);
+}
+
+/* Supplies windows of the ELF to elf_load_*(), see elf_load_get_window_t */
+static TEE_Result get_elf_window(void *priv, size_t offs, uint8_t **win,
+			size_t *win_len)
+{
+	TEE_Result res;
+	struct ta_nwdata *nw = priv;
+	size_t o = nw->elf_offs + offs;
+
+	if (o < offs)
+		return TEE_ERROR_SECURITY;
+
+	if (nw->chunked &&
+	    (o < nw->buf_offs || o - nw->buf_offs >= nw->buf_len)) {
+		res = rpc_load_chunk(nw, o, TA_LOAD_WINDOW_SIZE);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	if (o < nw->buf_offs || o - nw->buf_offs >= nw->buf_len)
+		return TEE_ERROR_SECURITY;
+
+	*win = nw->buf + (o - nw->buf_offs);
+	*win_len = nw->buf_len - (o - nw->buf_offs);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result load_header(struct ta_nwdata *nw, struct shdr **sec_shdr)
 {
+	TEE_Result res;
+	const struct shdr *signed_ta = (const struct shdr *)nw->buf;
 	size_t s;
 
-	if (!tee_vbuf_is_non_sec(signed_ta, sizeof(*signed_ta)))
+	if (nw->buf_offs || nw->buf_len < sizeof(*signed_ta))
 		return TEE_ERROR_SECURITY;
 
 	s = SHDR_GET_SIZE(signed_ta);
-	if (!tee_vbuf_is_non_sec(signed_ta, s))
+	if (nw->buf_len < s && nw->chunked && nw->buf_len < nw->size) {
+		/* Header larger than the first window, fetch a full one */
+		res = rpc_load_chunk(nw, 0, TA_LOAD_WINDOW_SIZE);
+		if (res != TEE_SUCCESS)
+			return res;
+		s = SHDR_GET_SIZE(signed_ta);
+	}
+	if (nw->buf_len < s)
 		return TEE_ERROR_SECURITY;
 
 	/* Copy signed header into secure memory */
@@ -76,6 +294,9 @@ static TEE_Result load_header(const struct shdr *signed_ta,
 		return TEE_ERROR_OUT_OF_MEMORY;
 	memcpy(*sec_shdr, signed_ta, s);
 
+	/* Use the size from the secure copy, the shared header may change */
+	nw->elf_offs = SHDR_GET_SIZE(*sec_shdr);
+
 	return TEE_SUCCESS;
 }
 
@@ -208,13 +429,45 @@ static paddr_t get_code_pa(struct user_ta_ctx *utc)
 }
 #endif /*!CFG_PAGED_USER_TA*/
 
+static TEE_Result get_elf_segments(struct elf_load_state *elf_state,
+			struct ta_image_seg **segs, size_t *num_segs)
+{
+	TEE_Result res;
+	size_t idx = 0;
+	size_t n = 0;
+
+	while (elf_load_get_next_segment(elf_state, &idx, NULL, NULL,
+					 NULL) == TEE_SUCCESS)
+		n++;
+	if (!n)
+		return TEE_ERROR_BAD_FORMAT;
+
+	*segs = calloc(n, sizeof(struct ta_image_seg));
+	if (!*segs)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	*num_segs = n;
+
+	idx = 0;
+	for (n = 0; n < *num_segs; n++) {
+		res = elf_load_get_next_segment(elf_state, &idx,
+						&(*segs)[n].offs,
+						&(*segs)[n].size,
+						&(*segs)[n].flags);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
+}
+
 static TEE_Result load_elf_segments(struct user_ta_ctx *utc,
-			struct elf_load_state *elf_state, bool init_attrs)
+			const struct ta_image_seg *segs, size_t num_segs,
+			bool init_attrs)
 {
 	TEE_Result res;
 	paddr_t pa;
 	uint32_t mattr;
-	size_t idx = 0;
+	size_t n;
 
 	tee_mmu_map_clear(utc);
 	/*
@@ -228,20 +481,10 @@ static TEE_Result load_elf_segments(struct user_ta_ctx *utc,
 	 * Add code segment
 	 */
 	pa = get_code_pa(utc);
-	while (true) {
-		vaddr_t offs;
-		size_t size;
-		uint32_t flags;
-
-		res = elf_load_get_next_segment(elf_state, &idx, &offs, &size,
-						&flags);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND)
-			break;
-		if (res != TEE_SUCCESS)
-			return res;
-
-		mattr = elf_flags_to_mattr(flags, init_attrs);
-		res = tee_mmu_map_add_segment(utc, pa, offs, size, mattr);
+	for (n = 0; n < num_segs; n++) {
+		mattr = elf_flags_to_mattr(segs[n].flags, init_attrs);
+		res = tee_mmu_map_add_segment(utc, pa, segs[n].offs,
+					      segs[n].size, mattr);
 		if (res != TEE_SUCCESS)
 			return res;
 	}
@@ -264,9 +507,26 @@ static TEE_Result alloc_code(struct user_ta_ctx *utc __unused,
 	return TEE_SUCCESS;
 }
 #else /*!CFG_PAGED_USER_TA*/
+static tee_mm_entry_t *alloc_ta_mem(size_t size)
+{
+	tee_mm_entry_t *mm;
+
+	while (true) {
+		mutex_lock(&tee_ta_mutex);
+		mm = tee_mm_alloc(&tee_mm_sec_ddr, size);
+		mutex_unlock(&tee_ta_mutex);
+#ifdef CFG_TA_IMAGE_CACHE
+		/* Cached TA images give way to TAs being loaded */
+		if (!mm && ta_image_cache_flush())
+			continue;
+#endif
+		return mm;
+	}
+}
+
 static TEE_Result alloc_stack(struct user_ta_ctx *utc)
 {
-	utc->mm_stack = tee_mm_alloc(&tee_mm_sec_ddr, utc->stack_size);
+	utc->mm_stack = alloc_ta_mem(utc->stack_size);
 	if (!utc->mm_stack) {
 		EMSG("Failed to allocate %zu bytes for user stack",
 		     utc->stack_size);
@@ -278,7 +538,7 @@ static TEE_Result alloc_stack(struct user_ta_ctx *utc)
 
 static TEE_Result alloc_code(struct user_ta_ctx *utc, size_t vasize)
 {
-	utc->mm = tee_mm_alloc(&tee_mm_sec_ddr, vasize);
+	utc->mm = alloc_ta_mem(vasize);
 	if (!utc->mm)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
@@ -286,23 +546,32 @@ static TEE_Result alloc_code(struct user_ta_ctx *utc, size_t vasize)
 }
 #endif /*!CFG_PAGED_USER_TA*/
 
+/*
+ * TAs are loaded without tee_ta_mutex, it's only held while the ASID and
+ * the secure DDR of a TA are allocated or freed.
+ */
+static void free_utc_mem(struct user_ta_ctx *utc)
+{
+	mutex_lock(&tee_ta_mutex);
+	tee_mmu_final(utc);
+	tee_mm_free(utc->mm_stack);
+	tee_mm_free(utc->mm);
+	mutex_unlock(&tee_ta_mutex);
+}
+
 static TEE_Result load_elf(struct user_ta_ctx *utc, struct shdr *shdr,
-			const struct shdr *nmem_shdr)
+			struct ta_nwdata *nw,
+			struct ta_image_seg **segs, size_t *num_segs,
+			size_t *vasize)
 {
 	TEE_Result res;
 	size_t hash_ctx_size;
 	void *hash_ctx = NULL;
 	uint32_t hash_algo;
-	uint8_t *nwdata = (uint8_t *)nmem_shdr + SHDR_GET_SIZE(shdr);
-	size_t nwdata_len = shdr->img_size;
 	void *digest = NULL;
 	struct elf_load_state *elf_state = NULL;
 	struct ta_head *ta_head;
 	void *p;
-	size_t vasize;
-
-	if (!tee_vbuf_is_non_sec(nwdata, nwdata_len))
-		return TEE_ERROR_SECURITY;
 
 	if (!crypto_ops.hash.get_ctx_size || !crypto_ops.hash.init ||
 	    !crypto_ops.hash.update || !crypto_ops.hash.final) {
@@ -326,18 +595,22 @@ static TEE_Result load_elf(struct user_ta_ctx *utc, struct shdr *shdr,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = elf_load_init(hash_ctx, hash_algo, nwdata, nwdata_len,
-			    &elf_state);
+	res = elf_load_init(hash_ctx, hash_algo, shdr->img_size,
+			    get_elf_window, nw, &elf_state);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = elf_load_head(elf_state, sizeof(struct ta_head), &p, &vasize,
+	res = elf_load_head(elf_state, sizeof(struct ta_head), &p, vasize,
 			    &utc->is_32bit);
 	if (res != TEE_SUCCESS)
 		goto out;
 	ta_head = p;
 
-	res = alloc_code(utc, vasize);
+	res = get_elf_segments(elf_state, segs, num_segs);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = alloc_code(utc, *vasize);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -360,11 +633,13 @@ static TEE_Result load_elf(struct user_ta_ctx *utc, struct shdr *shdr,
 	 * Map physical memory into TA virtual memory
 	 */
 
+	mutex_lock(&tee_ta_mutex);
 	res = tee_mmu_init(utc);
+	mutex_unlock(&tee_ta_mutex);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = load_elf_segments(utc, elf_state, true /* init attrs */);
+	res = load_elf_segments(utc, *segs, *num_segs, true /* init attrs */);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -394,14 +669,14 @@ static TEE_Result load_elf(struct user_ta_ctx *utc, struct shdr *shdr,
 	 * Replace the init attributes with attributes used when the TA is
 	 * running.
 	 */
-	res = load_elf_segments(utc, elf_state, false /* final attrs */);
+	res = load_elf_segments(utc, *segs, *num_segs, false /* final attrs */);
 	if (res != TEE_SUCCESS)
 		goto out;
 
 	cache_maintenance_l1(DCACHE_AREA_CLEAN,
-			     (void *)tee_mmu_get_load_addr(&utc->ctx), vasize);
+			     (void *)tee_mmu_get_load_addr(&utc->ctx), *vasize);
 	cache_maintenance_l1(ICACHE_AREA_INVALIDATE,
-			     (void *)tee_mmu_get_load_addr(&utc->ctx), vasize);
+			     (void *)tee_mmu_get_load_addr(&utc->ctx), *vasize);
 out:
 	elf_load_final(elf_state);
 	free(digest);
@@ -409,28 +684,223 @@ out:
 	return res;
 }
 
-/*-----------------------------------------------------------------------------
- * Loads TA header and hashes.
- * Verifies the TA signature.
- * Returns context ptr and TEE_Result.
- *---------------------------------------------------------------------------*/
-static TEE_Result ta_load(const TEE_UUID *uuid, const struct shdr *signed_ta,
-			struct tee_ta_ctx **ta_ctx)
+static struct user_ta_ctx *alloc_utc(void)
+{
+	struct user_ta_ctx *utc = calloc(1, sizeof(struct user_ta_ctx));
+
+	if (!utc)
+		return NULL;
+
+	TAILQ_INIT(&utc->open_sessions);
+	TAILQ_INIT(&utc->cryp_states);
+	TAILQ_INIT(&utc->objects);
+	TAILQ_INIT(&utc->storage_enums);
+	ptr_hash_init(&utc->cryp_state_hash);
+	ptr_hash_init(&utc->object_hash);
+	ptr_hash_init(&utc->storage_enum_hash);
+#if defined(CFG_SE_API)
+	utc->se_service = NULL;
+#endif
+	return utc;
+}
+
+/* Frees a context which failed to load, the TA has never been executed */
+static void free_utc(struct user_ta_ctx *utc)
+{
+	tee_mmu_set_ctx(NULL);
+	if (utc) {
+		pgt_flush_ctx(&utc->ctx);
+		tee_pager_rem_uta_areas(utc);
+		free_utc_mem(utc);
+		free(utc);
+	}
+}
+
+/*
+ * Checks the TA header of a loaded TA and completes the context, on
+ * success the context is ready to be registered in tee_ctxes.
+ */
+static TEE_Result init_utc_from_ta_head(struct user_ta_ctx *utc,
+			const TEE_UUID *uuid)
 {
-	TEE_Result res;
 	/* man_flags: mandatory flags */
 	uint32_t man_flags = TA_FLAG_USER_MODE | TA_FLAG_EXEC_DDR;
 	/* opt_flags: optional flags */
 	uint32_t opt_flags = man_flags | TA_FLAG_SINGLE_INSTANCE |
 	    TA_FLAG_MULTI_SESSION | TA_FLAG_UNSAFE_NW_PARAMS |
 	    TA_FLAG_INSTANCE_KEEP_ALIVE;
-	struct user_ta_ctx *utc = NULL;
-	struct shdr *sec_shdr = NULL;
 	struct ta_head *ta_head;
 
-	res = load_header(signed_ta, &sec_shdr);
+	utc->load_addr = tee_mmu_get_load_addr(&utc->ctx);
+	ta_head = (struct ta_head *)(vaddr_t)utc->load_addr;
+
+	if (memcmp(&ta_head->uuid, uuid, sizeof(TEE_UUID)) != 0)
+		return TEE_ERROR_SECURITY;
+
+	/* check input flags bitmask consistency and save flags */
+	if ((ta_head->flags & opt_flags) != ta_head->flags ||
+	    (ta_head->flags & man_flags) != man_flags) {
+		EMSG("TA flag issue: flags=%x opt=%X man=%X",
+		     ta_head->flags, opt_flags, man_flags);
+		return TEE_ERROR_BAD_FORMAT;
+	}
+
+	utc->ctx.flags = ta_head->flags;
+	utc->ctx.uuid = ta_head->uuid;
+	utc->entry_func = ta_head->entry.ptr64;
+
+	utc->ctx.ref_count = 1;
+
+	condvar_init(&utc->ctx.busy_cv);
+
+	if (utc->mm)
+		DMSG("Loaded TA at 0x%" PRIxPTR, tee_mm_get_smem(utc->mm));
+	DMSG("ELF load address 0x%x", utc->load_addr);
+
+	return TEE_SUCCESS;
+}
+
+#ifdef CFG_TA_IMAGE_CACHE
+/*
+ * Saves the image of a TA which has just been loaded and verified, before
+ * it has had a chance to modify its data. Failing to cache the image
+ * doesn't affect the TA.
+ */
+static void add_to_image_cache(struct user_ta_ctx *utc,
+			const struct shdr *shdr, struct ta_image_seg *segs,
+			size_t num_segs, size_t vasize)
+{
+	struct ta_image *img;
+
+	if (shdr->hash_size > sizeof(img->hash))
+		return;
+
+	img = ta_image_cache_alloc(vasize, num_segs);
+	if (!img)
+		return;
+
+	img->uuid = utc->ctx.uuid;
+	img->algo = shdr->algo;
+	img->hash_size = shdr->hash_size;
+	memcpy(img->hash, SHDR_GET_HASH(shdr), shdr->hash_size);
+	img->is_32bit = utc->is_32bit;
+	img->stack_size = utc->stack_size;
+	img->load_addr = utc->load_addr;
+	memcpy(img->segs, segs, num_segs * sizeof(*segs));
+	memcpy(img->data, (void *)(vaddr_t)utc->load_addr, vasize);
+
+	ta_image_cache_insert(img);
+}
+
+/*
+ * Loads a TA from its cached image if it matches the signed header of the
+ * TA in normal world. The image was verified when it was added to the
+ * cache so neither the rest of the TA nor its signature needs to be
+ * checked.
+ */
+static TEE_Result ta_load_cached(const TEE_UUID *uuid,
+			const struct shdr *shdr, struct tee_ta_ctx **ta_ctx)
+{
+	TEE_Result res;
+	struct ta_image *img;
+	struct user_ta_ctx *utc;
+
+	img = ta_image_cache_get(uuid, shdr->algo, SHDR_GET_HASH(shdr),
+				 shdr->hash_size);
+	if (!img)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+
+	utc = alloc_utc();
+	if (!utc) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	utc->is_32bit = img->is_32bit;
+	/* Temporary assignment to setup memory mapping */
+	utc->ctx.flags = TA_FLAG_USER_MODE | TA_FLAG_EXEC_DDR;
+	utc->stack_size = img->stack_size;
+
+	res = alloc_code(utc, img->vasize);
 	if (res != TEE_SUCCESS)
-		goto error_return;
+		goto out;
+	res = alloc_stack(utc);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	mutex_lock(&tee_ta_mutex);
+	res = tee_mmu_init(utc);
+	mutex_unlock(&tee_ta_mutex);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = load_elf_segments(utc, img->segs, img->num_segs,
+				true /* init attrs */);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	tee_mmu_set_ctx(&utc->ctx);
+
+	/* The image is relocated, it can only be used at the same address */
+	if (tee_mmu_get_load_addr(&utc->ctx) != img->load_addr) {
+		res = TEE_ERROR_ITEM_NOT_FOUND;
+		ta_image_cache_remove(uuid);
+		goto out;
+	}
+	memcpy((void *)img->load_addr, img->data, img->vasize);
+
+	res = load_elf_segments(utc, img->segs, img->num_segs,
+				false /* final attrs */);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	cache_maintenance_l1(DCACHE_AREA_CLEAN,
+			     (void *)img->load_addr, img->vasize);
+	cache_maintenance_l1(ICACHE_AREA_INVALIDATE,
+			     (void *)img->load_addr, img->vasize);
+
+	res = init_utc_from_ta_head(utc, uuid);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	/* Registered in tee_ctxes by tee_ta_init_session() */
+	*ta_ctx = &utc->ctx;
+	tee_mmu_set_ctx(NULL);
+out:
+	if (res != TEE_SUCCESS)
+		free_utc(utc);
+	ta_image_cache_put(img);
+	return res;
+}
+#else
+static void add_to_image_cache(struct user_ta_ctx *utc __unused,
+			const struct shdr *shdr __unused,
+			struct ta_image_seg *segs __unused,
+			size_t num_segs __unused, size_t vasize __unused)
+{
+}
+
+static TEE_Result ta_load_cached(const TEE_UUID *uuid __unused,
+			const struct shdr *shdr __unused,
+			struct tee_ta_ctx **ta_ctx __unused)
+{
+	return TEE_ERROR_ITEM_NOT_FOUND;
+}
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Verifies the TA signature of the header loaded with load_header() and
+ * loads the TA.
+ * Returns context ptr and TEE_Result.
+ *---------------------------------------------------------------------------*/
+static TEE_Result ta_load(const TEE_UUID *uuid, struct ta_nwdata *nw,
+			struct shdr *sec_shdr, struct tee_ta_ctx **ta_ctx)
+{
+	TEE_Result res;
+	struct user_ta_ctx *utc = NULL;
+	struct ta_image_seg *segs = NULL;
+	size_t num_segs = 0;
+	size_t vasize = 0;
 
 	res = check_shdr(sec_shdr);
 	if (res != TEE_SUCCESS)
@@ -448,72 +918,33 @@ static TEE_Result ta_load(const TEE_UUID *uuid, const struct shdr *signed_ta,
 	 * Register context
 	 */
 
-	/* code below must be protected by mutex (multi-threaded) */
-	utc = calloc(1, sizeof(struct user_ta_ctx));
+	utc = alloc_utc();
 	if (!utc) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto error_return;
 	}
-	TAILQ_INIT(&utc->open_sessions);
-	TAILQ_INIT(&utc->cryp_states);
-	TAILQ_INIT(&utc->objects);
-	TAILQ_INIT(&utc->storage_enums);
-#if defined(CFG_SE_API)
-	utc->se_service = NULL;
-#endif
 
-	res = load_elf(utc, sec_shdr, signed_ta);
+	res = load_elf(utc, sec_shdr, nw, &segs, &num_segs, &vasize);
 	if (res != TEE_SUCCESS)
 		goto error_return;
 
-	utc->load_addr = tee_mmu_get_load_addr(&utc->ctx);
-	ta_head = (struct ta_head *)(vaddr_t)utc->load_addr;
-
-	if (memcmp(&ta_head->uuid, uuid, sizeof(TEE_UUID)) != 0) {
-		res = TEE_ERROR_SECURITY;
-		goto error_return;
-	}
-
-	/* check input flags bitmask consistency and save flags */
-	if ((ta_head->flags & opt_flags) != ta_head->flags ||
-	    (ta_head->flags & man_flags) != man_flags) {
-		EMSG("TA flag issue: flags=%x opt=%X man=%X",
-		     ta_head->flags, opt_flags, man_flags);
-		res = TEE_ERROR_BAD_FORMAT;
+	res = init_utc_from_ta_head(utc, uuid);
+	if (res != TEE_SUCCESS)
 		goto error_return;
-	}
-
-	utc->ctx.flags = ta_head->flags;
-	utc->ctx.uuid = ta_head->uuid;
-	utc->entry_func = ta_head->entry.ptr64;
 
-	utc->ctx.ref_count = 1;
+	add_to_image_cache(utc, sec_shdr, segs, num_segs, vasize);
 
-	condvar_init(&utc->ctx.busy_cv);
-	TAILQ_INSERT_TAIL(&tee_ctxes, &utc->ctx, link);
+	/* Registered in tee_ctxes by tee_ta_init_session() */
 	*ta_ctx = &utc->ctx;
 
-	if (utc->mm)
-		DMSG("Loaded TA at 0x%" PRIxPTR, tee_mm_get_smem(utc->mm));
-	DMSG("ELF load address 0x%x", utc->load_addr);
-
 	tee_mmu_set_ctx(NULL);
-	/* end thread protection (multi-threaded) */
 
-	free(sec_shdr);
+	free(segs);
 	return TEE_SUCCESS;
 
 error_return:
-	free(sec_shdr);
-	tee_mmu_set_ctx(NULL);
-	if (utc) {
-		pgt_flush_ctx(&utc->ctx);
-		tee_pager_rem_uta_areas(utc);
-		tee_mmu_final(utc);
-		tee_mm_free(utc->mm_stack);
-		tee_mm_free(utc->mm);
-		free(utc);
-	}
+	free(segs);
+	free_utc(utc);
 	return res;
 }
 
@@ -652,70 +1083,15 @@ cleanup_return:
 	return res;
 }
 
-/*
- * Load a TA via RPC with UUID defined by input param uuid. The virtual
- * address of the TA is recieved in out parameter ta
- *
- * Function is not thread safe
- */
-static TEE_Result rpc_load(const TEE_UUID *uuid, struct shdr **ta,
-			uint64_t *cookie_ta)
-{
-	TEE_Result res;
-	struct optee_msg_param params[2];
-	paddr_t phta = 0;
-	uint64_t cta = 0;
-
-
-	if (!uuid || !ta || !cookie_ta)
-		return TEE_ERROR_BAD_PARAMETERS;
-
-	memset(params, 0, sizeof(params));
-	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
-	memcpy(&params[0].u.value, uuid, sizeof(TEE_UUID));
-	params[1].attr = OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT;
-	params[1].u.tmem.buf_ptr = 0;
-	params[1].u.tmem.size = 0;
-	params[1].u.tmem.shm_ref = 0;
-
-	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 2, params);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	thread_rpc_alloc_payload(params[1].u.tmem.size, &phta, &cta);
-	if (!phta)
-		return TEE_ERROR_OUT_OF_MEMORY;
-
-	*ta = phys_to_virt(phta, MEM_AREA_NSEC_SHM);
-	if (!*ta) {
-		res = TEE_ERROR_GENERIC;
-		goto out;
-	}
-	*cookie_ta = cta;
-
-	params[0].attr = OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
-	memcpy(&params[0].u.value, uuid, sizeof(TEE_UUID));
-	params[1].attr = OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT;
-	params[1].u.tmem.buf_ptr = phta;
-	params[1].u.tmem.shm_ref = cta;
-	/* Note that params[1].u.tmem.size is already assigned */
-
-	res = thread_rpc_cmd(OPTEE_MSG_RPC_CMD_LOAD_TA, 2, params);
-out:
-	if (res != TEE_SUCCESS)
-		thread_rpc_free_payload(cta);
-	return res;
-}
-
 static TEE_Result init_session_with_signed_ta(const TEE_UUID *uuid,
-				const struct shdr *signed_ta,
+				struct ta_nwdata *nw, struct shdr *sec_shdr,
 				struct tee_ta_session *s)
 {
 	TEE_Result res;
 
 	DMSG("   Load dynamic TA");
 	/* load and verify */
-	res = ta_load(uuid, signed_ta, &s->ctx);
+	res = ta_load(uuid, nw, sec_shdr, &s->ctx);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -806,9 +1182,7 @@ static void user_ta_ctx_destroy(struct tee_ta_ctx *ctx)
 				     &utc->open_sessions, KERN_IDENTITY);
 	}
 
-	tee_mmu_final(utc);
-	tee_mm_free(utc->mm_stack);
-	tee_mm_free(utc->mm);
+	free_utc_mem(utc);
 
 	/* Free cryp states created by this TA */
 	tee_svc_cryp_free_states(utc);
@@ -816,6 +1190,9 @@ static void user_ta_ctx_destroy(struct tee_ta_ctx *ctx)
 	tee_obj_close_all(utc);
 	/* Free emums created by this TA */
 	tee_svc_storage_close_all_enum(utc);
+	ptr_hash_destroy(&utc->cryp_state_hash);
+	ptr_hash_destroy(&utc->object_hash);
+	ptr_hash_destroy(&utc->storage_enum_hash);
 
 	free(utc);
 }
@@ -832,21 +1209,33 @@ TEE_Result tee_ta_init_user_ta_session(const TEE_UUID *uuid,
 			struct tee_ta_session *s)
 {
 	TEE_Result res;
-	struct shdr *ta = NULL;
-	uint64_t cookie_ta = 0;
-
+	struct ta_nwdata nw;
+	struct shdr *sec_shdr = NULL;
 
-	/* Request TA from tee-supplicant */
-	res = rpc_load(uuid, &ta, &cookie_ta);
+	/*
+	 * Request TA from tee-supplicant, only the signed header is fetched
+	 * until the image cache has been checked
+	 */
+	res = rpc_load(uuid, &nw);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = init_session_with_signed_ta(uuid, ta, s);
+	res = load_header(&nw, &sec_shdr);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = ta_load_cached(uuid, sec_shdr, &s->ctx);
+	if (res == TEE_SUCCESS)
+		DMSG("      cached TA : %pUl", (void *)&s->ctx->uuid);
+	else
+		res = init_session_with_signed_ta(uuid, &nw, sec_shdr, s);
+out:
+	free(sec_shdr);
 	/*
 	 * Free normal world shared memory now that the TA either has been
 	 * copied into secure memory or the TA failed to be initialized.
 	 */
-	thread_rpc_free_payload(cookie_ta);
+	thread_rpc_free_payload(nw.cookie);
 
 	if (res == TEE_SUCCESS)
 		s->ctx->ops = &user_ta_ops;
@@ -148,6 +148,37 @@ void wq_wake_one(struct wait_queue *wq, const void *sync_obj,
 		       sync_obj, fname, lineno);
 }
 
+void wq_wake_all(struct wait_queue *wq, const void *sync_obj,
+			const char *fname, int lineno)
+{
+	uint32_t old_itr_status;
+	struct wait_queue_elem *wqe;
+	short handles[CFG_NUM_THREADS];
+	size_t num_handles = 0;
+	size_t n;
+
+	old_itr_status = thread_mask_exceptions(THREAD_EXCP_ALL);
+	cpu_spin_lock(&wq_spin_lock);
+
+	/*
+	 * A thread can only wait in one wait queue at a time so there's at
+	 * most CFG_NUM_THREADS elements to wake up.
+	 */
+	SLIST_FOREACH(wqe, wq, link) {
+		if (!wqe->cv && !wqe->done) {
+			wqe->done = true;
+			handles[num_handles++] = wqe->handle;
+		}
+	}
+
+	cpu_spin_unlock(&wq_spin_lock);
+	thread_unmask_exceptions(old_itr_status);
+
+	for (n = 0; n < num_handles; n++)
+		wq_rpc(OPTEE_MSG_RPC_WAIT_QUEUE_WAKEUP, handles[n],
+		       sync_obj, fname, lineno);
+}
+
 void wq_promote_condvar(struct wait_queue *wq, struct condvar *cv,
 			bool only_one, const void *sync_obj __unused,
 			const char *fname, int lineno __maybe_unused)
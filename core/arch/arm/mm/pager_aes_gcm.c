@@ -59,6 +59,9 @@
 
 #define BLOCK_ALIGNMENT	sizeof(uint64_t)
 
+/* Number of blocks encrypted and hashed together */
+#define BATCH_BLOCKS	8
+
 static uint32_t get_be32(const void *a)
 {
 	return TEE_U32_FROM_BIG_ENDIAN(*(const uint32_t *)a);
@@ -80,6 +83,25 @@ static void aes_encrypt(symmetric_key *skey, const uint8_t *plain,
 	aes_ecb_encrypt(plain, crypt, skey);
 }
 
+/*
+ * Encrypts a number of blocks in place, with a single call when the AES
+ * implementation has a multi-block ECB routine (Crypto Extensions).
+ */
+static void aes_encrypt_blocks(symmetric_key *skey, uint8_t *blocks,
+			       size_t num_blocks)
+{
+	size_t n;
+
+	if (aes_desc.accel_ecb_encrypt &&
+	    aes_desc.accel_ecb_encrypt(blocks, blocks, num_blocks,
+				       skey) == CRYPT_OK)
+		return;
+
+	for (n = 0; n < num_blocks; n++)
+		aes_encrypt(skey, blocks + n * TEE_AES_BLOCK_SIZE,
+			    blocks + n * TEE_AES_BLOCK_SIZE);
+}
+
 static void inc32(uint8_t *block)
 {
 	uint32_t val;
@@ -98,107 +120,23 @@ static void xor_block(void *dst, const void *src)
 	*d++ ^= *s++;
 }
 
-static void shift_right_block(uint8_t *v)
+bool pager_aes_gcm_set_key(struct pager_aes_gcm_key *key, const void *raw_key,
+			   size_t raw_keylen)
 {
-	uint32_t next_val;
-	uint32_t val;
-
-	val = get_be32(v + 12);
-	next_val = get_be32(v + 8);
-	val >>= 1;
-	val |= next_val << 31;
-	put_be32(v + 12, val);
-
-	val = next_val;
-	next_val = get_be32(v + 4);
-	val >>= 1;
-	val |= next_val << 31;
-	put_be32(v + 8, val);
-
-	val = next_val;
-	next_val = get_be32(v);
-	val >>= 1;
-	val |= next_val << 31;
-	put_be32(v + 4, val);
-
-	val = next_val;
-	val >>= 1;
-	put_be32(v, val);
-}
+	uint8_t H[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT) = { 0 };
 
-/* Multiplication in GF(2^128) */
-static void gf_mult(const uint8_t *x, const uint8_t *y, uint8_t *z)
-{
-	uint8_t v[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
-	unsigned i;
-	unsigned j;
-
-	memset(z, 0, TEE_AES_BLOCK_SIZE); /* Z_0 = 0^128 */
-	memcpy(v, y, TEE_AES_BLOCK_SIZE); /* V_0 = Y */
-
-	for (i = 0; i < TEE_AES_BLOCK_SIZE; i++) {
-		for (j = 0; j < 8; j++) {
-			if (x[i] & BIT(7 - j)) {
-				/* Z_(i + 1) = Z_i XOR V_i */
-				xor_block(z, v);
-			} else {
-				/* Z_(i + 1) = Z_i */
-			}
-
-			if (v[15] & 0x01) {
-				/* V_(i + 1) = (V_i >> 1) XOR R */
-				shift_right_block(v);
-				/* R = 11100001 || 0^120 */
-				v[0] ^= 0xe1;
-			} else {
-				/* V_(i + 1) = V_i >> 1 */
-				shift_right_block(v);
-			}
-		}
-	}
-}
-
-static void ghash_start(uint8_t *y)
-{
-	/* Y_0 = 0^128 */
-	memset(y, 0, TEE_AES_BLOCK_SIZE);
-}
-
-
-static void ghash(const uint8_t *h, const uint8_t *in, size_t len, uint8_t *out)
-{
-	size_t n;
-	uint8_t tmp[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
-
-	/* We're only dealing with complete blocks */
-	assert(!(len % TEE_AES_BLOCK_SIZE));
-
-	for (n = 0; n < len; n += TEE_AES_BLOCK_SIZE) {
-		/* Y_i = (Y^(i-1) XOR X_i) dot H */
-		xor_block(out, in + n);
-
-		/* dot operation:
-		 * multiplication operation for binary Galois (finite) field of
-		 * 2^128 elements */
-		gf_mult(out, h, tmp);
-		memcpy(out, tmp, TEE_AES_BLOCK_SIZE);
-	}
-	/* Return Y_m */
-}
-
-static bool aes_gcm_init_hash_subkey(symmetric_key *skey, const uint8_t *key,
-				     size_t key_len, uint8_t *H)
-{
-	if (aes_setup(key, key_len, 0, skey) != CRYPT_OK)
+	if (aes_setup(raw_key, raw_keylen, 0, &key->skey) != CRYPT_OK)
 		return false;
 
 	/* Generate hash subkey H = AES_K(0^128) */
-	memset(H, 0, TEE_AES_BLOCK_SIZE);
-	aes_encrypt(skey, H, H);
+	aes_encrypt(&key->skey, H, H);
+	/* and the multiplication tables for GHASH_H */
+	gcm_ghash_setup(&key->hkey, H);
+
+	memset(H, 0, sizeof(H));
 	return true;
 }
 
-
 static void aes_gcm_prepare_j0(const struct pager_aes_gcm_iv *iv, uint8_t *J0)
 {
 	/* Prepare block J_0 = IV || 0^31 || 1 [len(IV) = 96] */
@@ -207,20 +145,26 @@ static void aes_gcm_prepare_j0(const struct pager_aes_gcm_iv *iv, uint8_t *J0)
 	J0[TEE_AES_BLOCK_SIZE - 1] = 0x01;
 }
 
-static void aes_gcm_core(symmetric_key *skey, bool enc, const uint8_t *J0,
-			 const uint8_t *H, const uint8_t *in, size_t len,
-			 uint8_t *out, uint8_t *tmp, uint8_t *S)
+static void aes_gcm_core(struct pager_aes_gcm_key *key, bool enc,
+			 const uint8_t *J0, const uint8_t *in, size_t len,
+			 uint8_t *out, uint8_t *S)
 {
-	uint8_t J0inc[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
+	uint8_t ks[BATCH_BLOCKS][TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
+	uint8_t buf[BATCH_BLOCKS][TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
+	uint8_t ctr[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
+	size_t num_blocks;
+	size_t nbytes;
 	size_t n;
+	size_t i;
 
 	/* We're only dealing with complete blocks */
 	assert(len && !(len % TEE_AES_BLOCK_SIZE));
 
 	/*
-	 * Below in the loop we're doing the encryption and hashing
-	 * on each block interleaved since the encrypted data is stored
-	 * in less secure memory.
+	 * Below in the loop we're doing the encryption and hashing on a
+	 * batch of blocks copied to the stack since the encrypted data is
+	 * stored in less secure memory: what's hashed is exactly the
+	 * ciphertext we produce or the ciphertext we decrypt.
 	 */
 
 	/*
@@ -229,94 +173,82 @@ static void aes_gcm_core(symmetric_key *skey, bool enc, const uint8_t *J0,
 	 * S = GHASH_H(A || 0^v || C || 0^u || [len(A)]64 || [len(C)]64)
 	 * (i.e., zero padded to block size A || C and lengths of each in bits)
 	 */
-	ghash_start(S);
+	memset(S, 0, TEE_AES_BLOCK_SIZE);
 
+	memcpy(ctr, J0, TEE_AES_BLOCK_SIZE);
+	inc32(ctr);
 
-	memcpy(J0inc, J0, TEE_AES_BLOCK_SIZE);
-	inc32(J0inc);
+	for (n = 0; n < len; n += nbytes) {
+		num_blocks = MIN((len - n) / TEE_AES_BLOCK_SIZE,
+				 (size_t)BATCH_BLOCKS);
+		nbytes = num_blocks * TEE_AES_BLOCK_SIZE;
 
-	/* Full blocks */
-	for (n = 0; n < len; n += TEE_AES_BLOCK_SIZE) {
-		aes_encrypt(skey, J0inc, tmp);
-		xor_block(tmp, in + n);
-		memcpy(out + n, tmp, TEE_AES_BLOCK_SIZE);
-		inc32(J0inc);
+		/* Key stream */
+		for (i = 0; i < num_blocks; i++) {
+			memcpy(ks[i], ctr, TEE_AES_BLOCK_SIZE);
+			inc32(ctr);
+		}
+		aes_encrypt_blocks(&key->skey, ks[0], num_blocks);
 
-		/* Hash */
+		memcpy(buf, in + n, nbytes);
+		if (!enc)
+			gcm_ghash_process(&key->hkey, S, buf[0], num_blocks);
+		for (i = 0; i < num_blocks; i++)
+			xor_block(buf[i], ks[i]);
 		if (enc)
-			xor_block(S, tmp);
-		else
-			xor_block(S, in + n);
-		gf_mult(S, H, tmp);
-		memcpy(S, tmp, TEE_AES_BLOCK_SIZE);
+			gcm_ghash_process(&key->hkey, S, buf[0], num_blocks);
+		memcpy(out + n, buf, nbytes);
 	}
 
-	put_be64(tmp, 0); /* no aad */
-	put_be64(tmp + 8, len * 8);
-	ghash(H, tmp, TEE_AES_BLOCK_SIZE, S);
+	put_be64(buf[0], 0); /* no aad */
+	put_be64(buf[0] + 8, len * 8);
+	gcm_ghash_process(&key->hkey, S, buf[0], 1);
 }
 
 /**
  * aes_gcm_ae - GCM-AE_K(IV, P, A)
  */
-static bool aes_gcm_ae(const uint8_t *key, size_t key_len,
+static void aes_gcm_ae(struct pager_aes_gcm_key *key,
 		       const struct pager_aes_gcm_iv *iv,
 		       const uint8_t *plain, size_t plain_len,
 		       uint8_t *crypt, uint8_t *tag)
 {
-	symmetric_key skey;
-	uint8_t H[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 	uint8_t J0[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 	uint8_t S[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
-	uint8_t tmp[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
-
-	if (!aes_gcm_init_hash_subkey(&skey, key, key_len, H))
-		return false;
 
 	aes_gcm_prepare_j0(iv, J0);
 
 	/* C = GCTR_K(inc_32(J_0), P) */
-	aes_gcm_core(&skey, true, J0, H, plain, plain_len, crypt, tmp, S);
+	aes_gcm_core(key, true, J0, plain, plain_len, crypt, S);
 
 	/* T = MSB_t(GCTR_K(J_0, S)) */
-	aes_encrypt(&skey, J0, tag);
+	aes_encrypt(&key->skey, J0, tag);
 	xor_block(tag, S);
 
 	/* Return (C, T) */
-
-	aes_done(&skey);
-
-	return true;
 }
 
 /**
  * aes_gcm_ad - GCM-AD_K(IV, C, A, T)
  */
-static bool aes_gcm_ad(const uint8_t *key, size_t key_len,
+static bool aes_gcm_ad(struct pager_aes_gcm_key *key,
 		       const struct pager_aes_gcm_iv *iv,
 		       const uint8_t *crypt, size_t crypt_len,
 		       const uint8_t *tag, uint8_t *plain)
 {
-	symmetric_key skey;
-	uint8_t H[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 	uint8_t J0[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 	uint8_t S[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 	uint8_t tmp[TEE_AES_BLOCK_SIZE] __aligned(BLOCK_ALIGNMENT);
 
-	if (!aes_gcm_init_hash_subkey(&skey, key, key_len, H))
-		return false;
-
 	aes_gcm_prepare_j0(iv, J0);
 
 	/* P = GCTR_K(inc_32(J_0), C) */
-	aes_gcm_core(&skey, false, J0, H, crypt, crypt_len, plain, tmp, S);
+	aes_gcm_core(key, false, J0, crypt, crypt_len, plain, S);
 
 	/* T' = MSB_t(GCTR_K(J_0, S)) */
-	aes_encrypt(&skey, J0, tmp);
+	aes_encrypt(&key->skey, J0, tmp);
 	xor_block(tmp, S);
 
-	aes_done(&skey);
-
 	return !buf_compare_ct(tag, tmp, TEE_AES_BLOCK_SIZE);
 }
 
@@ -325,7 +257,7 @@ static bool check_block_alignment(const void *p)
 	return !((vaddr_t)p % BLOCK_ALIGNMENT);
 }
 
-bool pager_aes_gcm_decrypt(const void *key, size_t keylen,
+bool pager_aes_gcm_decrypt(struct pager_aes_gcm_key *key,
 			   const struct pager_aes_gcm_iv *iv,
 			   const uint8_t tag[PAGER_AES_GCM_TAG_LEN],
 			   const void *src, void *dst, size_t datalen)
@@ -333,10 +265,10 @@ bool pager_aes_gcm_decrypt(const void *key, size_t keylen,
 	if (!datalen || (datalen % TEE_AES_BLOCK_SIZE) ||
 	    !check_block_alignment(src) || !check_block_alignment(dst))
 		return false;
-	return aes_gcm_ad(key, keylen, iv, src, datalen, tag, dst);
+	return aes_gcm_ad(key, iv, src, datalen, tag, dst);
 }
 
-bool pager_aes_gcm_encrypt(const void *key, size_t keylen,
+bool pager_aes_gcm_encrypt(struct pager_aes_gcm_key *key,
 			   const struct pager_aes_gcm_iv *iv,
 			   uint8_t tag[PAGER_AES_GCM_TAG_LEN],
 			   const void *src, void *dst, size_t datalen)
@@ -344,5 +276,6 @@ bool pager_aes_gcm_encrypt(const void *key, size_t keylen,
 	if (!datalen || (datalen % TEE_AES_BLOCK_SIZE) ||
 	    !check_block_alignment(src) || !check_block_alignment(dst))
 		return false;
-	return aes_gcm_ae(key, keylen, iv, src, datalen, dst, tag);
+	aes_gcm_ae(key, iv, src, datalen, dst, tag);
+	return true;
 }
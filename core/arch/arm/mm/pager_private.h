@@ -25,20 +25,34 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <tomcrypt.h>
 #include <types_ext.h>
 
 struct pager_aes_gcm_iv {
 	uint32_t iv[3];
 };
 
+/*
+ * Expanded pager key: the AES key schedule and the GHASH key derived from
+ * the hash subkey H, prepared once by pager_aes_gcm_set_key() instead of
+ * for each page.
+ */
+struct pager_aes_gcm_key {
+	symmetric_key skey;
+	gcm_ghash_key hkey;
+};
+
 #define PAGER_AES_GCM_TAG_LEN	16
 
-bool pager_aes_gcm_decrypt(const void *key, size_t keylen,
+bool pager_aes_gcm_set_key(struct pager_aes_gcm_key *key, const void *raw_key,
+			   size_t raw_keylen);
+
+bool pager_aes_gcm_decrypt(struct pager_aes_gcm_key *key,
 			   const struct pager_aes_gcm_iv *iv,
 			   const uint8_t tag[PAGER_AES_GCM_TAG_LEN],
 			   const void *src, void *dst, size_t datalen);
 
-bool pager_aes_gcm_encrypt(const void *key, size_t keylen,
+bool pager_aes_gcm_encrypt(struct pager_aes_gcm_key *key,
 			   const struct pager_aes_gcm_iv *iv,
 			   uint8_t tag[PAGER_AES_GCM_TAG_LEN],
 			   const void *src, void *dst, size_t datalen);
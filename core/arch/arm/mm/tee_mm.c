@@ -34,270 +34,603 @@
 #include <mm/tee_mm.h>
 #include <mm/tee_pager.h>
 
+/*
+ * Each pool is tiled by entries describing allocated or free ranges,
+ * adjacent free ranges are always merged. All entries are linked in
+ * address order and kept in an AVL tree ordered by offset, which gives
+ * O(log n) lookup of the entry covering an address. Free entries are also
+ * linked in segregated free lists, one per power of 2 of their size.
+ *
+ * An allocation picks the smallest free range that fits from the first
+ * size class which can hold it, preferring the high or low end of the
+ * pool depending on TEE_MM_POOL_HI_ALLOC for equally sized ranges, and
+ * the range is allocated from the same end.
+ *
+ * A zero sized allocation gets an empty entry which isn't part of the
+ * tiling, at the low end of the pool or the high end with
+ * TEE_MM_POOL_HI_ALLOC, as before.
+ *
+ * tee_mm_find() may be called from the abort handler, the tree is
+ * searched without recursion.
+ */
+
+static uint32_t pool_num_blocks(tee_mm_pool_t *pool)
+{
+	return (pool->hi - pool->lo) >> pool->shift;
+}
+
+static uint8_t tree_height(tee_mm_entry_t *e)
+{
+	return e ? e->height : 0;
+}
+
+static void tree_update_height(tee_mm_entry_t *e)
+{
+	e->height = MAX(tree_height(e->left), tree_height(e->right)) + 1;
+}
+
+static void tree_replace_child(tee_mm_pool_t *pool, tee_mm_entry_t *parent,
+			       tee_mm_entry_t *old, tee_mm_entry_t *new)
+{
+	if (!parent)
+		pool->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+static tee_mm_entry_t *tree_rotate_left(tee_mm_pool_t *pool,
+					tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *r = e->right;
+
+	e->right = r->left;
+	if (r->left)
+		r->left->parent = e;
+	r->parent = e->parent;
+	tree_replace_child(pool, e->parent, e, r);
+	r->left = e;
+	e->parent = r;
+	tree_update_height(e);
+	tree_update_height(r);
+	return r;
+}
+
+static tee_mm_entry_t *tree_rotate_right(tee_mm_pool_t *pool,
+					 tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *l = e->left;
+
+	e->left = l->right;
+	if (l->right)
+		l->right->parent = e;
+	l->parent = e->parent;
+	tree_replace_child(pool, e->parent, e, l);
+	l->right = e;
+	e->parent = l;
+	tree_update_height(e);
+	tree_update_height(l);
+	return l;
+}
+
+/* Restores the balance from e up to the root */
+static void tree_rebalance(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	int balance;
+
+	while (e) {
+		tree_update_height(e);
+		balance = tree_height(e->left) - tree_height(e->right);
+		if (balance > 1) {
+			if (tree_height(e->left->left) <
+			    tree_height(e->left->right))
+				tree_rotate_left(pool, e->left);
+			e = tree_rotate_right(pool, e);
+		} else if (balance < -1) {
+			if (tree_height(e->right->right) <
+			    tree_height(e->right->left))
+				tree_rotate_right(pool, e->right);
+			e = tree_rotate_left(pool, e);
+		}
+		e = e->parent;
+	}
+}
+
+static void tree_insert(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *parent = NULL;
+	tee_mm_entry_t **p = &pool->root;
+
+	while (*p) {
+		parent = *p;
+		if (e->offset < parent->offset)
+			p = &parent->left;
+		else
+			p = &parent->right;
+	}
+
+	e->parent = parent;
+	e->left = NULL;
+	e->right = NULL;
+	e->height = 1;
+	*p = e;
+	tree_rebalance(pool, parent);
+}
+
+static void tree_remove(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	tee_mm_entry_t *child;
+	tee_mm_entry_t *s;
+	tee_mm_entry_t *start;
+
+	if (e->left && e->right) {
+		/* Replace e with its successor s */
+		s = e->right;
+		while (s->left)
+			s = s->left;
+
+		if (s->parent == e) {
+			start = s;
+		} else {
+			start = s->parent;
+			start->left = s->right;
+			if (s->right)
+				s->right->parent = start;
+			s->right = e->right;
+			e->right->parent = s;
+		}
+		s->left = e->left;
+		e->left->parent = s;
+		s->parent = e->parent;
+		tree_replace_child(pool, e->parent, e, s);
+		tree_rebalance(pool, start);
+	} else {
+		child = e->left ? e->left : e->right;
+		if (child)
+			child->parent = e->parent;
+		tree_replace_child(pool, e->parent, e, child);
+		tree_rebalance(pool, e->parent);
+	}
+}
+
+/* Returns the entry covering the block at offset or NULL */
+static tee_mm_entry_t *tree_find(const tee_mm_pool_t *pool, uint32_t offset)
+{
+	tee_mm_entry_t *e = pool->root;
+
+	while (e) {
+		if (offset < e->offset)
+			e = e->left;
+		else if (offset - e->offset >= e->size)
+			e = e->right;
+		else
+			return e;
+	}
+
+	return NULL;
+}
+
+static unsigned int size_class(uint32_t size)
+{
+	return 31 - __builtin_clz(size);
+}
+
+static void free_list_add(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	unsigned int c = size_class(e->size);
+
+	e->is_free = true;
+	e->free_prev = NULL;
+	e->free_next = pool->free_lists[c];
+	if (e->free_next)
+		e->free_next->free_prev = e;
+	pool->free_lists[c] = e;
+	pool->free_lists_map |= BIT32(c);
+}
+
+static void free_list_remove(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	unsigned int c = size_class(e->size);
+
+	if (e->free_prev)
+		e->free_prev->free_next = e->free_next;
+	else
+		pool->free_lists[c] = e->free_next;
+	if (e->free_next)
+		e->free_next->free_prev = e->free_prev;
+	if (!pool->free_lists[c])
+		pool->free_lists_map &= ~BIT32(c);
+	e->is_free = false;
+}
+
+/* Links new_e into the pool between prev and next */
+static void insert_entry(tee_mm_pool_t *pool, tee_mm_entry_t *prev,
+			 tee_mm_entry_t *next, tee_mm_entry_t *new_e)
+{
+	new_e->pool = pool;
+	new_e->prev = prev;
+	new_e->next = next;
+	if (prev)
+		prev->next = new_e;
+	if (next)
+		next->prev = new_e;
+	tree_insert(pool, new_e);
+}
+
+static void remove_entry(tee_mm_pool_t *pool, tee_mm_entry_t *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	tree_remove(pool, e);
+	free(e);
+}
+
+/* Returns true if a is a better choice than b for an allocation */
+static bool better_fit(tee_mm_pool_t *pool, tee_mm_entry_t *a,
+		       tee_mm_entry_t *b)
+{
+	if (!b || a->size < b->size)
+		return true;
+	if (a->size > b->size)
+		return false;
+	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+		return a->offset > b->offset;
+	return a->offset < b->offset;
+}
+
+/* Returns the best fitting free range for psize blocks or NULL */
+static tee_mm_entry_t *find_free(tee_mm_pool_t *pool, uint32_t psize)
+{
+	unsigned int c = size_class(psize);
+	tee_mm_entry_t *best = NULL;
+	tee_mm_entry_t *e;
+	uint32_t map;
+
+	/* Ranges in the size class of psize may be too small */
+	for (e = pool->free_lists[c]; e; e = e->free_next)
+		if (e->size >= psize && better_fit(pool, e, best))
+			best = e;
+	if (best)
+		return best;
+
+	/* Any range in larger size classes is large enough */
+	if (c == 31)
+		return NULL;
+	map = pool->free_lists_map & ~(BIT32(c + 1) - 1);
+	if (!map)
+		return NULL;
+
+	c = __builtin_ctz(map);
+	for (e = pool->free_lists[c]; e; e = e->free_next)
+		if (better_fit(pool, e, best))
+			best = e;
+	return best;
+}
+
+/*
+ * Allocates psize blocks at offset out of the free range f, the parts of
+ * f before and after the allocation stay free.
+ */
+static tee_mm_entry_t *carve(tee_mm_pool_t *pool, tee_mm_entry_t *f,
+			     uint32_t offset, uint32_t psize)
+{
+	uint32_t before = offset - f->offset;
+	uint32_t after = f->offset + f->size - offset - psize;
+	tee_mm_entry_t *mm;
+	tee_mm_entry_t *f2 = NULL;
+
+	if (!before && !after) {
+		free_list_remove(pool, f);
+		mm = f;
+		goto out;
+	}
+
+	mm = calloc(1, sizeof(*mm));
+	if (!mm)
+		return NULL;
+	if (before && after) {
+		f2 = calloc(1, sizeof(*f2));
+		if (!f2) {
+			free(mm);
+			return NULL;
+		}
+	}
+
+	free_list_remove(pool, f);
+	mm->offset = offset;
+	mm->size = psize;
+	if (before) {
+		/* f keeps the part before the allocation */
+		f->size = before;
+		insert_entry(pool, f, f->next, mm);
+		free_list_add(pool, f);
+		if (f2) {
+			f2->offset = offset + psize;
+			f2->size = after;
+			insert_entry(pool, mm, mm->next, f2);
+			free_list_add(pool, f2);
+		}
+	} else {
+		/*
+		 * f keeps the part after the allocation, its offset moves
+		 * past mm which doesn't change the order of the tree.
+		 */
+		f->offset = offset + psize;
+		f->size = after;
+		insert_entry(pool, f->prev, f, mm);
+		free_list_add(pool, f);
+	}
+
+out:
+	pool->allocated += psize;
+	pool->num_allocated++;
+	return mm;
+}
+
 bool tee_mm_init(tee_mm_pool_t *pool, uint32_t lo, uint32_t hi, uint8_t shift,
 		 uint32_t flags)
 {
+	tee_mm_entry_t *e;
+
 	if (pool == NULL)
 		return false;
 
+	memset(pool, 0, sizeof(*pool));
 	lo = ROUNDUP(lo, 1 << shift);
 	hi = ROUNDDOWN(hi, 1 << shift);
 	pool->lo = lo;
 	pool->hi = hi;
 	pool->shift = shift;
 	pool->flags = flags;
-	pool->entry = calloc(1, sizeof(tee_mm_entry_t));
 
-	if (pool->entry == NULL)
-		return false;
+	if (!pool_num_blocks(pool))
+		return true;
 
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		pool->entry->offset = ((hi - lo - 1) >> shift) + 1;
-	pool->entry->pool = pool;
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return false;
+	e->size = pool_num_blocks(pool);
+	insert_entry(pool, NULL, NULL, e);
+	free_list_add(pool, e);
 
 	return true;
 }
 
-void tee_mm_final(tee_mm_pool_t *pool)
+/* Returns an empty entry at offset, not part of the tiling of the pool */
+static tee_mm_entry_t *alloc_empty(tee_mm_pool_t *pool, uint32_t offset)
 {
-	if (pool == NULL || pool->entry == NULL)
-		return;
+	tee_mm_entry_t *mm = calloc(1, sizeof(*mm));
 
-	while (pool->entry->next != NULL)
-		tee_mm_free(pool->entry->next);
-	free(pool->entry);
-	pool->entry = NULL;
+	if (!mm)
+		return NULL;
+	mm->offset = offset;
+	mm->pool = pool;
+	pool->num_allocated++;
+	return mm;
 }
 
-static tee_mm_entry_t *tee_mm_add(tee_mm_entry_t *p)
+void tee_mm_final(tee_mm_pool_t *pool)
 {
-	/* add to list */
-	if (p->next == NULL) {
-		p->next = malloc(sizeof(tee_mm_entry_t));
-		if (p->next == NULL)
-			return NULL;
-		p->next->next = NULL;
-	} else {
-		tee_mm_entry_t *nn = malloc(sizeof(tee_mm_entry_t));
+	tee_mm_entry_t *e;
+	tee_mm_entry_t *next;
 
-		if (nn == NULL)
-			return NULL;
-		nn->next = p->next;
-		p->next = nn;
+	if (pool == NULL || pool->root == NULL)
+		return;
+
+	e = pool->root;
+	while (e->left)
+		e = e->left;
+	while (e) {
+		next = e->next;
+		free(e);
+		e = next;
 	}
-	return p->next;
+
+	pool->root = NULL;
+	memset(pool->free_lists, 0, sizeof(pool->free_lists));
+	pool->free_lists_map = 0;
+	pool->allocated = 0;
+	pool->num_allocated = 0;
 }
 
 #ifdef CFG_WITH_STATS
-static size_t tee_mm_stats_allocated(tee_mm_pool_t *pool)
+static uint32_t largest_free(tee_mm_pool_t *pool)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *e;
 	uint32_t sz = 0;
 
-	if (!pool)
+	if (!pool->free_lists_map)
 		return 0;
 
-	entry = pool->entry;
-	while (entry) {
-		sz += entry->size;
-		entry = entry->next;
-	}
+	e = pool->free_lists[31 - __builtin_clz(pool->free_lists_map)];
+	for (; e; e = e->free_next)
+		sz = MAX(sz, e->size);
 
-	return sz << pool->shift;
+	return sz;
+}
+
+static void get_free_stats(tee_mm_pool_t *pool,
+			   struct tee_mm_free_stats *stats)
+{
+	uint32_t largest = largest_free(pool);
+	uint32_t free_blocks = pool_num_blocks(pool) - pool->allocated;
+
+	stats->largest_free = largest << pool->shift;
+	stats->fragmentation = 0;
+	if (free_blocks)
+		stats->fragmentation = 100 - (uint64_t)largest * 100 /
+					     free_blocks;
 }
 
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
-			   bool reset)
+			   struct tee_mm_free_stats *free_stats, bool reset)
 {
 	memset(stats, 0, sizeof(*stats));
 
 	stats->size = pool->hi - pool->lo;
 	stats->max_allocated = pool->max_allocated;
-	stats->allocated = tee_mm_stats_allocated(pool);
-
-	if (reset)
+	stats->allocated = pool->allocated << pool->shift;
+	stats->num_alloc_fail = pool->num_alloc_fail;
+	stats->biggest_alloc_fail = pool->biggest_alloc_fail;
+	stats->biggest_alloc_fail_used = pool->biggest_alloc_fail_used;
+	if (free_stats)
+		get_free_stats(pool, free_stats);
+
+	if (reset) {
 		pool->max_allocated = 0;
+		pool->num_alloc_fail = 0;
+		pool->biggest_alloc_fail = 0;
+		pool->biggest_alloc_fail_used = 0;
+	}
 }
 
 static void update_max_allocated(tee_mm_pool_t *pool)
 {
-	size_t sz = tee_mm_stats_allocated(pool);
+	size_t sz = pool->allocated << pool->shift;
 
 	if (sz > pool->max_allocated)
 		pool->max_allocated = sz;
 }
+
+static void update_alloc_fail(tee_mm_pool_t *pool, size_t size)
+{
+	pool->num_alloc_fail++;
+	if (size > pool->biggest_alloc_fail) {
+		pool->biggest_alloc_fail = size;
+		pool->biggest_alloc_fail_used = pool->allocated << pool->shift;
+	}
+}
 #else /* CFG_WITH_STATS */
 static inline void update_max_allocated(tee_mm_pool_t *pool __unused)
 {
 }
+
+static inline void update_alloc_fail(tee_mm_pool_t *pool __unused,
+				     size_t size __unused)
+{
+}
 #endif /* CFG_WITH_STATS */
 
 tee_mm_entry_t *tee_mm_alloc(tee_mm_pool_t *pool, uint32_t size)
 {
 	uint32_t psize;
-	tee_mm_entry_t *entry;
-	tee_mm_entry_t *nn;
-	uint32_t remaining;
+	uint32_t offset;
+	tee_mm_entry_t *f;
+	tee_mm_entry_t *mm = NULL;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->root)
 		return NULL;
 
-	entry = pool->entry;
-	if (size == 0)
-		psize = 0;
-	else
-		psize = ((size - 1) >> pool->shift) + 1;
-	/* Protect with mutex (multi thread) */
-
-	/* find free slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL && psize >
-		       (entry->offset - entry->next->offset -
-			entry->next->size))
-			entry = entry->next;
-	} else {
-		while (entry->next != NULL && psize >
-		       (entry->next->offset - entry->size - entry->offset))
-			entry = entry->next;
+	if (size == 0) {
+		if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+			return alloc_empty(pool, pool_num_blocks(pool));
+		return alloc_empty(pool, 0);
 	}
 
-	/* check if we have enough memory */
-	if (entry->next == NULL) {
-		if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-			/*
-			 * entry->offset is a "block count" offset from
-			 * pool->lo. The byte offset is
-			 * (entry->offset << pool->shift).
-			 * In the HI_ALLOC allocation scheme the memory is
-			 * allocated from the end of the segment, thus to
-			 * validate there is sufficient memory validate that
-			 * (entry->offset << pool->shift) > size.
-			 */
-			if ((entry->offset << pool->shift) < size)
-				/* out of memory */
-				return NULL;
-		} else {
-			if (pool->hi <= pool->lo)
-				panic("invalid pool");
+	psize = ((size - 1) >> pool->shift) + 1;
 
-			remaining = (pool->hi - pool->lo);
-			remaining -= ((entry->offset + entry->size) <<
-				      pool->shift);
+	/* Protect with mutex (multi thread) */
 
-			if (remaining < size)
-				/* out of memory */
-				return NULL;
-		}
+	f = find_free(pool, psize);
+	if (f) {
+		if (pool->flags & TEE_MM_POOL_HI_ALLOC)
+			offset = f->offset + f->size - psize;
+		else
+			offset = f->offset;
+		mm = carve(pool, f, offset, psize);
 	}
 
-	nn = tee_mm_add(entry);
-	if (nn == NULL)
-		return NULL;
-
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC)
-		nn->offset = entry->offset - psize;
+	if (mm)
+		update_max_allocated(pool);
 	else
-		nn->offset = entry->offset + entry->size;
-	nn->size = psize;
-	nn->pool = pool;
-
-	update_max_allocated(pool);
+		update_alloc_fail(pool, size);
 
 	/* Protect with mutex end (multi thread) */
 
-	return nn;
-}
-
-static inline bool fit_in_gap(tee_mm_pool_t *pool, tee_mm_entry_t *e,
-			      uint32_t offslo, uint32_t offshi)
-{
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		if (offshi > e->offset ||
-		    (e->next != NULL &&
-		     (offslo < e->next->offset + e->next->size)) ||
-		    (offshi << pool->shift) - 1 > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	} else {
-		if (offslo < (e->offset + e->size) ||
-		    (e->next != NULL && (offshi > e->next->offset)) ||
-		    (offshi << pool->shift) > (pool->hi - pool->lo))
-			/* memory not available */
-			return false;
-	}
-
-	return true;
+	return mm;
 }
 
 tee_mm_entry_t *tee_mm_alloc2(tee_mm_pool_t *pool, tee_vaddr_t base,
 			      size_t size)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *f;
+	tee_mm_entry_t *mm;
 	uint32_t offslo;
 	uint32_t offshi;
-	tee_mm_entry_t *mm;
 
 	/* Check that pool is initialized */
-	if (!pool || !pool->entry)
+	if (!pool || !pool->root)
 		return NULL;
 
 	/* Wrapping and sanity check */
-	if ((base + size) < base || base < pool->lo)
+	if ((base + size) < base || base < pool->lo || base > pool->hi)
 		return NULL;
 
-	entry = pool->entry;
 	offslo = (base - pool->lo) >> pool->shift;
-	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
-
-	/* find slot */
-	if (pool->flags & TEE_MM_POOL_HI_ALLOC) {
-		while (entry->next != NULL &&
-		       offshi < entry->next->offset + entry->next->size)
-			entry = entry->next;
-	} else {
-		while (entry->next != NULL && offslo > entry->next->offset)
-			entry = entry->next;
-	}
-
-	/* Check that memory is available */
-	if (!fit_in_gap(pool, entry, offslo, offshi))
+	if (!size)
+		return alloc_empty(pool, offslo);
+	if (base == pool->hi)
 		return NULL;
 
-	mm = tee_mm_add(entry);
-	if (mm == NULL)
+	offshi = ((base - pool->lo + size - 1) >> pool->shift) + 1;
+	if (offshi > pool_num_blocks(pool))
 		return NULL;
 
-	mm->offset = offslo;
-	mm->size = offshi - offslo;
-	mm->pool = pool;
+	/* Check that memory is available */
+	f = tree_find(pool, offslo);
+	if (!f || !f->is_free || offshi - f->offset > f->size)
+		return NULL;
 
-	update_max_allocated(pool);
+	mm = carve(pool, f, offslo, offshi - offslo);
+	if (mm)
+		update_max_allocated(pool);
 
 	return mm;
 }
 
 void tee_mm_free(tee_mm_entry_t *p)
 {
-	tee_mm_entry_t *entry;
+	tee_mm_pool_t *pool;
+	tee_mm_entry_t *n;
 
 	if (!p || !p->pool)
 		return;
 
-	entry = p->pool->entry;
+	pool = p->pool;
 
 	/* Protect with mutex (multi thread) */
 
-	/* remove entry from list */
-	while (entry->next != NULL && entry->next != p)
-		entry = entry->next;
+	if (!p->size) {
+		pool->num_allocated--;
+		free(p);
+		return;
+	}
 
-	if (!entry->next)
+	if (p->is_free || tree_find(pool, p->offset) != p)
 		panic("invalid mm_entry");
 
-	entry->next = entry->next->next;
+	pool->allocated -= p->size;
+	pool->num_allocated--;
 
-	free(p);
+	/* Merge with the free neighbours */
+	n = p->prev;
+	if (n && n->is_free) {
+		free_list_remove(pool, n);
+		n->size += p->size;
+		remove_entry(pool, p);
+		p = n;
+	}
+	n = p->next;
+	if (n && n->is_free) {
+		free_list_remove(pool, n);
+		p->size += n->size;
+		remove_entry(pool, n);
+	}
+	free_list_add(pool, p);
 
 	/* Protect with mutex end (multi thread) */
 }
@@ -317,7 +650,7 @@ bool tee_mm_addr_is_within_range(tee_mm_pool_t *pool, uint32_t addr)
 
 bool tee_mm_is_empty(tee_mm_pool_t *pool)
 {
-	return pool == NULL || pool->entry == NULL || pool->entry->next == NULL;
+	return pool == NULL || pool->num_allocated == 0;
 }
 
 /* Physical Secure DDR pool */
@@ -328,22 +661,16 @@ tee_mm_pool_t tee_mm_vcore __early_bss;
 
 tee_mm_entry_t *tee_mm_find(const tee_mm_pool_t *pool, uint32_t addr)
 {
-	tee_mm_entry_t *entry = pool->entry;
-	uint16_t offset = (addr - pool->lo) >> pool->shift;
+	tee_mm_entry_t *entry;
 
-	if (addr > pool->hi || addr < pool->lo)
+	if (addr >= pool->hi || addr < pool->lo)
 		return NULL;
 
-	while (entry->next != NULL) {
-		entry = entry->next;
-
-		if ((offset >= entry->offset) &&
-		    (offset < (entry->offset + entry->size))) {
-			return entry;
-		}
-	}
+	entry = tree_find(pool, (addr - pool->lo) >> pool->shift);
+	if (!entry || entry->is_free)
+		return NULL;
 
-	return NULL;
+	return entry;
 }
 
 uintptr_t tee_mm_get_smem(const tee_mm_entry_t *mm)
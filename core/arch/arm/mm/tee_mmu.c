@@ -375,41 +375,168 @@ void tee_mmu_map_clear(struct user_ta_ctx *utc)
 {
 	utc->mmu->ta_private_vmem_end = 0;
 	memset(utc->mmu->table, 0,
-	       TEE_MMU_UMAP_MAX_ENTRIES * sizeof(struct tee_mmap_region));
+	       utc->mmu->size * sizeof(struct tee_mmap_region));
+}
+
+/*
+ * Fragmented parameters need one entry per fragment after the
+ * TEE_MMU_UMAP_MAX_ENTRIES fixed entries.
+ */
+static TEE_Result tee_mmu_umap_resize(struct tee_mmu_info *mmu,
+			size_t num_entries)
+{
+	struct tee_mmap_region *table;
+
+	if (num_entries == mmu->size)
+		return TEE_SUCCESS;
+
+	table = realloc(mmu->table, num_entries * sizeof(*table));
+	if (!table)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (num_entries > mmu->size)
+		memset(table + mmu->size, 0,
+		       (num_entries - mmu->size) * sizeof(*table));
+	mmu->table = table;
+	mmu->size = num_entries;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Maps the fragments of a parameter at consecutive entries starting at
+ * *idx as one virtually contiguous range starting at *va.
+ */
+static TEE_Result tee_mmu_umap_add_frags(struct tee_mmu_info *mmu,
+			size_t *idx, vaddr_t *va,
+			const struct tee_ta_param_frags *frags, uint32_t attr)
+{
+	const size_t granule = CORE_MMU_USER_PARAM_SIZE;
+	const struct tee_ta_param_frag *f;
+	struct tee_mmap_region *r;
+	vaddr_t va_range_base;
+	size_t va_range_size;
+	size_t n;
+
+	if (!core_mmu_mattr_is_ok(attr))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	core_mmu_get_user_va_range(&va_range_base, &va_range_size);
+
+	for (n = 0; n < frags->num_frags; n++) {
+		f = frags->frags + n;
+		/* The gaps between the fragments must be invisible */
+		if (n && (f->pa & CORE_MMU_USER_PARAM_MASK))
+			return TEE_ERROR_BAD_PARAMETERS;
+		if ((n + 1) < frags->num_frags &&
+		    ((f->pa + f->size) & CORE_MMU_USER_PARAM_MASK))
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		r = mmu->table + *idx;
+		tee_mmu_umap_set_pa(r, granule, f->pa, f->size, attr);
+		r->va = *va;
+		*va += r->size;
+		(*idx)++;
+		if ((*va - va_range_base) >= va_range_size)
+			return TEE_ERROR_EXCESS_DATA;
+	}
+
+	/* Put some empty space between each area */
+	*va += granule;
+	return TEE_SUCCESS;
+}
+
+static uint32_t param_attr_to_mattr(uint32_t param_attr, bool secure)
+{
+	uint32_t attr = TEE_MMU_UDATA_ATTR;
+
+	if (!secure)
+		attr &= ~TEE_MATTR_SECURE;
+
+	if (param_attr == OPTEE_SMC_SHM_CACHED)
+		attr |= TEE_MATTR_CACHE_CACHED << TEE_MATTR_CACHE_SHIFT;
+	else
+		attr |= TEE_MATTR_CACHE_NONCACHE << TEE_MATTR_CACHE_SHIFT;
+
+	return attr;
+}
+
+/*
+ * Fragmented parameters are mapped after all other entries, they are
+ * always in nonsecure memory so a new page directory is used unless the
+ * last entry is nonsecure too.
+ */
+static TEE_Result tee_mmu_map_frags(struct user_ta_ctx *utc,
+			struct tee_ta_param *param)
+{
+	const size_t granule = CORE_MMU_USER_PARAM_SIZE;
+	struct tee_mmap_region *tbl = utc->mmu->table;
+	TEE_Result res;
+	size_t idx = TEE_MMU_UMAP_MAX_ENTRIES;
+	size_t last = 0;
+	size_t n;
+	vaddr_t va;
+
+	for (n = 1; n < TEE_MMU_UMAP_MAX_ENTRIES; n++)
+		if (tbl[n].size && tbl[n].va > tbl[last].va)
+			last = n;
+	va = tbl[last].va + tbl[last].size;
+	if (tbl[last].attr & TEE_MATTR_SECURE)
+		va = ROUNDUP(va, CORE_MMU_PGDIR_SIZE);
+	else
+		va += granule;
+
+	for (n = 0; n < TEE_NUM_PARAMS; n++) {
+		struct tee_ta_param_frags *frags = param->frags[n];
+		TEE_Param *p = &param->params[n];
+
+		if (!frags)
+			continue;
+
+		p->memref.buffer = (void *)(va +
+			(frags->frags[0].pa & CORE_MMU_USER_PARAM_MASK));
+		res = tee_mmu_umap_add_frags(utc->mmu, &idx, &va, frags,
+				param_attr_to_mattr(param->param_attr[n],
+						    false));
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 		struct tee_ta_param *param)
 {
 	TEE_Result res = TEE_SUCCESS;
+	size_t num_entries = TEE_MMU_UMAP_MAX_ENTRIES;
 	size_t n;
 
+	for (n = 0; n < TEE_NUM_PARAMS; n++)
+		if (param->frags[n])
+			num_entries += param->frags[n]->num_frags;
+	res = tee_mmu_umap_resize(utc->mmu, num_entries);
+	if (res != TEE_SUCCESS)
+		return res;
+
 	/* Clear all the param entries as they can hold old information */
 	memset(utc->mmu->table + TEE_MMU_UMAP_PARAM_IDX, 0,
-		(TEE_MMU_UMAP_MAX_ENTRIES - TEE_MMU_UMAP_PARAM_IDX) *
+		(utc->mmu->size - TEE_MMU_UMAP_PARAM_IDX) *
 		sizeof(struct tee_mmap_region));
 
 	for (n = 0; n < 4; n++) {
 		uint32_t param_type = TEE_PARAM_TYPE_GET(param->types, n);
 		TEE_Param *p = &param->params[n];
-		uint32_t attr = TEE_MMU_UDATA_ATTR;
+		uint32_t attr;
 
 		if (param_type != TEE_PARAM_TYPE_MEMREF_INPUT &&
 		    param_type != TEE_PARAM_TYPE_MEMREF_OUTPUT &&
 		    param_type != TEE_PARAM_TYPE_MEMREF_INOUT)
 			continue;
-		if (p->memref.size == 0)
+		if (p->memref.size == 0 || param->frags[n])
 			continue;
 
-		if (tee_pbuf_is_non_sec(p->memref.buffer, p->memref.size))
-			attr &= ~TEE_MATTR_SECURE;
-
-		if (param->param_attr[n] == OPTEE_SMC_SHM_CACHED)
-			attr |= TEE_MATTR_CACHE_CACHED << TEE_MATTR_CACHE_SHIFT;
-		else
-			attr |= TEE_MATTR_CACHE_NONCACHE <<
-				TEE_MATTR_CACHE_SHIFT;
-
+		attr = param_attr_to_mattr(param->param_attr[n],
+				!tee_pbuf_is_non_sec(p->memref.buffer,
+						     p->memref.size));
 		res = tee_mmu_umap_add_param(utc->mmu,
 				(paddr_t)p->memref.buffer, p->memref.size,
 				attr);
@@ -429,7 +556,7 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 		    param_type != TEE_PARAM_TYPE_MEMREF_OUTPUT &&
 		    param_type != TEE_PARAM_TYPE_MEMREF_INOUT)
 			continue;
-		if (p->memref.size == 0)
+		if (p->memref.size == 0 || param->frags[n])
 			continue;
 
 		res = tee_mmu_user_pa2va_helper(utc, (paddr_t)p->memref.buffer,
@@ -438,9 +565,13 @@ TEE_Result tee_mmu_map_param(struct user_ta_ctx *utc,
 			return res;
 	}
 
+	res = tee_mmu_map_frags(utc, param);
+	if (res != TEE_SUCCESS)
+		return res;
+
 	utc->mmu->ta_private_vmem_start = utc->mmu->table[0].va;
 
-	n = TEE_MMU_UMAP_MAX_ENTRIES;
+	n = utc->mmu->size;
 	do {
 		n--;
 	} while (n && !utc->mmu->table[n].size);
@@ -490,25 +621,48 @@ bool tee_mmu_is_vbuf_intersect_ta_private(const struct user_ta_ctx *utc,
 	  utc->mmu->ta_private_vmem_end - utc->mmu->ta_private_vmem_start + 1);
 }
 
+/*
+ * Returns the entry of the user mapping covering ua. Consecutive lookups
+ * tend to hit the same entry so the last hit is tried first.
+ */
+static struct tee_mmap_region *find_umap_by_va(struct tee_mmu_info *mmu,
+			tee_uaddr_t ua)
+{
+	struct tee_mmap_region *r;
+	size_t n = mmu->last_hit;
+
+	if (n < mmu->size) {
+		r = mmu->table + n;
+		if (r->size && core_is_buffer_inside(ua, 1, r->va, r->size))
+			return r;
+	}
+
+	for (n = 0; n < mmu->size; n++) {
+		r = mmu->table + n;
+		if (r->size && core_is_buffer_inside(ua, 1, r->va, r->size)) {
+			mmu->last_hit = n;
+			return r;
+		}
+	}
+	return NULL;
+}
+
 static TEE_Result tee_mmu_user_va2pa_attr(const struct user_ta_ctx *utc,
 			void *ua, paddr_t *pa, uint32_t *attr)
 {
-	size_t n;
+	struct tee_mmap_region *r;
 
 	if (!utc->mmu->table)
 		return TEE_ERROR_ACCESS_DENIED;
 
-	for (n = 0; n < utc->mmu->size; n++) {
-		if (core_is_buffer_inside(ua, 1, utc->mmu->table[n].va,
-					  utc->mmu->table[n].size)) {
-			*pa = (paddr_t)ua - utc->mmu->table[n].va +
-				utc->mmu->table[n].pa;
-			if (attr)
-				*attr = utc->mmu->table[n].attr;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_ACCESS_DENIED;
+	r = find_umap_by_va(utc->mmu, (tee_uaddr_t)ua);
+	if (!r)
+		return TEE_ERROR_ACCESS_DENIED;
+
+	*pa = (paddr_t)ua - r->va + r->pa;
+	if (attr)
+		*attr = r->attr;
+	return TEE_SUCCESS;
 }
 
 TEE_Result tee_mmu_user_va2pa_helper(const struct user_ta_ctx *utc, void *ua,
@@ -541,24 +695,27 @@ TEE_Result tee_mmu_check_access_rights(const struct user_ta_ctx *utc,
 				       uint32_t flags, tee_uaddr_t uaddr,
 				       size_t len)
 {
+	struct tee_mmap_region *r;
+	tee_uaddr_t end = uaddr + len;
 	tee_uaddr_t a;
-	size_t addr_incr = MIN(CORE_MMU_USER_CODE_SIZE,
-			       CORE_MMU_USER_PARAM_SIZE);
 
 	/* Address wrap */
-	if ((uaddr + len) < uaddr)
+	if (end < uaddr)
 		return TEE_ERROR_ACCESS_DENIED;
 
-	for (a = uaddr; a < (uaddr + len); a += addr_incr) {
-		paddr_t pa;
-		uint32_t attr;
-		TEE_Result res;
+	if (!utc->mmu->table)
+		return TEE_ERROR_ACCESS_DENIED;
 
-		res = tee_mmu_user_va2pa_attr(utc, (void *)a, &pa, &attr);
-		if (res != TEE_SUCCESS)
-			return res;
+	/* Check the buffer one mapping entry at a time */
+	for (a = uaddr; a < end; a = r->va + r->size) {
+		r = find_umap_by_va(utc->mmu, a);
+		if (!r)
+			return TEE_ERROR_ACCESS_DENIED;
 
 		if (!(flags & TEE_MEMORY_ACCESS_ANY_OWNER)) {
+			paddr_t pa = a - r->va + r->pa;
+			size_t l = MIN(end, r->va + r->size) - a;
+
 			/*
 			 * Strict check that no one else (wich equal or
 			 * less trust) may can access this memory.
@@ -574,15 +731,22 @@ TEE_Result tee_mmu_check_access_rights(const struct user_ta_ctx *utc,
 			 * If we do this check for an address on TA
 			 * internal memory it's harmless as it will always
 			 * be in secure DDR.
+			 *
+			 * The part of the entry covered by the buffer is
+			 * physically contiguous so checking both ends is
+			 * enough.
 			 */
-			if (!tee_mm_addr_is_within_range(&tee_mm_sec_ddr, pa))
+			if (!tee_mm_addr_is_within_range(&tee_mm_sec_ddr, pa) ||
+			    !tee_mm_addr_is_within_range(&tee_mm_sec_ddr,
+							 pa + l - 1))
 				return TEE_ERROR_ACCESS_DENIED;
-
 		}
 
-		if ((flags & TEE_MEMORY_ACCESS_WRITE) && !(attr & TEE_MATTR_UW))
+		if ((flags & TEE_MEMORY_ACCESS_WRITE) &&
+		    !(r->attr & TEE_MATTR_UW))
 			return TEE_ERROR_ACCESS_DENIED;
-		if ((flags & TEE_MEMORY_ACCESS_READ) && !(attr & TEE_MATTR_UR))
+		if ((flags & TEE_MEMORY_ACCESS_READ) &&
+		    !(r->attr & TEE_MATTR_UR))
 			return TEE_ERROR_ACCESS_DENIED;
 	}
 
@@ -627,7 +791,7 @@ uintptr_t tee_mmu_get_load_addr(const struct tee_ta_ctx *const ctx)
 	const struct user_ta_ctx *utc = to_user_ta_ctx((void *)ctx);
 
 	assert(utc->mmu && utc->mmu->table);
-	if (utc->mmu->size != TEE_MMU_UMAP_MAX_ENTRIES)
+	if (utc->mmu->size < TEE_MMU_UMAP_MAX_ENTRIES)
 		panic("invalid size");
 
 	return utc->mmu->table[1].va;
@@ -40,6 +40,7 @@
 #include <mm/tee_mm.h>
 #include <mm/tee_mmu_defs.h>
 #include <mm/tee_pager.h>
+#include <slab.h>
 #include <types_ext.h>
 #include <stdlib.h>
 #include <tee_api_defines.h>
@@ -82,6 +83,9 @@ TAILQ_HEAD(tee_pager_area_head, tee_pager_area);
 static struct tee_pager_area_head tee_pager_area_head =
 	TAILQ_HEAD_INITIALIZER(tee_pager_area_head);
 
+static struct slab_cache tee_pager_area_cache =
+	SLAB_CACHE_INITIALIZER("Pager area", struct tee_pager_area, NULL, NULL);
+
 #define INVALID_PGIDX	UINT_MAX
 
 /*
@@ -110,6 +114,9 @@ static struct tee_pager_pmem_head tee_pager_lock_pmem_head =
 	TAILQ_HEAD_INITIALIZER(tee_pager_lock_pmem_head);
 
 static uint8_t pager_ae_key[PAGER_AE_KEY_BITS / 8];
+/* Expanded pager_ae_key, set up on first use under pager_lock */
+static struct pager_aes_gcm_key pager_ae_ctx;
+static bool pager_ae_ctx_valid;
 
 /* number of pages hidden */
 #define TEE_PAGER_NHIDE (tee_pager_npages / 3)
@@ -273,7 +280,7 @@ static struct tee_pager_area *alloc_area(struct pgt *pgt,
 					 uint32_t flags, const void *store,
 					 const void *hashes)
 {
-	struct tee_pager_area *area = calloc(1, sizeof(*area));
+	struct tee_pager_area *area = slab_zalloc(&tee_pager_area_cache);
 	enum area_type at;
 	tee_mm_entry_t *mm_store = NULL;
 
@@ -312,7 +319,7 @@ out:
 bad:
 	tee_mm_free(mm_store);
 	free(area->u.rwp);
-	free(area);
+	slab_free(&tee_pager_area_cache, area);
 	return NULL;
 }
 
@@ -436,7 +443,7 @@ void tee_pager_rem_uta_areas(struct user_ta_ctx *utc)
 					virt_to_phys(area->store)));
 		if (area->type == AREA_TYPE_RW)
 			free(area->u.rwp);
-		free(area);
+		slab_free(&tee_pager_area_cache, area);
 	}
 
 	free(utc->areas);
@@ -497,6 +504,21 @@ static paddr_t get_pmem_pa(struct tee_pager_pmem *pmem)
 	return pa;
 }
 
+/*
+ * The key schedule can't be computed in tee_pager_init() since the AES
+ * implementation may need the VFP unit which requires a thread context.
+ */
+static struct pager_aes_gcm_key *get_ae_key(void)
+{
+	if (!pager_ae_ctx_valid) {
+		if (!pager_aes_gcm_set_key(&pager_ae_ctx, pager_ae_key,
+					   sizeof(pager_ae_key)))
+			panic("failed to set pager key");
+		pager_ae_ctx_valid = true;
+	}
+	return &pager_ae_ctx;
+}
+
 static bool decrypt_page(struct pager_rw_pstate *rwp, const void *src,
 			void *dst)
 {
@@ -504,8 +526,8 @@ static bool decrypt_page(struct pager_rw_pstate *rwp, const void *src,
 		{ (vaddr_t)rwp, rwp->iv >> 32, rwp->iv }
 	};
 
-	return pager_aes_gcm_decrypt(pager_ae_key, sizeof(pager_ae_key),
-				     &iv, rwp->tag, src, dst, SMALL_PAGE_SIZE);
+	return pager_aes_gcm_decrypt(get_ae_key(), &iv, rwp->tag, src, dst,
+				     SMALL_PAGE_SIZE);
 }
 
 static void encrypt_page(struct pager_rw_pstate *rwp, void *src, void *dst)
@@ -524,8 +546,7 @@ static void encrypt_page(struct pager_rw_pstate *rwp, void *src, void *dst)
 	iv.iv[1] = rwp->iv >> 32;
 	iv.iv[2] = rwp->iv;
 
-	if (!pager_aes_gcm_encrypt(pager_ae_key, sizeof(pager_ae_key),
-				   &iv, rwp->tag,
+	if (!pager_aes_gcm_encrypt(get_ae_key(), &iv, rwp->tag,
 				   src, dst, SMALL_PAGE_SIZE))
 		panic("gcm failed");
 }
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <kernel/tee_time.h>
+#include <string.h>
+#include <tee/tee_cryp_provider.h>
+#include <trace.h>
+#include <utee_defines.h>
+#include <util.h>
+#include "core_self_tests.h"
+
+/* Largest signature (P-521) and shared secret */
+#define ECC_BENCH_MAX_BYTES	66
+
+enum ecc_bench_op {
+	ECC_BENCH_SIGN,
+	ECC_BENCH_VERIFY,
+	ECC_BENCH_ECDH,
+};
+
+static const struct {
+	uint32_t bits;
+	uint32_t curve;
+	uint32_t algo;
+} ecc_bench_curves[] = {
+	{ 192, TEE_ECC_CURVE_NIST_P192, TEE_ALG_ECDSA_P192 },
+	{ 224, TEE_ECC_CURVE_NIST_P224, TEE_ALG_ECDSA_P224 },
+	{ 256, TEE_ECC_CURVE_NIST_P256, TEE_ALG_ECDSA_P256 },
+	{ 384, TEE_ECC_CURVE_NIST_P384, TEE_ALG_ECDSA_P384 },
+	{ 521, TEE_ECC_CURVE_NIST_P521, TEE_ALG_ECDSA_P521 },
+};
+
+static void free_ecc_keypair(struct ecc_keypair *key)
+{
+	crypto_ops.bignum.free(key->d);
+	crypto_ops.bignum.free(key->x);
+	crypto_ops.bignum.free(key->y);
+}
+
+static TEE_Result gen_ecc_keypair(struct ecc_keypair *key, uint32_t bits,
+				  uint32_t curve)
+{
+	TEE_Result res;
+
+	res = crypto_ops.acipher.alloc_ecc_keypair(key, bits);
+	if (res != TEE_SUCCESS)
+		return res;
+	key->curve = curve;
+	res = crypto_ops.acipher.gen_ecc_key(key);
+	if (res != TEE_SUCCESS)
+		free_ecc_keypair(key);
+	return res;
+}
+
+/*
+ * Runs count operations of one kind, returns the number of operations per
+ * second and adds the elapsed time to *total_ms. A signature of digest
+ * made with key is expected in sig for ECC_BENCH_VERIFY.
+ */
+static TEE_Result ecc_bench_run(enum ecc_bench_op op, uint32_t algo,
+				struct ecc_keypair *key,
+				struct ecc_keypair *peer, size_t count,
+				const uint8_t *digest, size_t digest_len,
+				uint8_t *sig, size_t *sig_len,
+				uint32_t *ops_per_sec, uint32_t *total_ms)
+{
+	struct ecc_public_key pub = { .x = key->x, .y = key->y,
+				      .curve = key->curve };
+	struct ecc_public_key peer_pub = { .x = peer->x, .y = peer->y,
+					   .curve = peer->curve };
+	uint8_t secret[ECC_BENCH_MAX_BYTES];
+	unsigned long secret_len;
+	TEE_Result res = TEE_SUCCESS;
+	size_t sig_size = *sig_len;
+	TEE_Time start;
+	TEE_Time end;
+	uint32_t ms;
+	size_t n;
+
+	res = tee_time_get_sys_time(&start);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < count && res == TEE_SUCCESS; n++) {
+		switch (op) {
+		case ECC_BENCH_SIGN:
+			*sig_len = sig_size;
+			res = crypto_ops.acipher.ecc_sign(algo, key, digest,
+							  digest_len, sig,
+							  sig_len);
+			break;
+		case ECC_BENCH_VERIFY:
+			res = crypto_ops.acipher.ecc_verify(algo, &pub, digest,
+							    digest_len, sig,
+							    *sig_len);
+			break;
+		case ECC_BENCH_ECDH:
+			secret_len = sizeof(secret);
+			res = crypto_ops.acipher.ecc_shared_secret(key,
+								   &peer_pub,
+								   secret,
+								   &secret_len);
+			break;
+		default:
+			res = TEE_ERROR_BAD_PARAMETERS;
+			break;
+		}
+	}
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = tee_time_get_sys_time(&end);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	ms = MAX(time_diff_ms(&start, &end), 1U);
+	*ops_per_sec = (uint64_t)count * 1000 / ms;
+	*total_ms += ms;
+	return TEE_SUCCESS;
+}
+
+/*
+ * ECDSA and ECDH throughput of the calling thread on one of the NIST
+ * curves. Two keys are generated, the first one signs a digest count
+ * times, then verifies the signature count times and finally computes the
+ * shared secret with the public key of the second one count times.
+ *
+ * [in]  value[0].a  Curve size in bits: 192, 224, 256, 384 or 521
+ * [in]  value[0].b  Number of operations of each kind
+ * [out] value[1].a  Signatures per second
+ * [out] value[1].b  Verifications per second
+ * [out] value[2].a  Shared secrets per second
+ * [out] value[2].b  Elapsed time in milliseconds
+ */
+TEE_Result core_ecc_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	uint8_t sig[2 * ECC_BENCH_MAX_BYTES];
+	size_t sig_len = sizeof(sig);
+	struct ecc_keypair key;
+	struct ecc_keypair peer;
+	TEE_Result res;
+	uint32_t bits;
+	uint32_t algo = 0;
+	uint32_t curve = 0;
+	size_t count;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	bits = pParams[0].value.a;
+	count = pParams[0].value.b;
+	for (n = 0; n < ARRAY_SIZE(ecc_bench_curves); n++) {
+		if (ecc_bench_curves[n].bits == bits) {
+			curve = ecc_bench_curves[n].curve;
+			algo = ecc_bench_curves[n].algo;
+		}
+	}
+	if (!count || !curve)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (!crypto_ops.acipher.alloc_ecc_keypair ||
+	    !crypto_ops.acipher.gen_ecc_key ||
+	    !crypto_ops.acipher.ecc_sign ||
+	    !crypto_ops.acipher.ecc_verify ||
+	    !crypto_ops.acipher.ecc_shared_secret)
+		return TEE_ERROR_NOT_IMPLEMENTED;
+
+	res = gen_ecc_keypair(&key, bits, curve);
+	if (res != TEE_SUCCESS)
+		return res;
+	res = gen_ecc_keypair(&peer, bits, curve);
+	if (res != TEE_SUCCESS)
+		goto out_key;
+
+	memset(digest, 0xa5, sizeof(digest));
+	pParams[2].value.b = 0;
+
+	res = ecc_bench_run(ECC_BENCH_SIGN, algo, &key, &peer, count, digest,
+			    sizeof(digest), sig, &sig_len,
+			    &pParams[1].value.a, &pParams[2].value.b);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = ecc_bench_run(ECC_BENCH_VERIFY, algo, &key, &peer, count,
+			    digest, sizeof(digest), sig, &sig_len,
+			    &pParams[1].value.b, &pParams[2].value.b);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = ecc_bench_run(ECC_BENCH_ECDH, algo, &key, &peer, count, digest,
+			    sizeof(digest), sig, &sig_len,
+			    &pParams[2].value.a, &pParams[2].value.b);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	IMSG("P-%" PRIu32 ": %" PRIu32 " signatures/s, %" PRIu32
+	     " verifications/s, %" PRIu32 " shared secrets/s", bits,
+	     pParams[1].value.a, pParams[1].value.b, pParams[2].value.a);
+
+out:
+	free_ecc_keypair(&peer);
+out_key:
+	free_ecc_keypair(&key);
+	return res;
+}
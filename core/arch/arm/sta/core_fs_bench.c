@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <string.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_fs_defs.h>
+#include <tee_api_defines_extensions.h>
+#include <trace.h>
+#include <util.h>
+#include "core_self_tests.h"
+
+#define FS_BENCH_FILENAME	"/core_fs_bench"
+#define FS_BENCH_MAX_CHUNK	(64 * 1024)
+
+static const struct tee_file_operations *bench_file_ops(uint32_t storage_id)
+{
+	switch (storage_id) {
+#ifdef CFG_REE_FS
+	case TEE_STORAGE_PRIVATE_REE:
+		return &ree_fs_ops;
+#endif
+#ifdef CFG_RPMB_FS
+	case TEE_STORAGE_PRIVATE_RPMB:
+		return &rpmb_fs_ops;
+#endif
+#ifdef CFG_SQL_FS
+	case TEE_STORAGE_PRIVATE_SQL:
+		return &sql_fs_ops;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Sequential read and write throughput of a secure storage backend. A
+ * temporary object is written with writes of a fixed size, closed, and,
+ * if value[3] is supplied, reopened and read back with reads of the same
+ * size before being removed. Reopening the object makes sure the data is
+ * read and decrypted from the backend rather than from a cache.
+ *
+ * [in]  value[0].a  Storage ID (TEE_STORAGE_PRIVATE_REE/_RPMB/_SQL)
+ * [in]  value[0].b  Number of bytes to write
+ * [in]  value[1].a  Size of each write and read
+ * [out] value[2].a  Write throughput in bytes/s
+ * [out] value[2].b  Write elapsed time in milliseconds
+ * [out] value[3].a  Read throughput in bytes/s (optional)
+ * [out] value[3].b  Read elapsed time in milliseconds (optional)
+ */
+TEE_Result core_fs_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	const struct tee_file_operations *fops;
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t exp_pt_rd = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					     TEE_PARAM_TYPE_VALUE_INPUT,
+					     TEE_PARAM_TYPE_VALUE_OUTPUT,
+					     TEE_PARAM_TYPE_VALUE_OUTPUT);
+	TEE_Result res = TEE_SUCCESS;
+	TEE_Result errno;
+	size_t total;
+	size_t chunk;
+	size_t pos;
+	uint8_t *buf;
+	TEE_Time start;
+	TEE_Time end;
+	uint32_t ms;
+	int fd;
+
+	if (nParamTypes != exp_pt && nParamTypes != exp_pt_rd)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	fops = bench_file_ops(pParams[0].value.a);
+	total = pParams[0].value.b;
+	chunk = pParams[1].value.a;
+	if (!fops || !total || !chunk || chunk > FS_BENCH_MAX_CHUNK)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+#if defined(CFG_RPMB_FS) && !defined(CFG_RPMB_FS_MULTI_BLOCK_WRITE)
+	/* Don't let the numbers be mistaken for the multi-block path */
+	if (fops == &rpmb_fs_ops)
+		IMSG("CFG_RPMB_FS_MULTI_BLOCK_WRITE=n, one RPMB block per write request");
+#endif
+
+	buf = malloc(chunk);
+	if (!buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	for (pos = 0; pos < chunk; pos++)
+		buf[pos] = pos;
+
+	fd = fops->open(&errno, FS_BENCH_FILENAME, TEE_FS_O_CREATE |
+			TEE_FS_O_TRUNC | TEE_FS_O_RDWR);
+	if (fd < 0) {
+		res = errno != TEE_SUCCESS ? errno : TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	res = tee_time_get_sys_time(&start);
+	if (res != TEE_SUCCESS)
+		goto out_close;
+
+	for (pos = 0; pos < total; pos += chunk) {
+		size_t len = MIN(chunk, total - pos);
+
+		if (fops->write(&errno, fd, buf, len) != (int)len) {
+			res = errno != TEE_SUCCESS ? errno : TEE_ERROR_GENERIC;
+			goto out_close;
+		}
+	}
+
+	res = tee_time_get_sys_time(&end);
+	if (res != TEE_SUCCESS)
+		goto out_close;
+
+	ms = MAX(time_diff_ms(&start, &end), 1U);
+	pParams[2].value.a = (uint64_t)total * 1000 / ms;
+	pParams[2].value.b = ms;
+	IMSG("Wrote %zu bytes in %zu byte writes: %" PRIu32 " ms, %" PRIu32
+	     " bytes/s", total, chunk, ms, pParams[2].value.a);
+
+	if (nParamTypes != exp_pt_rd)
+		goto out_close;
+
+	fops->close(fd);
+	fd = fops->open(&errno, FS_BENCH_FILENAME, TEE_FS_O_RDONLY);
+	if (fd < 0) {
+		res = errno != TEE_SUCCESS ? errno : TEE_ERROR_GENERIC;
+		goto out_unlink;
+	}
+
+	res = tee_time_get_sys_time(&start);
+	if (res != TEE_SUCCESS)
+		goto out_close;
+
+	for (pos = 0; pos < total; pos += chunk) {
+		size_t len = MIN(chunk, total - pos);
+
+		if (fops->read(&errno, fd, buf, len) != (int)len) {
+			res = errno != TEE_SUCCESS ? errno : TEE_ERROR_GENERIC;
+			goto out_close;
+		}
+	}
+
+	res = tee_time_get_sys_time(&end);
+	if (res != TEE_SUCCESS)
+		goto out_close;
+
+	ms = MAX(time_diff_ms(&start, &end), 1U);
+	pParams[3].value.a = (uint64_t)total * 1000 / ms;
+	pParams[3].value.b = ms;
+	IMSG("Read %zu bytes in %zu byte reads: %" PRIu32 " ms, %" PRIu32
+	     " bytes/s", total, chunk, ms, pParams[3].value.a);
+
+out_close:
+	fops->close(fd);
+out_unlink:
+	fops->unlink(FS_BENCH_FILENAME);
+out:
+	free(buf);
+	return res;
+}
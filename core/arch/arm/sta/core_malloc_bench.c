@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <kernel/misc.h>
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <string.h>
+#include <trace.h>
+#include <util.h>
+#include "core_self_tests.h"
+
+#define MALLOC_BENCH_NUM_BUFS	16
+#define MALLOC_BENCH_MAX_SIZE	4096
+
+/*
+ * Allocation throughput of the core heap. A small working set of
+ * buffers of pseudo-random sizes is repeatedly freed and allocated
+ * again. Invoked from several normal world threads at the same time
+ * this measures the contention on the heap.
+ *
+ * [in]  value[0].a  Number of malloc()/free() pairs
+ * [in]  value[0].b  Maximum size of an allocation
+ * [out] value[1].a  Number of pairs per second
+ * [out] value[1].b  Elapsed time in milliseconds
+ */
+TEE_Result core_malloc_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	void *bufs[MALLOC_BENCH_NUM_BUFS] = { NULL };
+	TEE_Result res;
+	uint32_t num_iter;
+	uint32_t max_size;
+	uint32_t seed;
+	uint32_t n;
+	TEE_Time start;
+	TEE_Time end;
+	uint32_t ms;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_iter = pParams[0].value.a;
+	max_size = pParams[0].value.b;
+	if (!num_iter || !max_size || max_size > MALLOC_BENCH_MAX_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	seed = get_core_pos() + 1;
+
+	res = tee_time_get_sys_time(&start);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num_iter; n++) {
+		size_t idx = n % MALLOC_BENCH_NUM_BUFS;
+
+		/* Numerical Recipes LCG, good enough to vary the sizes */
+		seed = seed * 1664525 + 1013904223;
+		free(bufs[idx]);
+		bufs[idx] = malloc((seed >> 8) % max_size + 1);
+		if (!bufs[idx]) {
+			res = TEE_ERROR_OUT_OF_MEMORY;
+			goto out;
+		}
+	}
+
+	res = tee_time_get_sys_time(&end);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	ms = MAX(time_diff_ms(&start, &end), 1U);
+	pParams[1].value.a = (uint64_t)num_iter * 1000 / ms;
+	pParams[1].value.b = ms;
+	IMSG("%" PRIu32 " allocations of at most %" PRIu32 " bytes: %" PRIu32
+	     " ms", num_iter, max_size, ms);
+
+out:
+	for (n = 0; n < MALLOC_BENCH_NUM_BUFS; n++)
+		free(bufs[n]);
+	return res;
+}
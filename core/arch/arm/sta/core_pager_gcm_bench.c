@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <arm.h>
+#include <malloc.h>
+#include <mm/core_mmu.h>
+#include <string.h>
+#include <trace.h>
+#include <util.h>
+#include "core_self_tests.h"
+#include "pager_private.h"
+
+/* Same key size as the pager */
+#define PAGER_GCM_BENCH_KEY_BYTES	32
+
+static uint32_t ticks_to_ns(uint64_t ticks)
+{
+	return ticks * 1000000000ULL / read_cntfrq();
+}
+
+/*
+ * Latency of the AES-GCM page encryption and decryption done by the pager
+ * when a read/write page is paged out and paged back in. A page is
+ * encrypted then decrypted and authenticated count times with the same
+ * functions as the pager, each operation is timed with the system counter
+ * (CNTPCT).
+ *
+ * [in]  value[0].a  Number of page encryptions and decryptions
+ * [out] value[1].a  Average counter ticks per page encryption
+ * [out] value[1].b  Average counter ticks per page decryption
+ * [out] value[2].a  Average nanoseconds per page encryption
+ * [out] value[2].b  Average nanoseconds per page decryption
+ */
+TEE_Result core_pager_gcm_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE);
+	uint8_t raw_key[PAGER_GCM_BENCH_KEY_BYTES];
+	uint8_t tag[PAGER_AES_GCM_TAG_LEN];
+	struct pager_aes_gcm_key *key;
+	struct pager_aes_gcm_iv iv = { { 0 } };
+	TEE_Result res = TEE_SUCCESS;
+	uint64_t enc_total = 0;
+	uint64_t dec_total = 0;
+	uint8_t *page = NULL;
+	uint8_t *enc = NULL;
+	uint8_t *dec = NULL;
+	uint64_t t;
+	size_t count;
+	size_t n;
+
+	if (nParamTypes != exp_pt)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	count = pParams[0].value.a;
+	if (!count)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	key = malloc(sizeof(*key));
+	page = malloc(SMALL_PAGE_SIZE);
+	enc = malloc(SMALL_PAGE_SIZE);
+	dec = malloc(SMALL_PAGE_SIZE);
+	if (!key || !page || !enc || !dec) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	for (n = 0; n < sizeof(raw_key); n++)
+		raw_key[n] = n;
+	for (n = 0; n < SMALL_PAGE_SIZE; n++)
+		page[n] = n * 7;
+	if (!pager_aes_gcm_set_key(key, raw_key, sizeof(raw_key))) {
+		res = TEE_ERROR_GENERIC;
+		goto out;
+	}
+
+	for (n = 0; n < count; n++) {
+		/* As the pager, a new IV for each encryption */
+		iv.iv[2] = n;
+
+		t = read_cntpct();
+		if (!pager_aes_gcm_encrypt(key, &iv, tag, page, enc,
+					   SMALL_PAGE_SIZE)) {
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+		enc_total += read_cntpct() - t;
+
+		t = read_cntpct();
+		if (!pager_aes_gcm_decrypt(key, &iv, tag, enc, dec,
+					   SMALL_PAGE_SIZE)) {
+			res = TEE_ERROR_SECURITY;
+			goto out;
+		}
+		dec_total += read_cntpct() - t;
+
+		if (memcmp(page, dec, SMALL_PAGE_SIZE)) {
+			res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+
+	pParams[1].value.a = enc_total / count;
+	pParams[1].value.b = dec_total / count;
+	pParams[2].value.a = ticks_to_ns(pParams[1].value.a);
+	pParams[2].value.b = ticks_to_ns(pParams[1].value.b);
+	IMSG("Pager AES-GCM %d bytes page: encryption %" PRIu32
+	     " ns, decryption %" PRIu32 " ns (%zu runs)", SMALL_PAGE_SIZE,
+	     pParams[2].value.a, pParams[2].value.b, count);
+
+out:
+	free(dec);
+	free(enc);
+	free(page);
+	free(key);
+	return res;
+}
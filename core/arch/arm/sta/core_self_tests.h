@@ -29,9 +29,39 @@
 
 #include <tee_api_types.h>
 #include <tee_api_defines.h>
+#include <utee_defines.h>
+
+/* Milliseconds from start to end, for the benchmarks */
+static inline uint32_t time_diff_ms(const TEE_Time *start, const TEE_Time *end)
+{
+	TEE_Time d;
+
+	TEE_TIME_SUB(*end, *start, d);
+	return d.seconds * TEE_TIME_MILLIS_BASE + d.millis;
+}
 
 /* basic run-time tests */
 TEE_Result core_self_tests(uint32_t nParamTypes,
 		TEE_Param pParams[TEE_NUM_PARAMS]);
 
+/* secure storage sequential write and read benchmark */
+TEE_Result core_fs_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS]);
+
+/* core heap allocation benchmark */
+TEE_Result core_malloc_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS]);
+
+/* RSA sign and verify benchmark, run from several threads for scaling */
+TEE_Result core_sign_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS]);
+
+/* ECDSA sign/verify and ECDH benchmark */
+TEE_Result core_ecc_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS]);
+
+/* pager AES-GCM page encryption and decryption latency */
+TEE_Result core_pager_gcm_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS]);
+
 #endif /*CORE_SELF_TESTS_H*/
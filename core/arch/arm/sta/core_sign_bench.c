@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <arm.h>
+#include <kernel/tee_time.h>
+#include <malloc.h>
+#include <string.h>
+#include <tee/tee_cryp_provider.h>
+#include <trace.h>
+#include <utee_defines.h>
+#include <util.h>
+#include "core_self_tests.h"
+
+#define SIGN_BENCH_MAX_KEY_BITS	4096
+
+static void free_rsa_keypair(struct rsa_keypair *key)
+{
+	crypto_ops.bignum.free(key->e);
+	crypto_ops.bignum.free(key->d);
+	crypto_ops.bignum.free(key->n);
+	crypto_ops.bignum.free(key->p);
+	crypto_ops.bignum.free(key->q);
+	crypto_ops.bignum.free(key->qp);
+	crypto_ops.bignum.free(key->dp);
+	crypto_ops.bignum.free(key->dq);
+}
+
+/*
+ * Average number of system counter ticks of a signature and of a
+ * verification of the signature.
+ */
+static TEE_Result sign_verify_ticks(struct rsa_keypair *key, size_t count,
+				    const uint8_t *digest, size_t digest_len,
+				    uint8_t *sig, size_t sig_size,
+				    uint32_t *sign_ticks,
+				    uint32_t *verify_ticks)
+{
+	const uint32_t algo = TEE_ALG_RSASSA_PKCS1_V1_5_SHA256;
+	struct rsa_public_key pub = { .e = key->e, .n = key->n };
+	uint64_t sign_total = 0;
+	uint64_t verify_total = 0;
+	uint64_t t;
+	TEE_Result res;
+	size_t sig_len;
+	size_t n;
+
+	for (n = 0; n < count; n++) {
+		sig_len = sig_size;
+		t = read_cntpct();
+		res = crypto_ops.acipher.rsassa_sign(algo, key, -1, digest,
+						     digest_len, sig, &sig_len);
+		sign_total += read_cntpct() - t;
+		if (res != TEE_SUCCESS)
+			return res;
+
+		t = read_cntpct();
+		res = crypto_ops.acipher.rsassa_verify(algo, &pub, -1, digest,
+						       digest_len, sig,
+						       sig_len);
+		verify_total += read_cntpct() - t;
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	*sign_ticks = sign_total / count;
+	*verify_ticks = verify_total / count;
+	return TEE_SUCCESS;
+}
+
+/*
+ * RSA signature throughput of the calling thread. A key is generated and
+ * then used for a number of RSASSA-PKCS1-v1_5 SHA-256 signatures. Invoking
+ * the command from several normal world threads at the same time shows
+ * how the signature rate scales with the number of cores.
+ *
+ * If value[2] is supplied each signature is also verified and the cost of
+ * both operations is measured with the system counter (CNTPCT).
+ *
+ * [in]  value[0].a  RSA key size in bits
+ * [in]  value[0].b  Number of signatures
+ * [out] value[1].a  Signatures per second
+ * [out] value[1].b  Elapsed time in milliseconds
+ * [out] value[2].a  Counter ticks per signature (optional)
+ * [out] value[2].b  Counter ticks per verification (optional)
+ */
+TEE_Result core_sign_bench(uint32_t nParamTypes,
+		TEE_Param pParams[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+					  TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	uint32_t exp_pt_ticks = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+						TEE_PARAM_TYPE_VALUE_OUTPUT,
+						TEE_PARAM_TYPE_VALUE_OUTPUT,
+						TEE_PARAM_TYPE_NONE);
+	const uint32_t algo = TEE_ALG_RSASSA_PKCS1_V1_5_SHA256;
+	static const uint8_t e[] = { 0x01, 0x00, 0x01 };
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	struct rsa_keypair key;
+	TEE_Result res;
+	uint8_t *sig = NULL;
+	size_t sig_len;
+	size_t key_bits;
+	size_t count;
+	size_t n;
+	TEE_Time start;
+	TEE_Time end;
+	uint32_t ms;
+
+	if (nParamTypes != exp_pt && nParamTypes != exp_pt_ticks)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	key_bits = pParams[0].value.a;
+	count = pParams[0].value.b;
+	if (!count || key_bits < 512 || key_bits > SIGN_BENCH_MAX_KEY_BITS ||
+	    key_bits % 8)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	if (!crypto_ops.acipher.alloc_rsa_keypair ||
+	    !crypto_ops.acipher.gen_rsa_key ||
+	    !crypto_ops.acipher.rsassa_sign ||
+	    !crypto_ops.acipher.rsassa_verify)
+		return TEE_ERROR_NOT_IMPLEMENTED;
+
+	res = crypto_ops.acipher.alloc_rsa_keypair(&key, key_bits);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = crypto_ops.bignum.bin2bn(e, sizeof(e), key.e);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = crypto_ops.acipher.gen_rsa_key(&key, key_bits);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	sig = malloc(key_bits / 8);
+	if (!sig) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	memset(digest, 0xa5, sizeof(digest));
+
+	res = tee_time_get_sys_time(&start);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	for (n = 0; n < count; n++) {
+		sig_len = key_bits / 8;
+		res = crypto_ops.acipher.rsassa_sign(algo, &key, -1, digest,
+						     sizeof(digest), sig,
+						     &sig_len);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	res = tee_time_get_sys_time(&end);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	ms = MAX(time_diff_ms(&start, &end), 1U);
+	pParams[1].value.a = (uint64_t)count * 1000 / ms;
+	pParams[1].value.b = ms;
+	IMSG("%zu RSA-%zu signatures: %" PRIu32 " ms, %" PRIu32
+	     " signatures/s", count, key_bits, ms, pParams[1].value.a);
+
+	if (nParamTypes != exp_pt_ticks)
+		goto out;
+
+	res = sign_verify_ticks(&key, count, digest, sizeof(digest), sig,
+				key_bits / 8, &pParams[2].value.a,
+				&pParams[2].value.b);
+	if (res != TEE_SUCCESS)
+		goto out;
+	IMSG("RSA-%zu: %" PRIu32 " ticks/sign, %" PRIu32
+	     " ticks/verify at %" PRIu32 " Hz", key_bits, pParams[2].value.a,
+	     pParams[2].value.b, read_cntfrq());
+
+out:
+	free(sig);
+	free_rsa_keypair(&key);
+	return res;
+}
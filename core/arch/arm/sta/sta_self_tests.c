@@ -41,6 +41,11 @@
 #define CMD_TRACE	0
 #define CMD_PARAMS	1
 #define CMD_SELF_TESTS	2
+#define CMD_FS_BENCH	3
+#define CMD_MALLOC_BENCH	4
+#define CMD_SIGN_BENCH	5
+#define CMD_ECC_BENCH	6
+#define CMD_PAGER_GCM_BENCH	7
 
 static TEE_Result test_trace(uint32_t param_types __unused,
 			TEE_Param params[4] __unused)
@@ -234,6 +239,18 @@ static TEE_Result invoke_command(void *pSessionContext __unused,
 		return test_entry_params(nParamTypes, pParams);
 	case CMD_SELF_TESTS:
 		return core_self_tests(nParamTypes, pParams);
+	case CMD_FS_BENCH:
+		return core_fs_bench(nParamTypes, pParams);
+	case CMD_MALLOC_BENCH:
+		return core_malloc_bench(nParamTypes, pParams);
+	case CMD_SIGN_BENCH:
+		return core_sign_bench(nParamTypes, pParams);
+	case CMD_ECC_BENCH:
+		return core_ecc_bench(nParamTypes, pParams);
+#ifdef CFG_WITH_PAGER
+	case CMD_PAGER_GCM_BENCH:
+		return core_pager_gcm_bench(nParamTypes, pParams);
+#endif
 	default:
 		break;
 	}
@@ -28,11 +28,16 @@
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/static_ta.h>
+#include <kernel/ta_image_cache.h>
+#include <kernel/tee_ta_manager.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
+#include <slab.h>
 #include <string.h>
 #include <string_ext.h>
 #include <malloc.h>
+#include <tee/tee_fs.h>
+#include <util.h>
 
 #define TA_NAME		"stats.ta"
 
@@ -42,13 +47,23 @@
 
 #define STATS_CMD_PAGER_STATS		0
 #define STATS_CMD_ALLOC_STATS		1
+#define STATS_CMD_FS_CACHE_STATS	2
+#define STATS_CMD_TA_LOAD_STATS		3
+#define STATS_CMD_TA_IMAGE_CACHE_STATS	4
+#define STATS_CMD_SLAB_STATS		5
 
+/* Pool ids of STATS_CMD_ALLOC_STATS */
+#define STATS_POOL_HEAP			1
+#define STATS_POOL_PUBLIC_DDR		2
+#define STATS_POOL_SECURE_DDR		3
 #define STATS_NB_POOLS			3
 
 static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[4])
 {
 	struct malloc_stats *stats;
+	struct tee_mm_free_stats *free_stats = NULL;
 	uint32_t size_to_retrieve;
+	uint32_t num_pools = 1;
 	uint32_t pool_id;
 	uint32_t i;
 
@@ -58,10 +73,16 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[4])
 	 *   - 1..n means pool id
 	 * p[0].value.b = 0 if no reset of the stats
 	 * p[1].memref.buffer = output buffer to struct malloc_stats
+	 * p[2].memref.buffer = optional output buffer to struct
+	 *   tee_mm_free_stats, left zeroed for pools not managed by tee_mm
 	 */
 	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
 			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
 			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type &&
+	    TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
 			    TEE_PARAM_TYPE_NONE) != type) {
 		return TEE_ERROR_BAD_PARAMETERS;
 	}
@@ -69,15 +90,28 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[4])
 	pool_id = p[0].value.a;
 	if (pool_id > STATS_NB_POOLS)
 		return TEE_ERROR_BAD_PARAMETERS;
-
-	size_to_retrieve = sizeof(struct malloc_stats);
 	if (!pool_id)
-		size_to_retrieve *= STATS_NB_POOLS;
+		num_pools = STATS_NB_POOLS;
 
+	size_to_retrieve = sizeof(struct malloc_stats) * num_pools;
 	if (p[1].memref.size < size_to_retrieve) {
 		p[1].memref.size = size_to_retrieve;
 		return TEE_ERROR_SHORT_BUFFER;
 	}
+
+	if (TEE_PARAM_TYPE_GET(type, 2) == TEE_PARAM_TYPE_MEMREF_OUTPUT) {
+		if (p[2].memref.size <
+		    sizeof(struct tee_mm_free_stats) * num_pools) {
+			p[2].memref.size = sizeof(struct tee_mm_free_stats) *
+					   num_pools;
+			return TEE_ERROR_SHORT_BUFFER;
+		}
+		p[2].memref.size = sizeof(struct tee_mm_free_stats) *
+				   num_pools;
+		free_stats = p[2].memref.buffer;
+		memset(free_stats, 0, p[2].memref.size);
+	}
+
 	p[1].memref.size = size_to_retrieve;
 	stats = p[1].memref.buffer;
 
@@ -86,20 +120,20 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[4])
 			continue;
 
 		switch (i) {
-		case 1:
+		case STATS_POOL_HEAP:
 			malloc_get_stats(stats);
 			strlcpy(stats->desc, "Heap", sizeof(stats->desc));
 			if (p[0].value.b)
 				malloc_reset_stats();
 			break;
 
-		case 2:
+		case STATS_POOL_PUBLIC_DDR:
 			EMSG("public DDR not managed by secure side anymore");
 			break;
 
-		case 3:
+		case STATS_POOL_SECURE_DDR:
 			tee_mm_get_pool_stats(&tee_mm_sec_ddr, stats,
-					      !!p[0].value.b);
+					      free_stats, !!p[0].value.b);
 			strlcpy(stats->desc, "Secure DDR", sizeof(stats->desc));
 			break;
 
@@ -109,6 +143,8 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[4])
 		}
 
 		stats++;
+		if (free_stats)
+			free_stats++;
 	}
 
 	return TEE_SUCCESS;
@@ -137,6 +173,113 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[4])
 	return TEE_SUCCESS;
 }
 
+#ifdef CFG_REE_FS_BLOCK_CACHE
+static TEE_Result get_fs_cache_stats(uint32_t type, TEE_Param p[4])
+{
+	struct tee_fs_cache_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = hits, p[1].value.b = misses
+	 * p[2].value.a = evictions, p[2].value.b = write backs
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_ree_fs_get_cache_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.hits;
+	p[1].value.b = stats.misses;
+	p[2].value.a = stats.evictions;
+	p[2].value.b = stats.writebacks;
+
+	return TEE_SUCCESS;
+}
+#endif
+
+static TEE_Result get_ta_load_stats(uint32_t type, TEE_Param p[4])
+{
+	struct tee_ta_load_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = loads, p[1].value.b = waits
+	 * p[2].value.a = max concurrent loads, p[2].value.b = max load ms
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_ta_get_load_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.loads;
+	p[1].value.b = stats.waits;
+	p[2].value.a = stats.max_concurrent;
+	p[2].value.b = stats.max_load_ms;
+
+	return TEE_SUCCESS;
+}
+
+#ifdef CFG_TA_IMAGE_CACHE
+static TEE_Result get_ta_image_cache_stats(uint32_t type, TEE_Param p[4])
+{
+	struct ta_image_cache_stats stats;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].value.a = hits, p[1].value.b = misses
+	 * p[2].value.a = evictions, p[2].value.b = cached images
+	 * p[3].value.a = bytes used, p[3].value.b = max bytes
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT,
+			    TEE_PARAM_TYPE_VALUE_OUTPUT) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	ta_image_cache_get_stats(&stats, !!p[0].value.a);
+	p[1].value.a = stats.hits;
+	p[1].value.b = stats.misses;
+	p[2].value.a = stats.evictions;
+	p[2].value.b = stats.num_images;
+	p[3].value.a = stats.size;
+	p[3].value.b = stats.max_size;
+
+	return TEE_SUCCESS;
+}
+#endif
+
+static TEE_Result get_slab_stats(uint32_t type, TEE_Param p[4])
+{
+	size_t num_caches;
+
+	/*
+	 * p[0].value.a = 0 if no reset of the stats
+	 * p[1].memref.buffer = output buffer to array of struct slab_stats
+	 */
+	if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+			    TEE_PARAM_TYPE_MEMREF_OUTPUT,
+			    TEE_PARAM_TYPE_NONE,
+			    TEE_PARAM_TYPE_NONE) != type)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	num_caches = slab_get_stats(NULL, 0, false);
+	if (p[1].memref.size < num_caches * sizeof(struct slab_stats)) {
+		p[1].memref.size = num_caches * sizeof(struct slab_stats);
+		return TEE_ERROR_SHORT_BUFFER;
+	}
+
+	num_caches = MIN(num_caches, slab_get_stats(p[1].memref.buffer,
+						    num_caches,
+						    !!p[0].value.a));
+	p[1].memref.size = num_caches * sizeof(struct slab_stats);
+
+	return TEE_SUCCESS;
+}
+
 /*
  * Trusted Application Entry Points
  */
@@ -170,6 +313,18 @@ static TEE_Result invoke_command(void *psess __unused,
 		return get_pager_stats(ptypes, params);
 	case STATS_CMD_ALLOC_STATS:
 		return get_alloc_stats(ptypes, params);
+#ifdef CFG_REE_FS_BLOCK_CACHE
+	case STATS_CMD_FS_CACHE_STATS:
+		return get_fs_cache_stats(ptypes, params);
+#endif
+	case STATS_CMD_TA_LOAD_STATS:
+		return get_ta_load_stats(ptypes, params);
+#ifdef CFG_TA_IMAGE_CACHE
+	case STATS_CMD_TA_IMAGE_CACHE_STATS:
+		return get_ta_image_cache_stats(ptypes, params);
+#endif
+	case STATS_CMD_SLAB_STATS:
+		return get_slab_stats(ptypes, params);
 	default:
 		break;
 	}
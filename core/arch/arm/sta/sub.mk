@@ -1,5 +1,13 @@
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += sta_self_tests.c
 srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_self_tests.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_fs_bench.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_malloc_bench.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_sign_bench.c
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_ecc_bench.c
+ifeq ($(CFG_WITH_PAGER),y)
+srcs-$(CFG_TEE_CORE_EMBED_INTERNAL_TESTS) += core_pager_gcm_bench.c
+cppflags-core_pager_gcm_bench.c-y += -Icore/arch/arm/mm
+endif
 srcs-$(CFG_WITH_STATS) += stats.c
 
 ifeq ($(CFG_SE_API),y)
@@ -98,6 +98,10 @@ static void tee_entry_exchange_capabilities(struct thread_smc_args *args)
 
 	args->a0 = OPTEE_SMC_RETURN_OK;
 	args->a1 = OPTEE_SMC_SEC_CAP_HAVE_RESERVED_SHM;
+#ifdef CFG_SMALL_PAGE_USER_TA
+	/* Fragmented temp memrefs can be mapped into user TAs */
+	args->a1 |= OPTEE_SMC_SEC_CAP_UNREGISTERED_SHM;
+#endif
 }
 
 static void tee_entry_disable_shm_cache(struct thread_smc_args *args)
@@ -31,35 +31,119 @@
 #include <optee_msg.h>
 #include <sm/optee_smc.h>
 #include <kernel/tee_dispatch.h>
+#include <kernel/tee_ta_manager.h>
 #include <mm/core_mmu.h>
 #include <mm/core_memprot.h>
+#include <stdlib.h>
+#include <string.h>
 #include <util.h>
 
 #define SHM_CACHE_ATTRS	\
 	(uint32_t)(core_mmu_is_shm_cached() ?  OPTEE_SMC_SHM_CACHED : 0)
 
+/*
+ * Copies the fragments of a fragmented temp memref starting at @params.
+ * All but the last fragment have OPTEE_MSG_ATTR_FRAGMENT set and all
+ * fragments must have the same type and cache attributes. Only the start
+ * of the first and the end of the last fragment may be unaligned to a
+ * small page, this allows the fragments to be mapped as one virtually
+ * contiguous buffer.
+ *
+ * Returns the number of struct optee_msg_param used or 0 on failure.
+ */
+static size_t copy_in_frags(const struct optee_msg_param *params,
+		uint32_t num_params, struct tee_ta_param_frags **frags_ret,
+		size_t *size_ret)
+{
+	const uint64_t attr = params[0].attr & ~OPTEE_MSG_ATTR_FRAGMENT;
+	struct tee_ta_param_frags *frags;
+	size_t num_frags;
+	size_t size = 0;
+	size_t n;
+
+	for (n = 0; n < num_params; n++)
+		if (!(params[n].attr & OPTEE_MSG_ATTR_FRAGMENT))
+			break;
+	if (n == num_params)
+		return 0;	/* Last fragment is missing */
+	num_frags = n + 1;
+
+	frags = malloc(sizeof(*frags) + num_frags * sizeof(frags->frags[0]));
+	if (!frags)
+		return 0;
+	frags->num_frags = num_frags;
+
+	for (n = 0; n < num_frags; n++) {
+		/* Normal world can modify the parameters at any time */
+		uint64_t a = params[n].attr;
+		paddr_t pa = params[n].u.tmem.buf_ptr;
+		size_t sz = params[n].u.tmem.size;
+		bool last = n == (num_frags - 1);
+
+		if ((a & ~OPTEE_MSG_ATTR_FRAGMENT) != attr)
+			goto err;
+		if (!(a & OPTEE_MSG_ATTR_FRAGMENT) != last)
+			goto err;
+		if (!sz || (pa + sz) < pa || (size + sz) < size)
+			goto err;
+		if (n && (pa & SMALL_PAGE_MASK))
+			goto err;
+		if (!last && ((pa + sz) & SMALL_PAGE_MASK))
+			goto err;
+
+		frags->frags[n].pa = pa;
+		frags->frags[n].size = sz;
+		size += sz;
+	}
+
+	*frags_ret = frags;
+	*size_ret = size;
+	return num_frags;
+err:
+	free(frags);
+	return 0;
+}
+
+static void free_frags(struct tee_ta_param_frags *frags[TEE_NUM_PARAMS])
+{
+	size_t n;
+
+	for (n = 0; n < TEE_NUM_PARAMS; n++) {
+		free(frags[n]);
+		frags[n] = NULL;
+	}
+}
+
+/*
+ * A fragmented memref occupies several struct optee_msg_param, msg_idx
+ * returns the index of the first struct optee_msg_param of each
+ * parameter. The caller frees the returned fragments with free_frags().
+ */
 static bool copy_in_params(const struct optee_msg_param *params,
 		uint32_t num_params, uint32_t *param_types,
 		uint32_t param_attr[TEE_NUM_PARAMS],
-		TEE_Param tee_params[TEE_NUM_PARAMS])
+		TEE_Param tee_params[TEE_NUM_PARAMS],
+		struct tee_ta_param_frags *frags[TEE_NUM_PARAMS],
+		size_t msg_idx[TEE_NUM_PARAMS])
 {
 	size_t n;
+	size_t m = 0;
+	size_t num_frags;
+	size_t size;
 	uint8_t pt[4];
 	uint32_t cache_attr;
 	uint32_t attr;
 
 	*param_types = 0;
+	memset(frags, 0, sizeof(*frags) * TEE_NUM_PARAMS);
 
-	if (num_params > TEE_NUM_PARAMS)
-		return false;
+	for (n = 0; n < TEE_NUM_PARAMS && m < num_params; n++) {
+		msg_idx[n] = m;
 
-	for (n = 0; n < num_params; n++) {
-		if (params[n].attr & OPTEE_MSG_ATTR_META)
-			return false;
-		if (params[n].attr & OPTEE_MSG_ATTR_FRAGMENT)
-			return false;
+		if (params[m].attr & OPTEE_MSG_ATTR_META)
+			goto err;
 
-		attr = params[n].attr & OPTEE_MSG_ATTR_TYPE_MASK;
+		attr = params[m].attr & OPTEE_MSG_ATTR_TYPE_MASK;
 
 		switch (attr) {
 		case OPTEE_MSG_ATTR_TYPE_NONE:
@@ -73,8 +157,8 @@ static bool copy_in_params(const struct optee_msg_param *params,
 			pt[n] = TEE_PARAM_TYPE_VALUE_INPUT + attr -
 				OPTEE_MSG_ATTR_TYPE_VALUE_INPUT;
 			param_attr[n] = 0;
-			tee_params[n].value.a = params[n].u.value.a;
-			tee_params[n].value.b = params[n].u.value.b;
+			tee_params[n].value.a = params[m].u.value.a;
+			tee_params[n].value.b = params[m].u.value.b;
 			break;
 		case OPTEE_MSG_ATTR_TYPE_TMEM_INPUT:
 		case OPTEE_MSG_ATTR_TYPE_TMEM_OUTPUT:
@@ -82,20 +166,39 @@ static bool copy_in_params(const struct optee_msg_param *params,
 			pt[n] = TEE_PARAM_TYPE_MEMREF_INPUT + attr -
 				OPTEE_MSG_ATTR_TYPE_TMEM_INPUT;
 			cache_attr =
-				(params[n].attr >> OPTEE_MSG_ATTR_CACHE_SHIFT) &
+				(params[m].attr >> OPTEE_MSG_ATTR_CACHE_SHIFT) &
 				OPTEE_MSG_ATTR_CACHE_MASK;
 			if (cache_attr == OPTEE_MSG_ATTR_CACHE_PREDEFINED)
 				param_attr[n] = SHM_CACHE_ATTRS;
 			else
-				return false;
+				goto err;
+			if (!(params[m].attr & OPTEE_MSG_ATTR_FRAGMENT)) {
+				tee_params[n].memref.buffer =
+				    (void *)(uintptr_t)params[m].u.tmem.buf_ptr;
+				tee_params[n].memref.size =
+					params[m].u.tmem.size;
+				break;
+			}
+			num_frags = copy_in_frags(params + m, num_params - m,
+						  frags + n, &size);
+			if (!num_frags)
+				goto err;
 			tee_params[n].memref.buffer =
-				(void *)(uintptr_t)params[n].u.tmem.buf_ptr;
-			tee_params[n].memref.size = params[n].u.tmem.size;
-			break;
+				(void *)(vaddr_t)frags[n]->frags[0].pa;
+			tee_params[n].memref.size = size;
+			m += num_frags;
+			continue;
 		default:
-			return false;
+			goto err;
 		}
+
+		if (params[m].attr & OPTEE_MSG_ATTR_FRAGMENT)
+			goto err;
+		m++;
 	}
+	if (m != num_params)
+		goto err;
+
 	for (; n < TEE_NUM_PARAMS; n++) {
 		pt[n] = TEE_PARAM_TYPE_NONE;
 		param_attr[n] = 0;
@@ -106,24 +209,32 @@ static bool copy_in_params(const struct optee_msg_param *params,
 	*param_types = TEE_PARAM_TYPES(pt[0], pt[1], pt[2], pt[3]);
 
 	return true;
+err:
+	free_frags(frags);
+	return false;
 }
 
+/*
+ * The updated size of a fragmented memref is returned in the first
+ * fragment.
+ */
 static void copy_out_param(const TEE_Param tee_params[TEE_NUM_PARAMS],
-		uint32_t param_types, uint32_t num_params,
+		uint32_t param_types, const size_t msg_idx[TEE_NUM_PARAMS],
 		struct optee_msg_param *params)
 {
 	size_t n;
 
-	for (n = 0; n < num_params; n++) {
+	for (n = 0; n < TEE_NUM_PARAMS; n++) {
 		switch (TEE_PARAM_TYPE_GET(param_types, n)) {
 		case TEE_PARAM_TYPE_MEMREF_OUTPUT:
 		case TEE_PARAM_TYPE_MEMREF_INOUT:
-			params[n].u.tmem.size = tee_params[n].memref.size;
+			params[msg_idx[n]].u.tmem.size =
+				tee_params[n].memref.size;
 			break;
 		case TEE_PARAM_TYPE_VALUE_OUTPUT:
 		case TEE_PARAM_TYPE_VALUE_INOUT:
-			params[n].u.value.a = tee_params[n].value.a;
-			params[n].u.value.b = tee_params[n].value.b;
+			params[msg_idx[n]].u.value.a = tee_params[n].value.a;
+			params[msg_idx[n]].u.value.b = tee_params[n].value.b;
 			break;
 		default:
 			break;
@@ -169,19 +280,21 @@ static void entry_open_session(struct thread_smc_args *smc_args,
 	struct tee_dispatch_open_session_out out;
 	struct optee_msg_param *params = OPTEE_MSG_GET_PARAMS(arg);
 	size_t num_meta = 0;
+	size_t msg_idx[TEE_NUM_PARAMS];
 
 	if (!get_open_session_meta(arg, num_params, &num_meta, &in.uuid,
 				   &in.clnt_id))
 		goto bad_params;
 
 	if (!copy_in_params(params + num_meta, num_params - num_meta,
-			    &in.param_types, in.param_attr, in.params))
+			    &in.param_types, in.param_attr, in.params,
+			    in.param_frags, msg_idx))
 		goto bad_params;
 
 	(void)tee_dispatch_open_session(&in, &out);
+	free_frags(in.param_frags);
 
-	copy_out_param(out.params, in.param_types, num_params - num_meta,
-		       params + num_meta);
+	copy_out_param(out.params, in.param_types, msg_idx, params + num_meta);
 
 	arg->session = (vaddr_t)out.sess;
 	arg->ret = out.msg.res;
@@ -219,9 +332,11 @@ static void entry_invoke_command(struct thread_smc_args *smc_args,
 	struct tee_dispatch_invoke_command_in in;
 	struct tee_dispatch_invoke_command_out out;
 	struct optee_msg_param *params = OPTEE_MSG_GET_PARAMS(arg);
+	size_t msg_idx[TEE_NUM_PARAMS];
 
-	if (!copy_in_params(params, num_params,
-			 &in.param_types, in.param_attr, in.params)) {
+	if (!copy_in_params(params, num_params, &in.param_types,
+			    in.param_attr, in.params, in.param_frags,
+			    msg_idx)) {
 		arg->ret = TEE_ERROR_BAD_PARAMETERS;
 		arg->ret_origin = TEE_ORIGIN_TEE;
 		smc_args->a0 = OPTEE_SMC_RETURN_OK;
@@ -231,8 +346,9 @@ static void entry_invoke_command(struct thread_smc_args *smc_args,
 	in.sess = (TEE_Session *)(vaddr_t)arg->session;
 	in.cmd = arg->func;
 	(void)tee_dispatch_invoke_command(&in, &out);
+	free_frags(in.param_frags);
 
-	copy_out_param(out.params, in.param_types, num_params, params);
+	copy_out_param(out.params, in.param_types, msg_idx, params);
 
 	arg->ret = out.msg.res;
 	arg->ret_origin = out.msg.err;
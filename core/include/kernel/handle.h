@@ -27,14 +27,35 @@
 #ifndef KERNEL_HANDLE_H
 #define KERNEL_HANDLE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/*
+ * A handle is made of the index of its slot in the database and the
+ * generation of the slot, stale handles to a slot which has been reused
+ * are detected by the generation not matching.
+ */
+#define HANDLE_INDEX_BITS	16
+#define HANDLE_INDEX_MASK	((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GEN_MASK		(INT32_MAX >> HANDLE_INDEX_BITS)
+
+struct handle {
+	void *ptr;
+	uint32_t gen;
+	/* Index + 1 of the next free slot, 0 ends the list */
+	uint32_t next_free;
+};
+
 struct handle_db {
-	void **ptrs;
-	size_t max_ptrs;
+	struct handle *handles;
+	size_t max_handles;
+	size_t num_handles;
+	/* Index + 1 of the first free slot, 0 if there's none */
+	size_t first_free;
+	uint32_t next_gen;
 };
 
-#define HANDLE_DB_INITIALIZER { NULL, 0 }
+#define HANDLE_DB_INITIALIZER { NULL, 0, 0, 0, 0 }
 
 /*
  * Frees all internal data structures of the database, but does not free
@@ -45,7 +66,9 @@ void handle_db_destroy(struct handle_db *db);
 
 /*
  * Allocates a new handle and assigns the supplied pointer to it,
- * ptr must not be NULL.
+ * ptr must not be NULL. Allocation, lookup and release of handles are
+ * O(1), the database grows as needed and shrinks again when most of it
+ * is unused.
  * The function returns
  * >= 0 on success and
  * -1 on failure
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef KERNEL_PTR_HASH_H
+#define KERNEL_PTR_HASH_H
+
+#include <stddef.h>
+#include <sys/queue.h>
+#include <types_ext.h>
+
+/*
+ * Hash table of nodes embedded in the objects it indexes, keyed by an
+ * address. It's used to validate references to objects handed out to
+ * user space without traversing all objects of the TA.
+ *
+ * Adding and removing nodes can't fail, if the bucket array can't be
+ * resized the table keeps working with longer chains.
+ */
+struct ptr_hash_node {
+	LIST_ENTRY(ptr_hash_node) link;
+	vaddr_t key;
+};
+
+LIST_HEAD(ptr_hash_bucket, ptr_hash_node);
+
+struct ptr_hash {
+	struct ptr_hash_bucket *buckets;
+	size_t num_buckets;
+	size_t num_nodes;
+	/* Used while there's no allocated bucket array */
+	struct ptr_hash_bucket first_bucket;
+};
+
+void ptr_hash_init(struct ptr_hash *h);
+
+/* Frees the bucket array, the nodes are owned by the caller */
+void ptr_hash_destroy(struct ptr_hash *h);
+
+void ptr_hash_add(struct ptr_hash *h, struct ptr_hash_node *n, vaddr_t key);
+
+void ptr_hash_remove(struct ptr_hash *h, struct ptr_hash_node *n);
+
+/* Returns the node added with key or NULL if there's none */
+struct ptr_hash_node *ptr_hash_find(struct ptr_hash *h, vaddr_t key);
+
+#endif /*KERNEL_PTR_HASH_H*/
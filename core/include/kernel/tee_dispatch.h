@@ -31,6 +31,8 @@
 #include <tee_api_types.h>
 #include <trace.h>
 
+struct tee_ta_param_frags;
+
 /*
  * output argument data structure is always TEE service specific but always
  * starts with the generic output data structure tee_dispatch_out.
@@ -48,6 +50,7 @@ struct tee_dispatch_open_session_in {
 	TEE_Param params[4];
 	TEE_Identity clnt_id;
 	uint32_t param_attr[4];
+	struct tee_ta_param_frags *param_frags[4];
 };
 
 /* Output arg structure specific to TEE service 'open session'. */
@@ -64,6 +67,7 @@ struct tee_dispatch_invoke_command_in {
 	uint32_t param_types;
 	TEE_Param params[4];
 	uint32_t param_attr[4];
+	struct tee_ta_param_frags *param_frags[4];
 };
 
 /* Output arg structure specific to TEE service 'invoke command'. */
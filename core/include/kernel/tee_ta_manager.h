@@ -45,10 +45,28 @@
 TAILQ_HEAD(tee_ta_session_head, tee_ta_session);
 TAILQ_HEAD(tee_ta_ctx_head, tee_ta_ctx);
 
+/* Physically contiguous part of a fragmented memref parameter */
+struct tee_ta_param_frag {
+	paddr_t pa;
+	size_t size;
+};
+
+/*
+ * A memref parameter made of several physically contiguous fragments.
+ * Only the start of the first and the end of the last fragment may be
+ * unaligned to a small page. The memref of such a parameter holds the
+ * physical address of the first fragment and the total size.
+ */
+struct tee_ta_param_frags {
+	size_t num_frags;
+	struct tee_ta_param_frag frags[];
+};
+
 struct tee_ta_param {
 	uint32_t types;
 	TEE_Param params[4];
 	uint32_t param_attr[4];
+	struct tee_ta_param_frags *frags[4];	/* NULL if not fragmented */
 };
 
 struct tee_ta_ctx;
@@ -146,6 +164,17 @@ void tee_ta_put_session(struct tee_ta_session *sess);
 
 void tee_ta_dump_current(void);
 
+#ifdef CFG_WITH_STATS
+struct tee_ta_load_stats {
+	uint32_t loads;		/* User TAs loaded */
+	uint32_t waits;		/* Opens waiting for a load of the same TA */
+	uint32_t max_concurrent; /* Most user TAs loaded at the same time */
+	uint32_t max_load_ms;	/* Longest time to load a user TA */
+};
+
+void tee_ta_get_load_stats(struct tee_ta_load_stats *stats, bool reset);
+#endif
+
 /*
  * Implemented under core/arch for architecure specific checks
  */
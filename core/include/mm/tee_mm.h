@@ -38,22 +38,47 @@
 /* Flag to indicate that memory is allocated from hi address to low address */
 #define TEE_MM_POOL_HI_ALLOC            (1u << 0)
 
+/* Number of free lists, one per power of 2 of the size of free ranges */
+#define TEE_MM_NUM_FREE_LISTS		32
+
+/*
+ * A pool is tiled by entries describing either an allocated range, handed
+ * out by the allocation functions, or a free range.
+ */
 struct _tee_mm_entry_t {
 	struct _tee_mm_pool_t *pool;
+	/* Neighbours in address order */
+	struct _tee_mm_entry_t *prev;
 	struct _tee_mm_entry_t *next;
+	/* Balanced tree of all entries ordered by offset */
+	struct _tee_mm_entry_t *parent;
+	struct _tee_mm_entry_t *left;
+	struct _tee_mm_entry_t *right;
+	/* Free list of the size class, only used by free entries */
+	struct _tee_mm_entry_t *free_prev;
+	struct _tee_mm_entry_t *free_next;
 	uint32_t offset;	/* offset in pages/sections */
 	uint32_t size;		/* size in pages/sections */
+	uint8_t height;		/* height of the subtree */
+	bool is_free;
 };
 typedef struct _tee_mm_entry_t tee_mm_entry_t;
 
 struct _tee_mm_pool_t {
-	tee_mm_entry_t *entry;
+	tee_mm_entry_t *root;
+	tee_mm_entry_t *free_lists[TEE_MM_NUM_FREE_LISTS];
+	uint32_t free_lists_map;	/* bit n set if free_lists[n] is used */
+	uint32_t allocated;	/* allocated pages/sections */
+	uint32_t num_allocated;	/* number of allocated entries */
 	uint32_t lo;		/* low boundery pf the pool */
 	uint32_t hi;		/* high boundery pf the pool */
 	uint32_t flags;		/* Config flags for the pool */
 	uint8_t shift;		/* size shift */
 #ifdef CFG_WITH_STATS
 	size_t max_allocated;
+	uint32_t num_alloc_fail;
+	uint32_t biggest_alloc_fail;
+	uint32_t biggest_alloc_fail_used;
 #endif
 };
 typedef struct _tee_mm_pool_t tee_mm_pool_t;
@@ -131,8 +156,14 @@ bool tee_mm_addr_is_within_range(tee_mm_pool_t *pool, uint32_t addr);
 bool tee_mm_is_empty(tee_mm_pool_t *pool);
 
 #ifdef CFG_WITH_STATS
+struct tee_mm_free_stats {
+	uint32_t largest_free;	/* Biggest free contiguous range */
+	uint32_t fragmentation;	/* % of free bytes not in above */
+};
+
+/* free_stats may be NULL */
 void tee_mm_get_pool_stats(tee_mm_pool_t *pool, struct malloc_stats *stats,
-			   bool reset);
+			   struct tee_mm_free_stats *free_stats, bool reset);
 #endif
 
 #endif
@@ -74,6 +74,7 @@ struct tee_mmu_info {
 	size_t size;
 	vaddr_t ta_private_vmem_start;
 	vaddr_t ta_private_vmem_end;
+	size_t last_hit;	/* Index of last entry found by va lookup */
 };
 
 #endif
@@ -180,7 +180,9 @@ struct optee_msg_param {
  * fragmented then all but the last fragment have the
  * OPTEE_MSG_ATTR_FRAGMENT bit set in attrs. Even if a memref is fragmented
  * it will still be presented as a single logical memref to the Trusted
- * Application.
+ * Application. Only the start of the first and the end of the last
+ * fragment may be unaligned to a 4 KiB page. The updated size of a
+ * fragmented output memref is returned in the first fragment.
  */
 struct optee_msg_arg {
 	uint32_t cmd;
@@ -343,6 +345,13 @@ struct optee_msg_arg {
 
 /*
  * Load a TA into memory, defined in tee-supplicant
+ *
+ * With an optional third parameter the TA is loaded in chunks:
+ * [in]     param[0].u.value	UUID of the TA
+ * [out]    param[1].u.tmem	Buffer receiving the chunk, size is updated
+ *				with the number of bytes supplied
+ * [in/out] param[2].u.value	.a offset of the chunk in the TA, .b size
+ *				of the TA
  */
 #define OPTEE_MSG_RPC_CMD_LOAD_TA	0
 
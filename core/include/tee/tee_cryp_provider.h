@@ -84,7 +84,13 @@ struct mac_ops {
 			    uint8_t *digest, size_t digest_len);
 };
 
-/* Authenticated encryption */
+/*
+ * Authenticated encryption
+ *
+ * For AES-GCM, init() may be called with a NULL key on a context which
+ * has already been initialized with a key: the key schedule and hash
+ * subkey are kept and only the nonce changes.
+ */
 struct authenc_ops {
 	TEE_Result (*get_ctx_size)(uint32_t algo, size_t *size);
 	TEE_Result (*init)(void *ctx, uint32_t algo,
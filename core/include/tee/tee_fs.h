@@ -28,6 +28,7 @@
 #ifndef TEE_FS_H
 #define TEE_FS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <tee_api_types.h>
@@ -64,6 +65,18 @@ struct tee_file_operations {
 
 #ifdef CFG_REE_FS
 extern const struct tee_file_operations ree_fs_ops;
+
+#ifdef CFG_REE_FS_BLOCK_CACHE
+struct tee_fs_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t writebacks;
+};
+
+/* Returns the block cache counters of all REE FS files */
+void tee_ree_fs_get_cache_stats(struct tee_fs_cache_stats *stats, bool reset);
+#endif
 #endif
 #ifdef CFG_RPMB_FS
 extern const struct tee_file_operations rpmb_fs_ops;
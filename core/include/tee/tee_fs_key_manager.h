@@ -28,6 +28,7 @@
 #ifndef TEE_FS_KEY_MANAGER_H
 #define TEE_FS_KEY_MANAGER_H
 
+#include <stdbool.h>
 #include <tee_api_types.h>
 #include <utee_defines.h>
 
@@ -60,6 +61,25 @@ struct block_header {
 	struct common_header common;
 };
 
+/*
+ * Key material of an open file. The FEK is decrypted the first time it's
+ * needed and kept, together with the cipher contexts derived from it,
+ * until tee_fs_key_ctx_final() clears everything. A zero initialized
+ * context has no key, decrypting a meta file with it takes the
+ * encrypted FEK from the header of the file.
+ */
+struct tee_fs_key_ctx {
+	bool has_key;
+	bool has_fek;
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	uint8_t fek[TEE_FS_KM_FEK_SIZE];
+	bool authenc_keyed;	/* authenc_ctx holds the FEK key schedule */
+	void *authenc_ctx;	/* AES-GCM */
+	void *essiv_ctx;	/* AES-ECB encryption with the ESSIV key */
+	void *enc_ctx;		/* AES-ECB encryption with the FEK */
+	void *dec_ctx;		/* AES-ECB decryption with the FEK */
+};
+
 size_t tee_fs_get_header_size(enum tee_fs_file_type type);
 TEE_Result tee_fs_generate_fek(uint8_t *encrypted_fek, int fek_size);
 TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
@@ -70,7 +90,18 @@ TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
 		const uint8_t *data_in, size_t data_in_size,
 		uint8_t *plaintext, size_t *plaintext_size,
 		uint8_t *encrypted_fek);
-TEE_Result tee_fs_crypt_block(uint8_t *out, const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
-			      TEE_OperationMode mode);
+void tee_fs_key_ctx_init(struct tee_fs_key_ctx *kc,
+			 const uint8_t *encrypted_fek);
+void tee_fs_key_ctx_final(struct tee_fs_key_ctx *kc);
+TEE_Result tee_fs_key_ctx_encrypt(struct tee_fs_key_ctx *kc,
+		enum tee_fs_file_type file_type,
+		const uint8_t *plaintext, size_t plaintext_size,
+		uint8_t *ciphertext, size_t *ciphertext_size);
+TEE_Result tee_fs_key_ctx_decrypt(struct tee_fs_key_ctx *kc,
+		enum tee_fs_file_type file_type,
+		const uint8_t *data_in, size_t data_in_size,
+		uint8_t *plaintext, size_t *plaintext_size);
+TEE_Result tee_fs_crypt_block(struct tee_fs_key_ctx *kc, uint8_t *out,
+			      const uint8_t *in, size_t size,
+			      uint16_t blk_idx, TEE_OperationMode mode);
 #endif
@@ -35,6 +35,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <tee_api_types.h>
+#include <tee/tee_fs.h>
 
 /* TEE FS operation */
 #define TEE_FS_OPEN       1
@@ -54,6 +55,9 @@
 #define TEE_FS_LINK      15
 #define TEE_FS_BEGIN     16 /* SQL FS: begin transaction */
 #define TEE_FS_END       17 /* SQL FS: end transaction */
+#define TEE_FS_WRITE_FILES 18 /* REE FS: create and write several files */
+#define TEE_FS_READ_FILES  19 /* REE FS: read several files */
+#define TEE_FS_UNLINK_FILES 20 /* REE FS: remove several files */
 
 /* sql_fs_send_cmd 'mode' */
 #define TEE_FS_MODE_NONE 0
@@ -69,6 +73,56 @@ struct tee_fs_rpc {
 	int res;
 };
 
+/*
+ * TEE_FS_WRITE_FILES, TEE_FS_READ_FILES and TEE_FS_UNLINK_FILES carry
+ * tee_fs_rpc.arg files in the payload following struct tee_fs_rpc. Each
+ * file is described by a struct tee_fs_rpc_file followed by path_len bytes
+ * of zero terminated path, padded to 8 bytes, and len bytes of file data,
+ * padded to 8 bytes.
+ *
+ * TEE_FS_WRITE_FILES creates or truncates each file, writes the data and
+ * closes it. TEE_FS_READ_FILES reads up to len bytes from the beginning of
+ * each file and updates len with the number of bytes read.
+ * TEE_FS_UNLINK_FILES removes each file, len is 0 and a missing file is
+ * not a failure. The files are processed in order and processing stops at
+ * the first failure, res holds the result of each processed file and
+ * tee_fs_rpc.res the number of files successfully processed or < 0 on
+ * error. The res of each file is TEE_FS_RPC_FILE_PENDING when sent, a
+ * reply leaving it on the first file means that the operation wasn't
+ * understood.
+ */
+#define TEE_FS_RPC_FILE_PENDING 1
+#define TEE_FS_RPC_PATH_MAX (TEE_FS_NAME_MAX + 20)
+
+struct tee_fs_rpc_file {
+	uint32_t path_len;
+	uint32_t len;
+	int res;
+	uint32_t reserved;
+};
+
+/* A batch of files transferred with a single RPC */
+struct tee_fs_rpc_batch {
+	int id;
+	int op;
+	uint64_t cookie;
+	uint8_t *va;
+	size_t size;
+	size_t used;
+	size_t num_files;
+	size_t max_files;
+	/* Set by tee_fs_rpc_batch_send() if tee-supplicant lacks batches */
+	bool unsupported;
+	/* Set by tee_fs_rpc_batch_send() if tee-supplicant has batches */
+	bool supported;
+	/* Secure copy of the payload layout, offsets from va */
+	struct tee_fs_rpc_batch_file {
+		size_t hdr_offs;
+		size_t data_offs;
+		size_t len;
+	} *files;
+};
+
 /*
  * Return values:
  *   < 0: error. The actual value is meaningless (see below).
@@ -99,4 +153,35 @@ int tee_fs_rpc_closedir(int id, struct tee_fs_dir *d);
 int tee_fs_rpc_rmdir(int id, const char *name);
 int tee_fs_rpc_unlink(int id, const char *file);
 
+/*
+ * Allocates shared memory for a batch of at most max_files files with a
+ * total of data_size bytes of file data, op is one of TEE_FS_WRITE_FILES,
+ * TEE_FS_READ_FILES and TEE_FS_UNLINK_FILES.
+ */
+TEE_Result tee_fs_rpc_batch_init(struct tee_fs_rpc_batch *b, int id, int op,
+				 size_t max_files, size_t data_size);
+/*
+ * Adds a file to the batch, returns a pointer to the len bytes of file
+ * data in shared memory or NULL if the batch is full. For writes the
+ * caller fills in the data before tee_fs_rpc_batch_send().
+ */
+void *tee_fs_rpc_batch_add(struct tee_fs_rpc_batch *b, const char *path,
+			   size_t len);
+/* Updates the length of the last added file, must not grow it */
+void tee_fs_rpc_batch_set_len(struct tee_fs_rpc_batch *b, size_t len);
+/*
+ * Sends the batch, returns the number of files processed or < 0. If the
+ * reply shows that tee-supplicant doesn't understand the operation
+ * b->unsupported is set, if it shows that it does b->supported is set.
+ * A reply may show neither, for instance when the RPC itself fails.
+ */
+int tee_fs_rpc_batch_send(struct tee_fs_rpc_batch *b);
+/*
+ * Returns the data of file idx of a sent TEE_FS_READ_FILES batch and the
+ * number of bytes read, the data is still in non-secure shared memory.
+ */
+const void *tee_fs_rpc_batch_get(struct tee_fs_rpc_batch *b, size_t idx,
+				 size_t *len);
+void tee_fs_rpc_batch_release(struct tee_fs_rpc_batch *b);
+
 #endif /* TEE_FS_RPC_H */
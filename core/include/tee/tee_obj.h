@@ -29,6 +29,7 @@
 #define TEE_OBJ_H
 
 #include <tee_api_types.h>
+#include <kernel/ptr_hash.h>
 #include <kernel/tee_ta_manager.h>
 #include <sys/queue.h>
 
@@ -36,6 +37,7 @@
 
 struct tee_obj {
 	TAILQ_ENTRY(tee_obj) link;
+	struct ptr_hash_node hash_node;
 	TEE_ObjectInfo info;
 	bool busy;		/* true if used by an operation */
 	uint32_t have_attrs;	/* bitfield identifying set properties */
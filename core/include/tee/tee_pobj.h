@@ -53,4 +53,12 @@ TEE_Result tee_pobj_release(struct tee_pobj *obj);
 TEE_Result tee_pobj_rename(struct tee_pobj *obj, void *obj_id,
 			   uint32_t obj_id_len);
 
+/*
+ * Allocates a zeroed object which isn't registered in the list of opened
+ * objects, used to inspect objects while enumerating them. Freed with
+ * tee_pobj_free_unlisted() which also frees obj_id.
+ */
+struct tee_pobj *tee_pobj_alloc_unlisted(void);
+void tee_pobj_free_unlisted(struct tee_pobj *obj);
+
 #endif
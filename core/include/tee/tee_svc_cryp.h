@@ -73,6 +73,14 @@ TEE_Result syscall_cipher_update(unsigned long state, const void *src,
 TEE_Result syscall_cipher_final(unsigned long state, const void *src,
 			size_t src_len, void *dest, uint64_t *dest_len);
 
+/*
+ * Does the equivalent of syscall_hash_update() or syscall_cipher_update()
+ * for each of the num_upd descriptors in upd, stopping at the first
+ * error.
+ */
+TEE_Result syscall_cryp_update_batch(struct utee_cryp_update *upd,
+			size_t num_upd);
+
 TEE_Result syscall_cryp_derive_key(unsigned long state,
 			const struct utee_attribute *params,
 			unsigned long param_count, unsigned long derived_key);
@@ -24,6 +24,7 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/handle.h>
@@ -36,66 +37,162 @@
  */
 #define HANDLE_DB_INITIAL_MAX_PTRS	4
 
+#define HANDLE_DB_MAX_HANDLES		(HANDLE_INDEX_MASK + 1)
+
+/*
+ * Links all free slots below max_handles into the free list, lowest index
+ * first so that the upper part of the database tends to be left unused
+ * and can be released.
+ */
+static void rebuild_free_list(struct handle_db *db)
+{
+	size_t n = db->max_handles;
+
+	db->first_free = 0;
+	while (n) {
+		n--;
+		if (!db->handles[n].ptr) {
+			db->handles[n].next_free = db->first_free;
+			db->first_free = n + 1;
+		}
+	}
+}
+
+static bool grow(struct handle_db *db)
+{
+	struct handle *h;
+	size_t new_max;
+
+	if (db->max_handles)
+		new_max = db->max_handles * 2;
+	else
+		new_max = HANDLE_DB_INITIAL_MAX_PTRS;
+	if (new_max > HANDLE_DB_MAX_HANDLES)
+		return false;
+
+	h = realloc(db->handles, new_max * sizeof(*h));
+	if (!h)
+		return false;
+	memset(h + db->max_handles, 0,
+	       (new_max - db->max_handles) * sizeof(*h));
+	db->handles = h;
+	db->max_handles = new_max;
+	/* The free list is empty, all new slots are free */
+	rebuild_free_list(db);
+	return true;
+}
+
+/*
+ * Halves the database while it's at most a quarter full and the upper
+ * half is unused. Only tried when the number of handles drops to a
+ * quarter of the capacity so that the scan is amortized over the
+ * releases since the last resize.
+ */
+static void shrink(struct handle_db *db)
+{
+	struct handle *h;
+	size_t new_max = db->max_handles;
+	size_t n;
+
+	while (new_max > HANDLE_DB_INITIAL_MAX_PTRS &&
+	       db->num_handles <= new_max / 4) {
+		for (n = new_max / 2; n < new_max; n++)
+			if (db->handles[n].ptr)
+				break;
+		if (n != new_max)
+			break;
+		new_max /= 2;
+	}
+
+	if (new_max == db->max_handles)
+		return;
+
+	h = realloc(db->handles, new_max * sizeof(*h));
+	if (h)
+		db->handles = h;
+	db->max_handles = new_max;
+	rebuild_free_list(db);
+}
+
 void handle_db_destroy(struct handle_db *db)
 {
 	if (db) {
-		free(db->ptrs);
-		db->ptrs = NULL;
-		db->max_ptrs = 0;
+		free(db->handles);
+		db->handles = NULL;
+		db->max_handles = 0;
+		db->num_handles = 0;
+		db->first_free = 0;
 	}
 }
 
 int handle_get(struct handle_db *db, void *ptr)
 {
+	struct handle *h;
 	size_t n;
-	void *p;
-	size_t new_max_ptrs;
 
 	if (!db || !ptr)
 		return -1;
 
-	/* Try to find an empty location */
-	for (n = 0; n < db->max_ptrs; n++) {
-		if (!db->ptrs[n]) {
-			db->ptrs[n] = ptr;
-			return n;
-		}
-	}
-
-	/* No location available, grow the ptrs array */
-	if (db->max_ptrs)
-		new_max_ptrs = db->max_ptrs * 2;
-	else
-		new_max_ptrs = HANDLE_DB_INITIAL_MAX_PTRS;
-	p = realloc(db->ptrs, new_max_ptrs * sizeof(void *));
-	if (!p)
+	if (!db->first_free && !grow(db))
 		return -1;
-	db->ptrs = p;
-	memset(db->ptrs + db->max_ptrs, 0,
-	       (new_max_ptrs - db->max_ptrs) * sizeof(void *));
-	db->max_ptrs = new_max_ptrs;
-
-	/* Since n stopped at db->max_ptrs there is an empty location there */
-	db->ptrs[n] = ptr;
-	return n;
+
+	n = db->first_free - 1;
+	h = db->handles + n;
+	db->first_free = h->next_free;
+	db->num_handles++;
+
+	h->ptr = ptr;
+	h->gen = db->next_gen;
+	db->next_gen = (db->next_gen + 1) & HANDLE_GEN_MASK;
+
+	return (h->gen << HANDLE_INDEX_BITS) | n;
+}
+
+static struct handle *find_handle(struct handle_db *db, int handle)
+{
+	size_t n;
+	struct handle *h;
+
+	if (!db || handle < 0)
+		return NULL;
+
+	n = handle & HANDLE_INDEX_MASK;
+	if (n >= db->max_handles)
+		return NULL;
+
+	h = db->handles + n;
+	if (!h->ptr || h->gen != ((uint32_t)handle >> HANDLE_INDEX_BITS))
+		return NULL;
+
+	return h;
 }
 
 void *handle_put(struct handle_db *db, int handle)
 {
+	struct handle *h = find_handle(db, handle);
 	void *p;
 
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	if (!h)
 		return NULL;
 
-	p = db->ptrs[handle];
-	db->ptrs[handle] = NULL;
+	p = h->ptr;
+	h->ptr = NULL;
+	h->next_free = db->first_free;
+	db->first_free = (handle & HANDLE_INDEX_MASK) + 1;
+	db->num_handles--;
+
+	if (db->num_handles == db->max_handles / 4)
+		shrink(db);
+
 	return p;
 }
 
 void *handle_lookup(struct handle_db *db, int handle)
 {
-	if (!db || handle < 0 || (size_t)handle >= db->max_ptrs)
+	struct handle *h = find_handle(db, handle);
+
+	if (!h)
 		return NULL;
 
-	return db->ptrs[handle];
+	return h->ptr;
 }
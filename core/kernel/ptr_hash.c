@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <kernel/ptr_hash.h>
+#include <stdlib.h>
+
+/* Maximum average number of nodes per bucket before the table grows */
+#define PTR_HASH_MAX_LOAD	2
+
+static size_t bucket_idx(vaddr_t key, size_t num_buckets)
+{
+	/* Objects are at least 8 byte aligned, the low bits carry nothing */
+	uint32_t h = (uint32_t)(key >> 3) * 2654435761u;
+
+	return (h ^ (h >> 16)) & (num_buckets - 1);
+}
+
+static void resize(struct ptr_hash *h, size_t num_buckets)
+{
+	struct ptr_hash_bucket *buckets;
+	struct ptr_hash_node *n;
+	size_t idx;
+
+	if (num_buckets > 1) {
+		buckets = malloc(num_buckets * sizeof(*buckets));
+		if (!buckets)
+			return;
+	} else {
+		buckets = &h->first_bucket;
+		num_buckets = 1;
+	}
+
+	for (idx = 0; idx < num_buckets; idx++)
+		LIST_INIT(buckets + idx);
+
+	for (idx = 0; idx < h->num_buckets; idx++) {
+		while ((n = LIST_FIRST(h->buckets + idx))) {
+			LIST_REMOVE(n, link);
+			LIST_INSERT_HEAD(buckets + bucket_idx(n->key,
+							      num_buckets),
+					 n, link);
+		}
+	}
+
+	if (h->buckets != &h->first_bucket)
+		free(h->buckets);
+	h->buckets = buckets;
+	h->num_buckets = num_buckets;
+}
+
+void ptr_hash_init(struct ptr_hash *h)
+{
+	LIST_INIT(&h->first_bucket);
+	h->buckets = &h->first_bucket;
+	h->num_buckets = 1;
+	h->num_nodes = 0;
+}
+
+void ptr_hash_destroy(struct ptr_hash *h)
+{
+	if (h->buckets != &h->first_bucket)
+		free(h->buckets);
+	ptr_hash_init(h);
+}
+
+void ptr_hash_add(struct ptr_hash *h, struct ptr_hash_node *n, vaddr_t key)
+{
+	n->key = key;
+	LIST_INSERT_HEAD(h->buckets + bucket_idx(key, h->num_buckets), n,
+			 link);
+	h->num_nodes++;
+
+	if (h->num_nodes > h->num_buckets * PTR_HASH_MAX_LOAD)
+		resize(h, h->num_buckets * 2);
+}
+
+void ptr_hash_remove(struct ptr_hash *h, struct ptr_hash_node *n)
+{
+	LIST_REMOVE(n, link);
+	h->num_nodes--;
+
+	if (h->num_buckets > 1 &&
+	    h->num_nodes < h->num_buckets * PTR_HASH_MAX_LOAD / 8)
+		resize(h, h->num_buckets / 2);
+}
+
+struct ptr_hash_node *ptr_hash_find(struct ptr_hash *h, vaddr_t key)
+{
+	struct ptr_hash_node *n;
+
+	LIST_FOREACH(n, h->buckets + bucket_idx(key, h->num_buckets), link)
+		if (n->key == key)
+			return n;
+
+	return NULL;
+}
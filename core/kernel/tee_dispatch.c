@@ -105,6 +105,7 @@ TEE_Result tee_dispatch_open_session(struct tee_dispatch_open_session_in *in,
 	param.types = in->param_types;
 	memcpy(param.params, in->params, sizeof(in->params));
 	memcpy(param.param_attr, in->param_attr, sizeof(in->param_attr));
+	memcpy(param.frags, in->param_frags, sizeof(in->param_frags));
 
 	res = tee_ta_open_session(&res_orig, &s, &tee_open_sessions, &in->uuid,
 				  &clnt_id, TEE_TIMEOUT_INFINITE, &param);
@@ -158,6 +159,7 @@ TEE_Result tee_dispatch_invoke_command(struct tee_dispatch_invoke_command_in *
 	param.types = in->param_types;
 	memcpy(param.params, in->params, sizeof(in->params));
 	memcpy(param.param_attr, in->param_attr, sizeof(in->param_attr));
+	memcpy(param.frags, in->param_frags, sizeof(in->param_frags));
 
 	res = tee_ta_invoke_command(&err, sess, NSAPP_IDENTITY,
 				    TEE_TIMEOUT_INFINITE, in->cmd, &param);
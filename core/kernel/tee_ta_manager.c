@@ -44,6 +44,7 @@
 #include <mm/core_mmu.h>
 #include <mm/core_memprot.h>
 #include <mm/tee_mmu.h>
+#include <slab.h>
 #include <tee/tee_svc_cryp.h>
 #include <tee/tee_obj.h>
 #include <tee/tee_svc_storage.h>
@@ -54,10 +55,31 @@
 
 /* This mutex protects the critical section in tee_ta_init_session */
 struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
+
+/*
+ * User TAs are loaded without holding tee_ta_mutex. A load in progress is
+ * registered in tee_ta_loads so that other sessions to the same TA wait
+ * for it to complete instead of loading the TA again, tee_ta_load_cv is
+ * signalled each time a load completes.
+ */
+struct tee_ta_load {
+	TEE_UUID uuid;
+	TAILQ_ENTRY(tee_ta_load) link;
+};
+
+static TAILQ_HEAD(tee_ta_load_head, tee_ta_load) tee_ta_loads =
+	TAILQ_HEAD_INITIALIZER(tee_ta_loads);
+static struct condvar tee_ta_load_cv = CONDVAR_INITIALIZER;
+#ifdef CFG_WITH_STATS
+static struct tee_ta_load_stats tee_ta_load_stats;
+static uint32_t tee_ta_num_loads;
+#endif
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static int tee_ta_single_instance_thread = THREAD_ID_INVALID;
 static size_t tee_ta_single_instance_count;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
+static struct slab_cache tee_ta_session_cache =
+	SLAB_CACHE_INITIALIZER("TA session", struct tee_ta_session, NULL, NULL);
 
 static void lock_single_instance(void)
 {
@@ -344,7 +366,7 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 	}
 
 	tee_ta_unlink_session(sess, open_sessions);
-	free(sess);
+	slab_free(&tee_ta_session_cache, sess);
 
 	tee_ta_clear_busy(ctx);
 
@@ -402,6 +424,70 @@ static TEE_Result tee_ta_init_session_with_context(struct tee_ta_ctx *ctx,
 
 
 
+static bool tee_ta_is_loading(const TEE_UUID *uuid)
+{
+	struct tee_ta_load *l;
+
+	/* Requires tee_ta_mutex to be held */
+	TAILQ_FOREACH(l, &tee_ta_loads, link)
+		if (!memcmp(&l->uuid, uuid, sizeof(TEE_UUID)))
+			return true;
+
+	return false;
+}
+
+#ifdef CFG_WITH_STATS
+void tee_ta_get_load_stats(struct tee_ta_load_stats *stats, bool reset)
+{
+	mutex_lock(&tee_ta_mutex);
+	*stats = tee_ta_load_stats;
+	if (reset)
+		memset(&tee_ta_load_stats, 0, sizeof(tee_ta_load_stats));
+	mutex_unlock(&tee_ta_mutex);
+}
+
+static void load_stats_wait(void)
+{
+	tee_ta_load_stats.waits++;
+}
+
+static void load_stats_begin(TEE_Time *start)
+{
+	tee_ta_num_loads++;
+	tee_ta_load_stats.max_concurrent = MAX(tee_ta_load_stats.max_concurrent,
+					       tee_ta_num_loads);
+	if (tee_time_get_sys_time(start) != TEE_SUCCESS)
+		memset(start, 0, sizeof(*start));
+}
+
+static void load_stats_end(TEE_Time *start, TEE_Result res)
+{
+	TEE_Time end;
+	uint32_t ms;
+
+	tee_ta_num_loads--;
+	if (res != TEE_SUCCESS || tee_time_get_sys_time(&end) != TEE_SUCCESS)
+		return;
+
+	tee_ta_load_stats.loads++;
+	ms = (end.seconds - start->seconds) * 1000 + end.millis - start->millis;
+	tee_ta_load_stats.max_load_ms = MAX(tee_ta_load_stats.max_load_ms, ms);
+}
+#else
+static void load_stats_wait(void)
+{
+}
+
+static void load_stats_begin(TEE_Time *start __unused)
+{
+}
+
+static void load_stats_end(TEE_Time *start __unused,
+			   TEE_Result res __unused)
+{
+}
+#endif
+
 static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 				struct tee_ta_session_head *open_sessions,
 				const TEE_UUID *uuid,
@@ -409,7 +495,9 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 {
 	TEE_Result res;
 	struct tee_ta_ctx *ctx;
-	struct tee_ta_session *s = calloc(1, sizeof(struct tee_ta_session));
+	struct tee_ta_session *s = slab_zalloc(&tee_ta_session_cache);
+	struct tee_ta_load load;
+	TEE_Time load_start;
 
 	*err = TEE_ORIGIN_TEE;
 	if (!s)
@@ -421,39 +509,59 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 	s->lock_thread = THREAD_ID_INVALID;
 	s->ref_count = 1;
 
-
-	/*
-	 * We take the global TA mutex here and hold it while doing
-	 * RPC to load the TA. This big critical section should be broken
-	 * down into smaller pieces.
-	 */
-
-
 	mutex_lock(&tee_ta_mutex);
-	TAILQ_INSERT_TAIL(open_sessions, s, link);
 
-	/* Look for already loaded TA */
-	ctx = tee_ta_context_find(uuid);
-	if (ctx) {
-		res = tee_ta_init_session_with_context(ctx, s);
+	while (true) {
+		/* Look for already loaded TA */
+		ctx = tee_ta_context_find(uuid);
+		if (ctx) {
+			res = tee_ta_init_session_with_context(ctx, s);
+			if (res == TEE_SUCCESS ||
+			    res != TEE_ERROR_ITEM_NOT_FOUND)
+				goto out;
+		}
+
+		/* Look for static TA */
+		res = tee_ta_init_static_ta_session(uuid, s);
 		if (res == TEE_SUCCESS || res != TEE_ERROR_ITEM_NOT_FOUND)
 			goto out;
+
+		if (!tee_ta_is_loading(uuid))
+			break;
+
+		/*
+		 * Someone else is loading this TA, check again once it's
+		 * done as the loaded context may be usable.
+		 */
+		load_stats_wait();
+		condvar_wait(&tee_ta_load_cv, &tee_ta_mutex);
 	}
 
-	/* Look for static TA */
-	res = tee_ta_init_static_ta_session(uuid, s);
-	if (res == TEE_SUCCESS || res != TEE_ERROR_ITEM_NOT_FOUND)
-		goto out;
+	/*
+	 * Look for user TA. The TA is loaded without holding tee_ta_mutex
+	 * as it involves RPCs, signature verification and copying the
+	 * TA, sessions to other TAs proceed in the meantime.
+	 */
+	load.uuid = *uuid;
+	TAILQ_INSERT_TAIL(&tee_ta_loads, &load, link);
+	load_stats_begin(&load_start);
+	mutex_unlock(&tee_ta_mutex);
 
-	/* Look for user TA */
 	res = tee_ta_init_user_ta_session(uuid, s);
 
+	mutex_lock(&tee_ta_mutex);
+	load_stats_end(&load_start, res);
+	TAILQ_REMOVE(&tee_ta_loads, &load, link);
+	if (res == TEE_SUCCESS)
+		TAILQ_INSERT_TAIL(&tee_ctxes, s->ctx, link);
+	condvar_broadcast(&tee_ta_load_cv);
+
 out:
 	if (res == TEE_SUCCESS) {
+		TAILQ_INSERT_TAIL(open_sessions, s, link);
 		*sess = s;
 	} else {
-		TAILQ_REMOVE(open_sessions, s, link);
-		free(s);
+		slab_free(&tee_ta_session_cache, s);
 	}
 	mutex_unlock(&tee_ta_mutex);
 	return res;
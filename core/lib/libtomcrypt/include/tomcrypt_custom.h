@@ -214,6 +214,9 @@
 #ifdef CFG_CRYPTO_GCM
    #define LTC_GCM_MODE
 #endif
+#ifdef CFG_CRYPTO_GCM_ARM64_CE
+   #define LTC_GCM_ARM64_CE
+#endif
 
 #define LTC_NO_PK
 
@@ -239,6 +242,9 @@
    /* do we want fixed point ECC */
    /* #define LTC_MECC_FP */
 
+   /* precomputed comb tables for the ECC-256 and ECC-384 generators */
+   #define LTC_ECC_FIXED_BASE
+
    /* Timing Resistant */
    #define LTC_ECC_TIMING_RESISTANT
 
@@ -296,8 +296,23 @@ extern const unsigned char gcm_shift_table[];
 #define LTC_GCM_MODE_AAD   1
 #define LTC_GCM_MODE_TEXT  2
 
+/* GHASH key, the hash subkey H prepared for gcm_ghash_mult() */
+typedef struct {
+#ifdef LTC_GCM_ARM64_CE
+   ulong64             H[2];         /* H * x, little endian lanes */
+#else
+   ulong64             M[16][2];     /* 4-bit table of multiples of H */
+#endif
+} gcm_ghash_key;
+
+void gcm_ghash_setup(gcm_ghash_key *key, const unsigned char *H);
+void gcm_ghash_mult(const gcm_ghash_key *key, unsigned char *X);
+void gcm_ghash_process(const gcm_ghash_key *key, unsigned char *X,
+                       const unsigned char *in, unsigned long blocks);
+
 typedef struct { 
    symmetric_key       K;
+   gcm_ghash_key       ghash;        /* prepared H */
    unsigned char       H[16],        /* multiplier */
                        X[16],        /* accumulator */
                        Y[16],        /* counter */
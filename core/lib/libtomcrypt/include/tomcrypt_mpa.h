@@ -31,8 +31,11 @@
 #include <mpalib.h>
 #include "tomcrypt.h"
 
-extern mpa_scratch_mem external_mem_pool;
-
-void init_mpa_tomcrypt(mpa_scratch_mem pool);
+/*
+ * @get_pool returns the scratch memory pool the calling thread allocates
+ * its temporary variables from. A thread holding temporary variables must
+ * always be given the pool they were allocated from.
+ */
+void init_mpa_tomcrypt(mpa_scratch_mem (*get_pool)(void));
 
 #endif /* TOMCRYPT_MPA_H_ */
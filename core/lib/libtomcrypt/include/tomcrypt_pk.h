@@ -352,6 +352,11 @@ void ltc_ecc_fp_tablelock(int lock);
 /* R = kG */
 int ltc_ecc_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map);
 
+#ifdef LTC_ECC_FIXED_BASE
+/* R = kG using precomputed tables, CRYPT_NOP if G has no table */
+int ltc_ecc_fixed_base_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map);
+#endif
+
 #ifdef LTC_ECC_SHAMIR
 /* kA*A + kB*B = C */
 int ltc_ecc_mul2add(ecc_point *A, void *kA,
@@ -83,165 +83,32 @@ const unsigned char gcm_shift_table[256*2] = {
 #endif
 
 
-#if defined(LTC_GCM_MODE) || defined(LRW_MODE)
+#ifdef LTC_GCM_MODE
 
-#ifndef LTC_FAST
-/* right shift */
-static void gcm_rightshift(unsigned char *a)
-{
-   int x;
-   for (x = 15; x > 0; x--) {
-       a[x] = (a[x]>>1) | ((a[x-1]<<7)&0x80);
-   }
-   a[0] >>= 1;
-}
-
-/* c = b*a */
-static const unsigned char mask[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
-static const unsigned char poly[] = { 0x00, 0xE1 };
-
-     
 /**
-  GCM GF multiplier (internal use only)  bitserial
+  GCM GF multiplier (internal use only), uses the GHASH engine
   @param a   First value
   @param b   Second value
   @param c   Destination for a * b
  */  
 void gcm_gf_mult(const unsigned char *a, const unsigned char *b, unsigned char *c)
 {
-   unsigned char Z[16], V[16];
-   unsigned char x, y, z;
-
-   zeromem(Z, 16);
-   XMEMCPY(V, a, 16);
-   for (x = 0; x < 128; x++) {
-       if (b[x>>3] & mask[x&7]) {
-          for (y = 0; y < 16; y++) {
-              Z[y] ^= V[y]; 
-          }
-       }
-       z     = V[15] & 0x01;
-       gcm_rightshift(V);
-       V[0] ^= poly[z];
-   }
-   XMEMCPY(c, Z, 16);
-}
-
-#else
-
-/* map normal numbers to "ieee" way ... e.g. bit reversed */
-#define M(x) ( ((x&8)>>3) | ((x&4)>>1) | ((x&2)<<1) | ((x&1)<<3) )
+   gcm_ghash_key key;
+   unsigned char T[16];
 
-#define BPD (sizeof(LTC_FAST_TYPE) * 8)
-#define WPV (1 + (16 / sizeof(LTC_FAST_TYPE)))
+   gcm_ghash_setup(&key, a);
+   XMEMCPY(T, b, 16);
+   gcm_ghash_mult(&key, T);
+   XMEMCPY(c, T, 16);
 
-/**
-  GCM GF multiplier (internal use only)  word oriented
-  @param a   First value
-  @param b   Second value
-  @param c   Destination for a * b
- */  
-void gcm_gf_mult(const unsigned char *a, const unsigned char *b, unsigned char *c)
-{
-   int i, j, k, u;
-   LTC_FAST_TYPE B[16][WPV], tmp[32 / sizeof(LTC_FAST_TYPE)], pB[16 / sizeof(LTC_FAST_TYPE)], zz, z;
-   unsigned char pTmp[32];
-
-   /* create simple tables */
-   zeromem(B[0],       sizeof(B[0]));
-   zeromem(B[M(1)],    sizeof(B[M(1)]));
-
-#ifdef ENDIAN_32BITWORD
-   for (i = 0; i < 4; i++) {
-       LOAD32H(B[M(1)][i], a + (i<<2));
-       LOAD32L(pB[i],      b + (i<<2));
-   }
-#else 
-   for (i = 0; i < 2; i++) {
-       LOAD64H(B[M(1)][i], a + (i<<3));
-       LOAD64L(pB[i],      b + (i<<3));
-   }
-#endif
-
-   /* now create 2, 4 and 8 */
-   B[M(2)][0] = B[M(1)][0] >> 1;
-   B[M(4)][0] = B[M(1)][0] >> 2;
-   B[M(8)][0] = B[M(1)][0] >> 3;
-   for (i = 1; i < (int)WPV; i++) {
-      B[M(2)][i] = (B[M(1)][i-1] << (BPD-1)) | (B[M(1)][i] >> 1);
-      B[M(4)][i] = (B[M(1)][i-1] << (BPD-2)) | (B[M(1)][i] >> 2);
-      B[M(8)][i] = (B[M(1)][i-1] << (BPD-3)) | (B[M(1)][i] >> 3);
-   }
-
-   /*  now all values with two bits which are 3, 5, 6, 9, 10, 12 */
-   for (i = 0; i < (int)WPV; i++) {
-      B[M(3)][i]  = B[M(1)][i] ^ B[M(2)][i];
-      B[M(5)][i]  = B[M(1)][i] ^ B[M(4)][i];
-      B[M(6)][i]  = B[M(2)][i] ^ B[M(4)][i];
-      B[M(9)][i]  = B[M(1)][i] ^ B[M(8)][i];
-      B[M(10)][i] = B[M(2)][i] ^ B[M(8)][i];
-      B[M(12)][i] = B[M(8)][i] ^ B[M(4)][i];
-   
-   /*  now all 3 bit values and the only 4 bit value: 7, 11, 13, 14, 15 */
-      B[M(7)][i]  = B[M(3)][i] ^ B[M(4)][i];
-      B[M(11)][i] = B[M(3)][i] ^ B[M(8)][i];
-      B[M(13)][i] = B[M(1)][i] ^ B[M(12)][i];
-      B[M(14)][i] = B[M(6)][i] ^ B[M(8)][i];
-      B[M(15)][i] = B[M(7)][i] ^ B[M(8)][i];
-   }
-
-   zeromem(tmp, sizeof(tmp));
-
-   /* compute product four bits of each word at a time */
-   /* for each nibble */
-   for (i = (BPD/4)-1; i >= 0; i--) {
-       /* for each word */
-       for (j = 0; j < (int)(WPV-1); j++) {
-        /* grab the 4 bits recall the nibbles are backwards so it's a shift by (i^1)*4 */
-           u = (pB[j] >> ((i^1)<<2)) & 15;
-
-        /* add offset by the word count the table looked up value to the result */
-           for (k = 0; k < (int)WPV; k++) {
-               tmp[k+j] ^= B[u][k];
-           }
-       }
-     /* shift result up by 4 bits */
-       if (i != 0) {
-          for (z = j = 0; j < (int)(32 / sizeof(LTC_FAST_TYPE)); j++) {
-              zz = tmp[j] << (BPD-4);
-              tmp[j] = (tmp[j] >> 4) | z;
-              z = zz;
-          }
-       }
-   }
-
-   /* store product */
-#ifdef ENDIAN_32BITWORD
-   for (i = 0; i < 8; i++) {
-       STORE32H(tmp[i], pTmp + (i<<2));
-   }
-#else 
-   for (i = 0; i < 4; i++) {
-       STORE64H(tmp[i], pTmp + (i<<3));
-   }
+#ifdef LTC_CLEAN_STACK
+   zeromem(&key, sizeof(key));
+   zeromem(T, sizeof(T));
 #endif
-
-   /* reduce by taking most significant byte and adding the appropriate two byte sequence 16 bytes down */
-   for (i = 31; i >= 16; i--) {
-       pTmp[i-16] ^= gcm_shift_table[((unsigned)pTmp[i]<<1)];
-       pTmp[i-15] ^= gcm_shift_table[((unsigned)pTmp[i]<<1)+1];
-   }
-
-   for (i = 0; i < 16; i++) {
-       c[i] = pTmp[i];
-   }
-
 }
 
 #endif
 
-#endif
-
 /* $Source: /cvs/libtom/libtomcrypt/src/encauth/gcm/gcm_gf_mult.c,v $ */
 /* $Revision: 1.25 $ */
 /* $Date: 2007/05/12 14:32:35 $ */
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "tomcrypt.h"
+
+/**
+   @file gcm_ghash.c
+   GCM implementation, GHASH multiplication by a fixed H
+*/
+
+#ifdef LTC_GCM_MODE
+
+#ifdef LTC_GCM_ARM64_CE
+
+#include "tomcrypt_arm_neon.h"
+
+/* Implemented in assembly */
+void gcm_ghash_ce_update(unsigned char *X, const ulong64 *H,
+                         const unsigned char *in, unsigned long blocks);
+
+/**
+  Prepare the hash subkey for the PMULL based multiplication
+  @param key   [out] The GHASH key
+  @param H     The hash subkey (16 octets)
+ */
+void gcm_ghash_setup(gcm_ghash_key *key, const unsigned char *H)
+{
+   ulong64 hi, lo;
+
+   LOAD64H(hi, H);
+   LOAD64H(lo, H + 8);
+
+   /* H * x, absorbs the one bit offset of the reflected PMULL product */
+   key->H[0] = (lo << 1) | (hi >> 63);
+   key->H[1] = (hi << 1) | (lo >> 63);
+   key->H[1] ^= (CONST64(0) - (hi >> 63)) & CONST64(0xc200000000000000);
+}
+
+/**
+  X = (X ^ in[i]) * H for each block of the input
+  @param key     The GHASH key
+  @param X       [in/out] The accumulator (16 octets)
+  @param in      The input blocks
+  @param blocks  The number of 16 octet blocks of the input
+ */
+void gcm_ghash_process(const gcm_ghash_key *key, unsigned char *X,
+                       const unsigned char *in, unsigned long blocks)
+{
+   struct tomcrypt_arm_neon_state state;
+
+   if (!blocks) {
+      return;
+   }
+
+   tomcrypt_arm_neon_enable(&state);
+   gcm_ghash_ce_update(X, key->H, in, blocks);
+   tomcrypt_arm_neon_disable(&state);
+}
+
+/**
+  X = X * H
+  @param key   The GHASH key
+  @param X     [in/out] The value to multiply (16 octets)
+ */
+void gcm_ghash_mult(const gcm_ghash_key *key, unsigned char *X)
+{
+   static const unsigned char zero[16];
+
+   gcm_ghash_process(key, X, zero, 1);
+}
+
+#else
+
+/*
+  Reduction of the four bits shifted out by a multiplication by x^4, to be
+  added to the top 16 bits of the result
+*/
+static const ulong32 gcm_ghash_rem4[16] = {
+   0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+   0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+/**
+  Build the 4-bit multiplication table of the hash subkey (Shoup's method)
+  @param key   [out] The GHASH key
+  @param H     The hash subkey (16 octets)
+ */
+void gcm_ghash_setup(gcm_ghash_key *key, const unsigned char *H)
+{
+   ulong64 hi, lo, carry;
+   int i, j;
+
+   LOAD64H(hi, H);
+   LOAD64H(lo, H + 8);
+
+   /* the bits are reflected: M[8] = H, M[4] = H * x, ... M[1] = H * x^3 */
+   key->M[0][0] = 0;
+   key->M[0][1] = 0;
+   for (i = 8; i > 0; i >>= 1) {
+      key->M[i][0] = hi;
+      key->M[i][1] = lo;
+      carry = lo & 1;
+      lo = (lo >> 1) | (hi << 63);
+      hi = (hi >> 1) ^ ((CONST64(0) - carry) & CONST64(0xe100000000000000));
+   }
+
+   /* the other multiples are sums of those */
+   for (i = 2; i < 16; i <<= 1) {
+      for (j = 1; j < i; j++) {
+         key->M[i + j][0] = key->M[i][0] ^ key->M[j][0];
+         key->M[i + j][1] = key->M[i][1] ^ key->M[j][1];
+      }
+   }
+}
+
+/**
+  X = X * H
+  @param key   The GHASH key
+  @param X     [in/out] The value to multiply (16 octets)
+ */
+void gcm_ghash_mult(const gcm_ghash_key *key, unsigned char *X)
+{
+   ulong64 hi, lo;
+   unsigned n, r;
+   int i;
+
+   hi = 0;
+   lo = 0;
+   /* Horner's rule over the nibbles, from the highest power of x */
+   for (i = 31; i >= 0; i--) {
+      n = (X[i >> 1] >> ((i & 1) ? 0 : 4)) & 15;
+
+      /* Z = Z * x^4 */
+      r  = (unsigned)lo & 15;
+      lo = (lo >> 4) | (hi << 60);
+      hi = (hi >> 4) ^ ((ulong64)gcm_ghash_rem4[r] << 48);
+
+      hi ^= key->M[n][0];
+      lo ^= key->M[n][1];
+   }
+
+   STORE64H(hi, X);
+   STORE64H(lo, X + 8);
+}
+
+/**
+  X = (X ^ in[i]) * H for each block of the input
+  @param key     The GHASH key
+  @param X       [in/out] The accumulator (16 octets)
+  @param in      The input blocks
+  @param blocks  The number of 16 octet blocks of the input
+ */
+void gcm_ghash_process(const gcm_ghash_key *key, unsigned char *X,
+                       const unsigned char *in, unsigned long blocks)
+{
+   int y;
+
+   while (blocks--) {
+      for (y = 0; y < 16; y++) {
+          X[y] ^= in[y];
+      }
+      gcm_ghash_mult(key, X);
+      in += 16;
+   }
+}
+
+#endif /* LTC_GCM_ARM64_CE */
+
+#endif /* LTC_GCM_MODE */
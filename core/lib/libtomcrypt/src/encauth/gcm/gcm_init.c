@@ -89,6 +89,9 @@ int gcm_init(gcm_state *gcm, int cipher,
       return err;
    }
 
+   /* prepare H for the GHASH multiplications */
+   gcm_ghash_setup(&gcm->ghash, gcm->H);
+
    /* setup state */
    zeromem(gcm->buf, sizeof(gcm->buf));
    zeromem(gcm->X,   sizeof(gcm->X));
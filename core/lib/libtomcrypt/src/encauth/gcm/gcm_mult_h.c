@@ -50,8 +50,8 @@
  */
 void gcm_mult_h(gcm_state *gcm, unsigned char *I)
 {
-   unsigned char T[16];
 #ifdef LTC_GCM_TABLES
+   unsigned char T[16];
    int x;
 #ifdef LTC_GCM_TABLES_SSE2
    asm("movdqa (%0),%%xmm0"::"r"(&gcm->PC[0][I[0]][0]));
@@ -74,10 +74,10 @@ void gcm_mult_h(gcm_state *gcm, unsigned char *I)
 #endif /* LTC_FAST */
    }
 #endif /* LTC_GCM_TABLES_SSE2 */
+   XMEMCPY(I, T, 16);
 #else     
-   gcm_gf_mult(gcm->H, I, T); 
+   gcm_ghash_mult(&gcm->ghash, I);
 #endif
-   XMEMCPY(I, T, 16);
 }
 #endif
 
@@ -44,6 +44,100 @@
 
 #ifdef LTC_GCM_MODE
 
+/* Number of counter blocks encrypted per call to accel_ecb_encrypt() */
+#define GCM_BATCH_BLOCKS 8
+
+static void gcm_inc_ctr(unsigned char *Y)
+{
+   int y;
+
+   for (y = 15; y >= 12; y--) {
+       if (++Y[y] & 255) { break; }
+   }
+}
+
+/* X = (X ^ in[i]) * H for each of the blocks */
+static void gcm_ghash_blocks(gcm_state *gcm, const unsigned char *in,
+                             unsigned long nblocks)
+{
+#ifdef LTC_GCM_TABLES
+   int y;
+
+   while (nblocks--) {
+      for (y = 0; y < 16; y++) {
+          gcm->X[y] ^= in[y];
+      }
+      gcm_mult_h(gcm, gcm->X);
+      in += 16;
+   }
+#else
+   gcm_ghash_process(&gcm->ghash, gcm->X, in, nblocks);
+#endif
+}
+
+/*
+  Process full blocks when the cipher has a multi-block ECB routine (for
+  instance the ARMv8 Crypto Extensions AES): the keystream of a batch of
+  blocks is computed in a single call, allowing the cipher to interleave
+  them, then the ciphertext of the batch is folded into the GHASH in a
+  single call too. The ciphertext is hashed from a private copy so that
+  what is authenticated is what was produced or consumed here.
+
+  On entry gcm->buf holds the keystream of the current counter and
+  gcm->buflen is 0, on return the same holds for the next counter.
+*/
+static int gcm_process_blocks(gcm_state *gcm, unsigned char *pt,
+                              unsigned char *ct, unsigned long nblocks,
+                              int direction)
+{
+   unsigned char ctr[GCM_BATCH_BLOCKS][16];
+   unsigned char ks[GCM_BATCH_BLOCKS][16];
+   const unsigned char *k;
+   unsigned long n, x;
+   unsigned char b;
+   int y, err = CRYPT_OK;
+
+   while (nblocks) {
+      n = nblocks < GCM_BATCH_BLOCKS ? nblocks : GCM_BATCH_BLOCKS;
+
+      /* block 0 uses gcm->buf, the last keystream is for the next call */
+      for (x = 0; x < n; x++) {
+          gcm_inc_ctr(gcm->Y);
+          XMEMCPY(ctr[x], gcm->Y, 16);
+      }
+      err = cipher_descriptor[gcm->cipher]->accel_ecb_encrypt(ctr[0], ks[0],
+                                                              n, &gcm->K);
+      if (err != CRYPT_OK) {
+         goto out;
+      }
+
+      for (x = 0; x < n; x++) {
+          k = x ? ks[x - 1] : gcm->buf;
+          for (y = 0; y < 16; y++) {
+              if (direction == GCM_ENCRYPT) {
+                 b = ct[y] = pt[y] ^ k[y];
+              } else {
+                 b = ct[y];
+                 pt[y] = b ^ k[y];
+              }
+              /* the counter block is consumed, keep the hash input */
+              ctr[x][y] = b;
+          }
+          pt += 16;
+          ct += 16;
+      }
+      /* GMAC it */
+      gcm_ghash_blocks(gcm, ctr[0], n);
+      gcm->pttotlen += 128 * n;
+      XMEMCPY(gcm->buf, ks[n - 1], 16);
+      nblocks -= n;
+   }
+
+out:
+   zeromem(ks, sizeof(ks));
+   return err;
+}
+
 /** 
   Process plaintext/ciphertext through GCM
   @param gcm       The GCM state 
@@ -102,8 +196,17 @@ int gcm_process(gcm_state *gcm,
    }
 
    x = 0;
+   if (gcm->buflen == 0 && ptlen >= 16 &&
+       cipher_descriptor[gcm->cipher]->accel_ecb_encrypt != NULL) {
+      if ((err = gcm_process_blocks(gcm, pt, ct, ptlen / 16,
+                                    direction)) != CRYPT_OK) {
+         return err;
+      }
+      x = ptlen & ~15;
+   }
+
 #ifdef LTC_FAST
-   if (gcm->buflen == 0) {
+   if (gcm->buflen == 0 && x == 0) {
       if (direction == GCM_ENCRYPT) { 
          for (x = 0; x < (ptlen & ~15); x += 16) {
              /* ctr encrypt */
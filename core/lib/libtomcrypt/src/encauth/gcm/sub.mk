@@ -2,6 +2,8 @@ srcs-y += gcm_add_aad.c
 srcs-y += gcm_add_iv.c
 srcs-y += gcm_done.c
 srcs-y += gcm_gf_mult.c
+srcs-y += gcm_ghash.c
+srcs-$(CFG_CRYPTO_GCM_ARM64_CE) += gcm_ghash_armv8a_ce_a64.S
 srcs-y += gcm_init.c
 srcs-y += gcm_memory.c
 srcs-y += gcm_mult_h.c
@@ -28,18 +28,18 @@
 #include "tomcrypt_mpa.h"
 #include <mpa.h>
 
-mpa_scratch_mem external_mem_pool;
+static mpa_scratch_mem (*external_mem_pool)(void);
 
-void init_mpa_tomcrypt(const mpa_scratch_mem pool)
+void init_mpa_tomcrypt(mpa_scratch_mem (*get_pool)(void))
 {
-	external_mem_pool = pool;
+	external_mem_pool = get_pool;
 }
 
 
 static int init(void **a)
 {
 	LTC_ARGCHK(a != NULL);
-	if (!mpa_alloc_static_temp_var((mpanum *)a, external_mem_pool))
+	if (!mpa_alloc_static_temp_var((mpanum *)a, external_mem_pool()))
 		return CRYPT_MEM;
 	mpa_set_S32(*a, 0);
 	return CRYPT_OK;
@@ -49,7 +49,7 @@ static int init_size(int size_bits, void **a)
 {
 	LTC_ARGCHK(a != NULL);
 	if (!mpa_alloc_static_temp_var_size(size_bits, (mpanum *)a,
-					    external_mem_pool))
+					    external_mem_pool()))
 		return CRYPT_MEM;
 	mpa_set_S32(*a, 0);
 	return CRYPT_OK;
@@ -59,7 +59,7 @@ static void deinit(void *a)
 {
 	LTC_ARGCHKVD(a != NULL);
 
-	mpa_free_static_temp_var((mpanum *) &a, external_mem_pool);
+	mpa_free_static_temp_var((mpanum *) &a, external_mem_pool());
 }
 
 static int neg(void *a, void *b)
@@ -264,7 +264,7 @@ static int add(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_add((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_add((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -275,7 +275,7 @@ static int addi(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_add_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_add_word((mpanum) c, (const mpanum) a, b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -285,7 +285,7 @@ static int sub(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_sub((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_sub((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -296,7 +296,7 @@ static int subi(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_sub_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_sub_word((mpanum) c, (const mpanum) a, b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -306,7 +306,7 @@ static int mul(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_mul((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mul((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -317,7 +317,7 @@ static int muli(void *a, unsigned long b, void *c)
 	if (b > (unsigned long) UINT32_MAX) {
 		return CRYPT_INVALID_ARG;
 	}
-	mpa_mul_word((mpanum) c, (const mpanum) a, b, external_mem_pool);
+	mpa_mul_word((mpanum) c, (const mpanum) a, b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -326,7 +326,7 @@ static int sqr(void *a, void *b)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
-	mpa_mul((mpanum) b, (const mpanum) a, (const mpanum) a, external_mem_pool);
+	mpa_mul((mpanum) b, (const mpanum) a, (const mpanum) a, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -335,7 +335,7 @@ static int divide(void *a, void *b, void *c, void *d)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
-	mpa_div(c, d, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_div(c, d, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -377,7 +377,7 @@ static int gcd(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_gcd((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_gcd((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -407,9 +407,9 @@ static int mod(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
-	mpa_mod((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mod((mpanum) c, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	if (mpa_cmp_short(c, 0) < 0) {
-		mpa_add(c, c, b, external_mem_pool);
+		mpa_add(c, c, b, external_mem_pool());
 	}
 	return CRYPT_OK;
 }
@@ -426,7 +426,7 @@ static int mulmod(void *a, void *b, void *c, void *d)
 
 	mod(a, c, tmpa);
 	mod(b, c, tmpb);
-	mpa_mul_mod((mpanum) d, (const mpanum) tmpa, (const mpanum) tmpb, (const mpanum) c, external_mem_pool);
+	mpa_mul_mod((mpanum) d, (const mpanum) tmpa, (const mpanum) tmpb, (const mpanum) c, external_mem_pool());
 	mp_clear_multi(tmpa, tmpb, NULL);
 	return CRYPT_OK;
 }
@@ -447,26 +447,42 @@ static int invmod(void *a, void *b, void *c)
 	LTC_ARGCHK(c != NULL);
 	LTC_ARGCHK(b != c);
 	mod(a, b, c);
-	if (mpa_inv_mod((mpanum) c, (const mpanum) c, (const mpanum) b, external_mem_pool) != 0) {
+	if (mpa_inv_mod((mpanum) c, (const mpanum) c, (const mpanum) b, external_mem_pool()) != 0) {
 		return CRYPT_ERROR;
 	}
 
 	return CRYPT_OK;
 }
 
+/*
+ * Montgomery context. For the NIST P-256 and P-384 primes the ECC code
+ * gets a normalization value of one and montgomery_reduce() does a plain
+ * fast reduction modulo p instead, see mpa_nist.c
+ */
+struct mont_ctx {
+	int nist_prime;
+	mpa_fmm_context fmm;
+};
+
 /* setup */
 static int montgomery_setup(void *a, void **b)
 {
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	mpa_word_t len = mpa_fmm_context_size_in_U32(count_bits(a));
-	*b = malloc(len * sizeof(mpa_word_t));
-	if (*b == NULL) {
+	struct mont_ctx *ctx;
+
+	ctx = malloc(sizeof(*ctx) + len * sizeof(mpa_word_t));
+	if (ctx == NULL) {
 		return CRYPT_MEM;
 	}
-	mpa_fmm_context_base * b_tmp = (mpa_fmm_context_base *) *b;
-	mpa_init_static_fmm_context(b_tmp, len);
-	mpa_compute_fmm_context((const mpanum) a, b_tmp->r_ptr, b_tmp->r2_ptr, &(b_tmp->n_inv), external_mem_pool);
+	ctx->nist_prime = mpa_nist_prime((const mpanum) a);
+	ctx->fmm = (mpa_fmm_context)(ctx + 1);
+	mpa_init_static_fmm_context(ctx->fmm, len);
+	mpa_compute_fmm_context((const mpanum) a, ctx->fmm->r_ptr,
+				ctx->fmm->r2_ptr, &ctx->fmm->n_inv,
+				external_mem_pool());
+	*b = ctx;
 	return CRYPT_OK;
 }
 
@@ -476,9 +492,14 @@ static int montgomery_normalization(void *a, void *b)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	mpa_asize_t s;
+
+	if (mpa_nist_prime((const mpanum) b)) {
+		mpa_set_S32((mpanum) a, 1);
+		return CRYPT_OK;
+	}
 	s = __mpanum_size((mpanum) b);
 	twoexpt(a, s * MPA_WORD_SIZE);
-	mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, external_mem_pool);
+	mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, external_mem_pool());
 	return CRYPT_OK;
 }
 
@@ -488,21 +509,33 @@ static int montgomery_reduce(void *a, void *b, void *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
+	struct mont_ctx *ctx = c;
 	mpanum tmp;
+
+	if (ctx->nist_prime) {
+		if (!mpa_nist_mod((mpanum) a, (const mpanum) a,
+				  ctx->nist_prime))
+			return CRYPT_OK;
+	} else {
+		if (!mpa_montgomery_reduce((mpanum) a, (const mpanum) a,
+					   (const mpanum) b, ctx->fmm->n_inv,
+					   external_mem_pool()))
+			return CRYPT_OK;
+	}
+
+	/* a is negative or too large, reduce it first */
+	mod(a, b, a);
+	if (ctx->nist_prime)
+		return CRYPT_OK;
 	if (init((void **)&tmp) != CRYPT_OK) {
 		return CRYPT_MEM;
 	}
-	// WARNING
-	//  Workaround for a bug when a > b (a greater than the modulus)
-	if (compare(a, b) == LTC_MP_GT) {
-		mpa_mod((mpanum) a, (const mpanum) a, (const mpanum) b, external_mem_pool);
-	}
 	mpa_montgomery_mul(tmp,
 			(mpanum) a,
 			mpa_constant_one(),
 			(mpanum) b,
-			((mpa_fmm_context) c)->n_inv,
-			external_mem_pool);
+			ctx->fmm->n_inv,
+			external_mem_pool());
 	mpa_copy(a, tmp);
 	deinit(tmp);
 	return CRYPT_OK;
@@ -520,8 +553,8 @@ static int exptmod(void *a, void *b, void *c, void *d)
 	LTC_ARGCHK(b != NULL);
 	LTC_ARGCHK(c != NULL);
 	LTC_ARGCHK(d != NULL);
-	void *c_mont;
-	if (montgomery_setup(c, &c_mont) != CRYPT_OK) {
+	struct mont_ctx *c_mont;
+	if (montgomery_setup(c, (void **)&c_mont) != CRYPT_OK) {
 		return CRYPT_MEM;
 	}
 
@@ -548,10 +581,10 @@ static int exptmod(void *a, void *b, void *c, void *d)
 			(const mpanum) d_tmp,
 			(const mpanum) b,
 			(const mpanum) c,
-			((mpa_fmm_context)c_mont)->r_ptr,
-			((mpa_fmm_context)c_mont)->r2_ptr,
-			((mpa_fmm_context)c_mont)->n_inv,
-			external_mem_pool);
+			c_mont->fmm->r_ptr,
+			c_mont->fmm->r2_ptr,
+			c_mont->fmm->n_inv,
+			external_mem_pool());
 	montgomery_deinit(c_mont);
 	if (memguard) {
 		deinit(d_tmp);
@@ -564,7 +597,7 @@ static int isprime(void *a, int b, int *c)
 	LTC_ARGCHK(a != NULL);
 	LTC_ARGCHK(c != NULL);
 	LTC_UNUSED_PARAM(b);
-	*c = mpa_is_prob_prime((mpanum) a, 100, external_mem_pool) != 0 ? LTC_MP_YES : LTC_MP_NO;
+	*c = mpa_is_prob_prime((mpanum) a, 100, external_mem_pool()) != 0 ? LTC_MP_YES : LTC_MP_NO;
 	return CRYPT_OK;
 }
 
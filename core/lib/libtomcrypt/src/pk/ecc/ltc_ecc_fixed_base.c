@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Implements ECC over Z/pZ for curve y^2 = x^3 - 3x + b
+ *
+ * All curves taken from NIST recommendation paper of July 1999
+ * Available at http://csrc.nist.gov/cryptval/dss.htm
+ */
+#include "tomcrypt.h"
+
+/**
+  @file ltc_ecc_fixed_base.c
+  ECC Crypto, fixed base point multiplication with comb tables
+*/
+
+#if defined(LTC_MECC) && defined(LTC_ECC_FIXED_BASE)
+
+/*
+ * Lim-Lee comb: the scalar is cut in ECC_COMB_TEETH rows of d bits and
+ * column j of the rows selects one of the precomputed points
+ * sum(bit_i * 2^(i * d) * G). kG is then found with d doublings and d
+ * additions instead of one doubling and one addition per scalar bit.
+ *
+ * The tables hold the points in affine coordinates, as big endian 32-bit
+ * words, and were computed offline.
+ */
+#define ECC_COMB_TEETH      5
+#define ECC_COMB_POINTS     ((1 << ECC_COMB_TEETH) - 1)
+#define ECC_COMB_MAX_WORDS  12
+
+static const ulong32 comb_p256[ECC_COMB_POINTS][2][8] = {
+   { { 0x6b17d1f2, 0xe12c4247, 0xf8bce6e5, 0x63a440f2,
+       0x77037d81, 0x2deb33a0, 0xf4a13945, 0xd898c296 },
+     { 0x4fe342e2, 0xfe1a7f9b, 0x8ee7eb4a, 0x7c0f9e16,
+       0x2bce3357, 0x6b315ece, 0xcbb64068, 0x37bf51f5 } },
+   { { 0x54ccc941, 0x5026d73f, 0x20a845b7, 0x2a58e5b1,
+       0x8bd27f19, 0x8542a0be, 0xeea6bc92, 0x071e5c83 },
+     { 0x1c433f45, 0xb4514532, 0x3a8f8715, 0xdad2bf22,
+       0x929e0bcc, 0x5d8ee496, 0xcfd08ef7, 0x140916a1 } },
+   { { 0x3cfa0f87, 0x297bed02, 0xdfcc2358, 0xf94c9d1d,
+       0x593a09a0, 0x3a23c6ab, 0xf7d24bb7, 0x04bac870 },
+     { 0xe4e37694, 0x70be12c6, 0xa758aa80, 0x8309af9b,
+       0x62121c0d, 0x0248a8af, 0xce98a30b, 0x40f26940 } },
+   { { 0x7ef2ee3c, 0x5c792a0c, 0x0fef6335, 0x224d9428,
+       0xa7d2c98f, 0x6743333e, 0xc739a5ea, 0x3ecca7e0 },
+     { 0xafb68627, 0x30acc011, 0xa4f67f51, 0xd5e609db,
+       0x81b21450, 0xdfbd3d20, 0x302b22dd, 0x552ac094 } },
+   { { 0xd6690337, 0x6df0fd5e, 0x28fe9a4f, 0x254c5491,
+       0xf6d77c27, 0x088b86db, 0xdd37e3ff, 0x86ef7d7d },
+     { 0x20e2a53c, 0xe6d13d22, 0xa13e9578, 0xdf074167,
+       0xf3d1a7af, 0x9e4373f9, 0x9ff04992, 0xaddad596 } },
+   { { 0xb666fac5, 0xb77e46e9, 0x276203c2, 0x12f01e9e,
+       0xa424ec2d, 0xbe3c7265, 0xd7b86aee, 0xb0879605 },
+     { 0x38aaa380, 0x90246904, 0xeb5abc19, 0xee3de5a9,
+       0xef46a44a, 0x726cd8b6, 0xf431bb1a, 0x3bf0c52d } },
+   { { 0x621c75d1, 0x02eadb2e, 0xdb82b3ea, 0x544920a4,
+       0xc302f8f4, 0x96bea25a, 0xaebfd735, 0x525d6abf },
+     { 0xd7c4a4fe, 0xb4fa649d, 0x4fdac96f, 0x522d7f70,
+       0x225d03d8, 0x57c46d63, 0x8939dc4c, 0x9ef485f0 } },
+   { { 0x0d2bf28b, 0xa7c2a51a, 0x90f573a8, 0x2589f18e,
+       0x07e50ab0, 0x1786df70, 0x9c762ef1, 0x943e832a },
+     { 0x0cac3f43, 0x13bd00ac, 0x7087a10a, 0x94b4e7ed,
+       0x27ec9db9, 0x60551446, 0x48263af1, 0x5b20d37c } },
+   { { 0x00dc46e7, 0xc99a739d, 0x9f05f94a, 0x8c267d88,
+       0xf7659958, 0xedd9583f, 0x8bc659aa, 0xc0b9372a },
+     { 0x0312a557, 0x45793424, 0x40d1e3ab, 0x5228c111,
+       0xb5eb202d, 0x8156bf6a, 0x4af50a00, 0xdf55d0f2 } },
+   { { 0x3c510ce2, 0x882a7892, 0x867c5580, 0x08dcd7ab,
+       0xc8a820bd, 0x1c7522c0, 0x9d90cda8, 0x9e6486e0 },
+     { 0xd35e620f, 0x5acf053f, 0xc3a7fc08, 0x5ba997b0,
+       0x33392776, 0xeda4e046, 0x0e283334, 0x646d54c6 } },
+   { { 0x3c53e290, 0x15b0a1e5, 0x76347a52, 0x84e32e59,
+       0x05e3f223, 0x0d8c013d, 0x8d9692f7, 0x7eb8cfee },
+     { 0xd30e7cda, 0x140efeb3, 0x11a9f072, 0x9a08693f,
+       0x1b9f1bd1, 0x00d23591, 0x538b7da5, 0xfae798d4 } },
+   { { 0x02fd7b73, 0x29c2024d, 0x39f9ff69, 0xb96b9911,
+       0xbfed14fe, 0xdad210d5, 0x81dec926, 0x4dd6c004 },
+     { 0x42ebd3cb, 0x59927df3, 0x00f34add, 0xc7797831,
+       0xb682b999, 0x0c236311, 0x50cfceb8, 0x715d29fc } },
+   { { 0xed84bb42, 0x5fe39aad, 0xfd426d94, 0x2df232cf,
+       0x13d72b7a, 0x3f7fbe90, 0x6dfcf787, 0xf8e8f683 },
+     { 0xa3233455, 0x583c33f2, 0x0cf83b61, 0x97a1d703,
+       0x67dd0a8e, 0x355430e3, 0x023e67a1, 0x732995fc } },
+   { { 0x9e9889bc, 0xd449242d, 0x6745ff87, 0x7009b958,
+       0xfb500882, 0x00cfa617, 0x27014ab4, 0x68142904 },
+     { 0xd9ba5b68, 0x7e79b3a2, 0x94c0d24b, 0x292e6aa0,
+       0x00855156, 0x138e99e2, 0x035b613b, 0x575616c8 } },
+   { { 0x95e18452, 0x66382ada, 0xb31d2353, 0x1b4d0d1f,
+       0x50cc51c1, 0x8a4eee61, 0xcebbbc7b, 0x5f165d99 },
+     { 0x68d68c8f, 0x6b0fb8f3, 0x3eaa8289, 0x1f4fa12f,
+       0xa0a2a96e, 0x4142ff0f, 0xacad4f81, 0x0a839b5b } },
+   { { 0x55d5398d, 0x1666432b, 0x557582c9, 0x9ad53458,
+       0x0101fb06, 0xa050e62c, 0x320f09c3, 0x839bb85f },
+     { 0x576e2290, 0x49ff8e2d, 0x059c6a9e, 0x8ebaa72a,
+       0xd90d6a7f, 0x1833d9e1, 0xf7f63118, 0x4fed936f } },
+   { { 0x54e244d5, 0x101e5de4, 0x9d3dc334, 0x6beccbb9,
+       0xe80f26bd, 0x8d0f4f65, 0x9311a269, 0x51bbb3f1 },
+     { 0xd6bbec0e, 0xec106eb6, 0x19bd4107, 0x35df9c25,
+       0x4334fbc0, 0x58c2e3b7, 0xb3ad4c6e, 0xf1b19e28 } },
+   { { 0x443737cd, 0x3c00736b, 0xf1c05d98, 0x4a8cb46e,
+       0x12839b95, 0xf179327b, 0x788251c7, 0xe5046dc5 },
+     { 0x83719dd7, 0xe6fe7af5, 0xc56eb80a, 0xf42c23e8,
+       0x797489de, 0x0817bdd9, 0xa760a456, 0x12cd8fe5 } },
+   { { 0xee0816a3, 0xd4d021b6, 0x10b37ecd, 0x771e4688,
+       0xaea3c9e0, 0xb9b5290b, 0xe8881a83, 0x3fefcfc8 },
+     { 0xc4a438e3, 0xad9006e1, 0x3a5fdf82, 0xdb49019f,
+       0x48915dcf, 0xc105f2d1, 0x8e9929bf, 0xb3a8caa1 } },
+   { { 0xdb96bb0c, 0x7853a937, 0x301ba1b2, 0x32acf105,
+       0xd7420c18, 0xd91ecb2e, 0x5db9620f, 0x87de4b29 },
+     { 0xb325074e, 0x7a13222c, 0x3fbee4d3, 0xb9da1717,
+       0xab80cef0, 0x64852a1d, 0xd84bfef6, 0xc359ac34 } },
+   { { 0x8699dd31, 0xe09cb9f0, 0x552788ac, 0xcbd21e33,
+       0xca9f7a1d, 0xaed035be, 0x5d6dc503, 0xe83ad2c9 },
+     { 0x16e65484, 0xe92859b7, 0x24199908, 0xc72c78c1,
+       0x4cb20e96, 0xb82a5af9, 0x38584196, 0x329bf961 } },
+   { { 0xeec0b975, 0x2cc67214, 0x4a759982, 0x16c1da96,
+       0x6c897123, 0x0031dbb4, 0x6a201c4b, 0x052fde29 },
+     { 0xe02af770, 0xf7f1d283, 0x789d664b, 0xf966f329,
+       0x367fb66a, 0x8439f6ba, 0xb908b9f1, 0x812c864e } },
+   { { 0x186c7f79, 0x3df3245e, 0xc9b97d37, 0x4b600b83,
+       0x5f0b46d5, 0xe99d5c7c, 0xa20a2c70, 0xdb3038dd },
+     { 0x9c428db8, 0x9ab58913, 0x8139b36a, 0x8d2ea797,
+       0x9249897f, 0x91e2d8ed, 0x2af72460, 0x4f1ce57f } },
+   { { 0xee2280f4, 0x4e33a65d, 0x7afccc8a, 0x295b57d2,
+       0xdcbab650, 0x1b6b9730, 0xb4a196fb, 0x6471aaa0 },
+     { 0xce46ec91, 0xa6a1eb84, 0x0d598f06, 0xed5fbbd2,
+       0x4e98a98d, 0x82604f6b, 0xc47a0803, 0x890fcd12 } },
+   { { 0xc62e155c, 0x58a5f263, 0x5bc5341e, 0x271a93f1,
+       0x5f72cc22, 0x595e6547, 0x1f1e4f3f, 0x4be6458d },
+     { 0xff9f2322, 0x18267e4e, 0xd33a7657, 0xeeaa4d04,
+       0x67e1f7dc, 0x7e36a6ad, 0x5f6f845a, 0x58ba7ff4 } },
+   { { 0xa0318a5f, 0x32f6e514, 0xa0e8f0a7, 0x0baba29a,
+       0xc7876fb6, 0x3696b437, 0xd369f11f, 0x4a53789f },
+     { 0xf320b8fc, 0xf0eebb3a, 0xfd08903f, 0x09a325aa,
+       0x418c507c, 0x362eebb1, 0x5c4a43d1, 0x11775a08 } },
+   { { 0x5e677d0c, 0x959c44fa, 0xa4486916, 0xf4646f9f,
+       0x4030ecc3, 0xbb9002d8, 0xe33f0255, 0xc7644c1d },
+     { 0x449f0ce6, 0x3100d31e, 0xe33d0bd5, 0x02993aea,
+       0x5d93a86f, 0x6248f91f, 0xe2e7d7d0, 0xd88b9144 } },
+   { { 0x8c568874, 0x5a7941e4, 0x9011091d, 0x3067791f,
+       0x34ca923b, 0xa6d0afc7, 0x3fcd925a, 0x73cf2678 },
+     { 0xfb3a48b1, 0x5bad14d2, 0xf2ddb693, 0xe88c6420,
+       0x7744316b, 0x595c51f4, 0x34d37180, 0xfc339800 } },
+   { { 0xe4da88e9, 0x93d0cb92, 0x2a849471, 0xa591f853,
+       0x68c0cd44, 0x3127354c, 0x52df1588, 0xfdaab256 },
+     { 0xf7fa4d15, 0x10062e80, 0x97fc50de, 0xd0f3bc51,
+       0x60fe2a36, 0x263707ba, 0x6d1ea35d, 0x1639c624 } },
+   { { 0x4b59253a, 0xf9c13de7, 0xb58a6071, 0xe639ec09,
+       0xb6c935fb, 0x3feaa272, 0xc429a113, 0x024c168d },
+     { 0xaa0307bf, 0x7fa79c93, 0xe85d7820, 0x01f185f5,
+       0xf0064c12, 0x50723fe2, 0x6d2d68f2, 0xfbfb8955 } },
+   { { 0x825f0194, 0x8e831d5b, 0x76c4c180, 0x4286fb42,
+       0x1a2530b0, 0x5a00169c, 0x2e75a266, 0x5b696527 },
+     { 0x435872fe, 0xbc723a17, 0x61794c4f, 0x24111150,
+       0x106f9bc4, 0xce5b106a, 0xdbf0a11f, 0xef703739 } },
+};
+
+static const ulong32 comb_p384[ECC_COMB_POINTS][2][12] = {
+   { { 0xaa87ca22, 0xbe8b0537, 0x8eb1c71e, 0xf320ad74,
+       0x6e1d3b62, 0x8ba79b98, 0x59f741e0, 0x82542a38,
+       0x5502f25d, 0xbf55296c, 0x3a545e38, 0x72760ab7 },
+     { 0x3617de4a, 0x96262c6f, 0x5d9e98bf, 0x9292dc29,
+       0xf8f41dbd, 0x289a147c, 0xe9da3113, 0xb5f0b8c0,
+       0x0a60b1ce, 0x1d7e819d, 0x7a431d7c, 0x90ea0e5f } },
+   { { 0xfdff5d78, 0xe52e83a1, 0xb2128765, 0x415b4393,
+       0x6ad56435, 0x05f1dbe9, 0xe8e8a314, 0x685cb49e,
+       0x8bb26b1f, 0x0baff67e, 0x214a5541, 0x574a2d7a },
+     { 0x4db0bc42, 0x7857aa4c, 0x13f5d41f, 0xf10b944a,
+       0x00377f99, 0x5963c951, 0xef01a9d8, 0xdd2d7ec4,
+       0xdcc72e10, 0xd4d391b8, 0xe715e976, 0x978e2b11 } },
+   { { 0x5e54d953, 0x0fdd804e, 0x492ecebd, 0x3eee915b,
+       0x0a9b91bd, 0x21ad8066, 0xa9d5e399, 0xeaac9420,
+       0x8244132b, 0x8547e6b6, 0x4df624db, 0x8e8cf6bd },
+     { 0x4a3d7763, 0x4ba24bc0, 0xb5e534ac, 0x0e8131d0,
+       0x5009a4b4, 0x95821b09, 0x6f98b352, 0x89a66c33,
+       0xf66d7125, 0x42727fd7, 0x44288c00, 0xcc5a43b2 } },
+   { { 0x2913d4eb, 0x34cb8fa1, 0xcd958f85, 0x7f52c6e5,
+       0x0e63f460, 0x50feaf12, 0xcf1df4fd, 0xc30bd659,
+       0x6cc28a6c, 0xca52b096, 0xd490b021, 0xe0bde8c2 },
+     { 0x047b885f, 0x5a14ffb1, 0xa5cce5a0, 0x7765a132,
+       0x27855d53, 0x7603fd5f, 0x2d48722e, 0xb3bb7da7,
+       0xb47f863a, 0xb1a874d8, 0xcbf987e9, 0xb083dcb0 } },
+   { { 0xd23b746b, 0x6aa71294, 0xd96204e4, 0xb7fd6664,
+       0x274e6260, 0x4b047385, 0xd50a0ac4, 0x1f2ccd66,
+       0x66004ec3, 0xd26c55b2, 0x3311ec54, 0x931694d6 },
+     { 0xe2f2cda7, 0x0169076a, 0x5f348f1d, 0x09a71ba8,
+       0x2786bd19, 0xb89d3090, 0xc5be101d, 0xaa3aec73,
+       0x47709b8e, 0xbe780847, 0x9a7231a7, 0x46b64add } },
+   { { 0xe9fb6a4d, 0xf5d93f24, 0x0fd7fc38, 0xe672c579,
+       0x50359755, 0xadba7324, 0xe7ea29a0, 0xb6f8c073,
+       0xcc589514, 0xa526f3f5, 0x0db699e4, 0x12d256e1 },
+     { 0x52ad7c38, 0xe51210f9, 0xeab70ffa, 0xd171104b,
+       0x6f5424a9, 0x66f0cd5a, 0x6c24c094, 0xdbdbae3d,
+       0x6e7107bd, 0x1de052be, 0x9103b778, 0x910a0fb5 } },
+   { { 0xb769b0be, 0xda1c1669, 0xd0472dd3, 0xd094b6a7,
+       0x5fc113e8, 0xdc50393c, 0xd6beaeb6, 0xc81ee126,
+       0xf04ba246, 0xf8ee3f37, 0x70cb8a4c, 0x1a465ee0 },
+     { 0x4fe542b9, 0xebaad0a2, 0x81d51b7f, 0xd415e1ca,
+       0xa2415911, 0x8b36d601, 0xb9c04f16, 0x284569c0,
+       0xde0aed5e, 0x96beeec6, 0x772481fa, 0x4157bca1 } },
+   { { 0xa8eb2114, 0x004241bd, 0x8b5d4209, 0x8ae7d58b,
+       0xc35a94e6, 0xac1b02f4, 0xcb538303, 0xfaac375a,
+       0xbd5059c9, 0x036afb3b, 0xcb610182, 0xa93c10a7 },
+     { 0xabb60ce6, 0x105529ba, 0x2c4382ff, 0xa2675d24,
+       0x89b18aed, 0x0ea77d12, 0x0adae8a9, 0xfab6be4d,
+       0xc6d2bcdf, 0x31306b48, 0xaa3c554a, 0x262fac2c } },
+   { { 0xa41ceb96, 0x5b46960b, 0x59bdb661, 0x79a8b5ab,
+       0x22bb9f3b, 0x4de7b0b3, 0x5fdc0c0f, 0xba5328e9,
+       0x4ee49986, 0xc58b999a, 0x7ffaf718, 0xedf8c996 },
+     { 0xc6e94cf8, 0x10e28346, 0x785cb625, 0xe5efaad0,
+       0x2cfe484d, 0x82edff44, 0x985159d4, 0x725e981d,
+       0x1682f977, 0x5546575d, 0xf95fd896, 0x673f565b } },
+   { { 0xc7fa7869, 0xeac69987, 0x9befb795, 0xa15af7c1,
+       0x907e97ba, 0xa506b01a, 0xdf363e09, 0x4ab1fb6e,
+       0xd8503095, 0x62a76a5b, 0xcfa78fcc, 0xe79fc953 },
+     { 0x9d434dbe, 0x0a61cdf5, 0x87519b7f, 0x43fc91f8,
+       0x306c8470, 0xf87f9262, 0xb37cc365, 0xaee80fb9,
+       0xb0917d3b, 0x2e6d0fb8, 0xde4d11b2, 0x1c404fe9 } },
+   { { 0x81c02c3e, 0xda05de0c, 0xc778ef62, 0x87f81db5,
+       0xc8a16564, 0xced42ab2, 0xa1344ad0, 0x164a20f6,
+       0x60fd2ceb, 0xac820a90, 0x49bf609f, 0xb33139e7 },
+     { 0x1ce0028a, 0x4c3ef2d3, 0x0c345297, 0x69cb4b1d,
+       0x46a2a12d, 0xc42f9a8e, 0x9ddad413, 0xa9ce292c,
+       0x8bf310b1, 0x90e31340, 0x924d0e64, 0xc17d28b9 } },
+   { { 0xa7208e9d, 0xa9cea0c5, 0x644e97b7, 0x5f27c64a,
+       0xb18e9e73, 0x53740ec9, 0x8b6136dd, 0x225a3dd1,
+       0xcdc53530, 0xde8d2145, 0x7b2ea237, 0x4484249f },
+     { 0x65be9e50, 0x335d77b6, 0x74a95c5b, 0x2cb2ec36,
+       0xae719373, 0x11cf7c4b, 0xbcc87131, 0x1f068fb5,
+       0x1deba7f3, 0x57c5f037, 0x6bb544bd, 0xa48b98ec } },
+   { { 0x714398bb, 0x6579d248, 0xf696c756, 0xb978fa06,
+       0x5c01a2be, 0xf7215966, 0x7171c038, 0xad2ad161,
+       0xedd5f953, 0x51d144a0, 0xf9a6e7f2, 0xb2319168 },
+     { 0x6545aa51, 0xa4b5d7b8, 0x8701f645, 0xe17f0476,
+       0x54ac28c5, 0x90cd7784, 0x7f0c9f34, 0xd6ee937e,
+       0x818b42b4, 0xff0c1846, 0x4ade5706, 0xab1fb325 } },
+   { { 0xf4b35b77, 0xcc281c52, 0xc747f85f, 0xbeb9f7af,
+       0x40371dc1, 0x7654c263, 0xaae46b81, 0x4644dbc4,
+       0xdf312f51, 0x9cb06473, 0x880f880f, 0x775226d6 },
+     { 0x33e139ef, 0xf07414d3, 0x047bbcf0, 0x120328ce,
+       0xd2d86e75, 0xe1b6365e, 0x28cf7bc3, 0xfd212d3f,
+       0x51537ca3, 0xfbf5433b, 0x28ec4ac0, 0x8c15e275 } },
+   { { 0xa49b602c, 0x54dbfc48, 0xd6958c1e, 0x60969a97,
+       0xc62df637, 0x4d83e11c, 0x6be08d5d, 0x1b5076c2,
+       0xcb5357ba, 0x5382ed59, 0xe2a2f4fc, 0xcb38e86d },
+     { 0x7e1d2f2e, 0xb5cf54d1, 0x9f5e1fe2, 0x17a818f2,
+       0xb8e8ca59, 0xa75f0046, 0x0adcd952, 0x00644d20,
+       0xb4bc64c9, 0xaa211719, 0xfb97d2ee, 0x51914bca } },
+   { { 0x5b4e8b1d, 0x9e9bf4d9, 0x1470159c, 0x993d3a02,
+       0xb13228b1, 0xe8a1a2a3, 0xdb6a4d39, 0x8f1546be,
+       0x7ad2a60b, 0xff7003c6, 0x3992d2a1, 0x31e76220 },
+     { 0xc3742094, 0xd5476d33, 0xbb844df2, 0x22c74609,
+       0x8727088a, 0x37a9b579, 0xf650285a, 0xc8a2265b,
+       0xe0781a9d, 0x3df1dfe2, 0x6fcb85e9, 0x0cd001d1 } },
+   { { 0xaa0e19aa, 0x44b8bf68, 0x7d81f68f, 0xdaf8aa6c,
+       0xa8782b8e, 0xba440754, 0xce254cfd, 0x853cb459,
+       0x5130bde7, 0xb6b90f17, 0x79fe2465, 0x1e060165 },
+     { 0x65db0b8a, 0xcb3c35a3, 0xc4750753, 0x154ec895,
+       0xd986b357, 0xca81498e, 0x7a282a2a, 0x131c050d,
+       0x8f1b7d25, 0x4e9fea80, 0x6e3ee96f, 0x2664a487 } },
+   { { 0x396b35a9, 0x3d0a9f44, 0xb327638e, 0xcca3b289,
+       0xb92110a3, 0xff3c56ce, 0xd87272f9, 0x4615ce5f,
+       0xbf5777fa, 0x91aee266, 0x4ac90b15, 0xce9499eb },
+     { 0xccd5df68, 0x021460ca, 0x16dd93b9, 0xa5b4cd7a,
+       0xa3c20977, 0x071dde46, 0xd7e221ed, 0xb843cde9,
+       0x44242d55, 0x3f9aa00a, 0x0dad5514, 0x8ad619ef } },
+   { { 0x5b6478b4, 0xc82a64c1, 0xdabb8957, 0x88492cb7,
+       0x2d31795f, 0x7f08eba2, 0xc0fe28de, 0x6ba2d13c,
+       0xe917b31c, 0x394fe427, 0x1d21128b, 0x6a570f04 },
+     { 0x0ae3337f, 0x7e9cc15b, 0x7093124c, 0x7b50f818,
+       0xacbb2ddc, 0xae07e0e5, 0xb38d3c11, 0x95033367,
+       0x552992d1, 0x217d14f8, 0x5d14f518, 0xcd430e4c } },
+   { { 0xdd790987, 0xd93c74a3, 0xdea8f23f, 0x89e66c63,
+       0xfb435379, 0xd299bc0d, 0x8d18ab7d, 0x7c632779,
+       0x4feb246b, 0x20e83e0d, 0x505f49ba, 0x428e5500 },
+     { 0xabad1376, 0x41e36869, 0x4f465f5f, 0x4569d2d3,
+       0x52d2575d, 0x105393d3, 0x4e1bb75c, 0x80c84b38,
+       0xff4caa4a, 0x677f9849, 0xa9ac8f10, 0x4b79adf6 } },
+   { { 0x8c9010d0, 0xdf1822b5, 0x26db96af, 0xfd1f7c82,
+       0x73c30bf5, 0x2857a9d5, 0x45e5b481, 0x91aea8c6,
+       0x53316ed1, 0x08e114ae, 0xb8566746, 0xeb3f72ed },
+     { 0xa44ad979, 0xd610b66b, 0xd9365cd7, 0x070a6e08,
+       0x664833bc, 0x1b71b3bd, 0x1298b738, 0x34cd1bdd,
+       0xa3a48c9f, 0x6a02c7cd, 0x246624ab, 0x20428d3d } },
+   { { 0x15c31cd6, 0x4f1d0704, 0xd5b17cec, 0x235c94e5,
+       0xf90dad22, 0x8506370b, 0x6507bbc3, 0x4ff222d2,
+       0x5883b4be, 0xc9196d36, 0xcc174eb1, 0xa6690fc0 },
+     { 0x92504aad, 0xb57a14dd, 0x64b1d3aa, 0x9277f031,
+       0x1cb6aade, 0x53ff8f7f, 0xfb14b0b9, 0x68c5d526,
+       0x30ca9241, 0x23632198, 0xa45e13e0, 0x83692e96 } },
+   { { 0x79baefe3, 0xea9d8eeb, 0x644657cd, 0x24dbdacc,
+       0x386cab94, 0xd3432743, 0xc632ef51, 0x67e331a8,
+       0xaba60a2b, 0xbc1b0886, 0xa651a249, 0x6f824a23 },
+     { 0xc33e942e, 0xc07ab981, 0x86116d31, 0xfd91b733,
+       0x54376ae2, 0x43b94872, 0xcc7c468d, 0xc625d47f,
+       0xc72c67d5, 0xb5552550, 0xce100b59, 0x7c0022a9 } },
+   { { 0x05e6b0a8, 0x4b8a03ba, 0xe9825aac, 0xe63b581e,
+       0x9f03a529, 0xb683d1db, 0x9187e8d4, 0xaa71be85,
+       0x4b2e6511, 0xef64936e, 0x7e0181b9, 0xc1a90c5b },
+     { 0xcc813d19, 0x80453061, 0xa152690c, 0x3b950770,
+       0x6e6a6097, 0xa645ca8f, 0x1e7b1e07, 0x9787c6ae,
+       0x2dda27d3, 0x7ccadf9d, 0x61907c78, 0xf3938636 } },
+   { { 0xb2a0c449, 0x37393d29, 0x177d47c6, 0xbcb04838,
+       0xde1f971d, 0xe7e95f9a, 0x092b8073, 0xcf05440b,
+       0x3a345564, 0xa41dac8d, 0x5026d3e0, 0xdc9bb565 },
+     { 0x597fc7f4, 0xa14ce4d5, 0x59c178ba, 0x98c7090f,
+       0x4ed22126, 0x091bc664, 0xee98b785, 0xbc55a51b,
+       0x31e37b98, 0x6a4e526e, 0x00224c3d, 0xe77340cd } },
+   { { 0x5aeedcb5, 0xfa0cb48f, 0x72817277, 0xeb51ab60,
+       0xda07a303, 0x2af3bfb2, 0x8703e4af, 0x939a89d1,
+       0x9195acaf, 0x49106b56, 0x0de0aed2, 0xa623862f },
+     { 0xb05ff572, 0x0afba91c, 0x6befaf87, 0xe11640b5,
+       0x4fec85d9, 0xc4a4ef51, 0x10d3abff, 0xdcb7b7f6,
+       0x09157d8f, 0xa6284e47, 0x43e24139, 0x6a386da2 } },
+   { { 0x110ab6a9, 0x94f5571c, 0xcd871803, 0xaf895173,
+       0xf0714d17, 0x10af674e, 0xf1841c28, 0xdfc76f75,
+       0x2322592a, 0x6082a9f9, 0x00f305d9, 0xfedf311d },
+     { 0x1a0825b1, 0xc67bbaa3, 0xc2a7a2cb, 0x3fffc9cd,
+       0x19e5161e, 0x3a31c961, 0xbbe918ba, 0xb6b4ac39,
+       0xcb6eb594, 0xa2fe7a5f, 0x5aa3b421, 0x22d4d124 } },
+   { { 0x1d7481e4, 0xd2e5d915, 0xac949aa9, 0xf7e0c93d,
+       0xf137a49c, 0xf79aec92, 0xee920d22, 0xa7ce557b,
+       0x1c06eebc, 0xe05da927, 0x283c9073, 0xa02d4bb0 },
+     { 0xd1b5960e, 0x27efac4c, 0xd335126c, 0x4c110c19,
+       0x2b4ecb07, 0xa5dc4090, 0xf2096e10, 0x1bdb11f5,
+       0x02459758, 0x128145fd, 0xaa5a8228, 0x5cbe77d3 } },
+   { { 0xdfa74fe2, 0x202d8833, 0x40ab25d0, 0x513497c6,
+       0x7c060a89, 0x2790439d, 0x5b64899f, 0xf6b3097e,
+       0x0899baad, 0xadc4c838, 0x3d4100e8, 0x77e930e1 },
+     { 0x6da590d6, 0x0c8d4931, 0xe8c55cc6, 0x31956f2b,
+       0x47c8301c, 0x5da9f7c2, 0x38d0d513, 0x56a78f16,
+       0xe757107a, 0xe0b8e88e, 0x689ccec5, 0x2466f95b } },
+   { { 0x36c1ac6a, 0x5d0d215d, 0xf0602625, 0x74db0e01,
+       0x7d7f61cd, 0xc98a97e8, 0xc6211452, 0x6c782f3c,
+       0xc0132d35, 0x2afedda2, 0xffeff253, 0x374e2772 },
+     { 0x0bc110fa, 0x0f73dfe9, 0x758ae55f, 0xfbc82854,
+       0x9066afe4, 0x656a1f61, 0x6d87fced, 0x034d07d8,
+       0x8ddeec0b, 0xc2c17408, 0x88cbe3cf, 0x59a579de } },
+   { { 0x25e209c5, 0x9da9121c, 0x15798146, 0x91dbe668,
+       0xe8c663c5, 0xcb1299c9, 0xfda047eb, 0x72495766,
+       0x31b92b91, 0x7fa01880, 0x96edf50f, 0x679a2aba },
+     { 0x553200b9, 0xda09fb6a, 0xda53b069, 0xfe5d6697,
+       0x6c279054, 0x6e6ce744, 0x96052f28, 0xe9103189,
+       0x6366e8f3, 0xd82adb97, 0x9ad033a2, 0xf69b64da } },
+};
+
+static const struct ecc_comb {
+   int             words;
+   const char     *prime;
+   const ulong32 *table;
+} ecc_combs[] = {
+#ifdef LTC_ECC256
+   { 8,  "FFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF",
+     &comb_p256[0][0][0] },
+#endif
+#ifdef LTC_ECC384
+   { 12, "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFFFF0000000000000000FFFFFFFF",
+     &comb_p384[0][0][0] },
+#endif
+};
+
+static int comb_read_coord(void *a, const ulong32 *w, int words)
+{
+   unsigned char buf[ECC_COMB_MAX_WORDS * 4];
+   int i;
+
+   for (i = 0; i < words; i++) {
+      STORE32H(w[i], buf + 4 * i);
+   }
+   return mp_read_unsigned_bin(a, buf, words * 4);
+}
+
+/* find the table of the generator G of the curve over modulus */
+static const struct ecc_comb *comb_find(ecc_point *G, void *modulus)
+{
+   const struct ecc_comb *comb = NULL;
+   void *t;
+   int   i;
+
+   if (mp_cmp_d(G->z, 1) != LTC_MP_EQ) {
+      return NULL;
+   }
+   if (mp_init(&t) != CRYPT_OK) {
+      return NULL;
+   }
+   for (i = 0; i < (int)(sizeof(ecc_combs) / sizeof(ecc_combs[0])); i++) {
+      if (mp_read_radix(t, ecc_combs[i].prime, 16) != CRYPT_OK ||
+          mp_cmp(t, modulus) != LTC_MP_EQ) {
+         continue;
+      }
+      if (comb_read_coord(t, ecc_combs[i].table, ecc_combs[i].words) == CRYPT_OK &&
+          mp_cmp(t, G->x) == LTC_MP_EQ &&
+          comb_read_coord(t, ecc_combs[i].table + ecc_combs[i].words, ecc_combs[i].words) == CRYPT_OK &&
+          mp_cmp(t, G->y) == LTC_MP_EQ) {
+         comb = ecc_combs + i;
+      }
+      break;
+   }
+   mp_clear(t);
+   return comb;
+}
+
+/* copy point v (1..ECC_COMB_POINTS) of the table, reading all of the table */
+static void comb_select(ulong32 *dst, const struct ecc_comb *comb, int v)
+{
+   int      n = 2 * comb->words;
+   int      i, j;
+   ulong32 mask;
+
+   for (j = 0; j < n; j++) {
+      dst[j] = 0;
+   }
+   for (i = 1; i <= ECC_COMB_POINTS; i++) {
+      mask = (ulong32)0 - (ulong32)(i == v);
+      for (j = 0; j < n; j++) {
+         dst[j] |= comb->table[(i - 1) * n + j] & mask;
+      }
+   }
+}
+
+/* column j of the big endian scalar kb of len bytes, d bits per row */
+static int comb_column(const unsigned char *kb, int len, int d, int j)
+{
+   int i, b, v = 0;
+
+   for (i = 0; i < ECC_COMB_TEETH; i++) {
+      b = i * d + j;
+      if (b < len * 8) {
+         v |= ((kb[len - 1 - b / 8] >> (b % 8)) & 1) << i;
+      }
+   }
+   return v;
+}
+
+/**
+   Perform a point multiplication with a precomputed comb table
+   @param k        The scalar to multiply by
+   @param G        The base point
+   @param R        [out] Destination for kG
+   @param modulus  The modulus of the field the ECC curve is in
+   @param map      Boolean whether to map back to affine or not (1==map, 0 == leave in projective)
+   @return CRYPT_OK on success, CRYPT_NOP if there is no table for G
+*/
+int ltc_ecc_fixed_base_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map)
+{
+   const struct ecc_comb *comb;
+   ecc_point     *M[2], T;
+   ulong32       sel[2 * ECC_COMB_MAX_WORDS];
+   unsigned char  kb[ECC_COMB_MAX_WORDS * 4];
+   unsigned long  len;
+   void          *mu, *mp;
+   int            j, d, v, started, convert, err;
+
+   LTC_ARGCHK(k       != NULL);
+   LTC_ARGCHK(G       != NULL);
+   LTC_ARGCHK(R       != NULL);
+   LTC_ARGCHK(modulus != NULL);
+
+   comb = comb_find(G, modulus);
+   if (comb == NULL || mp_iszero(k) == LTC_MP_YES) {
+      return CRYPT_NOP;
+   }
+   len = mp_unsigned_bin_size(k);
+   if (len > (unsigned long)comb->words * 4) {
+      return CRYPT_NOP;
+   }
+   zeromem(kb, sizeof(kb));
+   if ((err = mp_to_unsigned_bin(k, kb + comb->words * 4 - len)) != CRYPT_OK) {
+      return err;
+   }
+
+   /* init montgomery reduction */
+   if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
+      goto done_kb;
+   }
+   if ((err = mp_init_multi(&mu, &T.x, &T.y, NULL)) != CRYPT_OK) {
+      mp_montgomery_free(mp);
+      goto done_kb;
+   }
+   T.z = NULL;
+   M[0] = ltc_ecc_new_point();
+   M[1] = ltc_ecc_new_point();
+   if (M[0] == NULL || M[1] == NULL)                                                 { err = CRYPT_MEM; goto done; }
+   if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK)                 { goto done; }
+   convert = mp_cmp_d(mu, 1) != LTC_MP_EQ;
+
+   /* M[1] takes the dummy operations, start it from G */
+   if ((err = mp_mulmod(G->x, mu, modulus, M[1]->x)) != CRYPT_OK)                    { goto done; }
+   if ((err = mp_mulmod(G->y, mu, modulus, M[1]->y)) != CRYPT_OK)                    { goto done; }
+   if ((err = mp_copy(mu, M[1]->z)) != CRYPT_OK)                                     { goto done; }
+
+   d = (comb->words * 32 + ECC_COMB_TEETH - 1) / ECC_COMB_TEETH;
+   started = 0;
+   for (j = d - 1; j >= 0; j--) {
+      v = comb_column(kb, comb->words * 4, d, j);
+
+      /* a zero column still adds a point, the result goes to M[1] */
+      comb_select(sel, comb, v + (v == 0));
+      if ((err = comb_read_coord(T.x, sel, comb->words)) != CRYPT_OK)               { goto done; }
+      if ((err = comb_read_coord(T.y, sel + comb->words, comb->words)) != CRYPT_OK) { goto done; }
+      if (convert) {
+         if ((err = mp_mulmod(T.x, mu, modulus, T.x)) != CRYPT_OK)                  { goto done; }
+         if ((err = mp_mulmod(T.y, mu, modulus, T.y)) != CRYPT_OK)                  { goto done; }
+      }
+
+      if (started) {
+         if ((err = ltc_mp.ecc_ptdbl(M[0], M[0], modulus, mp)) != CRYPT_OK)         { goto done; }
+         if ((err = ltc_mp.ecc_ptadd(M[0], &T, M[v == 0], modulus, mp)) != CRYPT_OK) { goto done; }
+         continue;
+      }
+
+      /* dummy operations until the first non-zero column */
+      if ((err = ltc_mp.ecc_ptdbl(M[1], M[1], modulus, mp)) != CRYPT_OK)            { goto done; }
+      if ((err = ltc_mp.ecc_ptadd(M[1], &T, M[1], modulus, mp)) != CRYPT_OK)        { goto done; }
+      if (v != 0) {
+         started = 1;
+         if ((err = mp_copy(T.x, M[0]->x)) != CRYPT_OK)                             { goto done; }
+         if ((err = mp_copy(T.y, M[0]->y)) != CRYPT_OK)                             { goto done; }
+         if ((err = mp_copy(mu, M[0]->z)) != CRYPT_OK)                              { goto done; }
+      }
+   }
+
+   /* copy result out */
+   if ((err = mp_copy(M[0]->x, R->x)) != CRYPT_OK)                                   { goto done; }
+   if ((err = mp_copy(M[0]->y, R->y)) != CRYPT_OK)                                   { goto done; }
+   if ((err = mp_copy(M[0]->z, R->z)) != CRYPT_OK)                                   { goto done; }
+
+   /* map R back from projective space */
+   if (map) {
+      err = ltc_ecc_map(R, modulus, mp);
+   } else {
+      err = CRYPT_OK;
+   }
+done:
+   ltc_ecc_del_point(M[0]);
+   ltc_ecc_del_point(M[1]);
+   mp_clear_multi(mu, T.x, T.y, NULL);
+   mp_montgomery_free(mp);
+done_kb:
+   zeromem(kb, sizeof(kb));
+   zeromem(sel, sizeof(sel));
+   return err;
+}
+
+#endif
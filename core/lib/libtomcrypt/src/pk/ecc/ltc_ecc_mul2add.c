@@ -52,7 +52,49 @@
 
 #ifdef LTC_ECC_SHAMIR
 
-/** Computes kA*A + kB*B = C using Shamir's Trick
+/* width of the signed window, digits are odd and below 2^(ECC_WNAF_WIDTH-1) */
+#define ECC_WNAF_WIDTH   5
+#define ECC_WNAF_POINTS  (1 << (ECC_WNAF_WIDTH - 2))
+#define ECC_WNAF_SIZE    (ECC_BUF_SIZE * 8 + 1)
+
+/* bit j of the big endian number k of len bytes */
+#define ECC_WNAF_BIT(k, len, j) \
+   ((j) < (len) * 8 ? ((k)[(len) - 1 - (j) / 8] >> ((j) % 8)) & 1 : 0)
+
+/**
+  Recode a scalar in width-w non adjacent form
+  @param k        The scalar, big endian
+  @param len      The length of k in bytes
+  @param naf      [out] The signed digits, least significant first
+  @return The number of digits
+*/
+static unsigned ecc_wnaf(const unsigned char *k, unsigned len, signed char *naf)
+{
+   unsigned j;
+   int      window = 0, digit;
+
+   for (j = 0; j < ECC_WNAF_WIDTH; j++) {
+      window |= ECC_WNAF_BIT(k, len, j) << j;
+   }
+
+   for (j = 0; j < len * 8 || window != 0; j++) {
+      digit = 0;
+      if (window & 1) {
+         /* window mod 2^w as a signed value */
+         digit = window & ((1 << ECC_WNAF_WIDTH) - 1);
+         if (digit >= (1 << (ECC_WNAF_WIDTH - 1))) {
+            digit -= 1 << ECC_WNAF_WIDTH;
+         }
+         window -= digit;
+      }
+      naf[j] = (signed char)digit;
+      window = (window >> 1) +
+               (ECC_WNAF_BIT(k, len, j + ECC_WNAF_WIDTH) << (ECC_WNAF_WIDTH - 1));
+   }
+   return j;
+}
+
+/** Computes kA*A + kB*B = C using Shamir's Trick with interleaved wNAF
   @param A        First point to multiply
   @param kA       What to multiple A by
   @param B        Second point to multiply
@@ -60,17 +102,21 @@
   @param C        [out] Destination point (can overlap with A or B
   @param modulus  Modulus for curve 
   @return CRYPT_OK on success
+
+  This is not timing resistant, it is meant for the verification of
+  signatures where the scalars and the points are public.
 */ 
 int ltc_ecc_mul2add(ecc_point *A, void *kA,
                     ecc_point *B, void *kB,
                     ecc_point *C,
                          void *modulus)
 {
-  ecc_point     *precomp[16];
-  unsigned       bitbufA, bitbufB, lenA, lenB, len, x, y, nA, nB, nibble;
+  ecc_point     *precomp[2][ECC_WNAF_POINTS], *P, N;
+  unsigned       lenA, lenB, nA, nB, len, x, y, i;
   unsigned char *tA, *tB;
-  int            err, first;
-  void          *mp, *mu;
+  signed char   *naf[2];
+  int            err, first, digit;
+  void          *mp, *mu, *ny;
  
   /* argchks */
   LTC_ARGCHK(A       != NULL);
@@ -90,11 +136,17 @@ int ltc_ecc_mul2add(ecc_point *A, void *kA,
      XFREE(tA);
      return CRYPT_MEM;
   }
+  naf[0] = XCALLOC(2, ECC_WNAF_SIZE);
+  if (naf[0] == NULL) {
+     XFREE(tA);
+     XFREE(tB);
+     return CRYPT_MEM;
+  }
+  naf[1] = naf[0] + ECC_WNAF_SIZE;
 
   /* get sizes */
   lenA = mp_unsigned_bin_size(kA);
   lenB = mp_unsigned_bin_size(kB);
-  len  = MAX(lenA, lenB);
 
   /* sanity check */
   if ((lenA > ECC_BUF_SIZE) || (lenB > ECC_BUF_SIZE)) {
@@ -102,21 +154,22 @@ int ltc_ecc_mul2add(ecc_point *A, void *kA,
      goto ERR_T;
   }
 
-  /* extract and justify kA */
-  mp_to_unsigned_bin(kA, (len - lenA) + tA);
-
-  /* extract and justify kB */
-  mp_to_unsigned_bin(kB, (len - lenB) + tB);
+  /* extract and recode kA and kB */
+  mp_to_unsigned_bin(kA, tA);
+  mp_to_unsigned_bin(kB, tB);
+  nA  = ecc_wnaf(tA, lenA, naf[0]);
+  nB  = ecc_wnaf(tB, lenB, naf[1]);
+  len = MAX(nA, nB);
 
-  /* allocate the table */
-  for (x = 0; x < 16; x++) {
-     precomp[x] = ltc_ecc_new_point();
-     if (precomp[x] == NULL) {
-         for (y = 0; y < x; ++y) {
-            ltc_ecc_del_point(precomp[y]);
-         }
-         err = CRYPT_MEM;
-         goto ERR_T;
+  /* allocate the tables */
+  XMEMSET(precomp, 0, sizeof(precomp));
+  for (x = 0; x < 2; x++) {
+     for (y = 0; y < ECC_WNAF_POINTS; y++) {
+        precomp[x][y] = ltc_ecc_new_point();
+        if (precomp[x][y] == NULL) {
+           err = CRYPT_MEM;
+           goto ERR_P;
+        }
      }
   }
 
@@ -124,7 +177,7 @@ int ltc_ecc_mul2add(ecc_point *A, void *kA,
    if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
       goto ERR_P;
    }
-   if ((err = mp_init(&mu)) != CRYPT_OK) {
+   if ((err = mp_init_multi(&mu, &ny, NULL)) != CRYPT_OK) {
       goto ERR_MP;
    }
    if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK) {
@@ -132,73 +185,56 @@ int ltc_ecc_mul2add(ecc_point *A, void *kA,
    }
 
   /* copy ones ... */
-  if ((err = mp_mulmod(A->x, mu, modulus, precomp[1]->x)) != CRYPT_OK)                                         { goto ERR_MU; }
-  if ((err = mp_mulmod(A->y, mu, modulus, precomp[1]->y)) != CRYPT_OK)                                         { goto ERR_MU; }
-  if ((err = mp_mulmod(A->z, mu, modulus, precomp[1]->z)) != CRYPT_OK)                                         { goto ERR_MU; }
-
-  if ((err = mp_mulmod(B->x, mu, modulus, precomp[1<<2]->x)) != CRYPT_OK)                                      { goto ERR_MU; }
-  if ((err = mp_mulmod(B->y, mu, modulus, precomp[1<<2]->y)) != CRYPT_OK)                                      { goto ERR_MU; }
-  if ((err = mp_mulmod(B->z, mu, modulus, precomp[1<<2]->z)) != CRYPT_OK)                                      { goto ERR_MU; }
-
-  /* precomp [i,0](A + B) table */
-  if ((err = ltc_mp.ecc_ptdbl(precomp[1], precomp[2], modulus, mp)) != CRYPT_OK)                               { goto ERR_MU; }
-  if ((err = ltc_mp.ecc_ptadd(precomp[1], precomp[2], precomp[3], modulus, mp)) != CRYPT_OK)                   { goto ERR_MU; }
-
-  /* precomp [0,i](A + B) table */
-  if ((err = ltc_mp.ecc_ptdbl(precomp[1<<2], precomp[2<<2], modulus, mp)) != CRYPT_OK)                         { goto ERR_MU; }
-  if ((err = ltc_mp.ecc_ptadd(precomp[1<<2], precomp[2<<2], precomp[3<<2], modulus, mp)) != CRYPT_OK)          { goto ERR_MU; }
-
-  /* precomp [i,j](A + B) table (i != 0, j != 0) */
-  for (x = 1; x < 4; x++) {
-     for (y = 1; y < 4; y++) {
-        if ((err = ltc_mp.ecc_ptadd(precomp[x], precomp[(y<<2)], precomp[x+(y<<2)], modulus, mp)) != CRYPT_OK) { goto ERR_MU; }
-     }
-  }   
-
-  nibble  = 3;
-  first   = 1;
-  bitbufA = tA[0];
-  bitbufB = tB[0];
-
-  /* for every byte of the multiplicands */
-  for (x = -1;; ) {
-     /* grab a nibble */
-     if (++nibble == 4) {
-        ++x; if (x == len) break;
-        bitbufA = tA[x];
-        bitbufB = tB[x];
-        nibble  = 0;
-     }
+  if ((err = mp_mulmod(A->x, mu, modulus, precomp[0][0]->x)) != CRYPT_OK)                                      { goto ERR_MU; }
+  if ((err = mp_mulmod(A->y, mu, modulus, precomp[0][0]->y)) != CRYPT_OK)                                      { goto ERR_MU; }
+  if ((err = mp_mulmod(A->z, mu, modulus, precomp[0][0]->z)) != CRYPT_OK)                                      { goto ERR_MU; }
 
-     /* extract two bits from both, shift/update */
-     nA = (bitbufA >> 6) & 0x03;
-     nB = (bitbufB >> 6) & 0x03;
-     bitbufA = (bitbufA << 2) & 0xFF;   
-     bitbufB = (bitbufB << 2) & 0xFF;   
+  if ((err = mp_mulmod(B->x, mu, modulus, precomp[1][0]->x)) != CRYPT_OK)                                      { goto ERR_MU; }
+  if ((err = mp_mulmod(B->y, mu, modulus, precomp[1][0]->y)) != CRYPT_OK)                                      { goto ERR_MU; }
+  if ((err = mp_mulmod(B->z, mu, modulus, precomp[1][0]->z)) != CRYPT_OK)                                      { goto ERR_MU; }
 
-     /* if both zero, if first, continue */
-     if ((nA == 0) && (nB == 0) && (first == 1)) {
-        continue;
+  /* precomp[x][y] = (2y+1)P, the last entry holds 2P until it's needed */
+  for (x = 0; x < 2; x++) {
+     P = precomp[x][ECC_WNAF_POINTS - 1];
+     if ((err = ltc_mp.ecc_ptdbl(precomp[x][0], P, modulus, mp)) != CRYPT_OK)                                  { goto ERR_MU; }
+     for (y = 1; y < ECC_WNAF_POINTS; y++) {
+        if ((err = ltc_mp.ecc_ptadd(precomp[x][y - 1], P, precomp[x][y], modulus, mp)) != CRYPT_OK)            { goto ERR_MU; }
      }
+  }
 
-     /* double twice, only if this isn't the first */
+  /* the negated points share x and z with the table */
+  N.y   = ny;
+  first = 1;
+  for (i = len; i-- > 0; ) {
+     /* double, only if this isn't the first */
      if (first == 0) {
-        /* double twice */
-        if ((err = ltc_mp.ecc_ptdbl(C, C, modulus, mp)) != CRYPT_OK)                  { goto ERR_MU; }
-        if ((err = ltc_mp.ecc_ptdbl(C, C, modulus, mp)) != CRYPT_OK)                  { goto ERR_MU; }
+        if ((err = ltc_mp.ecc_ptdbl(C, C, modulus, mp)) != CRYPT_OK)                                           { goto ERR_MU; }
      }
 
-     /* if not both zero */
-     if ((nA != 0) || (nB != 0)) {
+     for (x = 0; x < 2; x++) {
+        digit = i < (x == 0 ? nA : nB) ? naf[x][i] : 0;
+        if (digit == 0) {
+           continue;
+        }
+        if (digit > 0) {
+           P = precomp[x][digit >> 1];
+        } else {
+           P    = precomp[x][(-digit) >> 1];
+           N.x  = P->x;
+           N.z  = P->z;
+           if ((err = mp_sub(modulus, P->y, ny)) != CRYPT_OK)                                                  { goto ERR_MU; }
+           P = &N;
+        }
+
         if (first == 1) {
            /* if first, copy from table */
            first = 0;
-           if ((err = mp_copy(precomp[nA + (nB<<2)]->x, C->x)) != CRYPT_OK)           { goto ERR_MU; }
-           if ((err = mp_copy(precomp[nA + (nB<<2)]->y, C->y)) != CRYPT_OK)           { goto ERR_MU; }
-           if ((err = mp_copy(precomp[nA + (nB<<2)]->z, C->z)) != CRYPT_OK)           { goto ERR_MU; }
+           if ((err = mp_copy(P->x, C->x)) != CRYPT_OK)                                                        { goto ERR_MU; }
+           if ((err = mp_copy(P->y, C->y)) != CRYPT_OK)                                                        { goto ERR_MU; }
+           if ((err = mp_copy(P->z, C->z)) != CRYPT_OK)                                                        { goto ERR_MU; }
         } else {
            /* if not first, add from table */
-           if ((err = ltc_mp.ecc_ptadd(C, precomp[nA + (nB<<2)], C, modulus, mp)) != CRYPT_OK) { goto ERR_MU; }
+           if ((err = ltc_mp.ecc_ptadd(C, P, C, modulus, mp)) != CRYPT_OK)                                     { goto ERR_MU; }
         }
      }
   }
@@ -208,12 +244,14 @@ int ltc_ecc_mul2add(ecc_point *A, void *kA,
 
   /* clean up */
 ERR_MU:
-   mp_clear(mu);
+   mp_clear_multi(mu, ny, NULL);
 ERR_MP:
    mp_montgomery_free(mp);
 ERR_P:
-   for (x = 0; x < 16; x++) {
-       ltc_ecc_del_point(precomp[x]);
+   for (x = 0; x < 2; x++) {
+      for (y = 0; y < ECC_WNAF_POINTS; y++) {
+         ltc_ecc_del_point(precomp[x][y]);
+      }
    }
 ERR_T:
 #ifdef LTC_CLEAN_STACK
@@ -222,6 +260,7 @@ ERR_T:
 #endif
    XFREE(tA);
    XFREE(tB);
+   XFREE(naf[0]);
 
    return err;
 }
@@ -74,6 +74,14 @@ int ltc_ecc_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map)
    LTC_ARGCHK(R       != NULL);
    LTC_ARGCHK(modulus != NULL);
 
+#ifdef LTC_ECC_FIXED_BASE
+   /* use the precomputed table if G is the generator of a known curve */
+   err = ltc_ecc_fixed_base_mulmod(k, G, R, modulus, map);
+   if (err != CRYPT_NOP) {
+      return err;
+   }
+#endif
+
    /* init montgomery reduction */
    if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK) {
       return err;
@@ -478,31 +478,41 @@ static TEE_Result hash_final(void *ctx, uint32_t algo, uint8_t *digest,
 	mpa_scratch_mem_size_in_U32(LTC_VARIABLE_NUMBER, \
 				    LTC_MAX_BITS_PER_VARIABLE)
 
+/*
+ * Each scratch memory pool lets one more thread run bignum arithmetic
+ * concurrently, a thread waits for a pool when all are in use.
+ */
+#if defined(CFG_LTC_OPTEE_THREAD) && defined(CFG_CRYPTO_MPA_NUM_POOLS)
+#define LTC_MEMPOOL_NUM		CFG_CRYPTO_MPA_NUM_POOLS
+#else
+#define LTC_MEMPOOL_NUM		1
+#endif
+
 #if defined(CFG_WITH_PAGER)
 #include <mm/tee_pager.h>
 #include <util.h>
 #include <mm/core_mmu.h>
 
-static uint32_t *_ltc_mempool_u32;
+static uint32_t *_ltc_mempool_u32[LTC_MEMPOOL_NUM];
 
 /* allocate pageable_zi vmem for mpa scratch memory pool */
-static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t *size_pool)
+static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t idx,
+						   size_t *size_pool)
 {
 	void *pool;
 
 	*size_pool = ROUNDUP((LTC_MEMPOOL_U32_SIZE * sizeof(uint32_t)),
 			     SMALL_PAGE_SIZE);
-	_ltc_mempool_u32 = tee_pager_alloc(*size_pool, 0);
-	if (!_ltc_mempool_u32)
+	_ltc_mempool_u32[idx] = tee_pager_alloc(*size_pool, 0);
+	if (!_ltc_mempool_u32[idx])
 		panic();
-	pool = (void *)_ltc_mempool_u32;
+	pool = (void *)_ltc_mempool_u32[idx];
 	return (mpa_scratch_mem)pool;
 }
 
 /* release unused pageable_zi vmem */
-static void release_unused_mpa_scratch_memory(void)
+static void release_unused_mpa_scratch_memory(mpa_scratch_mem pool)
 {
-	mpa_scratch_mem pool = (mpa_scratch_mem)_ltc_mempool_u32;
 	struct mpa_scratch_item *item;
 	vaddr_t start;
 	vaddr_t end;
@@ -524,89 +534,140 @@ static void release_unused_mpa_scratch_memory(void)
 }
 #else /* CFG_WITH_PAGER */
 
-static uint32_t _ltc_mempool_u32[LTC_MEMPOOL_U32_SIZE]
+static uint32_t _ltc_mempool_u32[LTC_MEMPOOL_NUM][LTC_MEMPOOL_U32_SIZE]
 	__aligned(__alignof__(mpa_scratch_mem_base));
 
-static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t *size_pool)
+static mpa_scratch_mem get_mpa_scratch_memory_pool(size_t idx,
+						   size_t *size_pool)
 {
-	void *pool = (void *)_ltc_mempool_u32;
+	void *pool = (void *)_ltc_mempool_u32[idx];
 
-	*size_pool = sizeof(_ltc_mempool_u32);
+	*size_pool = sizeof(_ltc_mempool_u32[idx]);
 	return (mpa_scratch_mem)pool;
 }
 
-static void release_unused_mpa_scratch_memory(void)
+static void release_unused_mpa_scratch_memory(mpa_scratch_mem pool __unused)
 {
 	/* nothing to do in non-pager mode */
 }
 
 #endif
 
-static void pool_postactions(void)
+static void pool_postactions(mpa_scratch_mem pool)
 {
-	mpa_scratch_mem pool = (void *)_ltc_mempool_u32;
-
 	if (pool->last_offset)
 		panic("release issue in mpa scratch memory");
-	release_unused_mpa_scratch_memory();
+	release_unused_mpa_scratch_memory(pool);
 }
 
 #if defined(CFG_LTC_OPTEE_THREAD)
 #include <kernel/thread.h>
 static struct mpa_scratch_mem_sync {
-	struct mutex mu;
-	struct condvar cv;
+	mpa_scratch_mem pool;
 	size_t count;
 	int owner;
-} pool_sync = {
-	.mu = MUTEX_INITIALIZER,
-	.cv = CONDVAR_INITIALIZER,
-	.owner = THREAD_ID_INVALID,
-};
+} pool_sync[LTC_MEMPOOL_NUM];
+
+/*
+ * Pool owned by each thread, NULL if none. An entry is only written and
+ * read by the thread it belongs to.
+ */
+static struct mpa_scratch_mem_sync *thread_pool[CFG_NUM_THREADS];
+
+/* Protects the transfer of ownership of all pools */
+static struct mutex pool_mu = MUTEX_INITIALIZER;
+static struct condvar pool_cv = CONDVAR_INITIALIZER;
 #elif defined(LTC_PTHREAD)
 #error NOT SUPPORTED
 #else
 static struct mpa_scratch_mem_sync {
+	mpa_scratch_mem pool;
 	size_t count;
-} pool_sync;
+} pool_sync[LTC_MEMPOOL_NUM];
 #endif
 
 /* Get exclusive access to scratch memory pool */
 #if defined(CFG_LTC_OPTEE_THREAD)
 static void get_pool(struct mpa_scratch_mem_sync *sync)
 {
-	mutex_lock(&sync->mu);
+	int id = thread_get_id();
 
-	if (sync->owner != thread_get_id()) {
-		/* Wait until the pool is available */
-		while (sync->owner != THREAD_ID_INVALID)
-			condvar_wait(&sync->cv, &sync->mu);
-
-		sync->owner = thread_get_id();
-		assert(sync->count == 0);
+	/*
+	 * Only the owner changes the owner of a pool it owns, and the count
+	 * is only used by the owner, so no lock is needed here.
+	 */
+	if (thread_pool[id] == sync) {
+		sync->count++;
+		return;
 	}
 
-	sync->count++;
+	mutex_lock(&pool_mu);
+
+	/* Wait until the pool is available */
+	while (sync->owner != THREAD_ID_INVALID)
+		condvar_wait(&pool_cv, &pool_mu);
 
-	mutex_unlock(&sync->mu);
+	sync->owner = id;
+	assert(sync->count == 0);
+	sync->count = 1;
+	thread_pool[id] = sync;
+
+	mutex_unlock(&pool_mu);
 }
 
 /* Put (release) exclusive access to scratch memory pool */
 static void put_pool(struct mpa_scratch_mem_sync *sync)
 {
-	mutex_lock(&sync->mu);
+	int id = thread_get_id();
 
-	assert(sync->owner == thread_get_id());
+	assert(thread_pool[id] == sync && sync->owner == id);
 	assert(sync->count > 0);
 
-	sync->count--;
-	if (!sync->count) {
-		sync->owner = THREAD_ID_INVALID;
-		condvar_signal(&sync->cv);
-		pool_postactions();
+	if (sync->count > 1) {
+		sync->count--;
+		return;
 	}
 
-	mutex_unlock(&sync->mu);
+	pool_postactions(sync->pool);
+	thread_pool[id] = NULL;
+
+	mutex_lock(&pool_mu);
+
+	sync->count = 0;
+	sync->owner = THREAD_ID_INVALID;
+	/* Waiters may be waiting for different pools */
+	condvar_broadcast(&pool_cv);
+
+	mutex_unlock(&pool_mu);
+}
+
+/*
+ * Returns the pool the calling thread is to use. A thread holding
+ * variables keeps its pool, else it takes its own pool if available, or
+ * else any available pool. If none is available get_pool() waits for the
+ * returned one.
+ */
+static mpa_scratch_mem select_pool(void)
+{
+	int id = thread_get_id();
+	size_t idx = id % LTC_MEMPOOL_NUM;
+	size_t n;
+
+	if (thread_pool[id])
+		return thread_pool[id]->pool;
+
+	/*
+	 * The owners are only peeked at to pick a likely available pool,
+	 * get_pool() takes the lock and waits if it is taken meanwhile.
+	 */
+	if (pool_sync[idx].owner == THREAD_ID_INVALID)
+		return pool_sync[idx].pool;
+
+	for (n = 0; n < LTC_MEMPOOL_NUM; n++)
+		if (pool_sync[n].owner == THREAD_ID_INVALID)
+			return pool_sync[n].pool;
+
+	return pool_sync[idx].pool;
 }
 #elif defined(LTC_PTHREAD)
 #error NOT SUPPORTED
@@ -621,7 +682,12 @@ static void put_pool(struct mpa_scratch_mem_sync *sync)
 {
 	sync->count--;
 	if (!sync->count)
-		pool_postactions();
+		pool_postactions(sync->pool);
+}
+
+static mpa_scratch_mem select_pool(void)
+{
+	return pool_sync[0].pool;
 }
 #endif
 
@@ -629,11 +695,19 @@ static void tee_ltc_alloc_mpa(void)
 {
 	mpa_scratch_mem pool;
 	size_t size_pool;
+	size_t n;
 
-	pool = get_mpa_scratch_memory_pool(&size_pool);
-	init_mpa_tomcrypt(pool);
-	mpa_init_scratch_mem_sync(pool, size_pool, LTC_MAX_BITS_PER_VARIABLE,
-				  get_pool, put_pool, &pool_sync);
+	for (n = 0; n < LTC_MEMPOOL_NUM; n++) {
+		pool = get_mpa_scratch_memory_pool(n, &size_pool);
+		pool_sync[n].pool = pool;
+#if defined(CFG_LTC_OPTEE_THREAD)
+		pool_sync[n].owner = THREAD_ID_INVALID;
+#endif
+		mpa_init_scratch_mem_sync(pool, size_pool,
+					  LTC_MAX_BITS_PER_VARIABLE,
+					  get_pool, put_pool, pool_sync + n);
+	}
+	init_mpa_tomcrypt(select_pool);
 
 	mpa_set_random_generator(crypto_ops.prng.read);
 }
@@ -2619,14 +2693,23 @@ static TEE_Result authenc_init(void *ctx, uint32_t algo,
 #endif
 #if defined(CFG_CRYPTO_GCM)
 	case TEE_ALG_AES_GCM:
-		/* reset the state */
 		gcm = ctx;
-		memset(gcm, 0, sizeof(struct tee_gcm_state));
-		gcm->tag_len = tag_len;
-
-		ltc_res = gcm_init(&gcm->ctx, ltc_cipherindex, key, key_len);
+		if (key) {
+			/* reset the state */
+			memset(gcm, 0, sizeof(struct tee_gcm_state));
+			ltc_res = gcm_init(&gcm->ctx, ltc_cipherindex, key,
+					   key_len);
+		} else {
+			/*
+			 * Keep the key schedule and hash subkey of a state
+			 * previously initialized with a key, only the IV
+			 * changes.
+			 */
+			ltc_res = gcm_reset(&gcm->ctx);
+		}
 		if (ltc_res != CRYPT_OK)
 			return TEE_ERROR_BAD_STATE;
+		gcm->tag_len = tag_len;
 
 		/* Add the IV */
 		ltc_res = gcm_add_iv(&gcm->ctx, nonce, nonce_len);
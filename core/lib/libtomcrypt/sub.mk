@@ -44,6 +44,11 @@ ifneq ($(CFG_CRYPTO_SHA256),y)
 $(warning Warning: Enabling CFG_CRYPTO_SHA256 [required by CFG_WITH_PAGER])
 CFG_CRYPTO_SHA256:=y
 endif
+# The pager shares the GHASH implementation of the GCM mode
+ifneq ($(CFG_CRYPTO_GCM),y)
+$(warning Warning: Enabling CFG_CRYPTO_GCM [required by CFG_WITH_PAGER])
+CFG_CRYPTO_GCM:=y
+endif
 endif
 
 ifeq ($(CFG_CRYPTO_WITH_CE),y)
@@ -56,6 +61,7 @@ ifeq ($(CFG_ARM64_core),y)
 CFG_CRYPTO_AES_ARM64_CE ?= $(CFG_CRYPTO_AES)
 CFG_CRYPTO_SHA1_ARM64_CE ?= $(CFG_CRYPTO_SHA1)
 CFG_CRYPTO_SHA256_ARM64_CE ?= $(CFG_CRYPTO_SHA256)
+CFG_CRYPTO_GCM_ARM64_CE ?= $(CFG_CRYPTO_GCM)
 endif
 endif
 
@@ -76,6 +82,9 @@ endif
 ifeq ($(CFG_CRYPTO_AES_ARM64_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_AES_ARM64_CE)
 endif
+ifeq ($(CFG_CRYPTO_GCM_ARM64_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_GCM_ARM64_CE)
+endif
 
 cryp-enable-all-depends = $(call cfg-enable-all-depends,$(strip $(1)),$(foreach v,$(2),CFG_CRYPTO_$(v)))
 $(eval $(call cryp-enable-all-depends,CFG_ENC_FS, AES ECB CTR HMAC SHA256 GCM))
@@ -204,16 +204,72 @@ static TEE_Result tee_fs_init_key_manager(void)
 	return res;
 }
 
+static TEE_Result alloc_cipher_ctx(void **ctx, uint32_t algo,
+				   TEE_OperationMode mode,
+				   const uint8_t *key, size_t key_size)
+{
+	TEE_Result res;
+	size_t ctx_size;
+	void *c;
+
+	res = crypto_ops.cipher.get_ctx_size(algo, &ctx_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	c = malloc(ctx_size);
+	if (!c)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = crypto_ops.cipher.init(c, algo, mode, key, key_size, NULL, 0,
+				     NULL, 0);
+	if (res != TEE_SUCCESS) {
+		free(c);
+		return res;
+	}
+
+	*ctx = c;
+	return TEE_SUCCESS;
+}
+
+static void free_cipher_ctx(void *ctx, uint32_t algo)
+{
+	size_t ctx_size;
+
+	if (!ctx)
+		return;
+
+	crypto_ops.cipher.final(ctx, algo);
+	/* The context holds a key schedule */
+	if (crypto_ops.cipher.get_ctx_size(algo, &ctx_size) == TEE_SUCCESS)
+		memset(ctx, 0, ctx_size);
+	free(ctx);
+}
+
+static void free_authenc_ctx(void *ctx, uint32_t algo)
+{
+	size_t ctx_size;
+
+	if (!ctx)
+		return;
+
+	if (crypto_ops.authenc.get_ctx_size(algo, &ctx_size) == TEE_SUCCESS)
+		memset(ctx, 0, ctx_size);
+	free(ctx);
+}
+
+/*
+ * The AES-GCM context of the key context is keyed with the FEK the first
+ * time only, later blocks of the same file only supply a new IV.
+ */
 static TEE_Result do_auth_enc(TEE_OperationMode mode,
-		struct km_header *hdr,
-		uint8_t *fek, int fek_len,
+		struct km_header *hdr, struct tee_fs_key_ctx *kc,
 		const uint8_t *data_in, size_t in_size,
 		uint8_t *data_out, size_t *out_size)
 {
 	TEE_Result res = TEE_SUCCESS;
-	uint8_t *ctx = NULL;
-	size_t ctx_size;
 	size_t tag_len = TEE_FS_KM_MAX_TAG_LEN;
+	void *ctx = kc->authenc_ctx;
+	const uint8_t *fek = kc->authenc_keyed ? NULL : kc->fek;
 
 	if ((mode != TEE_MODE_ENCRYPT) && (mode != TEE_MODE_DECRYPT))
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -224,23 +280,13 @@ static TEE_Result do_auth_enc(TEE_OperationMode mode,
 		return TEE_ERROR_SHORT_BUFFER;
 	}
 
-	res = crypto_ops.authenc.get_ctx_size(TEE_FS_KM_AUTH_ENC_ALG,
-			&ctx_size);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	ctx = malloc(ctx_size);
-	if (!ctx) {
-		EMSG("request memory size %zu failed", ctx_size);
-		return TEE_ERROR_OUT_OF_MEMORY;
-	}
-
 	res = crypto_ops.authenc.init(ctx, TEE_FS_KM_AUTH_ENC_ALG,
-			mode, fek, fek_len, hdr->aad.iv,
+			mode, fek, TEE_FS_KM_FEK_SIZE, hdr->aad.iv,
 			TEE_FS_KM_IV_LEN, TEE_FS_KM_MAX_TAG_LEN,
 			sizeof(struct aad), in_size);
 	if (res != TEE_SUCCESS)
-		goto exit;
+		return res;
+	kc->authenc_keyed = true;
 
 	res = crypto_ops.authenc.update_aad(ctx, TEE_FS_KM_AUTH_ENC_ALG,
 			mode, (uint8_t *)hdr->aad.encrypted_key,
@@ -264,13 +310,8 @@ static TEE_Result do_auth_enc(TEE_OperationMode mode,
 				hdr->tag, tag_len);
 	}
 
-	if (res != TEE_SUCCESS)
-		goto exit;
-
-	crypto_ops.authenc.final(ctx, TEE_FS_KM_AUTH_ENC_ALG);
-
 exit:
-	free(ctx);
+	crypto_ops.authenc.final(ctx, TEE_FS_KM_AUTH_ENC_ALG);
 	return res;
 }
 
@@ -307,16 +348,75 @@ TEE_Result tee_fs_generate_fek(uint8_t *buf, int buf_size)
 			TEE_FS_KM_FEK_SIZE);
 }
 
-TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
+void tee_fs_key_ctx_init(struct tee_fs_key_ctx *kc,
+			 const uint8_t *encrypted_fek)
+{
+	memset(kc, 0, sizeof(*kc));
+	memcpy(kc->encrypted_fek, encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	kc->has_key = true;
+}
+
+void tee_fs_key_ctx_final(struct tee_fs_key_ctx *kc)
+{
+	free_authenc_ctx(kc->authenc_ctx, TEE_FS_KM_AUTH_ENC_ALG);
+	free_cipher_ctx(kc->essiv_ctx, TEE_ALG_AES_ECB_NOPAD);
+	free_cipher_ctx(kc->enc_ctx, TEE_ALG_AES_ECB_NOPAD);
+	free_cipher_ctx(kc->dec_ctx, TEE_ALG_AES_ECB_NOPAD);
+	memset(kc, 0, sizeof(*kc));
+}
+
+/* Decrypts the FEK the first time it's needed */
+static TEE_Result get_fek(struct tee_fs_key_ctx *kc)
+{
+	TEE_Result res;
+
+	if (!kc->has_key)
+		return TEE_ERROR_BAD_STATE;
+	if (kc->has_fek)
+		return TEE_SUCCESS;
+
+	memcpy(kc->fek, kc->encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	res = fek_crypt(TEE_MODE_DECRYPT, kc->fek, TEE_FS_KM_FEK_SIZE);
+	if (res != TEE_SUCCESS) {
+		memset(kc->fek, 0, sizeof(kc->fek));
+		return res;
+	}
+
+	kc->has_fek = true;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_authenc_ctx(struct tee_fs_key_ctx *kc)
+{
+	TEE_Result res;
+	size_t ctx_size;
+
+	if (kc->authenc_ctx)
+		return TEE_SUCCESS;
+
+	res = crypto_ops.authenc.get_ctx_size(TEE_FS_KM_AUTH_ENC_ALG,
+					      &ctx_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	kc->authenc_ctx = malloc(ctx_size);
+	if (!kc->authenc_ctx) {
+		EMSG("request memory size %zu failed", ctx_size);
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_key_ctx_encrypt(struct tee_fs_key_ctx *kc,
+		enum tee_fs_file_type file_type,
 		const uint8_t *data_in, size_t data_in_size,
-		uint8_t *data_out, size_t *data_out_size,
-		const uint8_t *encrypted_fek)
+		uint8_t *data_out, size_t *data_out_size)
 {
 	TEE_Result res = TEE_SUCCESS;
 	struct km_header hdr;
 	uint8_t iv[TEE_FS_KM_IV_LEN];
 	uint8_t tag[TEE_FS_KM_MAX_TAG_LEN];
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
 	uint8_t *ciphertext;
 	size_t cipher_size;
 	size_t header_size = tee_fs_get_header_size(file_type);
@@ -341,8 +441,11 @@ TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
 	if (res != TEE_SUCCESS)
 		goto fail;
 
-	memcpy(fek, encrypted_fek, TEE_FS_KM_FEK_SIZE);
-	res = fek_crypt(TEE_MODE_DECRYPT, fek, TEE_FS_KM_FEK_SIZE);
+	res = get_fek(kc);
+	if (res != TEE_SUCCESS)
+		goto fail;
+
+	res = get_authenc_ctx(kc);
 	if (res != TEE_SUCCESS)
 		goto fail;
 
@@ -350,17 +453,16 @@ TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
 	cipher_size = data_in_size;
 
 	hdr.aad.iv = iv;
-	hdr.aad.encrypted_key = encrypted_fek;
+	hdr.aad.encrypted_key = kc->encrypted_fek;
 	hdr.tag = tag;
 
-	res = do_auth_enc(TEE_MODE_ENCRYPT, &hdr,
-			fek, TEE_FS_KM_FEK_SIZE,
-			data_in, data_in_size,
-			ciphertext, &cipher_size);
+	res = do_auth_enc(TEE_MODE_ENCRYPT, &hdr, kc, data_in, data_in_size,
+			  ciphertext, &cipher_size);
 
 	if (res == TEE_SUCCESS) {
 		if (file_type == META_FILE) {
-			memcpy(data_out, encrypted_fek, TEE_FS_KM_FEK_SIZE);
+			memcpy(data_out, kc->encrypted_fek,
+			       TEE_FS_KM_FEK_SIZE);
 			data_out += TEE_FS_KM_FEK_SIZE;
 		}
 
@@ -375,88 +477,102 @@ fail:
 	return res;
 }
 
-TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
+TEE_Result tee_fs_key_ctx_decrypt(struct tee_fs_key_ctx *kc,
+		enum tee_fs_file_type file_type,
 		const uint8_t *data_in, size_t data_in_size,
-		uint8_t *plaintext, size_t *plaintext_size,
-		uint8_t *encrypted_fek)
+		uint8_t *plaintext, size_t *plaintext_size)
 {
 	TEE_Result res = TEE_SUCCESS;
 	struct km_header km_hdr;
 	size_t file_hdr_size = tee_fs_get_header_size(file_type);
 	const uint8_t *cipher = data_in + file_hdr_size;
 	int cipher_size = data_in_size - file_hdr_size;
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
 
 	if (file_type == META_FILE) {
 		struct meta_header *hdr = (struct meta_header *)data_in;
 
-		km_hdr.aad.encrypted_key = hdr->encrypted_key;
+		if (!kc->has_key)
+			tee_fs_key_ctx_init(kc, hdr->encrypted_key);
+		else if (memcmp(kc->encrypted_fek, hdr->encrypted_key,
+				TEE_FS_KM_FEK_SIZE))
+			return TEE_ERROR_SECURITY;
+
 		km_hdr.aad.iv = hdr->common.iv;
 		km_hdr.tag = hdr->common.tag;
-
-		/* return encrypted FEK to tee_fs which is used for block
-		 * encryption/decryption */
-		memcpy(encrypted_fek, hdr->encrypted_key, TEE_FS_KM_FEK_SIZE);
 	} else {
 		struct block_header *hdr = (struct block_header *)data_in;
 
-		km_hdr.aad.encrypted_key = encrypted_fek;
 		km_hdr.aad.iv = hdr->common.iv;
 		km_hdr.tag = hdr->common.tag;
 	}
+	km_hdr.aad.encrypted_key = kc->encrypted_fek;
 
-	memcpy(fek, km_hdr.aad.encrypted_key, TEE_FS_KM_FEK_SIZE);
-	res = fek_crypt(TEE_MODE_DECRYPT, fek, TEE_FS_KM_FEK_SIZE);
+	res = get_fek(kc);
 	if (res != TEE_SUCCESS) {
 		EMSG("Failed to decrypt FEK, res=0x%x", res);
 		return res;
 	}
 
-	return do_auth_enc(TEE_MODE_DECRYPT, &km_hdr, fek, TEE_FS_KM_FEK_SIZE,
-			cipher, cipher_size, plaintext, plaintext_size);
+	res = get_authenc_ctx(kc);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return do_auth_enc(TEE_MODE_DECRYPT, &km_hdr, kc, cipher, cipher_size,
+			   plaintext, plaintext_size);
 }
 
-static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
-			 size_t in_size)
+TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
+		const uint8_t *data_in, size_t data_in_size,
+		uint8_t *data_out, size_t *data_out_size,
+		const uint8_t *encrypted_fek)
 {
 	TEE_Result res;
-	uint8_t *ctx = NULL;
-	size_t ctx_size;
-	uint32_t algo = TEE_ALG_SHA256;
+	struct tee_fs_key_ctx kc;
 
-	res = crypto_ops.hash.get_ctx_size(algo, &ctx_size);
-	if (res != TEE_SUCCESS)
-		return res;
+	tee_fs_key_ctx_init(&kc, encrypted_fek);
+	res = tee_fs_key_ctx_encrypt(&kc, file_type, data_in, data_in_size,
+				     data_out, data_out_size);
+	tee_fs_key_ctx_final(&kc);
+	return res;
+}
 
-	ctx = malloc(ctx_size);
-	if (!ctx)
-		return TEE_ERROR_OUT_OF_MEMORY;
+TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
+		const uint8_t *data_in, size_t data_in_size,
+		uint8_t *plaintext, size_t *plaintext_size,
+		uint8_t *encrypted_fek)
+{
+	TEE_Result res;
+	struct tee_fs_key_ctx kc;
 
-	res = crypto_ops.hash.init(ctx, algo);
-	if (res != TEE_SUCCESS)
-		goto out;
+	/* The FEK of a meta file is in its header */
+	if (file_type == META_FILE)
+		memset(&kc, 0, sizeof(kc));
+	else
+		tee_fs_key_ctx_init(&kc, encrypted_fek);
 
-	res = crypto_ops.hash.update(ctx, algo, in, in_size);
-	if (res != TEE_SUCCESS)
-		goto out;
+	res = tee_fs_key_ctx_decrypt(&kc, file_type, data_in, data_in_size,
+				     plaintext, plaintext_size);
 
-	res = crypto_ops.hash.final(ctx, algo, out, out_size);
+	/*
+	 * Return encrypted FEK to tee_fs which is used for block
+	 * encryption/decryption
+	 */
+	if (file_type == META_FILE && kc.has_key)
+		memcpy(encrypted_fek, kc.encrypted_fek, TEE_FS_KM_FEK_SIZE);
 
-out:
-	free(ctx);
+	tee_fs_key_ctx_final(&kc);
 	return res;
 }
 
-static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
-			  const uint8_t in[TEE_AES_BLOCK_SIZE],
-			  const uint8_t *key, size_t key_size)
+static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
+			 size_t in_size)
 {
 	TEE_Result res;
 	uint8_t *ctx = NULL;
 	size_t ctx_size;
-	uint32_t algo = TEE_ALG_AES_ECB_NOPAD;
+	uint32_t algo = TEE_ALG_SHA256;
 
-	res = crypto_ops.cipher.get_ctx_size(algo, &ctx_size);
+	res = crypto_ops.hash.get_ctx_size(algo, &ctx_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -464,90 +580,158 @@ static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
 	if (!ctx)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	res = crypto_ops.cipher.init(ctx, algo, TEE_MODE_ENCRYPT, key,
-				     key_size, NULL, 0, NULL, 0);
+	res = crypto_ops.hash.init(ctx, algo);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = crypto_ops.cipher.update(ctx, algo, TEE_MODE_ENCRYPT, true, in,
-				       TEE_AES_BLOCK_SIZE, out);
+	res = crypto_ops.hash.update(ctx, algo, in, in_size);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	crypto_ops.cipher.final(ctx, algo);
-	res = TEE_SUCCESS;
+	res = crypto_ops.hash.final(ctx, algo, out, out_size);
 
 out:
 	free(ctx);
 	return res;
 }
 
+/*
+ * ESSIV: IV = AES_ENCRYPT(SHA256(FEK)[0..15], block index). The AES
+ * context keyed with the hash of the FEK is kept in the key context.
+ */
 static TEE_Result essiv(uint8_t iv[TEE_AES_BLOCK_SIZE],
-			const uint8_t fek[TEE_FS_KM_FEK_SIZE],
-			uint16_t blk_idx)
+			struct tee_fs_key_ctx *kc, uint16_t blk_idx)
 {
 	TEE_Result res;
 	uint8_t sha[TEE_SHA256_HASH_SIZE];
 	uint8_t pad_blkid[TEE_AES_BLOCK_SIZE] = { 0, };
 
-	res = sha256(sha, sizeof(sha), fek, TEE_FS_KM_FEK_SIZE);
-	if (res != TEE_SUCCESS)
-		return res;
+	if (!kc->essiv_ctx) {
+		res = sha256(sha, sizeof(sha), kc->fek, TEE_FS_KM_FEK_SIZE);
+		if (res == TEE_SUCCESS)
+			res = alloc_cipher_ctx(&kc->essiv_ctx,
+					       TEE_ALG_AES_ECB_NOPAD,
+					       TEE_MODE_ENCRYPT, sha, 16);
+		memset(sha, 0, sizeof(sha));
+		if (res != TEE_SUCCESS)
+			return res;
+	}
 
 	pad_blkid[0] = (blk_idx & 0xFF);
 	pad_blkid[1] = (blk_idx & 0xFF00) >> 8;
 
-	return aes_ecb(iv, pad_blkid, sha, 16);
+	return crypto_ops.cipher.update(kc->essiv_ctx, TEE_ALG_AES_ECB_NOPAD,
+					TEE_MODE_ENCRYPT, false, pad_blkid,
+					TEE_AES_BLOCK_SIZE, iv);
+}
+
+static void xor_block(uint8_t *dst, const uint8_t *a, const uint8_t *b)
+{
+	size_t n;
+
+	for (n = 0; n < TEE_AES_BLOCK_SIZE; n++)
+		dst[n] = a[n] ^ b[n];
+}
+
+/*
+ * CBC on top of the AES-ECB contexts of the key context, the key
+ * schedules are computed once per file instead of once per block.
+ * Both directions work in place.
+ */
+static TEE_Result cbc_encrypt(struct tee_fs_key_ctx *kc, uint8_t *out,
+			      const uint8_t *in, size_t size,
+			      const uint8_t iv[TEE_AES_BLOCK_SIZE])
+{
+	TEE_Result res;
+	uint8_t x[TEE_AES_BLOCK_SIZE];
+	const uint8_t *prev = iv;
+	size_t n;
+
+	if (!kc->enc_ctx) {
+		res = alloc_cipher_ctx(&kc->enc_ctx, TEE_ALG_AES_ECB_NOPAD,
+				       TEE_MODE_ENCRYPT, kc->fek,
+				       TEE_FS_KM_FEK_SIZE);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	for (n = 0; n < size; n += TEE_AES_BLOCK_SIZE) {
+		xor_block(x, in + n, prev);
+		res = crypto_ops.cipher.update(kc->enc_ctx,
+					       TEE_ALG_AES_ECB_NOPAD,
+					       TEE_MODE_ENCRYPT, false, x,
+					       TEE_AES_BLOCK_SIZE, out + n);
+		if (res != TEE_SUCCESS)
+			return res;
+		prev = out + n;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result cbc_decrypt(struct tee_fs_key_ctx *kc, uint8_t *out,
+			      const uint8_t *in, size_t size,
+			      const uint8_t iv[TEE_AES_BLOCK_SIZE])
+{
+	TEE_Result res;
+	uint8_t x[TEE_AES_BLOCK_SIZE];
+	size_t n;
+
+	if (!kc->dec_ctx) {
+		res = alloc_cipher_ctx(&kc->dec_ctx, TEE_ALG_AES_ECB_NOPAD,
+				       TEE_MODE_DECRYPT, kc->fek,
+				       TEE_FS_KM_FEK_SIZE);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	/* Last block first so that in place the previous block is intact */
+	for (n = size; n; n -= TEE_AES_BLOCK_SIZE) {
+		res = crypto_ops.cipher.update(kc->dec_ctx,
+					       TEE_ALG_AES_ECB_NOPAD,
+					       TEE_MODE_DECRYPT, false,
+					       in + n - TEE_AES_BLOCK_SIZE,
+					       TEE_AES_BLOCK_SIZE, x);
+		if (res != TEE_SUCCESS)
+			return res;
+		if (n > TEE_AES_BLOCK_SIZE)
+			xor_block(out + n - TEE_AES_BLOCK_SIZE, x,
+				  in + n - 2 * TEE_AES_BLOCK_SIZE);
+		else
+			xor_block(out, x, iv);
+	}
+
+	return TEE_SUCCESS;
 }
 
 /*
  * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV.
  */
-TEE_Result tee_fs_crypt_block(uint8_t *out, const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
-			      TEE_OperationMode mode)
+TEE_Result tee_fs_crypt_block(struct tee_fs_key_ctx *kc, uint8_t *out,
+			      const uint8_t *in, size_t size,
+			      uint16_t blk_idx, TEE_OperationMode mode)
 {
 	TEE_Result res;
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
 	uint8_t iv[TEE_AES_BLOCK_SIZE];
-	uint8_t *ctx;
-	size_t ctx_size;
-	uint32_t algo = TEE_ALG_AES_CBC_NOPAD;
 
 	DMSG("%scrypt block #%u", (mode == TEE_MODE_ENCRYPT) ? "En" : "De",
 	     blk_idx);
 
-	/* Decrypt FEK */
-	memcpy(fek, encrypted_fek, TEE_FS_KM_FEK_SIZE);
-	res = fek_crypt(TEE_MODE_DECRYPT, fek, TEE_FS_KM_FEK_SIZE);
+	if (size % TEE_AES_BLOCK_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = get_fek(kc);
 	if (res != TEE_SUCCESS)
 		return res;
 
 	/* Compute initialization vector for this block */
-	res = essiv(iv, fek, blk_idx);
-
-	/* Run AES CBC */
-	res = crypto_ops.cipher.get_ctx_size(algo, &ctx_size);
+	res = essiv(iv, kc, blk_idx);
 	if (res != TEE_SUCCESS)
 		return res;
-	ctx = malloc(ctx_size);
-	if (!ctx)
-		return TEE_ERROR_OUT_OF_MEMORY;
 
-	res = crypto_ops.cipher.init(ctx, algo, mode, fek, sizeof(fek), NULL,
-				     0, iv, TEE_AES_BLOCK_SIZE);
-	if (res != TEE_SUCCESS)
-		goto exit;
-	res = crypto_ops.cipher.update(ctx, algo, mode, true, in, size, out);
-	if (res != TEE_SUCCESS)
-		goto exit;
-
-	crypto_ops.cipher.final(ctx, algo);
-
-exit:
-	free(ctx);
-	return res;
+	if (mode == TEE_MODE_ENCRYPT)
+		return cbc_encrypt(kc, out, in, size, iv);
+	return cbc_decrypt(kc, out, in, size, iv);
 }
 
 service_init_late(tee_fs_init_key_manager);
-
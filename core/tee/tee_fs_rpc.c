@@ -611,3 +611,165 @@ exit:
 	DMSG("...%d", rc);
 	return rc;
 }
+
+static size_t batch_file_size(size_t path_len, size_t len)
+{
+	return sizeof(struct tee_fs_rpc_file) + ROUNDUP(path_len, 8) +
+	       ROUNDUP(len, 8);
+}
+
+TEE_Result tee_fs_rpc_batch_init(struct tee_fs_rpc_batch *b, int id, int op,
+				 size_t max_files, size_t data_size)
+{
+	paddr_t pa = 0;
+
+	assert(op == TEE_FS_WRITE_FILES || op == TEE_FS_READ_FILES ||
+	       op == TEE_FS_UNLINK_FILES);
+
+	memset(b, 0, sizeof(*b));
+	b->id = id;
+	b->op = op;
+	b->max_files = max_files;
+	b->size = sizeof(struct tee_fs_rpc) +
+		  max_files * batch_file_size(TEE_FS_RPC_PATH_MAX, 0) +
+		  ROUNDUP(data_size, 8) + max_files * 8;
+
+	b->files = calloc(max_files, sizeof(*b->files));
+	if (!b->files)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	thread_rpc_alloc_payload(b->size, &pa, &b->cookie);
+	if (!pa)
+		goto err;
+	if (!ALIGNMENT_IS_OK(pa, struct tee_fs_rpc))
+		goto err;
+	b->va = phys_to_virt(pa, MEM_AREA_NSEC_SHM);
+	if (!b->va)
+		goto err;
+
+	b->used = sizeof(struct tee_fs_rpc);
+	return TEE_SUCCESS;
+err:
+	tee_fs_rpc_batch_release(b);
+	return TEE_ERROR_OUT_OF_MEMORY;
+}
+
+void *tee_fs_rpc_batch_add(struct tee_fs_rpc_batch *b, const char *path,
+			   size_t len)
+{
+	struct tee_fs_rpc_file *f;
+	struct tee_fs_rpc_batch_file *bf;
+	size_t path_len = strlen(path) + 1;
+	size_t sz = batch_file_size(path_len, len);
+
+	if (b->num_files >= b->max_files || path_len > TEE_FS_RPC_PATH_MAX ||
+	    sz > b->size - b->used)
+		return NULL;
+
+	bf = b->files + b->num_files;
+	bf->hdr_offs = b->used;
+	bf->data_offs = b->used + sizeof(*f) + ROUNDUP(path_len, 8);
+	bf->len = len;
+
+	f = (struct tee_fs_rpc_file *)(b->va + bf->hdr_offs);
+	f->path_len = path_len;
+	f->len = len;
+	f->res = TEE_FS_RPC_FILE_PENDING;
+	f->reserved = 0;
+	memcpy(f + 1, path, path_len);
+
+	b->used += sz;
+	b->num_files++;
+
+	return b->va + bf->data_offs;
+}
+
+void tee_fs_rpc_batch_set_len(struct tee_fs_rpc_batch *b, size_t len)
+{
+	struct tee_fs_rpc_batch_file *bf = b->files + b->num_files - 1;
+	struct tee_fs_rpc_file *f;
+
+	assert(b->num_files && len <= bf->len);
+	f = (struct tee_fs_rpc_file *)(b->va + bf->hdr_offs);
+	f->len = len;
+	bf->len = len;
+}
+
+int tee_fs_rpc_batch_send(struct tee_fs_rpc_batch *b)
+{
+	struct optee_msg_param params;
+	struct tee_fs_rpc *head = (struct tee_fs_rpc *)b->va;
+	struct tee_fs_rpc_file *first;
+	int rc = RPC_FAILED;
+	TEE_Result res;
+
+	DMSG("(id: %d, op: %d, files: %zu)...", b->id, b->op, b->num_files);
+
+	memset(head, 0, sizeof(*head));
+	head->op = b->op;
+	head->fd = -1;
+	head->arg = b->num_files;
+	head->len = b->used - sizeof(*head);
+
+	memset(&params, 0, sizeof(params));
+	params.attr = OPTEE_MSG_ATTR_TYPE_TMEM_INOUT;
+	params.u.tmem.buf_ptr = virt_to_phys(b->va);
+	params.u.tmem.size = b->used;
+	params.u.tmem.shm_ref = b->cookie;
+	first = (struct tee_fs_rpc_file *)(b->va + sizeof(*head));
+
+	res = thread_rpc_cmd(b->id, 1, &params);
+	if (res == TEE_SUCCESS) {
+		rc = head->res;
+		/* Any file with a result, even a failure, proves support */
+		if (b->num_files && *(volatile int *)&first->res ==
+				    TEE_FS_RPC_FILE_PENDING)
+			b->unsupported = true;
+		else
+			b->supported = true;
+	} else if (res == TEE_ERROR_BAD_PARAMETERS ||
+		   res == TEE_ERROR_NOT_SUPPORTED ||
+		   res == TEE_ERROR_NOT_IMPLEMENTED) {
+		b->unsupported = true;
+	}
+
+	/* Normal world can't report more files than we sent */
+	if (rc > (int)b->num_files)
+		rc = RPC_FAILED;
+
+	DMSG("...%d", rc);
+	return rc;
+}
+
+const void *tee_fs_rpc_batch_get(struct tee_fs_rpc_batch *b, size_t idx,
+				 size_t *len)
+{
+	struct tee_fs_rpc_batch_file *bf;
+	struct tee_fs_rpc_file *f;
+	uint32_t l;
+	int r;
+
+	assert(b->op == TEE_FS_READ_FILES);
+	if (idx >= b->num_files)
+		return NULL;
+
+	bf = b->files + idx;
+	f = (struct tee_fs_rpc_file *)(b->va + bf->hdr_offs);
+
+	/* Read only once from non-secure memory and check the result */
+	l = *(volatile uint32_t *)&f->len;
+	r = *(volatile int *)&f->res;
+	if (r < 0 || r == TEE_FS_RPC_FILE_PENDING || l > bf->len)
+		return NULL;
+
+	*len = l;
+	return b->va + bf->data_offs;
+}
+
+void tee_fs_rpc_batch_release(struct tee_fs_rpc_batch *b)
+{
+	if (b->cookie)
+		thread_rpc_free_payload(b->cookie);
+	free(b->files);
+	memset(b, 0, sizeof(*b));
+}
@@ -27,6 +27,7 @@
 
 #include <tee/tee_obj.h>
 
+#include <slab.h>
 #include <stdlib.h>
 #include <tee_api_defines.h>
 #include <mm/tee_mmu.h>
@@ -37,28 +38,31 @@
 #include <tee/tee_svc_storage.h>
 #include <tee/tee_svc_cryp.h>
 
+static struct slab_cache tee_obj_cache =
+	SLAB_CACHE_INITIALIZER("Object", struct tee_obj, NULL, NULL);
+
 void tee_obj_add(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_INSERT_TAIL(&utc->objects, o, link);
+	ptr_hash_add(&utc->object_hash, &o->hash_node, (vaddr_t)o);
 }
 
 TEE_Result tee_obj_get(struct user_ta_ctx *utc, uint32_t obj_id,
 		       struct tee_obj **obj)
 {
-	struct tee_obj *o;
+	struct ptr_hash_node *n = ptr_hash_find(&utc->object_hash, obj_id);
 
-	TAILQ_FOREACH(o, &utc->objects, link) {
-		if (obj_id == (vaddr_t)o) {
-			*obj = o;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (!n)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*obj = container_of(n, struct tee_obj, hash_node);
+	return TEE_SUCCESS;
 }
 
 void tee_obj_close(struct user_ta_ctx *utc, struct tee_obj *o)
 {
 	TAILQ_REMOVE(&utc->objects, o, link);
+	ptr_hash_remove(&utc->object_hash, &o->hash_node);
 
 	if ((o->info.handleFlags & TEE_HANDLE_FLAG_PERSISTENT) && o->fd >= 0) {
 		o->pobj->fops->close(o->fd);
@@ -131,7 +135,7 @@ exit:
 
 struct tee_obj *tee_obj_alloc(void)
 {
-	return calloc(1, sizeof(struct tee_obj));
+	return slab_zalloc(&tee_obj_cache);
 }
 
 void tee_obj_free(struct tee_obj *o)
@@ -139,6 +143,6 @@ void tee_obj_free(struct tee_obj *o)
 	if (o) {
 		tee_obj_attr_free(o);
 		free(o->attr);
-		free(o);
+		slab_free(&tee_obj_cache, o);
 	}
 }
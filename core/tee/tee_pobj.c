@@ -25,6 +25,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <atomic.h>
+#include <kernel/mutex.h>
+#include <slab.h>
 #include <tee/tee_pobj.h>
 #include <trace.h>
 
@@ -33,6 +36,15 @@
 
 static TAILQ_HEAD(tee_pobjs, tee_pobj) tee_pobjs =
 		TAILQ_HEAD_INITIALIZER(tee_pobjs);
+/*
+ * Lookups of already opened objects only take the lock shared, the
+ * reference counter is then updated atomically. Adding, removing and
+ * renaming objects takes the lock exclusively.
+ */
+static struct rwlock pobjs_lock = RWLOCK_INITIALIZER;
+static struct slab_cache tee_pobj_cache =
+	SLAB_CACHE_INITIALIZER("Persistent object", struct tee_pobj, NULL,
+			       NULL);
 
 static TEE_Result tee_pobj_check_access(uint32_t oflags, uint32_t nflags)
 {
@@ -78,6 +90,38 @@ static TEE_Result tee_pobj_check_access(uint32_t oflags, uint32_t nflags)
 	return TEE_SUCCESS;
 }
 
+static struct tee_pobj *find_pobj(TEE_UUID *uuid, void *obj_id,
+				  uint32_t obj_id_len,
+				  const struct tee_file_operations *fops)
+{
+	struct tee_pobj *o;
+	struct tee_pobj *found = NULL;
+
+	TAILQ_FOREACH(o, &tee_pobjs, link) {
+		if ((obj_id_len == o->obj_id_len) &&
+		    (memcmp(obj_id, o->obj_id, obj_id_len) == 0) &&
+		    (memcmp(uuid, &o->uuid, sizeof(TEE_UUID)) == 0) &&
+		    (fops == o->fops)) {
+			found = o;
+		}
+	}
+
+	return found;
+}
+
+/* Requires pobjs_lock to be held, shared or exclusive */
+static TEE_Result get_open_pobj(struct tee_pobj *o, uint32_t flags)
+{
+	TEE_Result res;
+
+	res = tee_pobj_check_access(o->flags, flags);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	atomic_inc32(&o->refcnt);
+	return TEE_SUCCESS;
+}
+
 TEE_Result tee_pobj_get(TEE_UUID *uuid, void *obj_id, uint32_t obj_id_len,
 			uint32_t flags, const struct tee_file_operations *fops,
 			struct tee_pobj **obj)
@@ -88,31 +132,35 @@ TEE_Result tee_pobj_get(TEE_UUID *uuid, void *obj_id, uint32_t obj_id_len,
 	*obj = NULL;
 
 	/* Check if file is open */
-	TAILQ_FOREACH(o, &tee_pobjs, link) {
-		if ((obj_id_len == o->obj_id_len) &&
-		    (memcmp(obj_id, o->obj_id, obj_id_len) == 0) &&
-		    (memcmp(uuid, &o->uuid, sizeof(TEE_UUID)) == 0) &&
-		    (fops == o->fops)) {
+	rwlock_read_lock(&pobjs_lock);
+	o = find_pobj(uuid, obj_id, obj_id_len, fops);
+	if (o) {
+		res = get_open_pobj(o, flags);
+		if (res == TEE_SUCCESS)
 			*obj = o;
-		}
 	}
+	rwlock_read_unlock(&pobjs_lock);
+	if (o)
+		return res;
 
-	if (*obj) {
-		res = tee_pobj_check_access((*obj)->flags, flags);
-		if (res != TEE_SUCCESS) {
-			*obj = NULL;
-			return res;
-		}
+	rwlock_write_lock(&pobjs_lock);
 
-		(*obj)->refcnt++;
-		return TEE_SUCCESS;
+	/* The object may have been opened while the lock was released */
+	o = find_pobj(uuid, obj_id, obj_id_len, fops);
+	if (o) {
+		res = get_open_pobj(o, flags);
+		if (res == TEE_SUCCESS)
+			*obj = o;
+		goto out;
 	}
 
 	/* new file */
-	o = calloc(sizeof(struct tee_pobj), 1);
+	o = slab_zalloc(&tee_pobj_cache);
 
-	if (!o)
-		return TEE_ERROR_OUT_OF_MEMORY;
+	if (!o) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
 
 	o->refcnt = 1;
 	memcpy(&o->uuid, uuid, sizeof(TEE_UUID));
@@ -121,16 +169,19 @@ TEE_Result tee_pobj_get(TEE_UUID *uuid, void *obj_id, uint32_t obj_id_len,
 
 	o->obj_id = malloc(obj_id_len);
 	if (o->obj_id == NULL) {
-		free(o);
-		return TEE_ERROR_OUT_OF_MEMORY;
+		slab_free(&tee_pobj_cache, o);
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
 	}
 	memcpy(o->obj_id, obj_id, obj_id_len);
 	o->obj_id_len = obj_id_len;
 
 	TAILQ_INSERT_TAIL(&tee_pobjs, o, link);
 	*obj = o;
-
-	return TEE_SUCCESS;
+	res = TEE_SUCCESS;
+out:
+	rwlock_write_unlock(&pobjs_lock);
+	return res;
 }
 
 TEE_Result tee_pobj_release(struct tee_pobj *obj)
@@ -138,16 +189,31 @@ TEE_Result tee_pobj_release(struct tee_pobj *obj)
 	if (obj == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
+	rwlock_write_lock(&pobjs_lock);
 	obj->refcnt--;
 	if (obj->refcnt == 0) {
 		TAILQ_REMOVE(&tee_pobjs, obj, link);
 		free(obj->obj_id);
-		free(obj);
+		slab_free(&tee_pobj_cache, obj);
 	}
+	rwlock_write_unlock(&pobjs_lock);
 
 	return TEE_SUCCESS;
 }
 
+struct tee_pobj *tee_pobj_alloc_unlisted(void)
+{
+	return slab_zalloc(&tee_pobj_cache);
+}
+
+void tee_pobj_free_unlisted(struct tee_pobj *obj)
+{
+	if (obj) {
+		free(obj->obj_id);
+		slab_free(&tee_pobj_cache, obj);
+	}
+}
+
 TEE_Result tee_pobj_rename(struct tee_pobj *obj, void *obj_id,
 			   uint32_t obj_id_len)
 {
@@ -157,8 +223,12 @@ TEE_Result tee_pobj_rename(struct tee_pobj *obj, void *obj_id,
 	if (obj == NULL || obj_id == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	if (obj->refcnt != 1)
-		return TEE_ERROR_BAD_STATE;
+	rwlock_write_lock(&pobjs_lock);
+
+	if (obj->refcnt != 1) {
+		res = TEE_ERROR_BAD_STATE;
+		goto exit;
+	}
 
 	new_obj_id = malloc(obj_id_len);
 	if (new_obj_id == NULL) {
@@ -174,6 +244,7 @@ TEE_Result tee_pobj_rename(struct tee_pobj *obj, void *obj_id,
 	new_obj_id = NULL;
 
 exit:
+	rwlock_write_unlock(&pobjs_lock);
 	free(new_obj_id);
 	return res;
 }
@@ -32,6 +32,7 @@
 #include <kernel/panic.h>
 #include <mm/core_memprot.h>
 #include <optee_msg.h>
+#include <slab.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,10 +51,19 @@
 
 #define BLOCK_FILE_SIZE		(1 << BLOCK_FILE_SHIFT)
 
-#define MAX_NUM_CACHED_BLOCKS	1
+#ifdef CFG_REE_FS_BLOCK_CACHE
+#define MAX_NUM_CACHED_BLOCKS	CFG_REE_FS_BLOCK_CACHE_SIZE
+#endif
 
 #define NUM_BLOCKS_PER_FILE	1024
 
+/*
+ * Reads and writes covering at least REE_FS_BATCH_MIN_BLOCKS blocks are
+ * transferred with one RPC per REE_FS_BATCH_MAX_BLOCKS blocks.
+ */
+#define REE_FS_BATCH_MIN_BLOCKS	2
+#define REE_FS_BATCH_MAX_BLOCKS	16
+
 #define MAX_FILE_SIZE	(BLOCK_FILE_SIZE * NUM_BLOCKS_PER_FILE)
 
 struct tee_fs_file_info {
@@ -74,8 +84,23 @@ struct block {
 	int block_num;
 	uint8_t *data;
 	size_t data_size;
+	bool dirty;
 };
 
+static struct slab_cache block_slab_cache =
+	SLAB_CACHE_INITIALIZER("REE FS block", struct block, NULL, NULL);
+
+#ifdef CFG_REE_FS_BLOCK_CACHE
+/*
+ * The data of the cached blocks of each open file are allocated on open
+ * and freed on close. Without the block cache a single block is allocated
+ * once and kept, its data is allocated with malloc().
+ */
+static struct slab_cache block_data_slab_cache =
+	SLAB_CACHE_INITIALIZER("REE FS block data", uint8_t [BLOCK_FILE_SIZE],
+			       NULL, NULL);
+#endif
+
 struct block_cache {
 	struct block_head block_lru;
 	uint8_t cached_block_num;
@@ -89,6 +114,7 @@ struct tee_fs_fd {
 	bool is_new_file;
 	char *filename;
 	struct block_cache block_cache;
+	struct tee_fs_key_ctx key_ctx;
 };
 
 static inline int pos_to_block_num(int position)
@@ -125,21 +151,54 @@ struct block_operations {
 
 	/*
 	 * Read a block from REE File System which is corresponding
-	 * to the given block_num.
+	 * to the given block_num. new_meta is the meta of an ongoing
+	 * update, or NULL, it's needed if a modified block has to be
+	 * written back to make room for the new block.
 	 */
-	struct block *(*read)(struct tee_fs_fd *fdp, int block_num);
+	struct block *(*read)(struct tee_fs_fd *fdp, int block_num,
+			struct tee_fs_file_meta *new_meta);
 
 	/*
-	 * Write the given block to REE File System
+	 * Write the given block to REE File System, may be deferred
+	 * until flush() is called.
 	 */
 	int (*write)(struct tee_fs_fd *fdp, struct block *b,
 			struct tee_fs_file_meta *new_meta);
+
+	/*
+	 * Write all deferred blocks to REE File System, must be called
+	 * before new_meta is committed.
+	 */
+	int (*flush)(struct tee_fs_fd *fdp,
+			struct tee_fs_file_meta *new_meta);
+
+	/*
+	 * Drop all cached blocks, used when an update has failed or the
+	 * file has been truncated.
+	 */
+	void (*invalidate)(struct tee_fs_fd *fdp);
 };
 
 static struct handle_db fs_handle_db = HANDLE_DB_INITIALIZER;
 
 static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
 
+#ifdef CFG_REE_FS_BLOCK_CACHE
+/* Protected by ree_fs_mutex */
+static struct tee_fs_cache_stats ree_fs_cache_stats;
+#endif
+
+/*
+ * Whether tee-supplicant supports batched RPCs, settled by the first reply
+ * that shows it one way or the other and final from then on. Protected by
+ * ree_fs_mutex.
+ */
+static enum {
+	REE_FS_BATCH_UNKNOWN,
+	REE_FS_BATCH_SUPPORTED,
+	REE_FS_BATCH_UNSUPPORTED,
+} ree_fs_batch;
+
 /*
  * We split a TEE file into multiple blocks and store them
  * on REE filesystem. A TEE file is represented by a REE file
@@ -254,9 +313,13 @@ static int create_block_file(struct tee_fs_fd *fdp,
 
 	/*
 	 * toggle block version in new meta to indicate
-	 * we are currently working on new block file
+	 * we are currently working on new block file, unless it's
+	 * already done as the block is written more than once in this
+	 * update
 	 */
-	toggle_backup_version_of_block(new_meta, block_num);
+	if (get_backup_version_of_block(new_meta, block_num) !=
+	    new_version)
+		toggle_backup_version_of_block(new_meta, block_num);
 	res = fd;
 
 exit:
@@ -295,13 +358,10 @@ static int remove_outdated_block(struct tee_fs_fd *fdp, size_t block_num)
 	return __remove_block_file(fdp, block_num, true);
 }
 
-/*
- * encrypted_fek: as input for META_FILE and BLOCK_FILE
- */
 static int encrypt_and_write_file(int fd,
 		enum tee_fs_file_type file_type,
 		void *data_in, size_t data_in_size,
-		uint8_t *encrypted_fek)
+		struct tee_fs_key_ctx *kc)
 {
 	TEE_Result tee_res;
 	int res = 0;
@@ -317,9 +377,9 @@ static int encrypt_and_write_file(int fd,
 		return -1;
 	}
 
-	tee_res = tee_fs_encrypt_file(file_type,
+	tee_res = tee_fs_key_ctx_encrypt(kc, file_type,
 			data_in, data_in_size,
-			ciphertext, &ciphertext_size, encrypted_fek);
+			ciphertext, &ciphertext_size);
 	if (tee_res != TEE_SUCCESS) {
 		EMSG("error code=%x", tee_res);
 		res = -1;
@@ -342,13 +402,12 @@ fail:
 }
 
 /*
- * encrypted_fek: as output for META_FILE
- *                as input for BLOCK_FILE
+ * kc: a key context without a key picks up the FEK of a META_FILE
  */
 static int read_and_decrypt_file(int fd,
 		enum tee_fs_file_type file_type,
 		void *data_out, size_t *data_out_size,
-		uint8_t *encrypted_fek)
+		struct tee_fs_key_ctx *kc)
 {
 	TEE_Result tee_res;
 	int res;
@@ -380,10 +439,9 @@ static int read_and_decrypt_file(int fd,
 		goto fail;
 	}
 
-	tee_res = tee_fs_decrypt_file(file_type,
+	tee_res = tee_fs_key_ctx_decrypt(kc, file_type,
 			ciphertext, file_size,
-			data_out, data_out_size,
-			encrypted_fek);
+			data_out, data_out_size);
 	if (tee_res != TEE_SUCCESS) {
 		EMSG("Failed to decrypt file, res=0x%x", tee_res);
 		res = -1;
@@ -413,7 +471,7 @@ exit:
 }
 
 static int write_meta_file(const char *filename,
-		struct tee_fs_file_meta *meta)
+		struct tee_fs_file_meta *meta, struct tee_fs_key_ctx *kc)
 {
 	int res, fd = -1;
 	char meta_path[REE_FS_NAME_MAX];
@@ -426,8 +484,7 @@ static int write_meta_file(const char *filename,
 		return -1;
 
 	res = encrypt_and_write_file(fd, META_FILE,
-			(void *)&meta->info, sizeof(meta->info),
-			meta->encrypted_fek);
+			(void *)&meta->info, sizeof(meta->info), kc);
 
 	tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fd);
 	return res;
@@ -437,6 +494,7 @@ static struct tee_fs_file_meta *create_meta_file(const char *file)
 {
 	TEE_Result tee_res;
 	struct tee_fs_file_meta *meta = NULL;
+	struct tee_fs_key_ctx kc;
 	int res;
 	const uint8_t default_backup_version = 0;
 
@@ -456,7 +514,9 @@ static struct tee_fs_file_meta *create_meta_file(const char *file)
 
 	meta->backup_version = default_backup_version;
 
-	res = write_meta_file(file, meta);
+	tee_fs_key_ctx_init(&kc, meta->encrypted_fek);
+	res = write_meta_file(file, meta, &kc);
+	tee_fs_key_ctx_final(&kc);
 	if (res < 0)
 		goto exit;
 
@@ -478,7 +538,7 @@ static int commit_meta_file(struct tee_fs_fd *fdp,
 	old_version = new_meta->backup_version;
 	new_meta->backup_version = !new_meta->backup_version;
 
-	res = write_meta_file(fdp->filename, new_meta);
+	res = write_meta_file(fdp->filename, new_meta, &fdp->key_ctx);
 
 	if (res < 0)
 		return res;
@@ -506,6 +566,7 @@ static int read_meta_file(const char *meta_path,
 {
 	int res, fd;
 	size_t meta_info_size = sizeof(struct tee_fs_file_info);
+	struct tee_fs_key_ctx kc;
 
 	res = tee_fs_rpc_open(OPTEE_MSG_RPC_CMD_FS, meta_path, TEE_FS_O_RDWR);
 	if (res < 0)
@@ -513,9 +574,12 @@ static int read_meta_file(const char *meta_path,
 
 	fd = res;
 
+	memset(&kc, 0, sizeof(kc));
 	res = read_and_decrypt_file(fd, META_FILE,
-			(void *)&meta->info, &meta_info_size,
-			meta->encrypted_fek);
+			(void *)&meta->info, &meta_info_size, &kc);
+	memcpy(meta->encrypted_fek, kc.encrypted_fek,
+	       sizeof(meta->encrypted_fek));
+	tee_fs_key_ctx_final(&kc);
 
 	tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fd);
 
@@ -580,8 +644,7 @@ static int read_block_from_storage(struct tee_fs_fd *fdp, struct block *b)
 		return fd;
 
 	res = read_and_decrypt_file(fd, BLOCK_FILE,
-			plaintext, &block_file_size,
-			fdp->meta->encrypted_fek);
+			plaintext, &block_file_size, &fdp->key_ctx);
 	if (res < 0) {
 		EMSG("Failed to read and decrypt file");
 		goto fail;
@@ -611,8 +674,7 @@ static int flush_block_to_storage(struct tee_fs_fd *fdp, struct block *b,
 	}
 
 	res = encrypt_and_write_file(fd, BLOCK_FILE,
-			b->data, b->data_size,
-			new_meta->encrypted_fek);
+			b->data, b->data_size, &fdp->key_ctx);
 	if (res < 0) {
 		EMSG("Failed to encrypt and write block file");
 		goto fail;
@@ -702,11 +764,15 @@ static struct block *alloc_block(void)
 {
 	struct block *c;
 
-	c = malloc(sizeof(struct block));
+	c = slab_alloc(&block_slab_cache);
 	if (!c)
 		return NULL;
 
+#ifdef CFG_REE_FS_BLOCK_CACHE
+	c->data = slab_alloc(&block_data_slab_cache);
+#else
 	c->data = malloc(BLOCK_FILE_SIZE);
+#endif
 	if (!c->data) {
 		EMSG("unable to alloc memory for block data");
 		goto exit;
@@ -714,20 +780,21 @@ static struct block *alloc_block(void)
 
 	c->block_num = -1;
 	c->data_size = 0;
+	c->dirty = false;
 
 	return c;
 
 exit:
-	free(c);
+	slab_free(&block_slab_cache, c);
 	return NULL;
 }
 
-#ifdef CFG_FS_BLOCK_CACHE
+#ifdef CFG_REE_FS_BLOCK_CACHE
 static void free_block(struct block *b)
 {
 	if (b) {
-		free(b->data);
-		free(b);
+		slab_free(&block_data_slab_cache, b->data);
+		slab_free(&block_slab_cache, b);
 	}
 }
 
@@ -736,9 +803,11 @@ static inline bool is_block_data_invalid(struct block *b)
 	return (b->data_size == 0);
 }
 
-static void get_block_from_cache(struct block_cache *cache,
-			int block_num, struct block **out_block)
+static int get_block_from_cache(struct tee_fs_fd *fdp, int block_num,
+			struct tee_fs_file_meta *new_meta,
+			struct block **out_block)
 {
+	struct block_cache *cache = &fdp->block_cache;
 	struct block *b, *found = NULL;
 
 	DMSG("Try to find block%d in cache", block_num);
@@ -754,16 +823,29 @@ static void get_block_from_cache(struct block_cache *cache,
 		TAILQ_REMOVE(&cache->block_lru, found, list);
 		TAILQ_INSERT_HEAD(&cache->block_lru, found, list);
 		*out_block = found;
-		return;
+		if (!is_block_data_invalid(found))
+			ree_fs_cache_stats.hits++;
+		return 0;
 	}
 
 	DMSG("Not found, reuse oldest block on LRU list");
 	b = TAILQ_LAST(&cache->block_lru, block_head);
+	if (b->block_num >= 0)
+		ree_fs_cache_stats.evictions++;
+	if (b->dirty) {
+		/* Dirty blocks only exist while an update is ongoing */
+		assert(new_meta);
+		if (flush_block_to_storage(fdp, b, new_meta))
+			return -1;
+		b->dirty = false;
+		ree_fs_cache_stats.writebacks++;
+	}
 	TAILQ_REMOVE(&cache->block_lru, b, list);
 	TAILQ_INSERT_HEAD(&cache->block_lru, b, list);
 	b->block_num = block_num;
 	b->data_size = 0;
 	*out_block = b;
+	return 0;
 }
 
 static int init_block_cache(struct block_cache *cache)
@@ -801,6 +883,15 @@ static void destroy_block_cache(struct block_cache *cache)
 		free_block(b);
 	}
 }
+
+void tee_ree_fs_get_cache_stats(struct tee_fs_cache_stats *stats, bool reset)
+{
+	mutex_lock(&ree_fs_mutex);
+	*stats = ree_fs_cache_stats;
+	if (reset)
+		memset(&ree_fs_cache_stats, 0, sizeof(ree_fs_cache_stats));
+	mutex_unlock(&ree_fs_mutex);
+}
 #else
 static int init_block_cache(struct block_cache *cache __unused)
 {
@@ -833,24 +924,92 @@ static void read_data_from_block(struct block *b, int offset,
 	memcpy(buf, b->data + offset, len);
 }
 
-#ifdef CFG_FS_BLOCK_CACHE
-static struct block *read_block_with_cache(struct tee_fs_fd *fdp, int block_num)
+#ifdef CFG_REE_FS_BLOCK_CACHE
+static struct block *read_block_with_cache(struct tee_fs_fd *fdp, int block_num,
+			struct tee_fs_file_meta *new_meta)
 {
 	struct block *b;
 
-	get_block_from_cache(&fdp->block_cache, block_num, &b);
-	if (is_block_data_invalid(b))
+	if (get_block_from_cache(fdp, block_num, new_meta, &b)) {
+		EMSG("Unable to write back cached block");
+		return NULL;
+	}
+	if (is_block_data_invalid(b)) {
+		ree_fs_cache_stats.misses++;
 		if (read_block_from_storage(fdp, b)) {
 			EMSG("Unable to read block%d from storage",
 					block_num);
+			b->block_num = -1;
 			return NULL;
 		}
+	}
 
 	return b;
 }
+
+static int write_block_to_cache(struct tee_fs_fd *fdp __unused,
+			struct block *b,
+			struct tee_fs_file_meta *new_meta __unused)
+{
+	/* Written back by flush_cached_blocks() or when evicted */
+	b->dirty = true;
+	return 0;
+}
+
+static int flush_cached_blocks(struct tee_fs_fd *fdp,
+			struct tee_fs_file_meta *new_meta)
+{
+	struct block *b;
+
+	TAILQ_FOREACH(b, &fdp->block_cache.block_lru, list) {
+		if (!b->dirty)
+			continue;
+		if (flush_block_to_storage(fdp, b, new_meta))
+			return -1;
+		b->dirty = false;
+		ree_fs_cache_stats.writebacks++;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the number of consecutive blocks starting at block_num, at most
+ * max_blocks, without valid data in the cache. Dirty blocks only exist
+ * while an update is ongoing, so the blocks which aren't cached are
+ * current in storage.
+ */
+static size_t num_uncached_blocks(struct tee_fs_fd *fdp, int block_num,
+			size_t max_blocks)
+{
+	struct block *b;
+	size_t n = max_blocks;
+
+	TAILQ_FOREACH(b, &fdp->block_cache.block_lru, list) {
+		assert(!b->dirty);
+		if (b->block_num >= block_num &&
+		    b->block_num < block_num + (int)n &&
+		    !is_block_data_invalid(b))
+			n = b->block_num - block_num;
+	}
+
+	return n;
+}
+
+static void invalidate_cached_blocks(struct tee_fs_fd *fdp)
+{
+	struct block *b;
+
+	TAILQ_FOREACH(b, &fdp->block_cache.block_lru, list) {
+		b->block_num = -1;
+		b->data_size = 0;
+		b->dirty = false;
+	}
+}
 #else
 
-static struct block *read_block_no_cache(struct tee_fs_fd *fdp, int block_num)
+static struct block *read_block_no_cache(struct tee_fs_fd *fdp, int block_num,
+			struct tee_fs_file_meta *new_meta __unused)
 {
 	static struct block *b;
 	int res;
@@ -866,17 +1025,56 @@ static struct block *read_block_no_cache(struct tee_fs_fd *fdp, int block_num)
 
 	return res ? NULL : b;
 }
+
+static int flush_no_cache(struct tee_fs_fd *fdp __unused,
+			struct tee_fs_file_meta *new_meta __unused)
+{
+	return 0;
+}
+
+static void invalidate_no_cache(struct tee_fs_fd *fdp __unused)
+{
+}
+
+static size_t num_uncached_blocks(struct tee_fs_fd *fdp __unused,
+			int block_num __unused, size_t max_blocks)
+{
+	return max_blocks;
+}
 #endif
 
 static struct block_operations block_ops = {
-#ifdef CFG_FS_BLOCK_CACHE
+#ifdef CFG_REE_FS_BLOCK_CACHE
 	.read = read_block_with_cache,
+	.write = write_block_to_cache,
+	.flush = flush_cached_blocks,
+	.invalidate = invalidate_cached_blocks,
 #else
 	.read = read_block_no_cache,
-#endif
 	.write = flush_block_to_storage,
+	.flush = flush_no_cache,
+	.invalidate = invalidate_no_cache,
+#endif
 };
 
+/*
+ * Writes all blocks modified by the update and then the new meta,
+ * the cached blocks are dropped if anything fails.
+ */
+static int commit_update(struct tee_fs_fd *fdp,
+		struct tee_fs_file_meta *new_meta)
+{
+	int res;
+
+	res = block_ops.flush(fdp, new_meta);
+	if (!res)
+		res = commit_meta_file(fdp, new_meta);
+	if (res < 0)
+		block_ops.invalidate(fdp);
+
+	return res;
+}
+
 static int out_of_place_write(struct tee_fs_fd *fdp, const void *buf,
 		size_t len, struct tee_fs_file_meta *new_meta)
 {
@@ -895,7 +1093,7 @@ static int out_of_place_write(struct tee_fs_fd *fdp, const void *buf,
 		if (size_to_write + offset > BLOCK_FILE_SIZE)
 			size_to_write = BLOCK_FILE_SIZE - offset;
 
-		b = block_ops.read(fdp, start_block_num);
+		b = block_ops.read(fdp, start_block_num, new_meta);
 		if (!b)
 			goto failed;
 
@@ -920,10 +1118,314 @@ static int out_of_place_write(struct tee_fs_fd *fdp, const void *buf,
 
 	return 0;
 failed:
+	block_ops.invalidate(fdp);
 	fdp->pos = orig_pos;
 	return -1;
 }
 
+static size_t get_stored_file_size(enum tee_fs_file_type file_type,
+		size_t data_size)
+{
+#ifndef CFG_ENC_FS
+	if (file_type == BLOCK_FILE)
+		return data_size;
+#endif
+	return tee_fs_get_header_size(file_type) + data_size;
+}
+
+static int add_file_to_batch(struct tee_fs_rpc_batch *batch,
+		const char *path, enum tee_fs_file_type file_type,
+		const void *data, size_t data_size,
+		struct tee_fs_key_ctx *kc)
+{
+	size_t file_size = get_stored_file_size(file_type, data_size);
+	uint8_t *out;
+
+	out = tee_fs_rpc_batch_add(batch, path, file_size);
+	if (!out)
+		return -1;
+
+#ifndef CFG_ENC_FS
+	if (file_type == BLOCK_FILE) {
+		memcpy(out, data, data_size);
+		return 0;
+	}
+#endif
+
+	/* Encrypt straight into the shared buffer */
+	if (tee_fs_key_ctx_encrypt(kc, file_type, data, data_size, out,
+				   &file_size) != TEE_SUCCESS)
+		return -1;
+	tee_fs_rpc_batch_set_len(batch, file_size);
+	return 0;
+}
+
+static int add_block_to_batch(struct tee_fs_fd *fdp,
+		struct tee_fs_rpc_batch *batch, int block_num,
+		const void *data, size_t data_size,
+		struct tee_fs_file_meta *new_meta)
+{
+	char block_path[REE_FS_NAME_MAX];
+	uint8_t new_version =
+		!get_backup_version_of_block(fdp->meta, block_num);
+
+	get_block_filepath(fdp->filename, block_num, new_version,
+			block_path);
+
+	if (add_file_to_batch(batch, block_path, BLOCK_FILE, data, data_size,
+			      &fdp->key_ctx))
+		return -1;
+
+	if (get_backup_version_of_block(new_meta, block_num) != new_version)
+		toggle_backup_version_of_block(new_meta, block_num);
+	return 0;
+}
+
+static bool use_batch(int num_blocks)
+{
+	return ree_fs_batch != REE_FS_BATCH_UNSUPPORTED &&
+	       num_blocks >= REE_FS_BATCH_MIN_BLOCKS;
+}
+
+static int send_batch(struct tee_fs_rpc_batch *batch)
+{
+	int rc = tee_fs_rpc_batch_send(batch);
+
+	if (ree_fs_batch != REE_FS_BATCH_UNKNOWN)
+		return rc;
+	if (batch->unsupported) {
+		DMSG("Batched RPCs not supported");
+		ree_fs_batch = REE_FS_BATCH_UNSUPPORTED;
+	} else if (batch->supported) {
+		ree_fs_batch = REE_FS_BATCH_SUPPORTED;
+	}
+	return rc;
+}
+
+/*
+ * Same as out_of_place_write() followed by commit_update(), but the new
+ * block files are written REE_FS_BATCH_MAX_BLOCKS at a time and the new
+ * meta file is the last file of the last batch. tee-supplicant processes
+ * the files of a batch in order so the update is still committed only
+ * once all blocks have been written.
+ */
+static int batched_write(struct tee_fs_fd *fdp, const void *buf,
+		size_t len, struct tee_fs_file_meta *new_meta)
+{
+	int start_block_num = pos_to_block_num(fdp->pos);
+	int end_block_num = pos_to_block_num(fdp->pos + len - 1);
+	size_t remain_bytes = len;
+	const uint8_t *data_ptr = buf;
+	tee_fs_off_t orig_pos = fdp->pos;
+	size_t orig_length = new_meta->info.length;
+	uint8_t old_version = new_meta->backup_version;
+	char meta_path[REE_FS_NAME_MAX];
+	struct tee_fs_rpc_batch batch;
+	size_t data_size;
+	size_t num_blocks;
+	int res = -1;
+
+	memset(&batch, 0, sizeof(batch));
+
+	while (start_block_num <= end_block_num) {
+		num_blocks = MIN(end_block_num - start_block_num + 1,
+				 REE_FS_BATCH_MAX_BLOCKS);
+		data_size = num_blocks *
+			    get_stored_file_size(BLOCK_FILE, BLOCK_FILE_SIZE) +
+			    get_stored_file_size(META_FILE,
+						 sizeof(new_meta->info));
+
+		if (tee_fs_rpc_batch_init(&batch, OPTEE_MSG_RPC_CMD_FS,
+					  TEE_FS_WRITE_FILES, num_blocks + 1,
+					  data_size) != TEE_SUCCESS)
+			goto failed;
+
+		while (num_blocks--) {
+			int offset = fdp->pos % BLOCK_FILE_SIZE;
+			size_t size_to_write = MIN(remain_bytes,
+					(size_t)(BLOCK_FILE_SIZE - offset));
+			const void *block_data = data_ptr;
+			size_t block_size = BLOCK_FILE_SIZE;
+
+			if (size_to_write != BLOCK_FILE_SIZE) {
+				/* Partial block, merge with current content */
+				struct block *b;
+
+				b = block_ops.read(fdp, start_block_num,
+						   new_meta);
+				if (!b)
+					goto failed;
+				write_data_to_block(b, offset, (void *)data_ptr,
+						    size_to_write);
+				block_data = b->data;
+				block_size = b->data_size;
+			}
+
+			if (add_block_to_batch(fdp, &batch, start_block_num,
+					       block_data, block_size,
+					       new_meta))
+				goto failed;
+
+			data_ptr += size_to_write;
+			remain_bytes -= size_to_write;
+			start_block_num++;
+			fdp->pos += size_to_write;
+		}
+
+		if (start_block_num > end_block_num) {
+			if (fdp->pos > (tee_fs_off_t)new_meta->info.length)
+				new_meta->info.length = fdp->pos;
+			new_meta->backup_version = !old_version;
+			get_meta_filepath(fdp->filename,
+					  new_meta->backup_version, meta_path);
+			if (add_file_to_batch(&batch, meta_path, META_FILE,
+					      &new_meta->info,
+					      sizeof(new_meta->info),
+					      &fdp->key_ctx))
+				goto failed;
+		}
+
+		if (send_batch(&batch) != (int)batch.num_files)
+			goto failed;
+		tee_fs_rpc_batch_release(&batch);
+	}
+
+	/* The new meta is committed, see commit_meta_file() */
+	memcpy(fdp->meta, new_meta, sizeof(*new_meta));
+	get_meta_filepath(fdp->filename, old_version, meta_path);
+	tee_fs_rpc_unlink(OPTEE_MSG_RPC_CMD_FS, meta_path);
+	res = 0;
+	goto out;
+
+failed:
+	tee_fs_rpc_batch_release(&batch);
+	new_meta->backup_version = old_version;
+	new_meta->info.length = orig_length;
+	fdp->pos = orig_pos;
+out:
+	/* Cached blocks are either stale or hold uncommitted data */
+	block_ops.invalidate(fdp);
+	return res;
+}
+
+/*
+ * Reads num_blocks complete blocks starting at block_num with a single
+ * RPC and decrypts them into data_out.
+ */
+static int batched_read(struct tee_fs_fd *fdp, int block_num,
+		size_t num_blocks, uint8_t *data_out)
+{
+	size_t file_size = get_stored_file_size(BLOCK_FILE, BLOCK_FILE_SIZE);
+	char block_path[REE_FS_NAME_MAX];
+	struct tee_fs_rpc_batch batch;
+	uint8_t *ciphertext = NULL;
+	int res = -1;
+	size_t n;
+
+	if (tee_fs_rpc_batch_init(&batch, OPTEE_MSG_RPC_CMD_FS,
+				  TEE_FS_READ_FILES, num_blocks,
+				  num_blocks * file_size) != TEE_SUCCESS)
+		return -1;
+
+	for (n = 0; n < num_blocks; n++) {
+		uint8_t version = get_backup_version_of_block(fdp->meta,
+							      block_num + n);
+
+		get_block_filepath(fdp->filename, block_num + n, version,
+				   block_path);
+		if (!tee_fs_rpc_batch_add(&batch, block_path, file_size))
+			goto exit;
+	}
+
+	if (send_batch(&batch) != (int)num_blocks)
+		goto exit;
+
+	ciphertext = malloc(file_size);
+	if (!ciphertext)
+		goto exit;
+
+	for (n = 0; n < num_blocks; n++) {
+		size_t plaintext_size = BLOCK_FILE_SIZE;
+		const void *p;
+		size_t len;
+
+		p = tee_fs_rpc_batch_get(&batch, n, &len);
+		if (!p || len != file_size)
+			goto exit;
+
+		/* The normal world can modify the shared buffer at any time */
+		memcpy(ciphertext, p, len);
+#ifdef CFG_ENC_FS
+		if (tee_fs_key_ctx_decrypt(&fdp->key_ctx, BLOCK_FILE,
+					   ciphertext, len, data_out,
+					   &plaintext_size) != TEE_SUCCESS ||
+		    plaintext_size != BLOCK_FILE_SIZE) {
+			EMSG("Failed to decrypt block%zu", block_num + n);
+			goto exit;
+		}
+#else
+		memcpy(data_out, ciphertext, plaintext_size);
+#endif
+		data_out += BLOCK_FILE_SIZE;
+	}
+	res = 0;
+exit:
+	free(ciphertext);
+	tee_fs_rpc_batch_release(&batch);
+	return res;
+}
+
+/* Removes the outdated version of blocks start_block_num..end_block_num */
+static void remove_outdated_blocks(struct tee_fs_fd *fdp,
+		int start_block_num, int end_block_num)
+{
+	char block_path[REE_FS_NAME_MAX];
+	struct tee_fs_rpc_batch batch;
+	size_t num_blocks;
+
+	if (!use_batch(end_block_num - start_block_num + 1))
+		goto one_by_one;
+
+	while (start_block_num <= end_block_num) {
+		num_blocks = MIN(end_block_num - start_block_num + 1,
+				 REE_FS_BATCH_MAX_BLOCKS);
+		if (tee_fs_rpc_batch_init(&batch, OPTEE_MSG_RPC_CMD_FS,
+					  TEE_FS_UNLINK_FILES, num_blocks,
+					  0) != TEE_SUCCESS)
+			goto one_by_one;
+
+		while (batch.num_files < num_blocks) {
+			int block_num = start_block_num + batch.num_files;
+			uint8_t version =
+				!get_backup_version_of_block(fdp->meta,
+							     block_num);
+
+			get_block_filepath(fdp->filename, block_num, version,
+					   block_path);
+			if (!tee_fs_rpc_batch_add(&batch, block_path, 0))
+				break;
+		}
+
+		if (batch.num_files != num_blocks ||
+		    send_batch(&batch) != (int)num_blocks) {
+			tee_fs_rpc_batch_release(&batch);
+			goto one_by_one;
+		}
+		tee_fs_rpc_batch_release(&batch);
+		start_block_num += num_blocks;
+	}
+	return;
+
+one_by_one:
+	while (start_block_num <= end_block_num) {
+		if (remove_outdated_block(fdp, start_block_num))
+			IMSG("Warning: Failed to free old block: %d",
+				start_block_num);
+
+		start_block_num++;
+	}
+}
+
 static inline int create_hard_link(const char *old_dir,
 			const char *new_dir,
 			const char *filename)
@@ -1112,6 +1614,7 @@ static int ree_fs_open(TEE_Result *errno, const char *file, int flags, ...)
 	fdp->flags = flags;
 	fdp->meta = meta;
 	fdp->pos = 0;
+	tee_fs_key_ctx_init(&fdp->key_ctx, meta->encrypted_fek);
 	if (init_block_cache(&fdp->block_cache)) {
 		res = -1;
 		goto exit_free_fd;
@@ -1146,6 +1649,7 @@ exit_free_filename:
 exit_destroy_block_cache:
 	destroy_block_cache(&fdp->block_cache);
 exit_free_fd:
+	tee_fs_key_ctx_final(&fdp->key_ctx);
 	free(fdp);
 exit_free_meta:
 	free(meta);
@@ -1168,6 +1672,7 @@ static int ree_fs_close(int fd)
 	handle_put(&fs_handle_db, fdp->fd);
 
 	destroy_block_cache(&fdp->block_cache);
+	tee_fs_key_ctx_final(&fdp->key_ctx);
 	free(fdp->meta);
 	free(fdp->filename);
 	free(fdp);
@@ -1301,6 +1806,9 @@ static int ree_fs_ftruncate_internal(TEE_Result *errno, struct tee_fs_fd *fdp,
 
 		DMSG("Truncate file length to %zu", (size_t)new_file_len);
 
+		/* Cached blocks may hold data beyond the new length */
+		block_ops.invalidate(fdp);
+
 		res = commit_meta_file(fdp, new_meta);
 		if (res < 0) {
 			*errno = TEE_ERROR_CORRUPT_OBJECT;
@@ -1357,7 +1865,7 @@ static int ree_fs_ftruncate_internal(TEE_Result *errno, struct tee_fs_fd *fdp,
 		fdp->pos = orig_pos;
 
 		if (res == 0) {
-			res = commit_meta_file(fdp, new_meta);
+			res = commit_update(fdp, new_meta);
 			if (res < 0) {
 				*errno = TEE_ERROR_CORRUPT_OBJECT;
 				EMSG("Failed to commit meta file");
@@ -1381,6 +1889,7 @@ static int ree_fs_read(TEE_Result *errno, int fd, void *buf, size_t len)
 	size_t remain_bytes = len;
 	uint8_t *data_ptr = buf;
 	struct tee_fs_fd *fdp;
+	bool batch_failed = false;
 
 	mutex_lock(&ree_fs_mutex);
 
@@ -1426,6 +1935,27 @@ static int ree_fs_read(TEE_Result *errno, int fd, void *buf, size_t len)
 		int offset = fdp->pos % BLOCK_FILE_SIZE;
 		size_t size_to_read = remain_bytes > BLOCK_FILE_SIZE ?
 			BLOCK_FILE_SIZE : remain_bytes;
+		size_t num_blocks = 0;
+
+		/* Blocks found in the cache are read from the cache below */
+		if (!offset && !batch_failed)
+			num_blocks = num_uncached_blocks(fdp, start_block_num,
+					MIN(remain_bytes / BLOCK_FILE_SIZE,
+					    (size_t)REE_FS_BATCH_MAX_BLOCKS));
+
+		if (use_batch(num_blocks)) {
+			size_to_read = num_blocks * BLOCK_FILE_SIZE;
+			if (!batched_read(fdp, start_block_num, num_blocks,
+					  data_ptr)) {
+				data_ptr += size_to_read;
+				remain_bytes -= size_to_read;
+				fdp->pos += size_to_read;
+				start_block_num += num_blocks;
+				continue;
+			}
+			batch_failed = true;
+			size_to_read = BLOCK_FILE_SIZE;
+		}
 
 		if (size_to_read + offset > BLOCK_FILE_SIZE)
 			size_to_read = BLOCK_FILE_SIZE - offset;
@@ -1433,7 +1963,7 @@ static int ree_fs_read(TEE_Result *errno, int fd, void *buf, size_t len)
 		DMSG("block_num:%d, offset:%d, size_to_read: %zd",
 			start_block_num, offset, size_to_read);
 
-		b = block_ops.read(fdp, start_block_num);
+		b = block_ops.read(fdp, start_block_num, NULL);
 		if (!b) {
 			*errno = TEE_ERROR_CORRUPT_OBJECT;
 			goto exit;
@@ -1484,6 +2014,7 @@ static int ree_fs_write(TEE_Result *errno, int fd, const void *buf, size_t len)
 	struct tee_fs_fd *fdp;
 	size_t file_size;
 	int orig_pos;
+	bool batched;
 
 	mutex_lock(&ree_fs_mutex);
 
@@ -1533,31 +2064,25 @@ static int ree_fs_write(TEE_Result *errno, int fd, const void *buf, size_t len)
 		goto exit;
 	}
 
-	res = out_of_place_write(fdp, buf, len, new_meta);
-	if (res < 0) {
-		*errno = TEE_ERROR_CORRUPT_OBJECT;
+	batched = use_batch(pos_to_block_num(fdp->pos + len - 1) -
+			    pos_to_block_num(fdp->pos) + 1);
+	if (batched && !batched_write(fdp, buf, len, new_meta)) {
+		res = 0;
 	} else {
-		int r;
-		int start_block_num;
-		int end_block_num;
-
-		r = commit_meta_file(fdp, new_meta);
-		if (r < 0) {
+		res = out_of_place_write(fdp, buf, len, new_meta);
+		if (res < 0) {
 			*errno = TEE_ERROR_CORRUPT_OBJECT;
-			res = -1;
+			goto exit;
 		}
 
-		/* we are safe to free old blocks */
-		start_block_num = pos_to_block_num(orig_pos);
-		end_block_num = pos_to_block_num(fdp->pos - 1);
-		while (start_block_num <= end_block_num) {
-			if (remove_outdated_block(fdp, start_block_num))
-				IMSG("Warning: Failed to free old block: %d",
-					start_block_num);
-
-			start_block_num++;
-		}
+		res = commit_update(fdp, new_meta);
+		if (res < 0)
+			*errno = TEE_ERROR_CORRUPT_OBJECT;
 	}
+
+	/* we are safe to free old blocks */
+	remove_outdated_blocks(fdp, pos_to_block_num(orig_pos),
+			       pos_to_block_num(fdp->pos - 1));
 exit:
 	mutex_unlock(&ree_fs_mutex);
 	free(new_meta);
@@ -92,6 +92,8 @@ struct rpmb_fat_entry {
  */
 struct rpmb_file_handle {
 	struct rpmb_fat_entry fat_entry;
+	/* Key material for the data of the file, see file_key() */
+	struct tee_fs_key_ctx key_ctx;
 	char filename[TEE_RPMB_FS_FILENAME_LENGTH];
 	/* Address for current entry in RPMB */
 	uint32_t rpmb_fat_address;
@@ -267,6 +269,12 @@ static struct tee_rpmb_ctx *rpmb_ctx;
  * Mutex to serialize the operations exported by this file.
  * It protects rpmb_ctx and prevents overlapping operations on eMMC devices with
  * different IDs.
+ *
+ * Lookups in the FAT cache (stat, access, opendir, open and read) are not
+ * done under a shared lock: before each lookup fat_cache_sync() reads the
+ * write counter from RPMB. That authenticated read is a request and a
+ * response through tee-supplicant which must not be interleaved with
+ * other RPMB requests, and it updates rpmb_ctx and may reload the cache.
  */
 static struct mutex rpmb_mutex = MUTEX_INITIALIZER;
 
@@ -518,16 +526,16 @@ static bool is_zero(const uint8_t *buf, size_t size)
 
 #ifdef CFG_ENC_FS
 static TEE_Result encrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek)
+				uint16_t blk_idx, struct tee_fs_key_ctx *kc)
 {
-	return tee_fs_crypt_block(out, in, RPMB_DATA_SIZE, blk_idx, fek,
+	return tee_fs_crypt_block(kc, out, in, RPMB_DATA_SIZE, blk_idx,
 				  TEE_MODE_ENCRYPT);
 }
 
 static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek)
+				uint16_t blk_idx, struct tee_fs_key_ctx *kc)
 {
-	return tee_fs_crypt_block(out, in, RPMB_DATA_SIZE, blk_idx, fek,
+	return tee_fs_crypt_block(kc, out, in, RPMB_DATA_SIZE, blk_idx,
 				  TEE_MODE_DECRYPT);
 }
 #endif /* CFG_ENC_FS */
@@ -535,7 +543,8 @@ static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
 /* Decrypt/copy at most one block of data */
 static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 			  size_t size, size_t offset,
-			  uint16_t blk_idx __maybe_unused, const uint8_t *fek)
+			  uint16_t blk_idx __maybe_unused,
+			  struct tee_fs_key_ctx *kc)
 {
 	uint8_t *tmp __maybe_unused;
 
@@ -543,10 +552,10 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 	if ((size + offset < size) || (size + offset > RPMB_DATA_SIZE))
 		panic("invalid size or offset");
 
-	if (!fek) {
+	if (!kc) {
 		/* Block is not encrypted (not a file data block) */
 		memcpy(out, frm->data + offset, size);
-	} else if (is_zero(fek, TEE_FS_KM_FEK_SIZE)) {
+	} else if (is_zero(kc->encrypted_fek, TEE_FS_KM_FEK_SIZE)) {
 		/*
 		 * The file was created with encryption disabled
 		 * (CFG_ENC_FS=n)
@@ -567,11 +576,11 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 			tmp = malloc(RPMB_DATA_SIZE);
 			if (!tmp)
 				return TEE_ERROR_OUT_OF_MEMORY;
-			decrypt_block(tmp, frm->data, blk_idx, fek);
+			decrypt_block(tmp, frm->data, blk_idx, kc);
 			memcpy(out, tmp + offset, size);
 			free(tmp);
 		} else {
-			decrypt_block(out, frm->data, blk_idx, fek);
+			decrypt_block(out, frm->data, blk_idx, kc);
 		}
 #else
 		return TEE_ERROR_SECURITY;
@@ -584,11 +593,14 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 				    struct rpmb_raw_data *rawdata,
 				    uint16_t nbr_frms, uint16_t dev_id,
-				    const uint8_t *fek __unused)
+				    struct tee_fs_key_ctx *kc __unused)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
-	struct rpmb_data_frame *datafrm;
+	struct rpmb_data_frame datafrm;
+	struct rpmb_data_frame *reqfrm;
+	uint8_t *ctx = NULL;
+	bool calc_mac;
 
 	if (!req || !rawdata || !nbr_frms)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -604,87 +616,104 @@ static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 		return TEE_ERROR_GENERIC;
 	}
 
+	/* Check the block index is within range. */
+	if (rawdata->blk_idx &&
+	    (*rawdata->blk_idx + nbr_frms) > rpmb_ctx->max_blk_idx)
+		return TEE_ERROR_GENERIC;
+
 	req->cmd = RPMB_CMD_DATA_REQ;
 	req->dev_id = dev_id;
+	reqfrm = TEE_RPMB_REQ_DATA(req);
 
-	/* Allocate memory for construct all data packets and calculate MAC. */
-	datafrm = calloc(nbr_frms, RPMB_DATA_FRAME_SIZE);
-	if (!datafrm)
-		return TEE_ERROR_OUT_OF_MEMORY;
+	/*
+	 * The MAC of a write request covers all the frames, it's computed
+	 * while the frames are constructed one by one in secure memory and
+	 * stored in the last frame.
+	 */
+	calc_mac = rawdata->key_mac &&
+		   rawdata->msg_type == RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE;
+	if (calc_mac) {
+		ctx = malloc(rpmb_ctx->hash_ctx_size);
+		if (!ctx)
+			return TEE_ERROR_OUT_OF_MEMORY;
+
+		res = crypto_ops.mac.init(ctx, TEE_ALG_HMAC_SHA256,
+					  rpmb_ctx->key, RPMB_KEY_MAC_SIZE);
+		if (res != TEE_SUCCESS)
+			goto func_exit;
+	}
 
 	for (i = 0; i < nbr_frms; i++) {
-		u16_to_bytes(rawdata->msg_type, datafrm[i].msg_type);
+		memset(&datafrm, 0, sizeof(datafrm));
+		u16_to_bytes(rawdata->msg_type, datafrm.msg_type);
 
 		if (rawdata->block_count)
 			u16_to_bytes(*rawdata->block_count,
-				     datafrm[i].block_count);
+				     datafrm.block_count);
 
-		if (rawdata->blk_idx) {
-			/* Check the block index is within range. */
-			if ((*rawdata->blk_idx + nbr_frms) >
-			    rpmb_ctx->max_blk_idx) {
-				res = TEE_ERROR_GENERIC;
-				goto func_exit;
-			}
-			u16_to_bytes(*rawdata->blk_idx, datafrm[i].address);
-		}
+		if (rawdata->blk_idx)
+			u16_to_bytes(*rawdata->blk_idx, datafrm.address);
 
 		if (rawdata->write_counter)
 			u32_to_bytes(*rawdata->write_counter,
-				     datafrm[i].write_counter);
+				     datafrm.write_counter);
 
 		if (rawdata->nonce)
-			memcpy(datafrm[i].nonce, rawdata->nonce,
+			memcpy(datafrm.nonce, rawdata->nonce,
 			       RPMB_NONCE_SIZE);
 
 		if (rawdata->data) {
 #ifdef CFG_ENC_FS
-			if (fek)
-				encrypt_block(datafrm[i].data,
+			if (kc)
+				encrypt_block(datafrm.data,
 					rawdata->data + (i * RPMB_DATA_SIZE),
-					*rawdata->blk_idx + i, fek);
+					*rawdata->blk_idx + i, kc);
 			else
 #endif
-				memcpy(datafrm[i].data,
+				memcpy(datafrm.data,
 				       rawdata->data + (i * RPMB_DATA_SIZE),
 				       RPMB_DATA_SIZE);
 		}
-	}
 
-	if (rawdata->key_mac) {
-		if (rawdata->msg_type == RPMB_MSG_TYPE_REQ_AUTH_DATA_WRITE) {
-			res =
-			    tee_rpmb_mac_calc(rawdata->key_mac,
-					      RPMB_KEY_MAC_SIZE, rpmb_ctx->key,
-					      RPMB_KEY_MAC_SIZE, datafrm,
-					      nbr_frms);
+		if (calc_mac) {
+			res = crypto_ops.mac.update(ctx, TEE_ALG_HMAC_SHA256,
+						    datafrm.data,
+						    RPMB_MAC_PROTECT_DATA_SIZE);
 			if (res != TEE_SUCCESS)
 				goto func_exit;
 		}
-		memcpy(datafrm[nbr_frms - 1].key_mac,
-		       rawdata->key_mac, RPMB_KEY_MAC_SIZE);
-	}
 
-	memcpy(TEE_RPMB_REQ_DATA(req), datafrm,
-	       nbr_frms * RPMB_DATA_FRAME_SIZE);
+		if (i == nbr_frms - 1 && rawdata->key_mac) {
+			if (calc_mac) {
+				res = crypto_ops.mac.final(ctx,
+						TEE_ALG_HMAC_SHA256,
+						rawdata->key_mac,
+						RPMB_KEY_MAC_SIZE);
+				if (res != TEE_SUCCESS)
+					goto func_exit;
+			}
+			memcpy(datafrm.key_mac, rawdata->key_mac,
+			       RPMB_KEY_MAC_SIZE);
+		}
 
 #ifdef CFG_RPMB_FS_DEBUG_DATA
-	for (i = 0; i < nbr_frms; i++) {
 		DMSG("Dumping data frame %d:", i);
-		DHEXDUMP((uint8_t *)&datafrm[i] + RPMB_STUFF_DATA_SIZE,
+		DHEXDUMP((uint8_t *)&datafrm + RPMB_STUFF_DATA_SIZE,
 			 512 - RPMB_STUFF_DATA_SIZE);
-	}
 #endif
 
+		memcpy(reqfrm + i, &datafrm, RPMB_DATA_FRAME_SIZE);
+	}
+
 	res = TEE_SUCCESS;
 func_exit:
-	free(datafrm);
+	free(ctx);
 	return res;
 }
 
 static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 				       struct rpmb_data_frame *frm,
-				       uint8_t *fek)
+				       struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res;
 	uint8_t *data;
@@ -701,7 +730,7 @@ static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 	data = rawdata->data;
 	bytes_to_u16(frm->address, &idx);
 
-	res = decrypt(data, frm, rawdata->len, rawdata->byte_offset, idx, fek);
+	res = decrypt(data, frm, rawdata->len, rawdata->byte_offset, idx, kc);
 	return res;
 }
 
@@ -709,7 +738,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 					     struct rpmb_raw_data *rawdata,
 					     uint16_t nbr_frms,
 					     struct rpmb_data_frame *lastfrm,
-					     uint8_t *fek)
+					     struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
@@ -724,7 +753,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	if (nbr_frms == 1)
-		return data_cpy_mac_calc_1b(rawdata, lastfrm, fek);
+		return data_cpy_mac_calc_1b(rawdata, lastfrm, kc);
 
 	/* nbr_frms > 1 */
 
@@ -774,7 +803,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 		}
 
 		res = decrypt(data, &localfrm, size, offset, start_idx + i,
-			      fek);
+			      kc);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 
@@ -785,7 +814,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 	size = (rawdata->len + rawdata->byte_offset) % RPMB_DATA_SIZE;
 	if (size == 0)
 		size = RPMB_DATA_SIZE;
-	res = decrypt(data, lastfrm, size, 0, start_idx + nbr_frms - 1, fek);
+	res = decrypt(data, lastfrm, size, 0, start_idx + nbr_frms - 1, kc);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -809,7 +838,8 @@ func_exit:
 
 static TEE_Result tee_rpmb_resp_unpack_verify(struct rpmb_data_frame *datafrm,
 					      struct rpmb_raw_data *rawdata,
-					      uint16_t nbr_frms, uint8_t *fek)
+					      uint16_t nbr_frms,
+					      struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint16_t msg_type;
@@ -884,7 +914,7 @@ static TEE_Result tee_rpmb_resp_unpack_verify(struct rpmb_data_frame *datafrm,
 
 			res = tee_rpmb_data_cpy_mac_calc(datafrm, rawdata,
 							 nbr_frms, &lastfrm,
-							 fek);
+							 kc);
 
 			if (res != TEE_SUCCESS)
 				return res;
@@ -1158,8 +1188,12 @@ static TEE_Result tee_rpmb_init(uint16_t dev_id)
 			goto func_exit;
 		}
 
-#ifdef RPMB_DRIVER_MULTIPLE_WRITE_FIXED
-		rpmb_ctx->rel_wr_blkcnt = dev_info.rel_wr_sec_c * 2;
+#ifdef CFG_RPMB_FS_MULTI_BLOCK_WRITE
+		/*
+		 * rel_wr_sec_c is in 512 byte sectors, each RPMB frame
+		 * carries half a sector.
+		 */
+		rpmb_ctx->rel_wr_blkcnt = MAX(dev_info.rel_wr_sec_c * 2, 1);
 #else
 		rpmb_ctx->rel_wr_blkcnt = 1;
 #endif
@@ -1207,10 +1241,10 @@ func_exit:
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @kc         Key context of the file or NULL.
  */
 static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
-				uint32_t len, uint8_t *fek)
+				uint32_t len, struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	struct tee_rpmb_mem mem = { 0 };
@@ -1280,7 +1314,7 @@ static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
 	rawdata.len = len;
 	rawdata.byte_offset = byte_offset;
 
-	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, blkcnt, fek);
+	res = tee_rpmb_resp_unpack_verify(resp, &rawdata, blkcnt, kc);
 	if (res != TEE_SUCCESS)
 		goto func_exit;
 
@@ -1293,7 +1327,7 @@ func_exit:
 
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
-				     const uint8_t *fek)
+				     struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res;
 	struct tee_rpmb_mem mem;
@@ -1368,7 +1402,7 @@ static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				i * rpmb_ctx->rel_wr_blkcnt * RPMB_DATA_SIZE;
 
 		res = tee_rpmb_req_pack(req, &rawdata, tmp_blkcnt, dev_id,
-					fek);
+					kc);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -1426,11 +1460,11 @@ static bool tee_rpmb_write_is_atomic(uint16_t dev_id __unused, uint32_t addr,
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @kc         Key context of the file or NULL.
  */
 static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 				 const uint8_t *data, uint32_t len,
-				 uint8_t *fek)
+				 struct tee_fs_key_ctx *kc)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint8_t *data_tmp = NULL;
@@ -1445,7 +1479,7 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 	    ROUNDUP(len + byte_offset, RPMB_DATA_SIZE) / RPMB_DATA_SIZE;
 
 	if (byte_offset == 0 && (len % RPMB_DATA_SIZE) == 0) {
-		res = tee_rpmb_write_blk(dev_id, blk_idx, data, blkcnt, fek);
+		res = tee_rpmb_write_blk(dev_id, blk_idx, data, blkcnt, kc);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 	} else {
@@ -1457,7 +1491,7 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 
 		/* Read the complete blocks */
 		res = tee_rpmb_read(dev_id, blk_idx * RPMB_DATA_SIZE, data_tmp,
-				    blkcnt * RPMB_DATA_SIZE, fek);
+				    blkcnt * RPMB_DATA_SIZE, kc);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 
@@ -1465,7 +1499,7 @@ static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 		memcpy(data_tmp + byte_offset, data, len);
 
 		res = tee_rpmb_write_blk(dev_id, blk_idx, data_tmp, blkcnt,
-					 fek);
+					 kc);
 		if (res != TEE_SUCCESS)
 			goto func_exit;
 	}
@@ -1532,8 +1566,7 @@ func_exit:
  * End of lower interface to RPMB device
  */
 
-static TEE_Result get_fat_start_address(uint32_t *addr);
-
+#if (TRACE_LEVEL >= TRACE_FLOW)
 static void dump_fat(void)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
@@ -1543,9 +1576,9 @@ static void dump_fat(void)
 	int i;
 	bool last_entry_found = false;
 
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
+	if (!fs_par)
+		return;
+	fat_address = fs_par->fat_start_address;
 
 	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
 	fat_entries = malloc(size);
@@ -1581,6 +1614,11 @@ static void dump_fat(void)
 out:
 	free(fat_entries);
 }
+#else
+static void dump_fat(void)
+{
+}
+#endif
 
 #if (TRACE_LEVEL >= TRACE_DEBUG)
 static void dump_fh(struct rpmb_file_handle *fh)
@@ -1611,6 +1649,333 @@ static struct rpmb_file_handle *alloc_file_handle(const char *filename)
 	return fh;
 }
 
+/*
+ * Returns the key context of the file, set up from the FEK in the FAT
+ * entry the first time the data of the file is accessed. The FEK of a
+ * file doesn't change once the file has been opened.
+ */
+static struct tee_fs_key_ctx *file_key(struct rpmb_file_handle *fh)
+{
+	if (!fh->key_ctx.has_key)
+		tee_fs_key_ctx_init(&fh->key_ctx, fh->fat_entry.fek);
+	return &fh->key_ctx;
+}
+
+/*
+ * In-memory copy of the FAT
+ *
+ * The FAT is read once with authenticated reads and then kept in sync by
+ * updating the cache after each successful FAT write. Every RPMB write
+ * increments the write counter, the counter value the cache corresponds
+ * to is recorded so that a mismatch, for instance after a failed write
+ * forced a resync of the counter, drops the cache and the FAT is read
+ * again.
+ *
+ * Active entries are indexed with a hash of the filename and the pool
+ * keeps the RPMB layout, the FAT and the data of all active files, so
+ * that space for a file can be found without traversing the FAT.
+ */
+#define FAT_CACHE_HASH_SIZE	32
+#define FAT_CACHE_NO_ENTRY	UINT32_MAX
+
+struct rpmb_fat_cache_entry {
+	uint32_t start_address;
+	uint32_t data_size;
+	uint32_t flags;
+	uint32_t write_counter;
+	uint8_t fek[TEE_FS_KM_FEK_SIZE];
+	/* Only set for active entries */
+	char *filename;
+	/* Next entry in the same hash bucket */
+	uint32_t hash_next;
+};
+
+struct rpmb_fat_cache {
+	struct rpmb_fat_cache_entry *entries;
+	/* Number of entries including the last entry */
+	uint32_t num_entries;
+	uint32_t max_entries;
+	uint32_t hash[FAT_CACHE_HASH_SIZE];
+	uint32_t wr_cnt;
+	tee_mm_pool_t pool;
+	tee_mm_entry_t *fat_mm;
+	bool valid;
+};
+
+static struct rpmb_fat_cache fat_cache;
+
+static uint32_t fat_cache_hash(const char *filename)
+{
+	uint32_t h = 2166136261u;
+
+	while (*filename) {
+		h ^= (uint8_t)*filename++;
+		h *= 16777619u;
+	}
+
+	return h % FAT_CACHE_HASH_SIZE;
+}
+
+static uint32_t fat_address_to_idx(uint32_t fat_address)
+{
+	return (fat_address - fs_par->fat_start_address) /
+	       sizeof(struct rpmb_fat_entry);
+}
+
+static uint32_t idx_to_fat_address(uint32_t idx)
+{
+	return fs_par->fat_start_address + idx * sizeof(struct rpmb_fat_entry);
+}
+
+static void fat_cache_invalidate(void)
+{
+	uint32_t n;
+
+	if (fat_cache.valid)
+		DMSG("Dropping FAT cache");
+
+	for (n = 0; n < fat_cache.num_entries; n++)
+		free(fat_cache.entries[n].filename);
+	free(fat_cache.entries);
+	tee_mm_final(&fat_cache.pool);
+	memset(&fat_cache, 0, sizeof(fat_cache));
+}
+
+/* True if the cache matches what's currently stored in RPMB */
+static bool fat_cache_is_synced(void)
+{
+	return fat_cache.valid && rpmb_ctx && rpmb_ctx->wr_cnt_synced &&
+	       fat_cache.wr_cnt == rpmb_ctx->wr_cnt;
+}
+
+static void fat_cache_unhash(uint32_t idx)
+{
+	struct rpmb_fat_cache_entry *e = fat_cache.entries + idx;
+	uint32_t *p = fat_cache.hash + fat_cache_hash(e->filename);
+
+	while (*p != idx) {
+		assert(*p != FAT_CACHE_NO_ENTRY);
+		p = &fat_cache.entries[*p].hash_next;
+	}
+	*p = e->hash_next;
+}
+
+static void fat_cache_hash_insert(uint32_t idx)
+{
+	struct rpmb_fat_cache_entry *e = fat_cache.entries + idx;
+	uint32_t *p = fat_cache.hash + fat_cache_hash(e->filename);
+
+	e->hash_next = *p;
+	*p = idx;
+}
+
+/*
+ * Makes the pool reflect that the data of an entry moved from old_mm to
+ * the area now described by the entry.
+ *
+ * The extent of a file in the pool may be larger than its data, the
+ * space past the end of the data is kept reserved for appends until the
+ * file is moved or the cache is reloaded from the FAT.
+ */
+static TEE_Result fat_cache_update_pool(struct rpmb_fat_cache_entry *e,
+					tee_mm_entry_t *old_mm)
+{
+	tee_mm_entry_t *new_mm = NULL;
+
+	if ((e->flags & FILE_IS_ACTIVE) && e->data_size)
+		new_mm = tee_mm_find(&fat_cache.pool, e->start_address);
+
+	if (old_mm && (old_mm != new_mm ||
+		       tee_mm_get_bytes(old_mm) < e->data_size)) {
+		tee_mm_free(old_mm);
+		if (old_mm == new_mm)
+			new_mm = NULL;
+	}
+
+	if ((e->flags & FILE_IS_ACTIVE) && e->data_size && !new_mm &&
+	    !tee_mm_alloc2(&fat_cache.pool, e->start_address, e->data_size))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result fat_cache_set_entry(uint32_t idx,
+				      const struct rpmb_fat_entry *fe)
+{
+	struct rpmb_fat_cache_entry *e;
+	tee_mm_entry_t *old_mm = NULL;
+
+	if (idx >= fat_cache.max_entries) {
+		uint32_t max_entries = MAX(idx + 1, fat_cache.max_entries * 2);
+
+		e = realloc(fat_cache.entries, max_entries * sizeof(*e));
+		if (!e)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		fat_cache.entries = e;
+		fat_cache.max_entries = max_entries;
+	}
+
+	while (fat_cache.num_entries <= idx) {
+		memset(fat_cache.entries + fat_cache.num_entries, 0,
+		       sizeof(*e));
+		fat_cache.num_entries++;
+	}
+
+	e = fat_cache.entries + idx;
+	if (e->filename) {
+		if (e->data_size)
+			old_mm = tee_mm_find(&fat_cache.pool, e->start_address);
+		fat_cache_unhash(idx);
+		free(e->filename);
+		e->filename = NULL;
+	}
+
+	e->start_address = fe->start_address;
+	e->data_size = fe->data_size;
+	e->flags = fe->flags;
+	e->write_counter = fe->write_counter;
+	memcpy(e->fek, fe->fek, sizeof(e->fek));
+
+	if (e->flags & FILE_IS_ACTIVE) {
+		e->filename = strndup(fe->filename, sizeof(fe->filename) - 1);
+		if (!e->filename)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		fat_cache_hash_insert(idx);
+	}
+
+	return fat_cache_update_pool(e, old_mm);
+}
+
+static void fat_cache_get_entry(uint32_t idx, struct rpmb_fat_entry *fe)
+{
+	struct rpmb_fat_cache_entry *e = fat_cache.entries + idx;
+
+	memset(fe, 0, sizeof(*fe));
+	fe->start_address = e->start_address;
+	fe->data_size = e->data_size;
+	fe->flags = e->flags;
+	fe->write_counter = e->write_counter;
+	memcpy(fe->fek, e->fek, sizeof(fe->fek));
+	if (e->filename)
+		strlcpy(fe->filename, e->filename, sizeof(fe->filename));
+}
+
+/* Reserves the FAT area in the pool, including num_entries entries */
+static TEE_Result fat_cache_reserve_fat(uint32_t num_entries)
+{
+	tee_mm_entry_t *mm;
+
+	if (fat_cache.fat_mm)
+		tee_mm_free(fat_cache.fat_mm);
+
+	mm = tee_mm_alloc2(&fat_cache.pool, RPMB_STORAGE_START_ADDRESS,
+			   idx_to_fat_address(num_entries));
+	if (!mm && fat_cache.num_entries) {
+		/* Restore the previous reservation */
+		fat_cache.fat_mm = tee_mm_alloc2(&fat_cache.pool,
+					RPMB_STORAGE_START_ADDRESS,
+					idx_to_fat_address(
+						fat_cache.num_entries));
+		return TEE_ERROR_OUT_OF_MEMORY;
+	}
+	fat_cache.fat_mm = mm;
+
+	return mm ? TEE_SUCCESS : TEE_ERROR_OUT_OF_MEMORY;
+}
+
+static TEE_Result fat_cache_load(void)
+{
+	TEE_Result res;
+	struct rpmb_fat_entry *fat_entries = NULL;
+	uint32_t fat_address;
+	uint32_t idx = 0;
+	size_t size;
+	int i;
+	bool last_entry_found = false;
+
+	memset(&fat_cache, 0, sizeof(fat_cache));
+	memset(fat_cache.hash, 0xff, sizeof(fat_cache.hash));
+
+	/* Upper memory allocation must be used for RPMB_FS. */
+	if (!tee_mm_init(&fat_cache.pool, RPMB_STORAGE_START_ADDRESS,
+			 fs_par->max_rpmb_address, RPMB_BLOCK_SIZE_SHIFT,
+			 TEE_MM_POOL_HI_ALLOC))
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
+	fat_entries = malloc(size);
+	if (!fat_entries) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	fat_address = fs_par->fat_start_address;
+	while (!last_entry_found) {
+		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
+				    (uint8_t *)fat_entries, size, NULL);
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		for (i = 0; i < N_ENTRIES; i++) {
+			res = fat_cache_set_entry(idx, fat_entries + i);
+			if (res != TEE_SUCCESS)
+				goto out;
+			idx++;
+
+			if (fat_entries[i].flags & FILE_IS_LAST_ENTRY) {
+				last_entry_found = true;
+				break;
+			}
+		}
+		fat_address += size;
+	}
+
+	res = fat_cache_reserve_fat(fat_cache.num_entries);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	fat_cache.wr_cnt = rpmb_ctx->wr_cnt;
+	fat_cache.valid = true;
+	DMSG("FAT cache loaded, %u entries", fat_cache.num_entries);
+out:
+	free(fat_entries);
+	if (res != TEE_SUCCESS)
+		fat_cache_invalidate();
+	return res;
+}
+
+static uint32_t fat_cache_lookup(const char *filename)
+{
+	uint32_t idx = fat_cache.hash[fat_cache_hash(filename)];
+
+	while (idx != FAT_CACHE_NO_ENTRY) {
+		struct rpmb_fat_cache_entry *e = fat_cache.entries + idx;
+
+		if (!strcmp(e->filename, filename))
+			break;
+		idx = e->hash_next;
+	}
+
+	return idx;
+}
+
+/*
+ * Writes to RPMB, if the FAT cache was in sync before the write it's
+ * still in sync after a successful write.
+ */
+static TEE_Result write_rpmb(uint32_t addr, const uint8_t *data,
+			     uint32_t len, struct tee_fs_key_ctx *kc)
+{
+	TEE_Result res;
+	bool synced = fat_cache_is_synced();
+
+	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, addr, data, len, kc);
+	if (res == TEE_SUCCESS && synced)
+		fat_cache.wr_cnt = rpmb_ctx->wr_cnt;
+
+	return res;
+}
+
 /**
  * write_fat_entry: Store info in a fat_entry to RPMB.
  */
@@ -1637,9 +2002,17 @@ static TEE_Result write_fat_entry(struct rpmb_file_handle *fh,
 			goto out;
 	}
 
-	res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, fh->rpmb_fat_address,
-			     (uint8_t *)&fh->fat_entry,
-			     sizeof(struct rpmb_fat_entry), NULL);
+	res = write_rpmb(fh->rpmb_fat_address, (uint8_t *)&fh->fat_entry,
+			 sizeof(struct rpmb_fat_entry), NULL);
+	if (res != TEE_SUCCESS) {
+		fat_cache_invalidate();
+		goto out;
+	}
+
+	if (fat_cache_is_synced() &&
+	    fat_cache_set_entry(fat_address_to_idx(fh->rpmb_fat_address),
+				&fh->fat_entry) != TEE_SUCCESS)
+		fat_cache_invalidate();
 
 	dump_fat();
 
@@ -1745,172 +2118,160 @@ out:
 	return res;
 }
 
-/**
- * get_fat_start_address:
- * FAT start_address from fs_par.
+/* Loads the FAT cache unless it's already valid */
+static TEE_Result fat_cache_sync(void)
+{
+	TEE_Result res;
+	uint32_t wr_cnt;
+
+	res = rpmb_fs_setup();
+	if (res != TEE_SUCCESS)
+		return res;
+
+	/* Resyncs the write counter with RPMB if needed */
+	res = tee_rpmb_get_write_counter(CFG_RPMB_FS_DEV_ID, &wr_cnt);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (fat_cache.valid && fat_cache.wr_cnt == wr_cnt)
+		return TEE_SUCCESS;
+
+	fat_cache_invalidate();
+	return fat_cache_load();
+}
+
+/*
+ * Returns the first unused FAT entry, if there is none the last entry is
+ * returned and a new last entry is added after it.
  */
-static TEE_Result get_fat_start_address(uint32_t *addr)
+static TEE_Result get_free_fat_entry(uint32_t *idx)
 {
-	if (!fs_par)
-		return TEE_ERROR_NO_DATA;
+	TEE_Result res;
+	struct rpmb_file_handle last_fh;
+	uint32_t n;
 
-	*addr = fs_par->fat_start_address;
+	for (n = 0; n < fat_cache.num_entries; n++) {
+		if (!(fat_cache.entries[n].flags &
+		      (FILE_IS_ACTIVE | FILE_IS_LAST_ENTRY))) {
+			*idx = n;
+			return TEE_SUCCESS;
+		}
+	}
+
+	/* Expand the FAT with one entry */
+	res = fat_cache_reserve_fat(fat_cache.num_entries + 1);
+	if (res != TEE_SUCCESS)
+		return res;
 
+	memset(&last_fh, 0, sizeof(last_fh));
+	last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
+	last_fh.rpmb_fat_address = idx_to_fat_address(fat_cache.num_entries);
+	res = write_fat_entry(&last_fh, true);
+	if (res != TEE_SUCCESS) {
+		/* The FAT reservation no longer matches the entries */
+		fat_cache_invalidate();
+		return res;
+	}
+	if (!fat_cache.valid)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	*idx = fat_cache.num_entries - 2;
 	return TEE_SUCCESS;
 }
 
 /**
- * read_fat: Read FAT entries
- * Return matching FAT entry for read, rm rename and stat.
- * Build up memory pool and return matching entry for write operation.
- * "Last FAT entry" can be returned during write.
+ * read_fat: Look up the FAT entry matching fh->filename for read, rm,
+ * rename and stat. With create an unused FAT entry is returned if there
+ * is no match.
  */
-static TEE_Result read_fat(struct rpmb_file_handle *fh, tee_mm_pool_t *p)
+static TEE_Result read_fat(struct rpmb_file_handle *fh, bool create)
 {
-	TEE_Result res = TEE_ERROR_GENERIC;
-	tee_mm_entry_t *mm = NULL;
-	struct rpmb_fat_entry *fat_entries = NULL;
-	uint32_t fat_address;
-	size_t size;
-	int i;
-	bool entry_found = false;
-	bool last_entry_found = false;
-	bool expand_fat = false;
-	struct rpmb_file_handle last_fh;
+	TEE_Result res;
+	uint32_t idx;
 
 	DMSG("fat_address %d", fh->rpmb_fat_address);
 
-	res = rpmb_fs_setup();
+	res = fat_cache_sync();
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
+	idx = fat_cache_lookup(fh->filename);
+	if (idx == FAT_CACHE_NO_ENTRY) {
+		if (!create)
+			return TEE_ERROR_FILE_NOT_FOUND;
 
-	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
-	fat_entries = malloc(size);
-	if (!fat_entries) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
+		res = get_free_fat_entry(&idx);
+		if (res != TEE_SUCCESS)
+			return res;
 	}
 
-	/*
-	 * The pool is used to represent the current RPMB layout. To find
-	 * a slot for the file tee_mm_alloc is called on the pool. Thus
-	 * if it is not NULL the entire FAT must be traversed to fill in
-	 * the pool.
-	 */
-	while (!last_entry_found && (!entry_found || p)) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
+	fh->rpmb_fat_address = idx_to_fat_address(idx);
+	fat_cache_get_entry(idx, &fh->fat_entry);
 
-		for (i = 0; i < N_ENTRIES; i++) {
-			/*
-			 * Look for an entry, matching filenames. (read, rm,
-			 * rename and stat.). Only store first filename match.
-			 */
-			if (fh->filename &&
-			    (strcmp(fh->filename,
-				    fat_entries[i].filename) == 0) &&
-			    (fat_entries[i].flags & FILE_IS_ACTIVE) &&
-			    (!entry_found)) {
-				entry_found = true;
-				fh->rpmb_fat_address = fat_address;
-				memcpy(&fh->fat_entry, &fat_entries[i],
-				       sizeof(struct rpmb_fat_entry));
-				if (!p)
-					break;
-			}
+	return TEE_SUCCESS;
+}
 
-			/* Add existing files to memory pool. (write) */
-			if (p) {
-				if ((fat_entries[i].flags & FILE_IS_ACTIVE) &&
-				    (fat_entries[i].data_size > 0)) {
-
-					mm = tee_mm_alloc2
-						(p,
-						 fat_entries[i].start_address,
-						 fat_entries[i].data_size);
-					if (!mm) {
-						res = TEE_ERROR_OUT_OF_MEMORY;
-						goto out;
-					}
-				}
-
-				/* Unused FAT entries can be reused (write) */
-				if (((fat_entries[i].flags & FILE_IS_ACTIVE) ==
-				     0) && (fh->rpmb_fat_address == 0)) {
-					fh->rpmb_fat_address = fat_address;
-					memcpy(&fh->fat_entry, &fat_entries[i],
-					       sizeof(struct rpmb_fat_entry));
-				}
-			}
+/*
+ * Returns the size of the extent reserved for the data of the file, zero
+ * if it has none.
+ */
+static size_t get_extent_size(struct rpmb_file_handle *fh)
+{
+	tee_mm_entry_t *mm;
 
-			if ((fat_entries[i].flags & FILE_IS_LAST_ENTRY) != 0) {
-				last_entry_found = true;
+	if (!fh->fat_entry.data_size || !fat_cache_is_synced())
+		return 0;
 
-				/*
-				 * If the last entry was reached and was chosen
-				 * by the previous check, then the FAT needs to
-				 * be expanded.
-				 * fh->rpmb_fat_address is the address chosen
-				 * to store the files FAT entry and fat_address
-				 * is the current FAT entry address being
-				 * compared.
-				 */
-				if (p && fh->rpmb_fat_address == fat_address)
-					expand_fat = true;
-				break;
-			}
+	mm = tee_mm_find(&fat_cache.pool, fh->fat_entry.start_address);
+	if (!mm || tee_mm_get_smem(mm) != fh->fat_entry.start_address)
+		return 0;
 
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
-		}
-	}
+	return tee_mm_get_bytes(mm);
+}
 
-	/*
-	 * Represent the FAT table in the pool.
-	 */
-	if (p) {
-		/*
-		 * Since fat_address is the start of the last entry it needs to
-		 * be moved up by an entry.
-		 */
-		fat_address += sizeof(struct rpmb_fat_entry);
+/*
+ * Allocates a new extent for size bytes of data, with some room to grow
+ * when possible so that a file being appended to isn't moved each time.
+ */
+static tee_mm_entry_t *alloc_extent(size_t size)
+{
+	tee_mm_entry_t *mm;
 
-		/* Make room for yet a FAT entry and add to memory pool. */
-		if (expand_fat)
-			fat_address += sizeof(struct rpmb_fat_entry);
+	mm = tee_mm_alloc(&fat_cache.pool, size + size / 2);
+	if (!mm)
+		mm = tee_mm_alloc(&fat_cache.pool, size);
 
-		mm = tee_mm_alloc2(p, RPMB_STORAGE_START_ADDRESS, fat_address);
-		if (!mm) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
+	return mm;
+}
 
-		if (expand_fat) {
-			/*
-			 * Point fat_address to the beginning of the new
-			 * entry.
-			 */
-			fat_address -= sizeof(struct rpmb_fat_entry);
-			memset(&last_fh, 0, sizeof(last_fh));
-			last_fh.fat_entry.flags = FILE_IS_LAST_ENTRY;
-			last_fh.rpmb_fat_address = fat_address;
-			res = write_fat_entry(&last_fh, true);
-			if (res != TEE_SUCCESS)
-				goto out;
-		}
-	}
+/*
+ * Writes size bytes from buf at offset offs of the file, in the unused
+ * part of its extent past the end of the data. The gap between the end of
+ * the data and offs is zero filled. The data becomes part of the file only
+ * once the FAT entry with the new size is written.
+ */
+static TEE_Result write_extent_tail(struct rpmb_file_handle *fh,
+				    uint32_t offs, const void *buf,
+				    size_t size)
+{
+	TEE_Result res;
+	uint32_t data_size = fh->fat_entry.data_size;
+	size_t gap = offs - data_size;
+	uint8_t *tmp;
 
-	if (fh->filename && !fh->rpmb_fat_address)
-		res = TEE_ERROR_FILE_NOT_FOUND;
+	if (!gap)
+		return write_rpmb(fh->fat_entry.start_address + offs, buf,
+				  size, file_key(fh));
 
-out:
-	free(fat_entries);
+	tmp = calloc(gap + size, 1);
+	if (!tmp)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	if (size)
+		memcpy(tmp + gap, buf, size);
+
+	res = write_rpmb(fh->fat_entry.start_address + data_size, tmp,
+			 gap + size, file_key(fh));
+	free(tmp);
 	return res;
 }
 
@@ -1942,9 +2303,8 @@ static int rpmb_fs_open_internal(const char *file, int flags, ...)
 	int fd = -1;
 	struct rpmb_file_handle *fh = NULL;
 	size_t filelen;
-	tee_mm_pool_t p;
-	bool pool_result;
 	TEE_Result res = TEE_ERROR_GENERIC;
+	bool fat_cache_changed = false;
 
 	mutex_lock(&rpmb_mutex);
 
@@ -1970,34 +2330,12 @@ static int rpmb_fs_open_internal(const char *file, int flags, ...)
 		goto out;
 	}
 
-	/* We need to do setup in order to make sure fs_par is filled in */
-	res = rpmb_fs_setup();
+	/* With create the FAT may be extended and a new entry written below */
+	fat_cache_changed = flags & TEE_FS_O_CREATE;
+	res = read_fat(fh, flags & TEE_FS_O_CREATE);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	if (flags & TEE_FS_O_CREATE) {
-		/* Upper memory allocation must be used for RPMB_FS. */
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-
-		res = read_fat(fh, &p);
-		tee_mm_final(&p);
-		if (res != TEE_SUCCESS)
-			goto out;
-	} else {
-		res = read_fat(fh, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-	}
-
 	/* Add the handle to the db */
 	fd = handle_get(&fs_handle_db, fh);
 	if (fd == -1) {
@@ -2045,6 +2383,12 @@ out:
 			free(fh);
 
 		fd = -1;
+		/*
+		 * The cache may describe a FAT change which didn't reach
+		 * RPMB, reload the FAT on next access to be safe.
+		 */
+		if (fat_cache_changed)
+			fat_cache_invalidate();
 	}
 
 	mutex_unlock(&rpmb_mutex);
@@ -2060,6 +2404,7 @@ static int rpmb_fs_close(int fd)
 	mutex_unlock(&rpmb_mutex);
 
 	if (fh) {
+		tee_fs_key_ctx_final(&fh->key_ctx);
 		free(fh);
 		return 0;
 	}
@@ -2090,7 +2435,7 @@ static int rpmb_fs_read(TEE_Result *errno, int fd, void *buf, size_t size)
 	}
 	dump_fh(fh);
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS) {
 		*errno = res;
 		goto out;
@@ -2105,7 +2450,7 @@ static int rpmb_fs_read(TEE_Result *errno, int fd, void *buf, size_t size)
 	if (size) {
 		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 				    fh->fat_entry.start_address + fh->pos, buf,
-				    size, fh->fat_entry.fek);
+				    size, file_key(fh));
 		if (res != TEE_SUCCESS) {
 			*errno = res;
 			goto out;
@@ -2124,9 +2469,7 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 {
 	TEE_Result res;
 	struct rpmb_file_handle *fh;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	size_t end;
 	size_t newsize;
 	uint8_t *newbuf = NULL;
@@ -2155,18 +2498,7 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 	}
 	dump_fh(fh);
 
-	/* Upper memory allocation must be used for RPMB_FS. */
-	pool_result = tee_mm_init(&p,
-				  RPMB_STORAGE_START_ADDRESS,
-				  fs_par->max_rpmb_address,
-				  RPMB_BLOCK_SIZE_SHIFT,
-				  TEE_MM_POOL_HI_ALLOC);
-	if (!pool_result) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
-	res = read_fat(fh, &p);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2180,19 +2512,40 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 	    tee_rpmb_write_is_atomic(CFG_RPMB_FS_DEV_ID, start_addr, size)) {
 
 		DMSG("Updating data in-place");
-		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, start_addr, buf,
-				     size, fh->fat_entry.fek);
+		res = write_rpmb(start_addr, buf, size, file_key(fh));
+		if (res != TEE_SUCCESS)
+			goto out;
+	} else if (fh->pos >= fh->fat_entry.data_size &&
+		   end <= get_extent_size(fh)) {
+		/*
+		 * Appending within the extent: only the new data is written,
+		 * the FAT entry update makes it visible.
+		 */
+		DMSG("Appending in-place");
+		res = write_extent_tail(fh, fh->pos, buf, size);
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		fh->fat_entry.data_size = end;
+		res = write_fat_entry(fh, true);
 		if (res != TEE_SUCCESS)
 			goto out;
 	} else {
 		/*
 		 * File must be extended, or update cannot be atomic: allocate,
 		 * read, update, write.
+		 *
+		 * This includes overwrites within the extent that don't fit
+		 * in one reliable write, and writes straddling the end of the
+		 * data. Only a single reliable write request is atomic, and
+		 * the FAT entry can't be part of it. Done in place, part of
+		 * the old data could already be overwritten when the write is
+		 * interrupted.
 		 */
 
 		DMSG("Need to re-allocate");
 		newsize = MAX(end, fh->fat_entry.data_size);
-		mm = tee_mm_alloc(&p, newsize);
+		mm = alloc_extent(newsize);
 		newbuf = calloc(newsize, 1);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2203,7 +2556,7 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek);
+					    file_key(fh));
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
@@ -2211,13 +2564,14 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 		memcpy(newbuf + fh->pos, buf, size);
 
 		newaddr = tee_mm_get_smem(mm);
-		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek);
+		res = write_rpmb(newaddr, newbuf, newsize, file_key(fh));
 		if (res != TEE_SUCCESS)
 			goto out;
 
 		fh->fat_entry.data_size = newsize;
 		fh->fat_entry.start_address = newaddr;
+		/* The FAT cache takes over mm, also if this fails */
+		mm = NULL;
 		res = write_fat_entry(fh, true);
 		if (res != TEE_SUCCESS)
 			goto out;
@@ -2225,9 +2579,8 @@ static int rpmb_fs_write(TEE_Result *errno, int fd, const void *buf,
 
 	fh->pos += size;
 out:
+	tee_mm_free(mm);
 	mutex_unlock(&rpmb_mutex);
-	if (pool_result)
-		tee_mm_final(&p);
 	if (newbuf)
 		free(newbuf);
 
@@ -2255,7 +2608,7 @@ static tee_fs_off_t rpmb_fs_lseek(TEE_Result *errno, int fd,
 	}
 
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS) {
 		*errno = res;
 		goto out;
@@ -2312,7 +2665,7 @@ static int rpmb_fs_unlink(const char *filename)
 		goto out;
 	}
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -2363,11 +2716,11 @@ static  int rpmb_fs_rename(const char *old_name, const char *new_name)
 		goto out;
 	}
 
-	res = read_fat(fh_old, NULL);
+	res = read_fat(fh_old, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = read_fat(fh_new, NULL);
+	res = read_fat(fh_new, false);
 	if (res == TEE_SUCCESS) {
 		res = TEE_ERROR_BAD_PARAMETERS;
 		goto out;
@@ -2400,9 +2753,7 @@ static int rpmb_fs_mkdir(const char *path __unused,
 static int rpmb_fs_ftruncate(TEE_Result *errno, int fd, tee_fs_off_t length)
 {
 	struct rpmb_file_handle *fh;
-	tee_mm_pool_t p;
-	bool pool_result = false;
-	tee_mm_entry_t *mm;
+	tee_mm_entry_t *mm = NULL;
 	uint32_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
@@ -2422,27 +2773,21 @@ static int rpmb_fs_ftruncate(TEE_Result *errno, int fd, tee_fs_off_t length)
 		goto out;
 	}
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	if (newsize > fh->fat_entry.data_size) {
-		/* Extend file */
-
-		pool_result = tee_mm_init(&p,
-					  RPMB_STORAGE_START_ADDRESS,
-					  fs_par->max_rpmb_address,
-					  RPMB_BLOCK_SIZE_SHIFT,
-					  TEE_MM_POOL_HI_ALLOC);
-		if (!pool_result) {
-			res = TEE_ERROR_OUT_OF_MEMORY;
-			goto out;
-		}
-		res = read_fat(fh, &p);
+	if (newsize > fh->fat_entry.data_size &&
+	    newsize <= get_extent_size(fh)) {
+		/* Extend file within its extent */
+		res = write_extent_tail(fh, newsize, NULL, 0);
 		if (res != TEE_SUCCESS)
 			goto out;
 
-		mm = tee_mm_alloc(&p, newsize);
+		newaddr = fh->fat_entry.start_address;
+	} else if (newsize > fh->fat_entry.data_size) {
+		/* Extend file */
+		mm = alloc_extent(newsize);
 		newbuf = calloc(newsize, 1);
 		if (!mm || !newbuf) {
 			res = TEE_ERROR_OUT_OF_MEMORY;
@@ -2453,14 +2798,13 @@ static int rpmb_fs_ftruncate(TEE_Result *errno, int fd, tee_fs_off_t length)
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek);
+					    file_key(fh));
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
 
 		newaddr = tee_mm_get_smem(mm);
-		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek);
+		res = write_rpmb(newaddr, newbuf, newsize, file_key(fh));
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -2472,12 +2816,13 @@ static int rpmb_fs_ftruncate(TEE_Result *errno, int fd, tee_fs_off_t length)
 	/* fh->pos is unchanged */
 	fh->fat_entry.data_size = newsize;
 	fh->fat_entry.start_address = newaddr;
+	/* The FAT cache takes over mm, also if this fails */
+	mm = NULL;
 	res = write_fat_entry(fh, true);
 
 out:
+	tee_mm_free(mm);
 	mutex_unlock(&rpmb_mutex);
-	if (pool_result)
-		tee_mm_final(&p);
 	if (newbuf)
 		free(newbuf);
 
@@ -2507,83 +2852,40 @@ static TEE_Result rpmb_fs_dir_populate(const char *path,
 				       struct tee_fs_dir *dir)
 {
 	struct tee_rpmb_fs_dirent *current = NULL;
-	struct rpmb_fat_entry *fat_entries = NULL;
-	uint32_t fat_address;
 	uint32_t filelen;
 	char *filename;
-	int i;
-	bool last_entry_found = false;
-	bool matched;
+	uint32_t i;
 	struct tee_rpmb_fs_dirent *next = NULL;
 	uint32_t pathlen;
 	TEE_Result res = TEE_ERROR_GENERIC;
-	uint32_t size;
-	char temp;
 
 	mutex_lock(&rpmb_mutex);
 
-	res = rpmb_fs_setup();
+	res = fat_cache_sync();
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = get_fat_start_address(&fat_address);
-	if (res != TEE_SUCCESS)
-		goto out;
-
-	size = N_ENTRIES * sizeof(struct rpmb_fat_entry);
-	fat_entries = malloc(size);
-	if (!fat_entries) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
-		goto out;
-	}
-
 	pathlen = strlen(path);
-	while (!last_entry_found) {
-		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID, fat_address,
-				    (uint8_t *)fat_entries, size, NULL);
-		if (res != TEE_SUCCESS)
-			goto out;
-
-		for (i = 0; i < N_ENTRIES; i++) {
-			filename = fat_entries[i].filename;
-			if (fat_entries[i].flags & FILE_IS_ACTIVE) {
-				matched = false;
-				filelen = strlen(filename);
-				if (filelen > pathlen) {
-					temp = filename[pathlen];
-					filename[pathlen] = '\0';
-					if (strcmp(filename, path) == 0)
-						matched = true;
-
-					filename[pathlen] = temp;
-				}
-
-				if (matched) {
-					next = malloc(sizeof(*next));
-					if (!next) {
-						res = TEE_ERROR_OUT_OF_MEMORY;
-						goto out;
-					}
-
-					memset(next, 0, sizeof(*next));
-					next->entry.d_name = next->name;
-					memcpy(next->name,
-						&filename[pathlen],
-						filelen - pathlen);
-
-					SIMPLEQ_INSERT_TAIL(&dir->next, next,
-							    link);
-					current = next;
-				}
+	for (i = 0; i < fat_cache.num_entries; i++) {
+		filename = fat_cache.entries[i].filename;
+		if (!filename)
+			continue;
+
+		filelen = strlen(filename);
+		if (filelen > pathlen && !memcmp(filename, path, pathlen)) {
+			next = malloc(sizeof(*next));
+			if (!next) {
+				res = TEE_ERROR_OUT_OF_MEMORY;
+				goto out;
 			}
 
-			if (fat_entries[i].flags & FILE_IS_LAST_ENTRY) {
-				last_entry_found = true;
-				break;
-			}
+			memset(next, 0, sizeof(*next));
+			next->entry.d_name = next->name;
+			memcpy(next->name, &filename[pathlen],
+			       filelen - pathlen);
 
-			/* Move to next fat_entry. */
-			fat_address += sizeof(struct rpmb_fat_entry);
+			SIMPLEQ_INSERT_TAIL(&dir->next, next, link);
+			current = next;
 		}
 	}
 
@@ -2599,8 +2901,6 @@ out:
 	mutex_unlock(&rpmb_mutex);
 	if (res != TEE_SUCCESS)
 		rpmb_fs_dir_free(dir);
-	if (fat_entries)
-		free(fat_entries);
 
 	return res;
 }
@@ -2747,7 +3047,7 @@ static int rpmb_fs_stat(const char *filename, struct tee_rpmb_fs_stat *stat)
 		goto out;
 	}
 
-	res = read_fat(fh, NULL);
+	res = read_fat(fh, false);
 	if (res != TEE_SUCCESS)
 		goto out;
 
@@ -70,7 +70,7 @@ struct sql_fs_file_meta {
 /* File descriptor */
 struct sql_fs_fd {
 	struct sql_fs_file_meta meta;
-	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	struct tee_fs_key_ctx key_ctx;
 	tee_fs_off_t pos;
 	int fd; /* returned by normal world */
 	int flags; /* open flags */
@@ -224,6 +224,7 @@ static tee_fs_off_t raw_to_pos(tee_fs_off_t raw_pos)
 static void put_fdp(struct sql_fs_fd *fdp)
 {
 	handle_put(&fs_db, fdp->fd);
+	tee_fs_key_ctx_final(&fdp->key_ctx);
 	free(fdp);
 }
 
@@ -264,10 +265,9 @@ static int write_meta(TEE_Result *errno, struct sql_fs_fd *fdp)
 	{
 		TEE_Result res;
 
-		res = tee_fs_encrypt_file(META_FILE,
-					  (const uint8_t *)&fdp->meta,
-					  sizeof(fdp->meta), ct, &ct_size,
-					  fdp->encrypted_fek);
+		res = tee_fs_key_ctx_encrypt(&fdp->key_ctx, META_FILE,
+					     (const uint8_t *)&fdp->meta,
+					     sizeof(fdp->meta), ct, &ct_size);
 		if (res != TEE_SUCCESS) {
 			*errno = res;
 			rc = -1;
@@ -293,12 +293,14 @@ exit:
 static int create_meta(TEE_Result *errno, struct sql_fs_fd *fdp)
 {
 	TEE_Result res;
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
 
 	memset(&fdp->meta, 0, sizeof(fdp->meta));
 
-	res = tee_fs_generate_fek(fdp->encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	res = tee_fs_generate_fek(encrypted_fek, TEE_FS_KM_FEK_SIZE);
 	if (res != TEE_SUCCESS)
 		return -1;
+	tee_fs_key_ctx_init(&fdp->key_ctx, encrypted_fek);
 
 	return write_meta(errno, fdp);
 }
@@ -340,9 +342,10 @@ static int read_meta(TEE_Result *errno, struct sql_fs_fd *fdp)
 #ifdef CFG_ENC_FS
 		TEE_Result res;
 
-		res = tee_fs_decrypt_file(META_FILE, meta, msize,
-					  (uint8_t *)&fdp->meta, &out_size,
-					  fdp->encrypted_fek);
+		/* fdp->key_ctx has no key yet, the FEK is taken from meta */
+		res = tee_fs_key_ctx_decrypt(&fdp->key_ctx, META_FILE, meta,
+					     msize, (uint8_t *)&fdp->meta,
+					     &out_size);
 		if (res != TEE_SUCCESS) {
 			*errno = res;
 			rc = -1;
@@ -407,8 +410,8 @@ static int read_block(TEE_Result *errno, struct sql_fs_fd *fdp, size_t bnum,
 	{
 		TEE_Result res;
 
-		res = tee_fs_decrypt_file(BLOCK_FILE, ct, ct_size, data,
-					  &out_size, fdp->encrypted_fek);
+		res = tee_fs_key_ctx_decrypt(&fdp->key_ctx, BLOCK_FILE, ct,
+					     ct_size, data, &out_size);
 		if (res != TEE_SUCCESS) {
 			*errno = res;
 			rc = -1;
@@ -450,8 +453,8 @@ static int write_block(TEE_Result *errno, struct sql_fs_fd *fdp,
 	{
 		TEE_Result res;
 
-		res = tee_fs_encrypt_file(BLOCK_FILE, data, BLOCK_SIZE, ct,
-					  &ct_size, fdp->encrypted_fek);
+		res = tee_fs_key_ctx_encrypt(&fdp->key_ctx, BLOCK_FILE, data,
+					     BLOCK_SIZE, ct, &ct_size);
 		if (res != TEE_SUCCESS) {
 			*errno = res;
 			rc = -1;
@@ -708,8 +711,10 @@ static int sql_fs_open(TEE_Result *errno, const char *file, int flags, ...)
 
 exit:
 	mutex_unlock(&sql_fs_mutex);
-	if (fd < 0)
+	if (fd < 0 && fdp) {
+		tee_fs_key_ctx_final(&fdp->key_ctx);
 		free(fdp);
+	}
 	DMSG("...%d", fd);
 	return fd;
 }
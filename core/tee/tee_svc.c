@@ -542,6 +542,21 @@ static void utee_param_to_param(struct tee_ta_param *p, struct utee_params *up)
 	}
 }
 
+/*
+ * The fragments of a fragmented memref are mapped virtually but not
+ * physically contiguous, such a buffer can't be passed on as a single
+ * physical buffer.
+ */
+static bool vbuf_is_phys_contig(void *va, size_t size, paddr_t pa)
+{
+	size_t offs = ROUNDUP((vaddr_t)va + 1, SMALL_PAGE_SIZE) - (vaddr_t)va;
+
+	for (; offs < size; offs += SMALL_PAGE_SIZE)
+		if (virt_to_phys((uint8_t *)va + offs) != pa + offs)
+			return false;
+	return true;
+}
+
 /*
  * TA invokes some TA with parameter.
  * If some parameters are memory references:
@@ -623,6 +638,10 @@ static TEE_Result tee_svc_copy_param(struct tee_ta_session *sess,
 			src_pa = virt_to_phys(param->params[n].memref.buffer);
 			if (!src_pa)
 				return TEE_ERROR_BAD_PARAMETERS;
+			if (!vbuf_is_phys_contig(param->params[n].memref.buffer,
+						 param->params[n].memref.size,
+						 src_pa))
+				return TEE_ERROR_BAD_PARAMETERS;
 
 			param->param_attr[n] = tee_mmu_user_get_cache_attr(
 				utc, (void *)param->params[n].memref.buffer);
@@ -37,6 +37,7 @@
 #include <tee/tee_obj.h>
 #include <tee/tee_cryp_provider.h>
 #include <trace.h>
+#include <slab.h>
 #include <string_ext.h>
 #include <util.h>
 #if defined(CFG_CRYPTO_HKDF) || defined(CFG_CRYPTO_CONCAT_KDF) || \
@@ -66,6 +67,7 @@
 typedef void (*tee_cryp_ctx_finalize_func_t) (void *ctx, uint32_t algo);
 struct tee_cryp_state {
 	TAILQ_ENTRY(tee_cryp_state) link;
+	struct ptr_hash_node hash_node;
 	uint32_t algo;
 	uint32_t mode;
 	vaddr_t key1;
@@ -75,6 +77,10 @@ struct tee_cryp_state {
 	tee_cryp_ctx_finalize_func_t ctx_finalize;
 };
 
+static struct slab_cache tee_cryp_state_cache =
+	SLAB_CACHE_INITIALIZER("Crypto state", struct tee_cryp_state, NULL,
+			       NULL);
+
 struct tee_cryp_obj_secret {
 	uint32_t key_size;
 	uint32_t alloc_size;
@@ -1840,16 +1846,15 @@ static TEE_Result tee_svc_cryp_get_state(struct tee_ta_session *sess,
 					 uint32_t state_id,
 					 struct tee_cryp_state **state)
 {
-	struct tee_cryp_state *s;
 	struct user_ta_ctx *utc = to_user_ta_ctx(sess->ctx);
+	struct ptr_hash_node *n = ptr_hash_find(&utc->cryp_state_hash,
+						state_id);
 
-	TAILQ_FOREACH(s, &utc->cryp_states, link) {
-		if (state_id == (vaddr_t)s) {
-			*state = s;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (!n)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*state = container_of(n, struct tee_cryp_state, hash_node);
+	return TEE_SUCCESS;
 }
 
 static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
@@ -1862,10 +1867,11 @@ static void cryp_state_free(struct user_ta_ctx *utc, struct tee_cryp_state *cs)
 		tee_obj_close(utc, o);
 
 	TAILQ_REMOVE(&utc->cryp_states, cs, link);
+	ptr_hash_remove(&utc->cryp_state_hash, &cs->hash_node);
 	if (cs->ctx_finalize != NULL)
 		cs->ctx_finalize(cs->ctx, cs->algo);
 	free(cs->ctx);
-	free(cs);
+	slab_free(&tee_cryp_state_cache, cs);
 }
 
 static TEE_Result tee_svc_cryp_check_key_type(const struct tee_obj *o,
@@ -1986,10 +1992,11 @@ TEE_Result syscall_cryp_state_alloc(unsigned long algo, unsigned long mode,
 			return res;
 	}
 
-	cs = calloc(1, sizeof(struct tee_cryp_state));
+	cs = slab_zalloc(&tee_cryp_state_cache);
 	if (!cs)
 		return TEE_ERROR_OUT_OF_MEMORY;
 	TAILQ_INSERT_TAIL(&utc->cryp_states, cs, link);
+	ptr_hash_add(&utc->cryp_state_hash, &cs->hash_node, (vaddr_t)cs);
 	cs->algo = algo;
 	cs->mode = mode;
 
@@ -2202,36 +2209,19 @@ TEE_Result syscall_hash_init(unsigned long state,
 	return TEE_SUCCESS;
 }
 
-TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
+static TEE_Result tee_svc_hash_update(struct user_ta_ctx *utc,
+			struct tee_cryp_state *cs, const void *chunk,
 			size_t chunk_size)
 {
 	TEE_Result res;
-	struct tee_cryp_state *cs;
-	struct tee_ta_session *sess;
-
-	/* No data, but size provided isn't valid parameters. */
-	if (!chunk && chunk_size)
-		return TEE_ERROR_BAD_PARAMETERS;
-
-	/* Zero length hash is valid, but nothing we need to do. */
-	if (!chunk_size)
-		return TEE_SUCCESS;
-
-	res = tee_ta_get_current_session(&sess);
-	if (res != TEE_SUCCESS)
-		return res;
 
-	res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
+	res = tee_mmu_check_access_rights(utc,
 					  TEE_MEMORY_ACCESS_READ |
 					  TEE_MEMORY_ACCESS_ANY_OWNER,
 					  (tee_uaddr_t)chunk, chunk_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	switch (TEE_ALG_GET_CLASS(cs->algo)) {
 	case TEE_OPERATION_DIGEST:
 		if (!crypto_ops.hash.update)
@@ -2256,6 +2246,33 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	return TEE_SUCCESS;
 }
 
+TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
+			size_t chunk_size)
+{
+	TEE_Result res;
+	struct tee_cryp_state *cs;
+	struct tee_ta_session *sess;
+
+	/* No data, but size provided isn't valid parameters. */
+	if (!chunk && chunk_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	/* Zero length hash is valid, but nothing we need to do. */
+	if (!chunk_size)
+		return TEE_SUCCESS;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_svc_hash_update(to_user_ta_ctx(sess->ctx), cs, chunk,
+				   chunk_size);
+}
+
 TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 			size_t chunk_size, void *hash, uint64_t *hash_len)
 {
@@ -2419,6 +2436,46 @@ TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
 	return TEE_SUCCESS;
 }
 
+/* dst is checked for dst_len bytes, src_len of them are written */
+static TEE_Result tee_svc_cipher_update(struct user_ta_ctx *utc,
+			struct tee_cryp_state *cs, bool last_block,
+			const void *src, size_t src_len, void *dst,
+			uint64_t dst_len)
+{
+	TEE_Result res;
+
+	res = tee_mmu_check_access_rights(utc,
+					  TEE_MEMORY_ACCESS_READ |
+					  TEE_MEMORY_ACCESS_ANY_OWNER,
+					  (tee_uaddr_t)src, src_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = tee_mmu_check_access_rights(utc,
+					  TEE_MEMORY_ACCESS_READ |
+					  TEE_MEMORY_ACCESS_WRITE |
+					  TEE_MEMORY_ACCESS_ANY_OWNER,
+					  (tee_uaddr_t)dst, dst_len);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	if (dst_len < src_len)
+		return TEE_ERROR_SHORT_BUFFER;
+
+	if (src_len > 0) {
+		/* Permit src_len == 0 to finalize the operation */
+		res = tee_do_cipher_update(cs->ctx, cs->algo, cs->mode,
+					   last_block, src, src_len, dst);
+	}
+
+	if (last_block && cs->ctx_finalize != NULL) {
+		cs->ctx_finalize(cs->ctx, cs->algo);
+		cs->ctx_finalize = NULL;
+	}
+
+	return res;
+}
+
 static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 			bool last_block, const void *src, size_t src_len,
 			void *dst, uint64_t *dst_len)
@@ -2436,46 +2493,17 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
-					  TEE_MEMORY_ACCESS_READ |
-					  TEE_MEMORY_ACCESS_ANY_OWNER,
-					  (tee_uaddr_t)src, src_len);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	if (!dst_len) {
 		dlen = 0;
 	} else {
 		res = tee_svc_copy_from_user(&dlen, dst_len, sizeof(dlen));
 		if (res != TEE_SUCCESS)
 			return res;
-
-		res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
-						  TEE_MEMORY_ACCESS_READ |
-						  TEE_MEMORY_ACCESS_WRITE |
-						  TEE_MEMORY_ACCESS_ANY_OWNER,
-						  (tee_uaddr_t)dst, dlen);
-		if (res != TEE_SUCCESS)
-			return res;
-	}
-
-	if (dlen < src_len) {
-		res = TEE_ERROR_SHORT_BUFFER;
-		goto out;
-	}
-
-	if (src_len > 0) {
-		/* Permit src_len == 0 to finalize the operation */
-		res = tee_do_cipher_update(cs->ctx, cs->algo, cs->mode,
-					   last_block, src, src_len, dst);
 	}
 
-	if (last_block && cs->ctx_finalize != NULL) {
-		cs->ctx_finalize(cs->ctx, cs->algo);
-		cs->ctx_finalize = NULL;
-	}
+	res = tee_svc_cipher_update(to_user_ta_ctx(sess->ctx), cs,
+				    last_block, src, src_len, dst, dlen);
 
-out:
 	if ((res == TEE_SUCCESS || res == TEE_ERROR_SHORT_BUFFER) &&
 	    dst_len != NULL) {
 		TEE_Result res2;
@@ -2503,6 +2531,83 @@ TEE_Result syscall_cipher_final(unsigned long state, const void *src,
 					    src, src_len, dst, dst_len);
 }
 
+TEE_Result syscall_cryp_update_batch(struct utee_cryp_update *upd,
+			size_t num_upd)
+{
+	TEE_Result res;
+	struct tee_cryp_state *cs = NULL;
+	struct tee_ta_session *sess;
+	struct user_ta_ctx *utc;
+	struct utee_cryp_update u;
+	uint64_t state = 0;
+	size_t n;
+
+	if (num_upd > (SIZE_MAX / sizeof(*upd)))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res != TEE_SUCCESS)
+		return res;
+	utc = to_user_ta_ctx(sess->ctx);
+
+	res = tee_mmu_check_access_rights(utc,
+					  TEE_MEMORY_ACCESS_READ |
+					  TEE_MEMORY_ACCESS_WRITE |
+					  TEE_MEMORY_ACCESS_ANY_OWNER,
+					  (tee_uaddr_t)upd,
+					  num_upd * sizeof(*upd));
+	if (res != TEE_SUCCESS)
+		return res;
+
+	for (n = 0; n < num_upd; n++) {
+		/* The TA could be updating the array from another thread */
+		memcpy(&u, upd + n, sizeof(u));
+
+		if ((!u.src && u.src_len) || u.src_len > SIZE_MAX ||
+		    u.dst_len > SIZE_MAX)
+			return TEE_ERROR_BAD_PARAMETERS;
+
+		/* Consecutive updates are usually on the same state */
+		if (!cs || u.state != state) {
+			res = tee_svc_cryp_get_state(sess,
+				tee_svc_uref_to_vaddr(u.state), &cs);
+			if (res != TEE_SUCCESS)
+				return res;
+			state = u.state;
+		}
+
+		switch (TEE_ALG_GET_CLASS(cs->algo)) {
+		case TEE_OPERATION_DIGEST:
+		case TEE_OPERATION_MAC:
+			if (!u.src_len)
+				break;
+			res = tee_svc_hash_update(utc, cs,
+					(const void *)(vaddr_t)u.src,
+					u.src_len);
+			if (res != TEE_SUCCESS)
+				return res;
+			break;
+		case TEE_OPERATION_CIPHER:
+			res = tee_svc_cipher_update(utc, cs, false,
+					(const void *)(vaddr_t)u.src,
+					u.src_len, (void *)(vaddr_t)u.dst,
+					u.dst_len);
+			if (res != TEE_SUCCESS)
+				return res;
+			u.dst_len = u.src_len;
+			res = tee_svc_copy_to_user(&upd[n].dst_len, &u.dst_len,
+						   sizeof(upd[n].dst_len));
+			if (res != TEE_SUCCESS)
+				return res;
+			break;
+		default:
+			return TEE_ERROR_BAD_PARAMETERS;
+		}
+	}
+
+	return TEE_SUCCESS;
+}
+
 #if defined(CFG_CRYPTO_HKDF)
 static TEE_Result get_hkdf_params(const TEE_Attribute *params,
 				  uint32_t param_count,
@@ -94,6 +94,7 @@ struct tee_svc_storage_head {
 
 struct tee_storage_enum {
 	TAILQ_ENTRY(tee_storage_enum) link;
+	struct ptr_hash_node hash_node;
 	struct tee_fs_dir *dir;
 	const struct tee_file_operations *fops;
 };
@@ -108,15 +109,14 @@ static TEE_Result tee_svc_storage_get_enum(struct user_ta_ctx *utc,
 					   uint32_t enum_id,
 					   struct tee_storage_enum **e_out)
 {
-	struct tee_storage_enum *e;
+	struct ptr_hash_node *n = ptr_hash_find(&utc->storage_enum_hash,
+						enum_id);
 
-	TAILQ_FOREACH(e, &utc->storage_enums, link) {
-		if (enum_id == (vaddr_t)e) {
-			*e_out = e;
-			return TEE_SUCCESS;
-		}
-	}
-	return TEE_ERROR_BAD_PARAMETERS;
+	if (!n)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	*e_out = container_of(n, struct tee_storage_enum, hash_node);
+	return TEE_SUCCESS;
 }
 
 static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
@@ -128,6 +128,7 @@ static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
 		return TEE_ERROR_BAD_PARAMETERS;
 
 	TAILQ_REMOVE(&utc->storage_enums, e, link);
+	ptr_hash_remove(&utc->storage_enum_hash, &e->hash_node);
 
 	if (!e->fops)
 		return TEE_ERROR_ITEM_NOT_FOUND;
@@ -815,7 +816,7 @@ err:
 	if (po)
 		tee_pobj_release(po);
 	if (o)
-		free(o);
+		tee_obj_free(o);
 
 exit:
 	free(file);
@@ -1006,6 +1007,7 @@ TEE_Result syscall_storage_alloc_enum(uint32_t *obj_enum)
 	e->dir = NULL;
 	e->fops = NULL;
 	TAILQ_INSERT_TAIL(&utc->storage_enums, e, link);
+	ptr_hash_add(&utc->storage_enum_hash, &e->hash_node, (vaddr_t)e);
 
 	return tee_svc_copy_kaddr_to_uref(obj_enum, e);
 }
@@ -1124,7 +1126,7 @@ TEE_Result syscall_storage_start_enum(unsigned long obj_enum,
 		goto exit;
 	}
 
-	o->pobj = calloc(1, sizeof(struct tee_pobj));
+	o->pobj = tee_pobj_alloc_unlisted();
 	if (!o->pobj) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto exit;
@@ -1167,9 +1169,7 @@ TEE_Result syscall_storage_start_enum(unsigned long obj_enum,
 
 exit:
 	if (o) {
-		if (o->pobj)
-			free(o->pobj->obj_id);
-		free(o->pobj);
+		tee_pobj_free_unlisted(o->pobj);
 		tee_obj_free(o);
 	}
 
@@ -1231,7 +1231,7 @@ TEE_Result syscall_storage_next_enum(unsigned long obj_enum,
 		goto exit;
 	}
 
-	o->pobj = calloc(1, sizeof(struct tee_pobj));
+	o->pobj = tee_pobj_alloc_unlisted();
 	if (!o->pobj) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto exit;
@@ -1257,9 +1257,7 @@ TEE_Result syscall_storage_next_enum(unsigned long obj_enum,
 
 exit:
 	if (o) {
-		if (o->pobj)
-			free(o->pobj->obj_id);
-		free(o->pobj);
+		tee_pobj_free_unlisted(o->pobj);
 		tee_obj_free(o);
 	}
 
@@ -187,7 +187,19 @@ void __mpa_mul_add_word_cum(mpa_word_t a,
 
 void __mpa_abs_mul_word(mpanum dest, const mpanum op1, mpa_word_t op2);
 
-void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2);
+void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2,
+		   mpa_word_t *tmp);
+
+mpa_word_t __mpa_mul_add_words(mpa_word_t *r, const mpa_word_t *a,
+			       mpa_usize_t n, mpa_word_t w);
+
+mpa_usize_t __mpa_mul_words_tmp_size(mpa_usize_t n);
+
+void __mpa_mul_words(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t na,
+		     const mpa_word_t *b, mpa_usize_t nb, mpa_word_t *tmp);
+
+void __mpa_sqr_words(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t n,
+		     mpa_word_t *tmp);
 
 /*------------------------------------------------------------
  *
@@ -225,8 +237,11 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src);
 
 void __mpa_montgomery_mul_add(mpanum dest, mpanum src, mpa_word_t w);
 
+mpa_usize_t __mpa_montgomery_mul_tmp_size(mpa_usize_t n_size);
+
 void __mpa_montgomery_mul(mpanum dest,
-			  mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv);
+			  mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv,
+			  mpa_word_t *tmp);
 
 /*------------------------------------------------------------
  *
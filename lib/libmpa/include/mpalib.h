@@ -413,6 +413,20 @@ MPALIB_EXPORT void mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2,
 				      mpanum n, mpa_word_t n_inv,
 				      mpa_scratch_mem pool);
 
+MPALIB_EXPORT int mpa_montgomery_reduce(mpanum dest, const mpanum op,
+					const mpanum n, mpa_word_t n_inv,
+					mpa_scratch_mem pool);
+
+/*
+ * From mpa_nist.c
+ */
+#define MPA_NIST_P256	1
+#define MPA_NIST_P384	2
+
+MPALIB_EXPORT int mpa_nist_prime(const mpanum n);
+
+MPALIB_EXPORT int mpa_nist_mod(mpanum dest, const mpanum op, int prime);
+
 /*
  * From mpa_mem_static.c
  */
@@ -103,6 +103,16 @@ typedef uint8_t mpa_byte_t;
  */
 /* #define     USE_ARM_ASM */
 
+/*
+ * On AArch64 the word array multiply-accumulate kernel used by the
+ * multiplication and the Montgomery reduction is implemented in assembler
+ * (arch/arm/mpa_a64.S). Comment out the line below to use the generic C
+ * version instead.
+ */
+#if defined(__aarch64__)
+#define MPA_USE_A64_ASM
+#endif
+
 /*
  * Include functionality for converting to and from strings; mpa_set_string
  * and mpa_get_string.
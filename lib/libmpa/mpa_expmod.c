@@ -26,12 +26,152 @@
  */
 #include "mpa.h"
 
+/*
+ * Exponents of up to this many bits use the binary method. Such short
+ * exponents are public ones, like the RSA public exponent, where
+ * precomputing a window table would only add multiplications.
+ */
+#define EXP_BINARY_MAX_BITS	64
+
+/* Largest window size used, the table has 1 << EXP_MAX_WINDOW entries */
+#define EXP_MAX_WINDOW		5
+
+static int exp_window_size(int bits)
+{
+	if (bits > 768)
+		return 5;
+	if (bits > 256)
+		return 4;
+	return 3;
+}
+
+/*
+ * Returns the @w bits of @e starting at bit @idx, bits above the most
+ * significant word read as zero.
+ */
+static mpa_word_t exp_window(const mpanum e, int idx, int w)
+{
+	mpa_word_t win = 0;
+	int b;
+
+	for (b = idx + w - 1; b >= idx; b--) {
+		mpa_usize_t wi = b >> LOG_OF_WORD_SIZE;
+
+		win <<= 1;
+		if (wi < __mpanum_size(e))
+			win |= (e->d[wi] >> (b & (WORD_SIZE - 1))) & 1;
+	}
+	return win;
+}
+
+/*
+ * dest = table[idx], all the entries are read whatever idx is so that
+ * the memory access pattern doesn't depend on the exponent.
+ */
+static void exp_select(mpanum dest, mpanum *table, mpa_word_t num_entries,
+		       mpa_word_t idx, mpa_usize_t num_words)
+{
+	mpa_word_t diff;
+	mpa_word_t mask;
+	mpa_word_t size = 0;
+	mpa_word_t i;
+	mpa_usize_t n;
+
+	for (n = 0; n < num_words; n++)
+		dest->d[n] = 0;
+
+	for (i = 0; i < num_entries; i++) {
+		diff = i ^ idx;
+		/* all ones if i == idx, else zero */
+		mask = ((diff | (0 - diff)) >> (WORD_SIZE - 1)) - 1;
+		for (n = 0; n < num_words; n++)
+			dest->d[n] |= table[i]->d[n] & mask;
+		size |= (mpa_word_t)table[i]->size & mask;
+	}
+	dest->size = size;
+}
+
+/*
+ * Left-to-right binary method, a multiplication for each set bit of the
+ * exponent. A is R mod n and xtilde op1 in Montgomery form on entry, the
+ * result in Montgomery form is returned.
+ */
+static mpanum exp_mod_binary(mpanum A, mpanum B, const mpanum xtilde,
+			     const mpanum op2, const mpanum n,
+			     const mpa_word_t n_inv, mpa_word_t *scratch)
+{
+	mpanum *ptr_a = &A;
+	mpanum *ptr_b = &B;
+	mpanum *swapper;
+	int idx;
+
+	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
+		__mpa_montgomery_mul(*ptr_b, *ptr_a, *ptr_a, n, n_inv,
+				     scratch);
+		if (mpa_get_bit(op2, idx) == 1) {
+			__mpa_montgomery_mul(*ptr_a, *ptr_b, xtilde, n, n_inv,
+					     scratch);
+		} else {
+			swapper = ptr_a;
+			ptr_a = ptr_b;
+			ptr_b = swapper;
+		}
+	}
+	return *ptr_a;
+}
+
+/*
+ * Fixed window method: table[i] = op1^i in Montgomery form, then for each
+ * window of w exponent bits w squarings followed by a multiplication with
+ * the table entry selected by the window, also when the window is zero.
+ * The sequence of operations only depends on the length of the exponent.
+ */
+static mpanum exp_mod_window(mpanum A, mpanum B, mpanum *table, int w,
+			     const mpanum op2, const mpanum n,
+			     const mpa_word_t n_inv, mpa_word_t *scratch)
+{
+	mpa_word_t num_entries = 1 << w;
+	mpa_usize_t num_words = __mpanum_size(n) + 1;
+	mpanum sel = table[num_entries];
+	mpanum tmp;
+	mpa_word_t i;
+	int idx;
+	int k;
+
+	/* table[0] = R mod n (one), table[1] = xtilde */
+	for (i = 2; i < num_entries; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], table[1], n,
+				     n_inv, scratch);
+
+	idx = ((mpa_highest_bit_index(op2) + w) / w) * w;
+	while (idx > 0) {
+		idx -= w;
+		for (k = 0; k < w; k++) {
+			__mpa_montgomery_mul(B, A, A, n, n_inv, scratch);
+			tmp = A;
+			A = B;
+			B = tmp;
+		}
+		exp_select(sel, table, num_entries, exp_window(op2, idx, w),
+			   num_words);
+		__mpa_montgomery_mul(B, A, sel, n, n_inv, scratch);
+		tmp = A;
+		A = B;
+		B = tmp;
+	}
+	return A;
+}
+
 /*------------------------------------------------------------
  *
  *  mpa_exp_mod
  *
  *  Calculates dest = op1 ^ op2 mod n
  *
+ *  Exponents longer than EXP_BINARY_MAX_BITS are processed with a fixed
+ *  window if the scratch memory pool can hold the table, else with the
+ *  binary method.
+ *
  */
 void mpa_exp_mod(mpanum dest,
 		const mpanum op1,
@@ -44,42 +184,66 @@ void mpa_exp_mod(mpanum dest,
 	mpanum A;
 	mpanum B;
 	mpanum xtilde;
-	mpanum *ptr_a;
-	mpanum *ptr_b;
-	mpanum *swapper;
-	int idx;
+	mpanum res;
+	mpanum scratch;
+	mpa_word_t *tmp = NULL;
+	/* 1 << w entries and the selected entry */
+	mpanum table[(1 << EXP_MAX_WINDOW) + 1];
+	int bits = mpa_highest_bit_index(op2) + 1;
+	int num_table = 0;
+	int w = 0;
+	int i;
 
 	mpa_alloc_static_temp_var(&A, pool);
 	mpa_alloc_static_temp_var(&B, pool);
 	mpa_alloc_static_temp_var(&xtilde, pool);
+	/* scratch memory for the Montgomery multiplications, if available */
+	mpa_alloc_static_temp_var_size(
+		__mpa_montgomery_mul_tmp_size(__mpanum_size(n)) * WORD_SIZE,
+		&scratch, pool);
+	if (scratch)
+		tmp = scratch->d;
+
+	if (bits > EXP_BINARY_MAX_BITS) {
+		w = exp_window_size(bits);
+		for (i = 0; i <= (1 << w); i++) {
+			if (!mpa_alloc_static_temp_var_size(
+					(__mpanum_size(n) + 2) * WORD_SIZE,
+					table + i, pool))
+				break;
+			__mpa_set_unused_digits_to_zero(table[i]);
+			num_table++;
+		}
+		if (num_table != (1 << w) + 1)
+			w = 0;
+	}
 
 	/* transform to Montgomery space */
 	/* use internal version since xtidle is big enough */
-	__mpa_montgomery_mul(xtilde, op1, r2_modn, n, n_inv);
+	__mpa_montgomery_mul(xtilde, op1, r2_modn, n, n_inv, tmp);
 
 	mpa_copy(A, r_modn);
-	ptr_a = &A;
-	ptr_b = &B;
 	__mpa_set_unused_digits_to_zero(A);
 	__mpa_set_unused_digits_to_zero(B);
-	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
-		__mpa_montgomery_mul(*ptr_b, *ptr_a, *ptr_a, n, n_inv);
-		if (mpa_get_bit(op2, idx) == 1) {
-			__mpa_montgomery_mul(*ptr_a, *ptr_b, xtilde, n, n_inv);
-		} else {
-			swapper = ptr_a;
-			ptr_a = ptr_b;
-			ptr_b = swapper;
-		}
+	if (w) {
+		mpa_copy(table[0], r_modn);
+		mpa_copy(table[1], xtilde);
+		res = exp_mod_window(A, B, table, w, op2, n, n_inv, tmp);
+	} else {
+		res = exp_mod_binary(A, B, xtilde, op2, n, n_inv, tmp);
 	}
 
 	/* transform back form Montgomery space */
-	__mpa_montgomery_mul(*ptr_b, (const mpanum)&const_one, *ptr_a,
-			     n, n_inv);
+	__mpa_montgomery_mul(res == A ? B : A, (const mpanum)&const_one, res,
+			     n, n_inv, tmp);
 
-	mpa_copy(dest, *ptr_b);
+	mpa_copy(dest, res == A ? B : A);
 
-	mpa_free_static_temp_var(&A, pool);
-	mpa_free_static_temp_var(&B, pool);
+	/* freed in reverse order of allocation */
+	for (i = num_table - 1; i >= 0; i--)
+		mpa_free_static_temp_var(table + i, pool);
+	mpa_free_static_temp_var(&scratch, pool);
 	mpa_free_static_temp_var(&xtilde, pool);
+	mpa_free_static_temp_var(&B, pool);
+	mpa_free_static_temp_var(&A, pool);
 }
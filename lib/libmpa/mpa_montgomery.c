@@ -124,20 +124,102 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src)
 
 #endif /* USE_ARM_ASM */
 
+/*------------------------------------------------------------
+ *
+ *  __mpa_montgomery_mul_tmp_size
+ *
+ *  Returns the number of words of scratch memory __mpa_montgomery_mul()
+ *  needs for a modulus of n_size words.
+ *
+ */
+mpa_usize_t __mpa_montgomery_mul_tmp_size(mpa_usize_t n_size)
+{
+	return 2 * n_size + 1 + __mpa_mul_words_tmp_size(n_size);
+}
+
+/*------------------------------------------------------------
+ *
+ *  redc_words
+ *
+ *  Reduces t one word at a time: t = (t + u * n) / B with u chosen so
+ *  that the lowest word becomes zero. t holds 2 * n->size + 1 words and
+ *  a value less than n * R, the result, less than 2 * n, is left in the
+ *  upper n->size + 1 words and copied to dest.
+ *
+ */
+static void redc_words(mpanum dest, mpa_word_t *t, const mpanum n,
+		       mpa_word_t n_inv)
+{
+	mpa_usize_t s = __mpanum_size(n);
+	mpa_word_t carry;
+	mpa_usize_t idx;
+	mpa_usize_t i;
+
+	for (idx = 0; idx < s; idx++) {
+		carry = __mpa_mul_add_words(t + idx, n->d, s, t[idx] * n_inv);
+		for (i = idx + s; carry; i++) {
+			t[i] += carry;
+			carry = t[i] < carry;
+		}
+	}
+
+	/* set dest to zero (with all unused digits to zero as well) */
+	mpa_wipe(dest);
+	mpa_memcpy(dest->d, t + s, (s + 1) * BYTES_PER_WORD);
+	dest->size = s + 1;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+}
+
+/*------------------------------------------------------------
+ *
+ *  montgomery_redc
+ *
+ *  Computes the full product op1 * op2 with the word array kernels, a
+ *  square when op1 and op2 are the same, and reduces it with
+ *  redc_words().
+ *
+ */
+static void montgomery_redc(mpanum dest, mpanum op1, mpanum op2, mpanum n,
+			    mpa_word_t n_inv, mpa_word_t *tmp)
+{
+	mpa_usize_t s = __mpanum_size(n);
+	mpa_usize_t s1 = __mpanum_size(op1);
+	mpa_usize_t s2 = __mpanum_size(op2);
+
+	if (op1 == op2)
+		__mpa_sqr_words(tmp, op1->d, s1, tmp + 2 * s + 1);
+	else
+		__mpa_mul_words(tmp, op1->d, s1, op2->d, s2, tmp + 2 * s + 1);
+	mpa_memset(tmp + s1 + s2, 0, (2 * s + 1 - s1 - s2) * BYTES_PER_WORD);
+
+	redc_words(dest, tmp, n, n_inv);
+}
+
 /*------------------------------------------------------------
  *
  *  __mpa_montgomery_mul
  *
+ *  tmp is either NULL or holds __mpa_montgomery_mul_tmp_size(n->size)
+ *  words. Without it, or if an operand is longer than n, the product is
+ *  accumulated directly in dest.
+ *
  *  NOTE:
  *  Dest need to be able to hold one more word than the size of n
  *
  */
 void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
-			  mpa_word_t n_inv)
+			  mpa_word_t n_inv, mpa_word_t *tmp)
 {
 	mpa_word_t u;
 	mpa_usize_t idx;
 
+	if (tmp && __mpanum_size(op1) <= __mpanum_size(n) &&
+	    __mpanum_size(op2) <= __mpanum_size(n)) {
+		montgomery_redc(dest, op1, op2, n, n_inv, tmp);
+		goto out;
+	}
+
 	/* set dest to zero (with all unused digits to zero as well) */
 	mpa_wipe(dest);
 
@@ -157,6 +239,7 @@ void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 		*(dest->d + dest->size) = 0;	/* set unused digit to zero. */
 	}
 
+out:
 	/* check if dest > n, if so set dest = dest - n */
 	if (__mpa_abs_cmp(dest, n) >= 0)
 		__mpa_montgomery_sub_ack(dest, n);
@@ -256,11 +339,53 @@ void mpa_montgomery_mul(mpanum dest,
 		       mpanum n, mpa_word_t n_inv, mpa_scratch_mem pool)
 {
 	mpanum tmp_dest;
+	mpanum tmp;
 
 	mpa_alloc_static_temp_var(&tmp_dest, pool);
+	/* falls back to the slower method if there's no room for tmp */
+	mpa_alloc_static_temp_var_size(
+		__mpa_montgomery_mul_tmp_size(__mpanum_size(n)) * WORD_SIZE,
+		&tmp, pool);
 
-	__mpa_montgomery_mul(tmp_dest, op1, op2, n, n_inv);
+	__mpa_montgomery_mul(tmp_dest, op1, op2, n, n_inv,
+			     tmp ? tmp->d : NULL);
 
 	mpa_copy(dest, tmp_dest);
+	mpa_free_static_temp_var(&tmp, pool);
 	mpa_free_static_temp_var(&tmp_dest, pool);
 }
+
+/*------------------------------------------------------------
+ *
+ *  mpa_montgomery_reduce
+ *
+ *  dest = op * R^-1 mod n where R = 1 << (WORD_SIZE * n->size), op
+ *  must be non-negative and less than n * R. Returns -1 if op is out of
+ *  range or there's not enough scratch memory.
+ *
+ */
+int mpa_montgomery_reduce(mpanum dest, const mpanum op, const mpanum n,
+			  mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpa_usize_t s = __mpanum_size(n);
+	mpanum tmp;
+
+	/* op < n * R if the top word of op is below the top word of n */
+	if (__mpanum_sign(op) == MPA_NEG_SIGN || op->size > 2 * s ||
+	    (op->size == 2 * s && op->d[2 * s - 1] >= n->d[s - 1]))
+		return -1;
+
+	if (!mpa_alloc_static_temp_var_size((2 * s + 1) * WORD_SIZE, &tmp,
+					    pool))
+		return -1;
+
+	mpa_memcpy(tmp->d, op->d, op->size * BYTES_PER_WORD);
+	mpa_memset(tmp->d + op->size, 0,
+		   (2 * s + 1 - op->size) * BYTES_PER_WORD);
+	redc_words(dest, tmp->d, n, n_inv);
+	if (__mpa_abs_cmp(dest, n) >= 0)
+		__mpa_montgomery_sub_ack(dest, n);
+
+	mpa_free_static_temp_var(&tmp, pool);
+	return 0;
+}
@@ -84,6 +84,505 @@ void __mpa_mul_add_word_cum(mpa_word_t a,
 
 #endif /* USE_ARM_ASM */
 
+/*************************************************************
+ *
+ *   WORD ARRAY KERNELS
+ *
+ *   The kernels below work on little endian arrays of words and are
+ *   used both by __mpa_abs_mul() and by the Montgomery multiplication.
+ *   Products are computed column by column (comba). Operands of 4 and 8
+ *   words (8 words is a P-256 field element) have fully unrolled
+ *   kernels and large operands of equal size are split with Karatsuba
+ *   when the caller provides scratch memory.
+ *
+ *************************************************************/
+
+#if !defined(MPA_SUPPORT_DWORD_T)
+#error "error: write non-dword_t code for the word array kernels"
+#endif
+
+/*
+ * Operands of at least this many words are multiplied with Karatsuba,
+ * below it the comba kernels are faster.
+ */
+#define MPA_KARATSUBA_THRESHOLD	32
+
+/*
+ * The column sum is kept in acc (two lower words) and c2 (upper word),
+ * the caller declares both.
+ */
+#define COMBA_MULADD(x, y) \
+	do { \
+		mpa_dword_t _t = (mpa_dword_t)(x) * (mpa_dword_t)(y); \
+		\
+		acc += _t; \
+		c2 += (acc < _t); \
+	} while (0)
+
+/* Adds the product twice, for the off-diagonal terms of a square */
+#define COMBA_MULADD2(x, y) \
+	do { \
+		mpa_dword_t _t = (mpa_dword_t)(x) * (mpa_dword_t)(y); \
+		\
+		acc += _t; \
+		c2 += (acc < _t); \
+		acc += _t; \
+		c2 += (acc < _t); \
+	} while (0)
+
+/* Stores the lowest word of the column sum and shifts it down a word */
+#define COMBA_STORE(x) \
+	do { \
+		(x) = (mpa_word_t)acc; \
+		acc = (acc >> WORD_SIZE) | ((mpa_dword_t)c2 << WORD_SIZE); \
+		c2 = 0; \
+	} while (0)
+
+#if defined(MPA_USE_A64_ASM)
+mpa_word_t __mpa_mul_add_words_a64(mpa_word_t *r, const mpa_word_t *a,
+				   mpa_usize_t n, mpa_word_t w);
+#endif
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_mul_add_words
+ *
+ *  r[0..n-1] += a[0..n-1] * w, returns the outgoing carry.
+ */
+mpa_word_t __mpa_mul_add_words(mpa_word_t *r, const mpa_word_t *a,
+			       mpa_usize_t n, mpa_word_t w)
+{
+#if defined(MPA_USE_A64_ASM)
+	return __mpa_mul_add_words_a64(r, a, n, w);
+#else
+	mpa_dword_t t;
+	mpa_word_t carry = 0;
+	mpa_usize_t i;
+
+	for (i = 0; i < n; i++) {
+		t = (mpa_dword_t)a[i] * (mpa_dword_t)w + (mpa_dword_t)r[i] +
+		    (mpa_dword_t)carry;
+		r[i] = (mpa_word_t)t;
+		carry = (mpa_word_t)(t >> WORD_SIZE);
+	}
+	return carry;
+#endif
+}
+
+/*
+ * r[0..nb-1] = a[0..na-1] + b[0..nb-1] where na <= nb, returns the carry.
+ * r may be the same as a or b.
+ */
+static mpa_word_t add_words(mpa_word_t *r, const mpa_word_t *a,
+			    mpa_usize_t na, const mpa_word_t *b,
+			    mpa_usize_t nb)
+{
+	mpa_dword_t t = 0;
+	mpa_usize_t i;
+
+	for (i = 0; i < na; i++) {
+		t = (mpa_dword_t)a[i] + (mpa_dword_t)b[i] + (t >> WORD_SIZE);
+		r[i] = (mpa_word_t)t;
+	}
+	for (; i < nb; i++) {
+		t = (mpa_dword_t)b[i] + (t >> WORD_SIZE);
+		r[i] = (mpa_word_t)t;
+	}
+	return (mpa_word_t)(t >> WORD_SIZE);
+}
+
+/*
+ * r[0..nr-1] -= a[0..na-1] where na <= nr and the result is known not to
+ * be negative.
+ */
+static void sub_words(mpa_word_t *r, mpa_usize_t nr, const mpa_word_t *a,
+		      mpa_usize_t na)
+{
+	mpa_word_t borrow = 0;
+	mpa_dword_t t;
+	mpa_usize_t i;
+
+	for (i = 0; i < nr && (i < na || borrow); i++) {
+		t = (mpa_dword_t)r[i] - (mpa_dword_t)(i < na ? a[i] : 0) -
+		    (mpa_dword_t)borrow;
+		r[i] = (mpa_word_t)t;
+		borrow = (mpa_word_t)(t >> WORD_SIZE) & 1;
+	}
+}
+
+static void mul_comba_4(mpa_word_t *r, const mpa_word_t *a,
+			const mpa_word_t *b)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+
+	COMBA_MULADD(a[0], b[0]);
+	COMBA_STORE(r[0]);
+	COMBA_MULADD(a[0], b[1]);
+	COMBA_MULADD(a[1], b[0]);
+	COMBA_STORE(r[1]);
+	COMBA_MULADD(a[0], b[2]);
+	COMBA_MULADD(a[1], b[1]);
+	COMBA_MULADD(a[2], b[0]);
+	COMBA_STORE(r[2]);
+	COMBA_MULADD(a[0], b[3]);
+	COMBA_MULADD(a[1], b[2]);
+	COMBA_MULADD(a[2], b[1]);
+	COMBA_MULADD(a[3], b[0]);
+	COMBA_STORE(r[3]);
+	COMBA_MULADD(a[1], b[3]);
+	COMBA_MULADD(a[2], b[2]);
+	COMBA_MULADD(a[3], b[1]);
+	COMBA_STORE(r[4]);
+	COMBA_MULADD(a[2], b[3]);
+	COMBA_MULADD(a[3], b[2]);
+	COMBA_STORE(r[5]);
+	COMBA_MULADD(a[3], b[3]);
+	COMBA_STORE(r[6]);
+	r[7] = (mpa_word_t)acc;
+}
+
+static void mul_comba_8(mpa_word_t *r, const mpa_word_t *a,
+			const mpa_word_t *b)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+
+	COMBA_MULADD(a[0], b[0]);
+	COMBA_STORE(r[0]);
+	COMBA_MULADD(a[0], b[1]);
+	COMBA_MULADD(a[1], b[0]);
+	COMBA_STORE(r[1]);
+	COMBA_MULADD(a[0], b[2]);
+	COMBA_MULADD(a[1], b[1]);
+	COMBA_MULADD(a[2], b[0]);
+	COMBA_STORE(r[2]);
+	COMBA_MULADD(a[0], b[3]);
+	COMBA_MULADD(a[1], b[2]);
+	COMBA_MULADD(a[2], b[1]);
+	COMBA_MULADD(a[3], b[0]);
+	COMBA_STORE(r[3]);
+	COMBA_MULADD(a[0], b[4]);
+	COMBA_MULADD(a[1], b[3]);
+	COMBA_MULADD(a[2], b[2]);
+	COMBA_MULADD(a[3], b[1]);
+	COMBA_MULADD(a[4], b[0]);
+	COMBA_STORE(r[4]);
+	COMBA_MULADD(a[0], b[5]);
+	COMBA_MULADD(a[1], b[4]);
+	COMBA_MULADD(a[2], b[3]);
+	COMBA_MULADD(a[3], b[2]);
+	COMBA_MULADD(a[4], b[1]);
+	COMBA_MULADD(a[5], b[0]);
+	COMBA_STORE(r[5]);
+	COMBA_MULADD(a[0], b[6]);
+	COMBA_MULADD(a[1], b[5]);
+	COMBA_MULADD(a[2], b[4]);
+	COMBA_MULADD(a[3], b[3]);
+	COMBA_MULADD(a[4], b[2]);
+	COMBA_MULADD(a[5], b[1]);
+	COMBA_MULADD(a[6], b[0]);
+	COMBA_STORE(r[6]);
+	COMBA_MULADD(a[0], b[7]);
+	COMBA_MULADD(a[1], b[6]);
+	COMBA_MULADD(a[2], b[5]);
+	COMBA_MULADD(a[3], b[4]);
+	COMBA_MULADD(a[4], b[3]);
+	COMBA_MULADD(a[5], b[2]);
+	COMBA_MULADD(a[6], b[1]);
+	COMBA_MULADD(a[7], b[0]);
+	COMBA_STORE(r[7]);
+	COMBA_MULADD(a[1], b[7]);
+	COMBA_MULADD(a[2], b[6]);
+	COMBA_MULADD(a[3], b[5]);
+	COMBA_MULADD(a[4], b[4]);
+	COMBA_MULADD(a[5], b[3]);
+	COMBA_MULADD(a[6], b[2]);
+	COMBA_MULADD(a[7], b[1]);
+	COMBA_STORE(r[8]);
+	COMBA_MULADD(a[2], b[7]);
+	COMBA_MULADD(a[3], b[6]);
+	COMBA_MULADD(a[4], b[5]);
+	COMBA_MULADD(a[5], b[4]);
+	COMBA_MULADD(a[6], b[3]);
+	COMBA_MULADD(a[7], b[2]);
+	COMBA_STORE(r[9]);
+	COMBA_MULADD(a[3], b[7]);
+	COMBA_MULADD(a[4], b[6]);
+	COMBA_MULADD(a[5], b[5]);
+	COMBA_MULADD(a[6], b[4]);
+	COMBA_MULADD(a[7], b[3]);
+	COMBA_STORE(r[10]);
+	COMBA_MULADD(a[4], b[7]);
+	COMBA_MULADD(a[5], b[6]);
+	COMBA_MULADD(a[6], b[5]);
+	COMBA_MULADD(a[7], b[4]);
+	COMBA_STORE(r[11]);
+	COMBA_MULADD(a[5], b[7]);
+	COMBA_MULADD(a[6], b[6]);
+	COMBA_MULADD(a[7], b[5]);
+	COMBA_STORE(r[12]);
+	COMBA_MULADD(a[6], b[7]);
+	COMBA_MULADD(a[7], b[6]);
+	COMBA_STORE(r[13]);
+	COMBA_MULADD(a[7], b[7]);
+	COMBA_STORE(r[14]);
+	r[15] = (mpa_word_t)acc;
+}
+
+static void sqr_comba_4(mpa_word_t *r, const mpa_word_t *a)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+
+	COMBA_MULADD(a[0], a[0]);
+	COMBA_STORE(r[0]);
+	COMBA_MULADD2(a[0], a[1]);
+	COMBA_STORE(r[1]);
+	COMBA_MULADD2(a[0], a[2]);
+	COMBA_MULADD(a[1], a[1]);
+	COMBA_STORE(r[2]);
+	COMBA_MULADD2(a[0], a[3]);
+	COMBA_MULADD2(a[1], a[2]);
+	COMBA_STORE(r[3]);
+	COMBA_MULADD2(a[1], a[3]);
+	COMBA_MULADD(a[2], a[2]);
+	COMBA_STORE(r[4]);
+	COMBA_MULADD2(a[2], a[3]);
+	COMBA_STORE(r[5]);
+	COMBA_MULADD(a[3], a[3]);
+	COMBA_STORE(r[6]);
+	r[7] = (mpa_word_t)acc;
+}
+
+static void sqr_comba_8(mpa_word_t *r, const mpa_word_t *a)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+
+	COMBA_MULADD(a[0], a[0]);
+	COMBA_STORE(r[0]);
+	COMBA_MULADD2(a[0], a[1]);
+	COMBA_STORE(r[1]);
+	COMBA_MULADD2(a[0], a[2]);
+	COMBA_MULADD(a[1], a[1]);
+	COMBA_STORE(r[2]);
+	COMBA_MULADD2(a[0], a[3]);
+	COMBA_MULADD2(a[1], a[2]);
+	COMBA_STORE(r[3]);
+	COMBA_MULADD2(a[0], a[4]);
+	COMBA_MULADD2(a[1], a[3]);
+	COMBA_MULADD(a[2], a[2]);
+	COMBA_STORE(r[4]);
+	COMBA_MULADD2(a[0], a[5]);
+	COMBA_MULADD2(a[1], a[4]);
+	COMBA_MULADD2(a[2], a[3]);
+	COMBA_STORE(r[5]);
+	COMBA_MULADD2(a[0], a[6]);
+	COMBA_MULADD2(a[1], a[5]);
+	COMBA_MULADD2(a[2], a[4]);
+	COMBA_MULADD(a[3], a[3]);
+	COMBA_STORE(r[6]);
+	COMBA_MULADD2(a[0], a[7]);
+	COMBA_MULADD2(a[1], a[6]);
+	COMBA_MULADD2(a[2], a[5]);
+	COMBA_MULADD2(a[3], a[4]);
+	COMBA_STORE(r[7]);
+	COMBA_MULADD2(a[1], a[7]);
+	COMBA_MULADD2(a[2], a[6]);
+	COMBA_MULADD2(a[3], a[5]);
+	COMBA_MULADD(a[4], a[4]);
+	COMBA_STORE(r[8]);
+	COMBA_MULADD2(a[2], a[7]);
+	COMBA_MULADD2(a[3], a[6]);
+	COMBA_MULADD2(a[4], a[5]);
+	COMBA_STORE(r[9]);
+	COMBA_MULADD2(a[3], a[7]);
+	COMBA_MULADD2(a[4], a[6]);
+	COMBA_MULADD(a[5], a[5]);
+	COMBA_STORE(r[10]);
+	COMBA_MULADD2(a[4], a[7]);
+	COMBA_MULADD2(a[5], a[6]);
+	COMBA_STORE(r[11]);
+	COMBA_MULADD2(a[5], a[7]);
+	COMBA_MULADD(a[6], a[6]);
+	COMBA_STORE(r[12]);
+	COMBA_MULADD2(a[6], a[7]);
+	COMBA_STORE(r[13]);
+	COMBA_MULADD(a[7], a[7]);
+	COMBA_STORE(r[14]);
+	r[15] = (mpa_word_t)acc;
+}
+
+
+/* r[0..na+nb-1] = a[0..na-1] * b[0..nb-1], na and nb larger than zero */
+static void mul_comba(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t na,
+		      const mpa_word_t *b, mpa_usize_t nb)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+	mpa_usize_t k;
+	mpa_usize_t i;
+	mpa_usize_t i_end;
+
+	for (k = 0; k < na + nb - 1; k++) {
+		i = k < nb ? 0 : k - nb + 1;
+		i_end = k < na ? k : na - 1;
+		for (; i <= i_end; i++)
+			COMBA_MULADD(a[i], b[k - i]);
+		COMBA_STORE(r[k]);
+	}
+	r[k] = (mpa_word_t)acc;
+}
+
+/*
+ * r[0..2n-1] = a[0..n-1]^2, each off-diagonal product is only computed
+ * once and added twice.
+ */
+static void sqr_comba(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t n)
+{
+	mpa_dword_t acc = 0;
+	mpa_word_t c2 = 0;
+	mpa_usize_t k;
+	mpa_usize_t i;
+	mpa_usize_t j;
+
+	for (k = 0; k < 2 * n - 1; k++) {
+		i = k < n ? 0 : k - n + 1;
+		for (j = k - i; i < j; i++, j--)
+			COMBA_MULADD2(a[i], a[j]);
+		if (i == j)
+			COMBA_MULADD(a[i], a[i]);
+		COMBA_STORE(r[k]);
+	}
+	r[k] = (mpa_word_t)acc;
+}
+
+/*
+ * Karatsuba with a = a1 * B^h + a0 and b = b1 * B^h + b0:
+ * a * b = z2 * B^2h + (z1 - z2 - z0) * B^h + z0 where z0 = a0 * b0,
+ * z2 = a1 * b1 and z1 = (a0 + a1) * (b0 + b1). z0 and z2 are computed
+ * straight into r, the sums and z1 are kept in tmp.
+ */
+static void mul_karatsuba(mpa_word_t *r, const mpa_word_t *a,
+			  const mpa_word_t *b, mpa_usize_t n, mpa_word_t *tmp)
+{
+	mpa_usize_t h = n / 2;
+	mpa_usize_t hh = n - h;
+	mpa_word_t *sa = tmp;
+	mpa_word_t *sb = sa + hh + 1;
+	mpa_word_t *z1 = sb + hh + 1;
+	mpa_usize_t nz1 = 2 * (hh + 1);
+
+	__mpa_mul_words(r, a, h, b, h, tmp);
+	__mpa_mul_words(r + 2 * h, a + h, hh, b + h, hh, tmp);
+
+	sa[hh] = add_words(sa, a, h, a + h, hh);
+	sb[hh] = add_words(sb, b, h, b + h, hh);
+	__mpa_mul_words(z1, sa, hh + 1, sb, hh + 1, z1 + nz1);
+
+	sub_words(z1, nz1, r, 2 * h);
+	sub_words(z1, nz1, r + 2 * h, 2 * hh);
+	/* z1 < B^(n + 1), the upper words are zero */
+	add_words(r + h, z1, n + 1, r + h, n + hh);
+}
+
+/* As mul_karatsuba() with b = a, z1 = (a0 + a1)^2 */
+static void sqr_karatsuba(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t n,
+			  mpa_word_t *tmp)
+{
+	mpa_usize_t h = n / 2;
+	mpa_usize_t hh = n - h;
+	mpa_word_t *sa = tmp;
+	mpa_word_t *z1 = sa + hh + 1;
+	mpa_usize_t nz1 = 2 * (hh + 1);
+
+	__mpa_sqr_words(r, a, h, tmp);
+	__mpa_sqr_words(r + 2 * h, a + h, hh, tmp);
+
+	sa[hh] = add_words(sa, a, h, a + h, hh);
+	__mpa_sqr_words(z1, sa, hh + 1, z1 + nz1);
+
+	sub_words(z1, nz1, r, 2 * h);
+	sub_words(z1, nz1, r + 2 * h, 2 * hh);
+	add_words(r + h, z1, n + 1, r + h, n + hh);
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_mul_words_tmp_size
+ *
+ *  Returns the number of words of scratch memory __mpa_mul_words() and
+ *  __mpa_sqr_words() need to use Karatsuba on operands of n words.
+ */
+mpa_usize_t __mpa_mul_words_tmp_size(mpa_usize_t n)
+{
+	mpa_usize_t size = 0;
+
+	while (n >= MPA_KARATSUBA_THRESHOLD) {
+		n = n - n / 2 + 1;
+		size += 4 * n;
+	}
+	return size;
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_mul_words
+ *
+ *  r[0..na+nb-1] = a[0..na-1] * b[0..nb-1], r must not overlap a or b.
+ *  tmp is either NULL or holds __mpa_mul_words_tmp_size(max(na, nb))
+ *  words, Karatsuba is only used in the latter case.
+ */
+void __mpa_mul_words(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t na,
+		     const mpa_word_t *b, mpa_usize_t nb, mpa_word_t *tmp)
+{
+	if (!na || !nb) {
+		mpa_memset(r, 0, (na + nb) * BYTES_PER_WORD);
+		return;
+	}
+
+	if (na == nb) {
+		if (na == 4) {
+			mul_comba_4(r, a, b);
+			return;
+		}
+		if (na == 8) {
+			mul_comba_8(r, a, b);
+			return;
+		}
+		if (tmp && na >= MPA_KARATSUBA_THRESHOLD) {
+			mul_karatsuba(r, a, b, na, tmp);
+			return;
+		}
+	}
+	mul_comba(r, a, na, b, nb);
+}
+
+/*  --------------------------------------------------------------------
+ *  Function:   __mpa_sqr_words
+ *
+ *  r[0..2n-1] = a[0..n-1]^2, with the same constraints as
+ *  __mpa_mul_words().
+ */
+void __mpa_sqr_words(mpa_word_t *r, const mpa_word_t *a, mpa_usize_t n,
+		     mpa_word_t *tmp)
+{
+	if (!n)
+		return;
+
+	if (n == 4) {
+		sqr_comba_4(r, a);
+		return;
+	}
+	if (n == 8) {
+		sqr_comba_8(r, a);
+		return;
+	}
+	if (tmp && n >= MPA_KARATSUBA_THRESHOLD) {
+		sqr_karatsuba(r, a, n, tmp);
+		return;
+	}
+	sqr_comba(r, a, n);
+}
+
 /*  --------------------------------------------------------------------
  *  Function:   __mpa_abs_mul_word
  *
@@ -120,37 +619,25 @@ void __mpa_abs_mul_word(mpanum dest, const mpanum op1, mpa_word_t op2)
  *
  *  Calculates |op1| * |op2| and puts result in dest.
  *  dest must be big enough to hold result and cannot be
- *  the same as op1 or op2.
+ *  the same as op1 or op2. tmp is passed on to __mpa_mul_words().
  */
-void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2)
+void __mpa_abs_mul(mpanum dest, const mpanum op1, const mpanum op2,
+		   mpa_word_t *tmp)
 {
-	mpa_word_t i = 0;
-	mpa_word_t j = 0;
-	mpa_word_t carry = 0;
-	mpa_word_t *prod;
-	const mpa_word_t *a;
-	const mpa_word_t *b;
+	mpa_usize_t size = __mpanum_size(op1) + __mpanum_size(op2);
 
-	/* clear dest digits */
-	mpa_memset(dest->d, 0, dest->alloc * BYTES_PER_WORD);
+	if (op1 == op2)
+		__mpa_sqr_words(dest->d, op1->d, __mpanum_size(op1), tmp);
+	else
+		__mpa_mul_words(dest->d, op1->d, __mpanum_size(op1), op2->d,
+				__mpanum_size(op2), tmp);
 
-	a = op1->d;
-	prod = dest->d;
-	for (i = 0; i < __mpanum_size(op1); i++) {
-		b = op2->d;
-		carry = 0;
-		for (j = 0; j < __mpanum_size(op2); j++) {
-			__mpa_mul_add_word_cum(*a, *b, prod + j, &carry);
-			b++;
-		}
-		if (carry)
-			*(prod + j) = carry;
-		a++;
-		prod++;
-	}
-	dest->size = i + j - 1;
-	if (carry)
-		dest->size++;
+	/* clear the unused digits */
+	mpa_memset(dest->d + size, 0, (dest->alloc - size) * BYTES_PER_WORD);
+
+	while (size > 0 && dest->d[size - 1] == 0)
+		size--;
+	dest->size = size;
 }
 
 /*************************************************************
@@ -168,6 +655,8 @@ void mpa_mul(mpanum dest,
 	     const mpanum op1, const mpanum op2, mpa_scratch_mem pool)
 {
 	mpanum tmp_dest;
+	mpanum tmp = NULL;
+	mpa_usize_t tmp_size;
 	char mem_marker;
 
 	if (__mpanum_is_zero(op1) || __mpanum_is_zero(op2)) {
@@ -182,12 +671,20 @@ void mpa_mul(mpanum dest,
 	else
 		tmp_dest = dest;
 
-	__mpa_abs_mul(tmp_dest, op1, op2);
+	/* without scratch memory for Karatsuba the comba kernels are used */
+	tmp_size = __mpa_mul_words_tmp_size(__MAX(__mpanum_size(op1),
+						  __mpanum_size(op2)));
+	if (tmp_size)
+		mpa_alloc_static_temp_var_size(tmp_size * WORD_SIZE, &tmp,
+					       pool);
+
+	__mpa_abs_mul(tmp_dest, op1, op2, tmp ? tmp->d : NULL);
 
 	if (__mpanum_sign(op1) != __mpanum_sign(op2))
 		__mpanum_neg(tmp_dest);
 
 	mpa_copy(dest, tmp_dest);
+	mpa_free_static_temp_var(&tmp, pool);
 	if (mem_marker)
 		mpa_free_static_temp_var(&tmp_dest, pool);
 }
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "mpa.h"
+
+/*
+ * Fast reduction modulo the NIST primes P-256 and P-384, FIPS 186-4
+ * appendix D.2. The special form of p lets an input c of up to twice the
+ * size of p be rewritten as a signed sum of terms, each term a number
+ * built from words of c, which is congruent to c modulo p. The sum is
+ * a few multiples of p away from the result, which is then found with
+ * a few additions or subtractions of p.
+ */
+
+#define NIST_MAX_WORDS	12
+#define NIST_MAX_TERMS	10
+
+struct nist_prime {
+	mpa_usize_t size;
+	mpa_word_t p[NIST_MAX_WORDS];
+	int8_t coef[NIST_MAX_TERMS];
+	/* word of c each term adds to each result word, -1 for none */
+	int8_t idx[NIST_MAX_WORDS][NIST_MAX_TERMS];
+};
+
+static const struct nist_prime nist_primes[] = {
+	[MPA_NIST_P256 - 1] = {
+		.size = 8,
+		.p = { 0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+		       0x00000000, 0x00000000, 0x00000001, 0xffffffff },
+		.coef = { 1, 2, 2, 1, 1, -1, -1, -1, -1, 0 },
+		.idx = {
+			{ 0, -1, -1, 8, 9, 11, 12, 13, 14, -1 },
+			{ 1, -1, -1, 9, 10, 12, 13, 14, 15, -1 },
+			{ 2, -1, -1, 10, 11, 13, 14, 15, -1, -1 },
+			{ 3, 11, 12, -1, 13, -1, 15, 8, 9, -1 },
+			{ 4, 12, 13, -1, 14, -1, -1, 9, 10, -1 },
+			{ 5, 13, 14, -1, 15, -1, -1, 10, 11, -1 },
+			{ 6, 14, 15, 14, 13, 8, 9, -1, -1, -1 },
+			{ 7, 15, -1, 15, 8, 10, 11, 12, 13, -1 },
+		},
+	},
+	[MPA_NIST_P384 - 1] = {
+		.size = 12,
+		.p = { 0xffffffff, 0x00000000, 0x00000000, 0xffffffff,
+		       0xfffffffe, 0xffffffff, 0xffffffff, 0xffffffff,
+		       0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+		.coef = { 1, 2, 1, 1, 1, 1, 1, -1, -1, -1 },
+		.idx = {
+			{ 0, -1, 12, 21, -1, -1, 20, 23, -1, -1 },
+			{ 1, -1, 13, 22, 23, -1, -1, 12, 20, -1 },
+			{ 2, -1, 14, 23, -1, -1, -1, 13, 21, -1 },
+			{ 3, -1, 15, 12, 20, -1, 21, 14, 22, 23 },
+			{ 4, 21, 16, 13, 12, 20, 22, 15, 23, 23 },
+			{ 5, 22, 17, 14, 13, 21, 23, 16, -1, -1 },
+			{ 6, 23, 18, 15, 14, 22, -1, 17, -1, -1 },
+			{ 7, -1, 19, 16, 15, 23, -1, 18, -1, -1 },
+			{ 8, -1, 20, 17, 16, -1, -1, 19, -1, -1 },
+			{ 9, -1, 21, 18, 17, -1, -1, 20, -1, -1 },
+			{ 10, -1, 22, 19, 18, -1, -1, 21, -1, -1 },
+			{ 11, -1, 23, 20, 19, -1, -1, 22, -1, -1 },
+		},
+	},
+};
+
+/* r += p, returns the carry */
+static mpa_word_t add_p(mpa_word_t *r, const struct nist_prime *np)
+{
+	mpa_dword_t t = 0;
+	mpa_usize_t i;
+
+	for (i = 0; i < np->size; i++) {
+		t = (mpa_dword_t)r[i] + (mpa_dword_t)np->p[i] + (t >> WORD_SIZE);
+		r[i] = (mpa_word_t)t;
+	}
+	return (mpa_word_t)(t >> WORD_SIZE);
+}
+
+/* r -= p, returns the borrow */
+static mpa_word_t sub_p(mpa_word_t *r, const struct nist_prime *np)
+{
+	mpa_word_t borrow = 0;
+	mpa_dword_t t;
+	mpa_usize_t i;
+
+	for (i = 0; i < np->size; i++) {
+		t = (mpa_dword_t)r[i] - (mpa_dword_t)np->p[i] -
+		    (mpa_dword_t)borrow;
+		r[i] = (mpa_word_t)t;
+		borrow = (mpa_word_t)(t >> WORD_SIZE) & 1;
+	}
+	return borrow;
+}
+
+static int cmp_p(const mpa_word_t *r, const struct nist_prime *np)
+{
+	mpa_usize_t i = np->size;
+
+	while (i > 0) {
+		i--;
+		if (r[i] != np->p[i])
+			return r[i] > np->p[i] ? 1 : -1;
+	}
+	return 0;
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_nist_prime
+ *
+ *  Returns MPA_NIST_P256 or MPA_NIST_P384 if n is one of those primes,
+ *  else 0.
+ *
+ */
+int mpa_nist_prime(const mpanum n)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(nist_primes) / sizeof(nist_primes[0]); i++) {
+		if (n->size == nist_primes[i].size &&
+		    cmp_p(n->d, nist_primes + i) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_nist_mod
+ *
+ *  dest = op mod p where p is the prime given by mpa_nist_prime(), op
+ *  must be non-negative and at most twice the size of p. dest may be the
+ *  same as op. Returns -1 if op is out of range.
+ *
+ */
+int mpa_nist_mod(mpanum dest, const mpanum op, int prime)
+{
+	const struct nist_prime *np;
+	/* words of op, c[-1] is zero for the -1 entries of the table */
+	mpa_word_t cbuf[2 * NIST_MAX_WORDS + 1];
+	mpa_word_t *c = cbuf + 1;
+	mpa_word_t r[NIST_MAX_WORDS];
+	int64_t acc = 0;
+	mpa_usize_t k;
+	size_t t;
+
+	if (prime < MPA_NIST_P256 || prime > MPA_NIST_P384)
+		return -1;
+	np = nist_primes + prime - 1;
+	if (__mpanum_sign(op) == MPA_NEG_SIGN || op->size > 2 * np->size)
+		return -1;
+
+	cbuf[0] = 0;
+	mpa_memcpy(c, op->d, op->size * BYTES_PER_WORD);
+	mpa_memset(c + op->size, 0,
+		   (2 * np->size - op->size) * BYTES_PER_WORD);
+
+	for (k = 0; k < np->size; k++) {
+		for (t = 0; t < NIST_MAX_TERMS; t++)
+			acc += np->coef[t] * (int64_t)c[np->idx[k][t]];
+		r[k] = (mpa_word_t)acc;
+		/* exact division, acc may be negative */
+		acc = (acc - r[k]) / ((int64_t)1 << WORD_SIZE);
+	}
+
+	/* r + acc * B^size is congruent to op, bring it into [0, p) */
+	while (acc < 0)
+		acc += add_p(r, np);
+	while (acc > 0 || cmp_p(r, np) >= 0)
+		acc -= sub_p(r, np);
+
+	mpa_memcpy(dest->d, r, np->size * BYTES_PER_WORD);
+	dest->size = np->size;
+	while (dest->size > 0 && dest->d[dest->size - 1] == 0)
+		dest->size--;
+	return 0;
+}
@@ -37,5 +37,6 @@ srcs-y += mpa_expmod.c
 srcs-y += mpa_init.c
 srcs-y += mpa_io.c
 srcs-y += mpa_modulus.c
+srcs-y += mpa_nist.c
 
 subdirs-$(arch_arm) += arch/$(ARCH)
@@ -59,4 +59,30 @@ TEE_Result TEE_CacheClean(char *buf, size_t len);
 TEE_Result TEE_CacheFlush(char *buf, size_t len);
 TEE_Result TEE_CacheInvalidate(char *buf, size_t len);
 
+/*
+ * Batched crypto updates
+ *
+ * TEE_CryptoUpdateBatch() does the equivalent of TEE_DigestUpdate(),
+ * TEE_MACUpdate() or TEE_CipherUpdate() for each of the numUpdates
+ * elements in updates, in order, entering TEE Core once for many small
+ * updates. dst and dstLen are only used with cipher operations, on return
+ * dstLen holds the number of bytes written to dst.
+ *
+ * If dstLen of a cipher update is too small the updates before it are
+ * done, its dstLen is updated with the required size and
+ * TEE_ERROR_SHORT_BUFFER is returned. Other errors are handled as by the
+ * individual functions. If numDone isn't NULL it's updated with the
+ * number of updates done.
+ */
+typedef struct {
+	TEE_OperationHandle operation;
+	const void *src;
+	uint32_t srcLen;
+	void *dst;
+	uint32_t dstLen;
+} TEE_CryptoUpdate;
+
+TEE_Result TEE_CryptoUpdateBatch(TEE_CryptoUpdate *updates,
+				 uint32_t numUpdates, uint32_t *numDone);
+
 #endif
@@ -118,6 +118,9 @@ TEE_Result utee_cipher_update(unsigned long state, const void *src,
 TEE_Result utee_cipher_final(unsigned long state, const void *src,
 			size_t src_len, void *dest, uint64_t *dest_len);
 
+TEE_Result utee_cryp_update_batch(struct utee_cryp_update *upd,
+			size_t num_upd);
+
 /* Generic Object Functions */
 TEE_Result utee_cryp_obj_get_info(unsigned long obj, TEE_ObjectInfo *info);
 TEE_Result utee_cryp_obj_restrict_usage(unsigned long obj, unsigned long usage);
@@ -63,6 +63,19 @@ struct utee_params {
 	uint64_t vals[TEE_NUM_PARAMS * 2];
 };
 
+/*
+ * Descriptor of one update with utee_cryp_update_batch(). dst and dst_len
+ * are only used with cipher operations, dst_len is updated with the
+ * number of bytes written to dst.
+ */
+struct utee_cryp_update {
+	uint64_t state;
+	uint64_t src;	/* pointer */
+	uint64_t src_len;
+	uint64_t dst;	/* pointer */
+	uint64_t dst_len;
+};
+
 struct utee_attribute {
 	uint64_t a;	/* also serves as a pointer for references */
 	uint64_t b;	/* also serves as a length for references */
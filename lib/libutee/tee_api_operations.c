@@ -1008,6 +1008,110 @@ out:
 	return res;
 }
 
+/* Number of updates passed with each utee_cryp_update_batch() */
+#define CRYPTO_UPDATE_BATCH_SIZE	16
+
+static void crypto_update_batch(TEE_CryptoUpdate *updates,
+				struct utee_cryp_update *batch, size_t num)
+{
+	TEE_Result res;
+	size_t n;
+
+	if (!num)
+		return;
+
+	res = utee_cryp_update_batch(batch, num);
+	if (res != TEE_SUCCESS)
+		TEE_Panic(res);
+
+	for (n = 0; n < num; n++)
+		if (updates[n].operation->info.operationClass ==
+		    TEE_OPERATION_CIPHER)
+			updates[n].dstLen = batch[n].dst_len;
+}
+
+TEE_Result TEE_CryptoUpdateBatch(TEE_CryptoUpdate *updates,
+				 uint32_t numUpdates, uint32_t *numDone)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct utee_cryp_update batch[CRYPTO_UPDATE_BATCH_SIZE];
+	TEE_CryptoUpdate *u;
+	TEE_OperationHandle op;
+	size_t first = 0;	/* Index of the first update in batch */
+	size_t num = 0;		/* Number of updates in batch */
+	size_t n;
+
+	for (n = 0; n < numUpdates; n++) {
+		u = updates + n;
+		op = u->operation;
+
+		if (op == TEE_HANDLE_NULL || (!u->src && u->srcLen))
+			TEE_Panic(0);
+
+		switch (op->info.operationClass) {
+		case TEE_OPERATION_DIGEST:
+			op->operationState = TEE_OPERATION_STATE_ACTIVE;
+			break;
+		case TEE_OPERATION_MAC:
+		case TEE_OPERATION_CIPHER:
+			if (!(op->info.handleState &
+			      TEE_HANDLE_FLAG_INITIALIZED) ||
+			    op->operationState != TEE_OPERATION_STATE_ACTIVE)
+				TEE_Panic(0);
+			break;
+		default:
+			TEE_Panic(0);
+		}
+
+		if (op->info.operationClass == TEE_OPERATION_CIPHER) {
+			if (!u->dst && u->dstLen)
+				TEE_Panic(0);
+
+			if (op->buffer_two_blocks || op->buffer_offs ||
+			    (u->srcLen % op->block_size)) {
+				/* Needs buffering, see tee_buffer_update() */
+				crypto_update_batch(updates + first, batch,
+						    num);
+				first = n + 1;
+				num = 0;
+				res = TEE_CipherUpdate(op, (void *)u->src,
+						       u->srcLen, u->dst,
+						       &u->dstLen);
+				if (res != TEE_SUCCESS)
+					goto out;
+				continue;
+			}
+
+			if (u->dstLen < u->srcLen) {
+				crypto_update_batch(updates + first, batch,
+						    num);
+				u->dstLen = u->srcLen;
+				res = TEE_ERROR_SHORT_BUFFER;
+				goto out;
+			}
+		}
+
+		batch[num].state = op->state;
+		batch[num].src = (uintptr_t)u->src;
+		batch[num].src_len = u->srcLen;
+		batch[num].dst = (uintptr_t)u->dst;
+		batch[num].dst_len = u->dstLen;
+		num++;
+
+		if (num == CRYPTO_UPDATE_BATCH_SIZE) {
+			crypto_update_batch(updates + first, batch, num);
+			first = n + 1;
+			num = 0;
+		}
+	}
+
+	crypto_update_batch(updates + first, batch, num);
+out:
+	if (numDone)
+		*numDone = n;
+	return res;
+}
+
 TEE_Result TEE_CipherDoFinal(TEE_OperationHandle operation,
 			     void *srcData, uint32_t srcLen, void *destData,
 			     uint32_t *destLen)
@@ -33,4 +33,11 @@
 uint32_t atomic_inc32(volatile uint32_t *v);
 uint32_t atomic_dec32(volatile uint32_t *v);
 
+/*
+ * Atomically replaces *v with nval if *v equals oval. Returns the value
+ * *v had before the operation, so the exchange succeeded if the returned
+ * value equals oval. Implies a full memory barrier on success.
+ */
+uint32_t atomic_cmpxchg32(volatile uint32_t *v, uint32_t oval, uint32_t nval);
+
 #endif /*__ATOMIC_H*/
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/queue.h>
+
+struct slab;
+
+/*
+ * A cache of objects of a single type. Objects are carved out of slabs,
+ * heap buffers holding several objects each, which keeps small objects
+ * together instead of spread all over the heap.
+ *
+ * @ctor is, if not NULL, called once for each object when its slab is
+ * allocated and objects are expected to be in this constructed state
+ * when freed to the cache. @dtor is, if not NULL, called for each
+ * object before its slab is returned to the heap.
+ *
+ * Define caches with SLAB_CACHE_INITIALIZER(), the remaining fields are
+ * initialized when the cache is first used.
+ */
+struct slab_cache {
+	const char *name;
+	size_t obj_size;
+	bool (*ctor)(void *obj);
+	void (*dtor)(void *obj);
+
+	unsigned int lock;
+	bool registered;
+	size_t stride;
+	size_t objs_per_slab;
+	size_t num_slabs;
+	size_t num_empty;
+	TAILQ_HEAD(, slab) slabs;
+	SLIST_ENTRY(slab_cache) link;
+
+	size_t allocated;
+	size_t max_allocated;
+	size_t num_alloc_fail;
+};
+
+#define SLAB_CACHE_INITIALIZER(_name, _type, _ctor, _dtor) \
+	{ .name = (_name), .obj_size = sizeof(_type), \
+	  .ctor = (_ctor), .dtor = (_dtor) }
+
+/* Returns a constructed object or NULL if out of memory */
+void *slab_alloc(struct slab_cache *cache);
+
+/* Like slab_alloc() but returns a zeroed object, only for caches w/o ctor */
+void *slab_zalloc(struct slab_cache *cache);
+
+/* Returns an object to the cache it was allocated from, NULL is ignored */
+void slab_free(struct slab_cache *cache, void *obj);
+
+#define SLAB_DESC_LENGTH	32
+struct slab_stats {
+	char desc[SLAB_DESC_LENGTH];
+	uint32_t obj_size;
+	uint32_t num_slabs;		/* Slabs allocated from the heap */
+	uint32_t num_objs;		/* Objects in those slabs */
+	uint32_t allocated;		/* Objects currently allocated */
+	uint32_t max_allocated;		/* Max value of allocated */
+	uint32_t num_alloc_fail;	/* Number of failed alloc requests */
+};
+
+/*
+ * Fills in the statistics of at most @num_stats caches that have been
+ * used so far and returns the number of such caches. The max_allocated
+ * and num_alloc_fail counters are cleared if @reset is true.
+ */
+size_t slab_get_stats(struct slab_stats *stats, size_t num_stats, bool reset);
+
+#endif /*SLAB_H*/
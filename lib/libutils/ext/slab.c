@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2016, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <compiler.h>
+#include <malloc.h>
+#include <slab.h>
+#include <string.h>
+#include <string_ext.h>
+#include <util.h>
+
+#if defined(__KERNEL__)
+/* Compiling for TEE Core */
+#include <kernel/thread.h>
+#include <kernel/tz_proc.h>
+
+static uint32_t slab_lock(unsigned int *lock)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+
+	cpu_spin_lock(lock);
+	return exceptions;
+}
+
+static void slab_unlock(unsigned int *lock, uint32_t exceptions)
+{
+	cpu_spin_unlock(lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+#else /*__KERNEL__*/
+/* Compiling for TA */
+static uint32_t slab_lock(unsigned int *lock __unused)
+{
+	return 0;
+}
+
+static void slab_unlock(unsigned int *lock __unused,
+			uint32_t exceptions __unused)
+{
+}
+#endif /*__KERNEL__*/
+
+/* Objects get the same alignment as buffers returned by malloc() */
+#define SLAB_ALIGN		(2 * sizeof(uintptr_t))
+/* Aimed size of the objects in a slab */
+#define SLAB_SIZE		512
+#define SLAB_MIN_OBJS		4
+
+/*
+ * A slab is a single heap buffer starting with this header followed by
+ * the objects. Indexes of the free objects are kept on a stack in the
+ * header rather than in the objects, which preserves their constructed
+ * state.
+ */
+struct slab {
+	TAILQ_ENTRY(slab) link;
+	uint8_t *objs;
+	size_t num_free;
+	uint16_t free_idx[];
+};
+
+static SLIST_HEAD(, slab_cache) slab_caches =
+	SLIST_HEAD_INITIALIZER(slab_caches);
+static unsigned int slab_caches_lock;
+
+static void slab_register(struct slab_cache *cache)
+{
+	uint32_t exceptions = slab_lock(&slab_caches_lock);
+	uint32_t cache_exceptions = slab_lock(&cache->lock);
+
+	if (!cache->registered) {
+		cache->stride = ROUNDUP(MAX(cache->obj_size, (size_t)1),
+					SLAB_ALIGN);
+		cache->objs_per_slab = MAX(SLAB_SIZE / cache->stride,
+					   (size_t)SLAB_MIN_OBJS);
+		TAILQ_INIT(&cache->slabs);
+		SLIST_INSERT_HEAD(&slab_caches, cache, link);
+		cache->registered = true;
+	}
+
+	slab_unlock(&cache->lock, cache_exceptions);
+	slab_unlock(&slab_caches_lock, exceptions);
+}
+
+static size_t slab_hdr_size(struct slab_cache *cache)
+{
+	return ROUNDUP(sizeof(struct slab) +
+		       cache->objs_per_slab * sizeof(uint16_t), SLAB_ALIGN);
+}
+
+static void free_slab(struct slab_cache *cache, struct slab *slab,
+		      size_t num_constructed)
+{
+	size_t n;
+
+	if (cache->dtor)
+		for (n = 0; n < num_constructed; n++)
+			cache->dtor(slab->objs + n * cache->stride);
+	free(slab);
+}
+
+static struct slab *alloc_slab(struct slab_cache *cache)
+{
+	size_t hdr_size = slab_hdr_size(cache);
+	struct slab *slab;
+	size_t n;
+
+	slab = calloc(1, hdr_size + cache->objs_per_slab * cache->stride);
+	if (!slab)
+		return NULL;
+
+	slab->objs = (uint8_t *)slab + hdr_size;
+	for (n = 0; n < cache->objs_per_slab; n++) {
+		void *obj = slab->objs + n * cache->stride;
+
+		if (cache->ctor && !cache->ctor(obj)) {
+			free_slab(cache, slab, n);
+			return NULL;
+		}
+		/* Hand out the objects in address order */
+		slab->free_idx[n] = cache->objs_per_slab - 1 - n;
+	}
+	slab->num_free = cache->objs_per_slab;
+
+	return slab;
+}
+
+/*
+ * Slabs with free objects are kept in front of the full ones so an
+ * object can always be taken from the first slab. Called with the cache
+ * locked.
+ */
+static void *alloc_obj(struct slab_cache *cache)
+{
+	struct slab *slab = TAILQ_FIRST(&cache->slabs);
+	size_t idx;
+
+	if (!slab || !slab->num_free)
+		return NULL;
+
+	if (slab->num_free == cache->objs_per_slab)
+		cache->num_empty--;
+
+	idx = slab->free_idx[--slab->num_free];
+	if (!slab->num_free) {
+		TAILQ_REMOVE(&cache->slabs, slab, link);
+		TAILQ_INSERT_TAIL(&cache->slabs, slab, link);
+	}
+
+	cache->allocated++;
+	if (cache->allocated > cache->max_allocated)
+		cache->max_allocated = cache->allocated;
+
+	return slab->objs + idx * cache->stride;
+}
+
+void *slab_alloc(struct slab_cache *cache)
+{
+	uint32_t exceptions;
+	struct slab *slab;
+	void *obj;
+
+	if (!cache->registered)
+		slab_register(cache);
+
+	exceptions = slab_lock(&cache->lock);
+	obj = alloc_obj(cache);
+	slab_unlock(&cache->lock, exceptions);
+	if (obj)
+		return obj;
+
+	/* Out of objects, the cache can't be locked while using the heap */
+	slab = alloc_slab(cache);
+
+	exceptions = slab_lock(&cache->lock);
+	if (slab) {
+		TAILQ_INSERT_HEAD(&cache->slabs, slab, link);
+		cache->num_slabs++;
+		cache->num_empty++;
+	}
+	obj = alloc_obj(cache);
+	if (!obj)
+		cache->num_alloc_fail++;
+	slab_unlock(&cache->lock, exceptions);
+
+	return obj;
+}
+
+void *slab_zalloc(struct slab_cache *cache)
+{
+	void *obj;
+
+	assert(!cache->ctor);
+	obj = slab_alloc(cache);
+	if (obj)
+		memset(obj, 0, cache->obj_size);
+	return obj;
+}
+
+static struct slab *find_slab(struct slab_cache *cache, uint8_t *obj)
+{
+	size_t objs_size = cache->objs_per_slab * cache->stride;
+	struct slab *slab;
+
+	TAILQ_FOREACH(slab, &cache->slabs, link)
+		if (obj >= slab->objs && obj < slab->objs + objs_size)
+			return slab;
+	return NULL;
+}
+
+void slab_free(struct slab_cache *cache, void *obj)
+{
+	struct slab *release = NULL;
+	uint32_t exceptions;
+	struct slab *slab;
+	size_t idx;
+
+	if (!obj)
+		return;
+
+	exceptions = slab_lock(&cache->lock);
+
+	slab = find_slab(cache, obj);
+	assert(slab);
+	if (!slab)
+		goto out;
+	idx = ((uint8_t *)obj - slab->objs) / cache->stride;
+	assert(slab->objs + idx * cache->stride == obj);
+
+	if (!slab->num_free) {
+		TAILQ_REMOVE(&cache->slabs, slab, link);
+		TAILQ_INSERT_HEAD(&cache->slabs, slab, link);
+	}
+	slab->free_idx[slab->num_free++] = idx;
+	cache->allocated--;
+
+	/* Keep one empty slab around, give the others back to the heap */
+	if (slab->num_free == cache->objs_per_slab) {
+		if (cache->num_empty) {
+			TAILQ_REMOVE(&cache->slabs, slab, link);
+			cache->num_slabs--;
+			release = slab;
+		} else {
+			cache->num_empty++;
+		}
+	}
+out:
+	slab_unlock(&cache->lock, exceptions);
+
+	if (release)
+		free_slab(cache, release, cache->objs_per_slab);
+}
+
+size_t slab_get_stats(struct slab_stats *stats, size_t num_stats, bool reset)
+{
+	uint32_t exceptions = slab_lock(&slab_caches_lock);
+	uint32_t cache_exceptions;
+	struct slab_cache *cache;
+	size_t n = 0;
+
+	SLIST_FOREACH(cache, &slab_caches, link) {
+		cache_exceptions = slab_lock(&cache->lock);
+		if (n < num_stats) {
+			memset(stats + n, 0, sizeof(*stats));
+			strlcpy(stats[n].desc, cache->name,
+				sizeof(stats[n].desc));
+			stats[n].obj_size = cache->obj_size;
+			stats[n].num_slabs = cache->num_slabs;
+			stats[n].num_objs = cache->num_slabs *
+					    cache->objs_per_slab;
+			stats[n].allocated = cache->allocated;
+			stats[n].max_allocated = cache->max_allocated;
+			stats[n].num_alloc_fail = cache->num_alloc_fail;
+		}
+		if (reset) {
+			cache->max_allocated = cache->allocated;
+			cache->num_alloc_fail = 0;
+		}
+		slab_unlock(&cache->lock, cache_exceptions);
+		n++;
+	}
+
+	slab_unlock(&slab_caches_lock, exceptions);
+	return n;
+}
@@ -5,5 +5,6 @@ srcs-y += strlcat.c
 srcs-y += strlcpy.c
 srcs-y += buf_compare_ct.c
 srcs-y += trace.c
+srcs-y += slab.c
 
 subdirs-$(arch_arm) += arch/$(ARCH)
@@ -109,8 +109,16 @@
 
 #if defined(__KERNEL__)
 /* Compiling for TEE Core */
+#include <platform_config.h>
 #include <kernel/asan.h>
+#include <kernel/misc.h>
 #include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <kernel/tz_proc.h>
+
+#if defined(CFG_CORE_MALLOC_CACHE) && !defined(ENABLE_MDBG)
+#define MALLOC_CACHE
+#endif
 
 static void malloc_lock(void)
 {
@@ -161,6 +169,228 @@ struct malloc_pool {
 static struct malloc_pool *malloc_pool;
 static size_t malloc_pool_len;
 
+#ifdef MALLOC_CACHE
+/*
+ * Per-core caches of small buffers in front of the bget pool.
+ *
+ * Requests of up to MCACHE_MAX_SIZE bytes are rounded up to one of
+ * MCACHE_NUM_CLASSES power of two size classes. A freed buffer is kept
+ * in the magazine of the current core and handed out again by the next
+ * request of the same class on that core, without taking __malloc_mu.
+ * Magazines are refilled from and drained to the pool MCACHE_BATCH
+ * buffers at a time.
+ *
+ * Cached buffers are still allocated as far as bget is concerned. All
+ * magazines are drained before an allocation from the pool is reported
+ * as failed.
+ */
+#define MCACHE_MIN_SIZE		32
+#define MCACHE_NUM_CLASSES	4
+#define MCACHE_MAX_SIZE		(MCACHE_MIN_SIZE << (MCACHE_NUM_CLASSES - 1))
+#define MCACHE_MAG_SIZE		4
+#define MCACHE_BATCH		(MCACHE_MAG_SIZE / 2)
+/* Keeps the magazines of different cores in different cache lines */
+#define MCACHE_ALIGN		64
+
+struct mcache_mag {
+	unsigned int lock;
+	size_t cached_bytes;
+	size_t count[MCACHE_NUM_CLASSES];
+	void *bufs[MCACHE_NUM_CLASSES][MCACHE_MAG_SIZE];
+} __aligned(MCACHE_ALIGN);
+
+static struct mcache_mag mcache_mags[CFG_TEE_CORE_NB_CORE];
+
+static size_t mcache_class_size(int c)
+{
+	return MCACHE_MIN_SIZE << c;
+}
+
+/* Returns the class to allocate @size bytes from or -1 if too large */
+static int mcache_class(size_t size)
+{
+	int c = 0;
+
+	if (size > MCACHE_MAX_SIZE)
+		return -1;
+	while (mcache_class_size(c) < size)
+		c++;
+	return c;
+}
+
+/* Returns the size of a bget buffer including its header */
+static size_t mcache_buf_size(void *buf)
+{
+	return -BH((char *)buf - sizeof(struct bhead))->bsize;
+}
+
+/*
+ * Returns the class a freed buffer can be cached in or -1 if it should
+ * go straight back to the pool. Buffers not allocated via a cache may be
+ * larger than the class size, but less than twice as large.
+ */
+static int mcache_buf_class(void *buf)
+{
+	size_t size = mcache_buf_size(buf) - sizeof(struct bhead);
+	int c;
+
+	for (c = MCACHE_NUM_CLASSES - 1; c >= 0; c--)
+		if (size >= mcache_class_size(c))
+			return size < 2 * mcache_class_size(c) ? c : -1;
+	return -1;
+}
+
+static void mcache_lock_mag(struct mcache_mag *mag, uint32_t *exceptions)
+{
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	cpu_spin_lock(&mag->lock);
+}
+
+static void mcache_unlock(struct mcache_mag *mag, uint32_t exceptions)
+{
+	cpu_spin_unlock(&mag->lock);
+	thread_unmask_exceptions(exceptions);
+}
+
+/* Locks and returns the magazine of the current core */
+static struct mcache_mag *mcache_lock(uint32_t *exceptions)
+{
+	struct mcache_mag *mag;
+
+	*exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	mag = mcache_mags + get_core_pos();
+	cpu_spin_lock(&mag->lock);
+	return mag;
+}
+
+/* Called with the magazine locked, returns false if it's full */
+static bool mcache_push(struct mcache_mag *mag, int c, void *buf)
+{
+	size_t size = mcache_buf_size(buf);
+
+	if (mag->count[c] == MCACHE_MAG_SIZE)
+		return false;
+
+	tag_asan_free(buf, size - sizeof(struct bhead));
+	mag->bufs[c][mag->count[c]++] = buf;
+	mag->cached_bytes += size;
+	return true;
+}
+
+/* Called with the magazine locked, returns NULL if it's empty */
+static void *mcache_pop(struct mcache_mag *mag, int c)
+{
+	void *buf;
+	size_t size;
+
+	if (!mag->count[c])
+		return NULL;
+
+	buf = mag->bufs[c][--mag->count[c]];
+	size = mcache_buf_size(buf);
+	mag->cached_bytes -= size;
+	tag_asan_alloced(buf, size - sizeof(struct bhead));
+	return buf;
+}
+
+/*
+ * Releases the buffers in all magazines to the pool, returns true if
+ * anything was released. Called with __malloc_mu held.
+ */
+static bool mcache_drain(void)
+{
+	void *bufs[MCACHE_NUM_CLASSES * MCACHE_MAG_SIZE];
+	struct mcache_mag *mag;
+	uint32_t exceptions;
+	bool ret = false;
+	size_t num_bufs;
+	void *buf;
+	size_t n;
+	int c;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
+		mag = mcache_mags + n;
+		num_bufs = 0;
+
+		mcache_lock_mag(mag, &exceptions);
+		for (c = 0; c < MCACHE_NUM_CLASSES; c++)
+			while ((buf = mcache_pop(mag, c)))
+				bufs[num_bufs++] = buf;
+		mcache_unlock(mag, exceptions);
+
+		if (num_bufs)
+			ret = true;
+		while (num_bufs)
+			brel(bufs[--num_bufs]);
+	}
+
+	return ret;
+}
+
+/* Returns true if @buf is a free buffer kept in a magazine */
+static bool mcache_contains(void *buf)
+{
+	struct mcache_mag *mag;
+	uint32_t exceptions;
+	bool ret = false;
+	size_t n;
+	size_t m;
+	int c;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE && !ret; n++) {
+		mag = mcache_mags + n;
+		mcache_lock_mag(mag, &exceptions);
+		for (c = 0; c < MCACHE_NUM_CLASSES; c++)
+			for (m = 0; m < mag->count[c]; m++)
+				if (mag->bufs[c][m] == buf)
+					ret = true;
+		mcache_unlock(mag, exceptions);
+	}
+
+	return ret;
+}
+
+static size_t __maybe_unused mcache_cached_bytes(void)
+{
+	struct mcache_mag *mag;
+	uint32_t exceptions;
+	size_t ret = 0;
+	size_t n;
+
+	for (n = 0; n < CFG_TEE_CORE_NB_CORE; n++) {
+		mag = mcache_mags + n;
+		mcache_lock_mag(mag, &exceptions);
+		ret += mag->cached_bytes;
+		mcache_unlock(mag, exceptions);
+	}
+
+	return ret;
+}
+
+#else /*MALLOC_CACHE*/
+
+static int __maybe_unused mcache_class(size_t size __unused)
+{
+	return -1;
+}
+
+static bool mcache_drain(void)
+{
+	return false;
+}
+
+static bool mcache_contains(void *buf __unused)
+{
+	return false;
+}
+
+static size_t __maybe_unused mcache_cached_bytes(void)
+{
+	return 0;
+}
+
+#endif /*MALLOC_CACHE*/
+
 #ifdef BufStats
 
 static struct malloc_stats mstats;
@@ -193,7 +423,8 @@ void malloc_get_stats(struct malloc_stats *stats)
 {
 	malloc_lock();
 	memcpy(stats, &mstats, sizeof(*stats));
-	stats->allocated = totalloc;
+	/* Buffers kept in the per-core caches aren't in use */
+	stats->allocated = totalloc - mcache_cached_bytes();
 	malloc_unlock();
 }
 
@@ -308,6 +539,8 @@ static void *raw_malloc(size_t hdr_size, size_t ftr_size, size_t pl_size)
 		s++;
 
 	ptr = bget(s);
+	if (!ptr && mcache_drain())
+		ptr = bget(s);
 out:
 	raw_malloc_return_hook(ptr, pl_size);
 
@@ -339,6 +572,8 @@ static void *raw_calloc(size_t hdr_size, size_t ftr_size, size_t pl_nmemb,
 		s++;
 
 	ptr = bgetz(s);
+	if (!ptr && mcache_drain())
+		ptr = bgetz(s);
 out:
 	raw_malloc_return_hook(ptr, pl_nmemb * pl_size);
 
@@ -362,6 +597,8 @@ static void *raw_realloc(void *ptr, size_t hdr_size, size_t ftr_size,
 		s++;
 
 	p = bgetr(ptr, s);
+	if (!p && mcache_drain())
+		p = bgetr(ptr, s);
 out:
 	raw_malloc_return_hook(p, pl_size);
 
@@ -540,6 +777,8 @@ static void *raw_memalign(size_t hdr_size, size_t ftr_size, size_t alignment,
 		return NULL;
 
 	b = (uintptr_t)bget(s);
+	if (!b && mcache_drain())
+		b = (uintptr_t)bget(s);
 	if (!b)
 		goto out;
 
@@ -802,18 +1041,130 @@ void mdbg_check(int bufdump)
 
 #else
 
+#ifdef MALLOC_CACHE
+static void *mcache_get(int c)
+{
+	uint32_t exceptions;
+	struct mcache_mag *mag = mcache_lock(&exceptions);
+	void *buf = mcache_pop(mag, c);
+
+	mcache_unlock(mag, exceptions);
+	return buf;
+}
+
+/*
+ * Allocates a buffer of class @c from the pool and stocks the magazine
+ * of the current core with a few more. Called with __malloc_mu held.
+ */
+static void *mcache_refill(int c)
+{
+	void *bufs[MCACHE_BATCH - 1];
+	struct mcache_mag *mag;
+	uint32_t exceptions;
+	size_t num_bufs;
+	size_t n;
+	void *buf;
+
+	buf = raw_malloc(0, 0, mcache_class_size(c));
+	if (!buf)
+		return NULL;
+
+	for (num_bufs = 0; num_bufs < ARRAY_SIZE(bufs); num_bufs++) {
+		bufs[num_bufs] = bget(mcache_class_size(c));
+		if (!bufs[num_bufs])
+			break;
+	}
+
+	mag = mcache_lock(&exceptions);
+	for (n = 0; n < num_bufs; n++)
+		if (!mcache_push(mag, c, bufs[n]))
+			break;
+	mcache_unlock(mag, exceptions);
+
+	/* The magazine was filled by someone else in the meantime */
+	for (; n < num_bufs; n++)
+		brel(bufs[n]);
+
+	return buf;
+}
+
+/* Returns false if @buf isn't cached and should be freed to the pool */
+static bool mcache_put(void *buf)
+{
+	void *bufs[MCACHE_BATCH];
+	struct mcache_mag *mag;
+	uint32_t exceptions;
+	size_t num_bufs = 0;
+	int c;
+
+	if (!buf)
+		return false;
+
+	c = mcache_buf_class(buf);
+	if (c < 0)
+		return false;
+
+	mag = mcache_lock(&exceptions);
+	if (!mcache_push(mag, c, buf)) {
+		/* Full magazine, give half of it back to the pool */
+		while (num_bufs < MCACHE_BATCH)
+			bufs[num_bufs++] = mcache_pop(mag, c);
+		mcache_push(mag, c, buf);
+	}
+	mcache_unlock(mag, exceptions);
+
+	if (num_bufs) {
+		malloc_lock();
+		raw_malloc_validate_pools();
+		while (num_bufs)
+			brel(bufs[--num_bufs]);
+		malloc_unlock();
+	}
+
+	return true;
+}
+#else /*MALLOC_CACHE*/
+static void *mcache_get(int c __unused)
+{
+	return NULL;
+}
+
+static void *mcache_refill(int c __unused)
+{
+	return NULL;
+}
+
+static bool mcache_put(void *buf __unused)
+{
+	return false;
+}
+#endif /*MALLOC_CACHE*/
+
 void *malloc(size_t size)
 {
+	int c = mcache_class(size);
 	void *p;
 
+	if (c >= 0) {
+		p = mcache_get(c);
+		if (p)
+			return p;
+	}
+
 	malloc_lock();
-	p = raw_malloc(0, 0, size);
+	if (c >= 0)
+		p = mcache_refill(c);
+	else
+		p = raw_malloc(0, 0, size);
 	malloc_unlock();
 	return p;
 }
 
 void free(void *ptr)
 {
+	if (mcache_put(ptr))
+		return;
+
 	malloc_lock();
 	raw_free(ptr);
 	malloc_unlock();
@@ -821,8 +1172,17 @@ void free(void *ptr)
 
 void *calloc(size_t nmemb, size_t size)
 {
+	size_t s = nmemb * size;
 	void *p;
 
+	/* Small requests that don't overflow are served by malloc() */
+	if ((!nmemb || s / nmemb == size) && mcache_class(s) >= 0) {
+		p = malloc(s);
+		if (p)
+			memset(p, 0, s);
+		return p;
+	}
+
 	malloc_lock();
 	p = raw_calloc(0, 0, nmemb, size);
 	malloc_unlock();
@@ -923,7 +1283,8 @@ bool malloc_buffer_is_within_alloced(void *buf, size_t len)
 		end_b = start_b + s;
 
 		if (start_buf >= start_b && end_buf <= end_b) {
-			ret = true;
+			/* Buffers kept in the per-core caches are free */
+			ret = !mcache_contains(b);
 			goto out;
 		}
 	}
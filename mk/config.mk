@@ -120,8 +120,13 @@ CFG_TEE_FW_MANUFACTURER ?= FW_MAN_UNDEF
 CFG_REE_FS ?= y
 
 # REE filesystem block cache support
+# Decrypted blocks are kept per open file, and blocks modified by an update
+# are written once when the update is committed.
 CFG_REE_FS_BLOCK_CACHE ?= n
 
+# Number of 4 KiB blocks cached per open file when CFG_REE_FS_BLOCK_CACHE = y
+CFG_REE_FS_BLOCK_CACHE_SIZE ?= 4
+
 # RPMB file system support
 CFG_RPMB_FS ?= n
 
@@ -130,6 +135,12 @@ CFG_RPMB_FS ?= n
 # tee-supplicant process will open /dev/mmcblk<id>rpmb
 CFG_RPMB_FS_DEV_ID ?= 0
 
+# Write up to the eMMC "Reliable Write Sector Count" blocks with each RPMB
+# write request (one RPC and one MAC) instead of one block per request.
+# Requires an RPMB driver in normal world that supports multi-block
+# reliable writes, so it's disabled by default.
+CFG_RPMB_FS_MULTI_BLOCK_WRITE ?= n
+
 # SQL FS stores its data in a SQLite database, accessed by normal world
 CFG_SQL_FS ?= n
 
@@ -164,6 +175,17 @@ endif
 # Enable support for dynamically loaded user TAs
 CFG_WITH_USER_TA ?= y
 
+# Keep the images of loaded and verified user TAs in secure DDR. Loading a
+# TA again fetches its signed header from normal world, if the header
+# matches the cached image the image is copied instead of fetching the rest
+# of the TA and verifying its signature. With a tee-supplicant that can't
+# load TAs in chunks the whole TA is fetched anyway and a cache hit only
+# saves the verification. Requires CFG_WITH_USER_TA = y.
+CFG_TA_IMAGE_CACHE ?= n
+
+# Maximum number of bytes of secure DDR used by cached TA images
+CFG_TA_IMAGE_CACHE_SIZE ?= 0x100000
+
 # Use small pages to map user TAs
 CFG_SMALL_PAGE_USER_TA ?= y
 
@@ -213,3 +235,16 @@ CFG_DT_ADDR ?= 0x0
 
 # Default heap size for Core, 64 kB
 CFG_CORE_HEAP_SIZE ?= 65536
+
+# Keep small freed heap buffers of Core in per-core caches and hand them
+# out again without taking the global malloc lock. Cached buffers are
+# given back to the heap when an allocation would otherwise fail.
+CFG_CORE_MALLOC_CACHE ?= y
+
+# Number of scratch memory pools used by the LibTomCrypt bignum arithmetic.
+# Each pool lets one more thread run RSA, DSA, DH or ECC operations
+# concurrently, further threads wait for a pool to become available. A pool
+# takes about 53 kB of .bss, or of paged memory only populated while in use
+# with CFG_WITH_PAGER=y. Increase up to CFG_NUM_THREADS on platforms with
+# the memory to spare.
+CFG_CRYPTO_MPA_NUM_POOLS ?= 2